@@ -387,6 +387,7 @@ DUH *dumb_read_s3m_quick(DUMBFILE *f);
 DUH *dumb_read_mod_quick(DUMBFILE *f);
 
 long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata);
+long dumb_it_build_checkpoints_at_interval(DUMB_IT_SIGDATA *sigdata, long interval);
 void dumb_it_do_initial_runthrough(DUH *duh);
 
 const unsigned char *dumb_it_sd_get_song_message(DUMB_IT_SIGDATA *sd);
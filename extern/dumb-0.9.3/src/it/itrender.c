@@ -3673,11 +3673,15 @@ int dumb_it_callback_midi_block(void *data, int channel, unsigned char midi_byte
 
 
 
-/* Returns the length of the module, up until it first loops. */
-long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata)
+/* Returns the length of the module, up until it first loops. Checkpoints are
+ * placed every 'interval' ticks; denser checkpoints make seeking cheaper at
+ * the cost of one duplicated sigrenderer per checkpoint.
+ */
+long dumb_it_build_checkpoints_at_interval(DUMB_IT_SIGDATA *sigdata, long interval)
 {
 	IT_CHECKPOINT *checkpoint;
 	if (!sigdata) return 0;
+	if (interval <= 0) interval = IT_CHECKPOINT_INTERVAL;
 	checkpoint = sigdata->checkpoint;
 	while (checkpoint) {
 		IT_CHECKPOINT *next = checkpoint->next;
@@ -3707,8 +3711,8 @@ long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata)
 			return checkpoint->time;
 		}
 
-		l = it_sigrenderer_get_samples(sigrenderer, 0, 1.0f, IT_CHECKPOINT_INTERVAL, NULL);
-		if (l < IT_CHECKPOINT_INTERVAL) {
+		l = it_sigrenderer_get_samples(sigrenderer, 0, 1.0f, interval, NULL);
+		if (l < interval) {
 			_dumb_it_end_sigrenderer(sigrenderer);
 			checkpoint->next = NULL;
 			return checkpoint->time + l;
@@ -3717,10 +3721,10 @@ long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata)
 		checkpoint->next = malloc(sizeof(*checkpoint->next));
 		if (!checkpoint->next) {
 			_dumb_it_end_sigrenderer(sigrenderer);
-			return checkpoint->time + IT_CHECKPOINT_INTERVAL;
+			return checkpoint->time + interval;
 		}
 
-		checkpoint->next->time = checkpoint->time + IT_CHECKPOINT_INTERVAL;
+		checkpoint->next->time = checkpoint->time + interval;
 		checkpoint = checkpoint->next;
 		checkpoint->sigrenderer = sigrenderer;
 	}
@@ -3728,6 +3732,13 @@ long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata)
 
 
 
+long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata)
+{
+	return dumb_it_build_checkpoints_at_interval(sigdata, IT_CHECKPOINT_INTERVAL);
+}
+
+
+
 void dumb_it_do_initial_runthrough(DUH *duh)
 {
 	if (duh) {
@@ -19,6 +19,8 @@
 **************************************************************************/
 
 
+#include <algorithm>
+#include <cmath>
 #include <stdint.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread/locks.hpp>
@@ -43,7 +45,8 @@ namespace adplug_detail
 
 
 source_binbase::source_binbase(source &source_):
-	source_(source_)
+	source_(source_),
+	reader_(source_)
 {
 }
 
@@ -59,13 +62,13 @@ void source_binbase::seek(long p, Offset offs)
 	switch (offs)
 	{
 		case binio::Set:
-			source_.seek(p, source::seek_absolute);
+			reader_.seek(p, source::seek_absolute);
 			break;
 		case binio::Add:
-			source_.seek(p, source::seek_relative);
+			reader_.seek(p, source::seek_relative);
 			break;
 		case binio::End:
-			source_.seek(p, source::seek_from_end);
+			reader_.seek(p, source::seek_from_end);
 			break;
 		default:
 			break;
@@ -75,7 +78,7 @@ void source_binbase::seek(long p, Offset offs)
 
 long source_binbase::pos()
 {
-	return source_.get_position();
+	return reader_.get_position();
 }
 
 
@@ -102,12 +105,13 @@ source_binistream::~source_binistream()
 
 binio::Byte source_binistream::getByte()
 {
-	binio::Byte read;
-	if (source_.can_read())
-		source_.read(&read, 1);
-	if (!source_.can_read())
+	int byte_value = reader_.get_byte();
+	if (byte_value < 0)
+	{
 		err |= Eof;
-	return read;
+		return 0;
+	}
+	return binio::Byte(byte_value);
 }
 
 
@@ -152,6 +156,122 @@ void adplug_source_file_provider::close(binistream *f) const
 }
 
 
+
+
+/*
+* OPL wrapper that sits between the player and the actual OPL emulator. Normally, it just forwards everything.
+* In register-only mode (used for seeking), register writes are merely recorded, so the player can be stepped without
+* the emulator doing any work. Leaving this mode writes the final register state to the emulator in one go.
+*/
+class seekable_opl:
+	public Copl
+{
+public:
+	explicit seekable_opl(Copl *target):
+		target(target),
+		register_only_mode(false),
+		init_requested(false)
+	{
+		currType = target->gettype();
+		std::fill(registers_written, registers_written + 2 * 256, false);
+	}
+
+	~seekable_opl()
+	{
+		delete target;
+	}
+
+	virtual void write(int reg, int val)
+	{
+		if (register_only_mode)
+		{
+			int index = (currChip & 1) * 256 + (reg & 0xFF);
+			registers[index] = uint8_t(val);
+			registers_written[index] = true;
+		}
+		else
+			target->write(reg, val);
+	}
+
+	virtual void setchip(int n)
+	{
+		Copl::setchip(n);
+		if (!register_only_mode)
+			target->setchip(n);
+	}
+
+	virtual void init()
+	{
+		if (register_only_mode)
+		{
+			// the emulator is initialized when register-only mode is left; any writes recorded so far are obsolete
+			init_requested = true;
+			std::fill(registers_written, registers_written + 2 * 256, false);
+		}
+		else
+			target->init();
+	}
+
+	virtual void update(short *buf, int samples)
+	{
+		target->update(buf, samples);
+	}
+
+	void begin_register_only_mode()
+	{
+		register_only_mode = true;
+		init_requested = false;
+		std::fill(registers_written, registers_written + 2 * 256, false);
+	}
+
+	void end_register_only_mode()
+	{
+		register_only_mode = false;
+
+		if (init_requested)
+			target->init();
+
+		for (int chip = 0; chip < 2; ++chip)
+		{
+			target->setchip(chip);
+			// key-on and rhythm registers go last, so notes are started with their final instrument and frequency settings
+			for (int reg = 0; reg < 256; ++reg)
+			{
+				if (!is_key_on_register(reg))
+					replay_register(chip, reg);
+			}
+			for (int reg = 0; reg < 256; ++reg)
+			{
+				if (is_key_on_register(reg))
+					replay_register(chip, reg);
+			}
+		}
+
+		target->setchip(currChip);
+	}
+
+
+protected:
+	static bool is_key_on_register(int const reg)
+	{
+		return ((reg >= 0xB0) && (reg <= 0xB8)) || (reg == 0xBD);
+	}
+
+	void replay_register(int const chip, int const reg)
+	{
+		int index = chip * 256 + reg;
+		if (registers_written[index])
+			target->write(reg, registers[index]);
+	}
+
+
+	Copl *target;
+	bool register_only_mode, init_requested;
+	uint8_t registers[2 * 256];
+	bool registers_written[2 * 256];
+};
+
+
 }
 
 
@@ -314,10 +434,10 @@ void adplug_decoder::initialize_player(unsigned int const frequency)
 	{
 		CEmuopl *oplA = new CEmuopl(frequency, is16bit, false);
 		CEmuopl *oplB = new CEmuopl(frequency, is16bit, false);
-		opl = new CSurroundopl(oplA, oplB, is16bit);
+		opl = new adplug_detail::seekable_opl(new CSurroundopl(oplA, oplB, is16bit));
 	}
 	else
-		opl = new CEmuopl(frequency, is16bit, stereo);
+		opl = new adplug_detail::seekable_opl(new CEmuopl(frequency, is16bit, stereo));
 
 	adplug_detail::adplug_source_file_provider file_provider(*source_);
 	player = CAdPlug::factory(
@@ -340,63 +460,72 @@ unsigned int adplug_decoder::update(void *dest, unsigned int const num_samples_t
 	if (player == 0)
 		return 0;
 
+	boost::lock_guard < boost::mutex > lock(mutex_);
+
+	if (seek_to != -1)
 	{
-		boost::lock_guard < boost::mutex > lock(mutex_);
+		// Step the player with the OPL emulator in register-only mode; the emulator only receives the final
+		// register state once the target position is reached, so seeking costs little more than the player's tick logic
+		opl->begin_register_only_mode();
 
-		if (seek_to != -1)
+		if (seek_to < current_position)
 		{
-			if (seek_to < current_position)
-			{
-				player->rewind(subsong_nr);
-				current_position = 0.0f;
-			}
-
-			while (current_position < seek_to)
-			{
-				if (!player->update())
-					break;
-				current_position += 1000.0f / player->getrefresh();
-			}
+			player->rewind(subsong_nr);
+			current_position = 0.0f;
+		}
 
-			seek_to = -1;
+		// if at least one tick was performed, a full tick period has to be rendered before the next tick
+		to_add = 0;
+		while (current_position < seek_to)
+		{
+			if (!player->update())
+				break;
+			current_position += 1000.0f / player->getrefresh();
+			to_add = playback_properties_.frequency;
 		}
 
-		float songlength = float(cur_song_length);
-		if (current_position >= songlength)
+		opl->end_register_only_mode();
+
+		seek_to = -1;
+	}
+
+	float songlength = float(cur_song_length);
+	if (current_position >= songlength)
+	{
+		if (loop_mode < 0)
+			return 0;
+		else if (loop_mode >= 0)
 		{
-			if (loop_mode < 0)
+			if ((loop_mode > 0) && (cur_num_loops >= loop_mode))
 				return 0;
-			else if (loop_mode >= 0)
-			{
-				if ((loop_mode > 0) && (cur_num_loops >= loop_mode))
-					return 0;
 
-				++cur_num_loops;
-				current_position = std::fmod(current_position, songlength);
-			}
+			++cur_num_loops;
+			current_position = std::fmod(current_position, songlength);
 		}
 	}
 
+	// Render the samples between two player ticks with one contiguous opl->update() call each
+	// to_add is the remaining time until the next tick, in units of (samples * refresh rate)
+	long const frequency = playback_properties_.frequency;
+	unsigned int const bytes_per_sample = (stereo ? 2 : 1) * (is16bit ? 2 : 1);
+	float refresh = player->getrefresh();
 	long to_write = num_samples_to_write;
 	uint8_t *bufpos = reinterpret_cast < uint8_t*> (dest);
 	while (to_write > 0)
 	{
-		while (to_add < 0)
+		while (to_add <= 0)
 		{
-			to_add += playback_properties_.frequency;
+			to_add += frequency;
 			player->update();
-
-			{
-				boost::lock_guard < boost::mutex > lock(mutex_);
-				current_position += 1000.0f / player->getrefresh();
-			}
+			refresh = player->getrefresh();
+			current_position += 1000.0f / refresh;
 		}
 
-		long i = std::min(to_write, long(to_add / player->getrefresh() + 4) & ~3);
+		long i = std::min(to_write, std::max(long(std::ceil(float(to_add) / refresh)), 1L));
 		opl->update(reinterpret_cast < short * > (bufpos), i);
-		bufpos += i * (stereo ? 2 : 1) * (is16bit ? 2 : 1);
+		bufpos += i * bytes_per_sample;
 		to_write -= i;
-		to_add -= long(player->getrefresh() * i);
+		to_add -= long(refresh * i);
 	}
 
 	return num_samples_to_write;
@@ -27,6 +27,7 @@
 #include "decoder.hpp"
 #include "decoder_creator.hpp"
 #include "source.hpp"
+#include "source_block_reader.hpp"
 
 
 class Copl;
@@ -58,6 +59,7 @@ public:
 
 protected:
 	source &source_;
+	source_block_reader reader_; // shared by seek(), pos() and the stream's getByte(), so all of them see the same logical position
 };
 
 
@@ -76,6 +78,9 @@ protected:
 };
 
 
+class seekable_opl;
+
+
 } // namespace adplug_detail
 
 
@@ -118,7 +123,7 @@ protected:
 
 
 	mutable boost::mutex mutex_;
-	Copl *opl;
+	adplug_detail::seekable_opl *opl;
 	CPlayer *player;
 	source_ptr_t source_;
 	long to_add, subsong_nr;
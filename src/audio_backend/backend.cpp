@@ -19,8 +19,11 @@
 **************************************************************************/
 
 
+#include <algorithm>
 #include <exception>
 #include <iostream>
+#include <utility>
+#include <vector>
 #include <boost/assign/list_of.hpp>
 #include <boost/spirit/home/phoenix/bind.hpp>
 #include <boost/spirit/home/phoenix/core/argument.hpp>
@@ -31,6 +34,7 @@
 #include <ion/metadata.hpp>
 #include <ion/resource_exceptions.hpp>
 #include "backend.hpp"
+#include "header_cached_source.hpp"
 
 
 namespace ion
@@ -42,19 +46,72 @@ namespace audio_backend
 using namespace audio_common;
 
 
-backend::backend()
+namespace
+{
+
+
+// Number of bytes read from the beginning of a resource for the decoder creators' probes.
+// Large enough for signatures at fixed offsets, like the MOD tag at offset 1080.
+unsigned long const probe_header_size = 4096;
+
+
+struct compare_scored_creators
+{
+	bool operator()(std::pair < int, decoder_creator* > const &first, std::pair < int, decoder_creator* > const &second) const
+	{
+		return first.first < second.first;
+	}
+};
+
+
+}
+
+
+backend::backend():
+	response_metadata_encoding(json_metadata_encoding),
+	playback_generation(0),
+	next_resource_generation(0),
+	decoder_construction_thread_running(false),
+	metadata_batch_thread_running(false),
+	metadata_batch_busy(false)
 {
 }
 
 
 backend::backend(send_event_callback_t const &send_event_callback):
-	send_event_callback(send_event_callback)
+	send_event_callback(send_event_callback),
+	response_metadata_encoding(json_metadata_encoding),
+	playback_generation(0),
+	next_resource_generation(0),
+	decoder_construction_thread_running(false),
+	metadata_batch_thread_running(false),
+	metadata_batch_busy(false)
 {
 }
 
 
 backend::~backend()
 {
+	// Shut down the decoder construction thread first; a decoder construction that is in progress is finished, pending jobs are discarded
+	{
+		boost::lock_guard < boost::mutex > lock(decoder_construction_mutex);
+		decoder_construction_thread_running = false;
+		decoder_construction_jobs.clear();
+	}
+	decoder_construction_condition.notify_one();
+	if (decoder_construction_thread.joinable())
+		decoder_construction_thread.join();
+
+	// Same for the metadata batch thread; a request that is in progress is finished, queued ones are discarded
+	{
+		boost::lock_guard < boost::mutex > lock(metadata_batch_mutex);
+		metadata_batch_thread_running = false;
+		metadata_batch_requests.clear();
+	}
+	metadata_batch_condition.notify_one();
+	if (metadata_batch_thread.joinable())
+		metadata_batch_thread.join();
+
 	if (current_sink)
 		current_sink->stop();
 }
@@ -66,17 +123,69 @@ void backend::set_send_event_callback(send_event_callback_t const &new_send_even
 }
 
 
+namespace
+{
+
+void fill_sub_resource_metadata(metadata_t &sub_resource_metadata, metadata_t const &resource_metadata)
+{
+	// fills in the values fill_autogenerated_metadata() would have generated for the sub-resource, in case the decoder did not set them
+	// (num_ticks is not taken from the resource, since it usually differs between sub-resources)
+	// the resource's title is used if the sub-resource has none, just like the URI basename would be used when scanning the sub-resource individually
+
+	char const *value_names[] = { "decoder_type", "num_ticks_per_second", "title" };
+	for (unsigned int i = 0; i < sizeof(value_names) / sizeof(char const *); ++i)
+	{
+		if (!has_metadata_value(sub_resource_metadata, value_names[i]) && has_metadata_value(resource_metadata, value_names[i]))
+			sub_resource_metadata[value_names[i]] = resource_metadata[value_names[i]];
+	}
+}
+
+}
+
+
 metadata_t backend::get_metadata(std::string const &uri_str)
 {
-	decoder_ptr_t temp_decoder = create_new_decoder(ion::uri(uri_str), "", empty_metadata());
+	ion::uri uri_(uri_str);
+	decoder_ptr_t temp_decoder = create_new_decoder(uri_, "", empty_metadata(), false);
 	if (temp_decoder)
 	{
 		metadata_t metadata_ = temp_decoder->get_metadata();
 		temp_decoder->fill_autogenerated_metadata(metadata_);
+
+		// If the URI refers to the resource as a whole, include the metadata of all its sub-resources if the decoder can deliver it in one go.
+		// This way, the scanner does not have to issue one get_metadata request (= one decoder construction) per sub-resource.
+		if (uri_.get_options().find("sub_resource_index") == uri_.get_options().end())
+		{
+			metadata_t sub_resources = temp_decoder->get_sub_resources_metadata();
+			if (sub_resources.isArray() && (sub_resources.size() > 1))
+			{
+				for (Json::Value::ArrayIndex i = 0; i < sub_resources.size(); ++i)
+					fill_sub_resource_metadata(sub_resources[i], metadata_);
+				metadata_["sub_resources"] = sub_resources;
+			}
+		}
+
 		return metadata_;
 	}
-	else
-		throw unrecognized_resource(uri_str);
+
+	// No decoder recognized the resource; if it is an archive, list its members instead, so the scanner can scan them one by one.
+	// Decoders get the first try, since some of them read compressed files directly (gzip compressed VGM files, for example).
+	source_creators_t::ordered_t::iterator source_creator_iter = source_creators.get < source_creators_t::ordered_tag > ().find(uri_.get_type());
+	std::vector < ion::uri > member_uris;
+	if ((source_creator_iter != source_creators.get < source_creators_t::ordered_tag > ().end()) && (*source_creator_iter)->get_member_uris(uri_, member_uris))
+	{
+		metadata_t archive_members(Json::arrayValue);
+		BOOST_FOREACH(ion::uri const &member_uri, member_uris)
+		{
+			archive_members.append(member_uri.get_full());
+		}
+
+		metadata_t metadata_(Json::objectValue);
+		metadata_["archive_members"] = archive_members;
+		return metadata_;
+	}
+
+	throw unrecognized_resource(uri_str);
 }
 
 
@@ -86,6 +195,106 @@ std::string backend::get_metadata_as_string(std::string const &uri_str)
 }
 
 
+void backend::get_metadata_result(std::string const &uri_str, metadata_encoding const encoding, std::string &event_command, params_t &event_params)
+{
+	event_command = "metadata_result";
+	event_params.clear();
+	event_params.push_back(uri_str);
+
+	try
+	{
+		std::string metadata_str = get_metadata_string(get_metadata(uri_str), encoding);
+		event_params.push_back("ok");
+		event_params.push_back(metadata_str);
+	}
+	catch (resource_not_found const &)
+	{
+		event_params.push_back("resource_not_found");
+	}
+	catch (unrecognized_resource const &)
+	{
+		event_params.push_back("unrecognized_resource");
+	}
+	catch (resource_corrupted const &)
+	{
+		event_params.push_back("resource_corrupted");
+	}
+	catch (ion::uri::invalid_uri const &)
+	{
+		event_params.push_back("invalid_uri");
+	}
+	catch (std::exception const &exc)
+	{
+		event_params.push_back("error");
+		event_params.push_back(exc.what());
+	}
+}
+
+
+void backend::queue_metadata_batch(params_t const &uris)
+{
+	{
+		boost::lock_guard < boost::mutex > lock(metadata_batch_mutex);
+
+		// The encoding is recorded with each request, since the metadata batch thread must not access response_metadata_encoding
+		BOOST_FOREACH(param_t const &uri_str, uris)
+		{
+			metadata_batch_requests.push_back(std::make_pair(uri_str, response_metadata_encoding));
+		}
+
+		if (!metadata_batch_thread_running)
+		{
+			metadata_batch_thread_running = true;
+			metadata_batch_thread = boost::thread(boost::phoenix::bind(&backend::metadata_batch_loop, this));
+		}
+	}
+
+	metadata_batch_condition.notify_one();
+}
+
+
+void backend::wait_for_metadata_batches()
+{
+	boost::unique_lock < boost::mutex > lock(metadata_batch_mutex);
+	while (metadata_batch_busy || !metadata_batch_requests.empty())
+		metadata_batch_idle_condition.wait(lock);
+}
+
+
+void backend::metadata_batch_loop()
+{
+	std::string event_command;
+	params_t event_params;
+
+	while (true)
+	{
+		metadata_batch_requests_t::value_type request;
+
+		{
+			boost::unique_lock < boost::mutex > lock(metadata_batch_mutex);
+
+			metadata_batch_busy = false;
+			if (metadata_batch_requests.empty())
+				metadata_batch_idle_condition.notify_all();
+
+			while (metadata_batch_thread_running && metadata_batch_requests.empty())
+				metadata_batch_condition.wait(lock);
+
+			if (!metadata_batch_thread_running)
+				return;
+
+			request = metadata_batch_requests.front();
+			metadata_batch_requests.pop_front();
+			metadata_batch_busy = true;
+		}
+
+		get_metadata_result(request.first, request.second, event_command, event_params);
+		if (send_event_callback)
+			send_event_callback(event_command, event_params);
+	}
+}
+
+
 // Helper functions for getting/setting values
 namespace
 {
@@ -226,6 +435,35 @@ void backend::exec_command(std::string const &command, params_t const &params, s
 				}
 			}
 		}
+		else if (command == "get_module_statistics")
+		{
+			if (params.size() == 0)
+				throw std::invalid_argument(std::string("missing arguments"));
+
+			component_creator const *creator = 0;
+			{
+				decoder_creators_t::ordered_t::iterator iter = decoder_creators.get < decoder_creators_t::ordered_tag > ().find(params[0]);
+				if (iter != decoder_creators.get < decoder_creators_t::ordered_tag > ().end())
+					creator = *iter;
+			}
+			{
+				sink_creators_t::ordered_t::iterator iter = sink_creators.get < sink_creators_t::ordered_tag > ().find(params[0]);
+				if (iter != sink_creators.get < sink_creators_t::ordered_tag > ().end())
+					creator = *iter;
+			}
+			{
+				source_creators_t::ordered_t::iterator iter = source_creators.get < source_creators_t::ordered_tag > ().find(params[0]);
+				if (iter != source_creators.get < source_creators_t::ordered_tag > ().end())
+					creator = *iter;
+			}
+
+			if (creator != 0)
+			{
+				response_command = "module_statistics";
+				response_params.push_back(params[0]);
+				response_params.push_back(Json::FastWriter().write(creator->get_statistics()));
+			}
+		}
 		else if (command == "set_module_properties")
 		{
 			if (params.size() < 2)
@@ -256,7 +494,7 @@ void backend::exec_command(std::string const &command, params_t const &params, s
 
 			metadata_t new_metadata = update_metadata(ion::uri(params[0]), checked_parse_metadata(params[1], "metadata given to the update_metadata command is not a valid JSON object"));
 
-			std::string metadata_string = get_metadata_string(new_metadata);
+			std::string metadata_string = get_metadata_string(new_metadata, response_metadata_encoding);
 			response_command = "metadata";
 			response_params.push_back(params[0]);
 			response_params.push_back(metadata_string);
@@ -266,11 +504,19 @@ void backend::exec_command(std::string const &command, params_t const &params, s
 			if (params.size() == 0)
 				throw std::invalid_argument(std::string("missing arguments"));
 
-			std::string metadata_string = get_metadata_as_string(params[0]);
+			std::string metadata_string = get_metadata_string(get_metadata(params[0]), response_metadata_encoding);
 			response_command = "metadata";
 			response_params.push_back(params[0]);
 			response_params.push_back(metadata_string);
 		}
+		else if (command == "get_metadata_batch")
+		{
+			if (params.size() == 0)
+				throw std::invalid_argument(std::string("missing arguments"));
+
+			queue_metadata_batch(params);
+			response_command = "";
+		}
 		else
 		{
 			response_command = "unknown_command";
@@ -321,54 +567,245 @@ void backend::start_playback(params_t const &params)
 	if (params.empty())
 		throw std::invalid_argument("no URL specified");
 
-	std::string uri_str[2], decoder_type[2];
-	uri_str[0] = params[0];
-	if (params.size() >= 3) uri_str[1] = params[2];
+	decoder_construction_job job;
+	job.type = decoder_construction_job::play_job;
+	job.params = params;
 
-	metadata_t metadata[2];
-	if (params.size() >= 2) { metadata[0] = checked_parse_metadata(params[1], "current uri metadata is not a valid JSON object"); decoder_type[0] = metadata[0].get("decoder_type", "").asString(); }
-	if (params.size() >= 4) { metadata[1] = checked_parse_metadata(params[3], "next uri metadata is not a valid JSON object"); decoder_type[1] = metadata[1].get("decoder_type", "").asString(); }
+	job.uri_str[0] = params[0];
+	if (params.size() >= 3) job.uri_str[1] = params[2];
 
+	if (params.size() >= 2) { job.metadata[0] = checked_parse_metadata(params[1], "current uri metadata is not a valid JSON object"); job.decoder_type[0] = job.metadata[0].get("decoder_type", "").asString(); }
+	if (params.size() >= 4) { job.metadata[1] = checked_parse_metadata(params[3], "next uri metadata is not a valid JSON object"); job.decoder_type[1] = job.metadata[1].get("decoder_type", "").asString(); }
 
-	boost::lock_guard < boost::mutex > lock(decoder_mutex);
+	enqueue_decoder_construction_job(job);
+}
+
+
+decoder_ptr_t backend::create_next_decoder(std::string const &uri_str, std::string const &decoder_type, metadata_t const &metadata)
+{
+	if (uri_str.empty())
+	{
+		send_event_callback("info", boost::assign::list_of("no next decoder given -> not setting a next decoder"));
+		return decoder_ptr_t();
+	}
+
+	uri uri_(uri_str);
+	decoder_ptr_t new_next_decoder = create_new_decoder(uri_, decoder_type, metadata, true);
+
+	if (!new_next_decoder)
+		throw unrecognized_resource(uri_.get_full());
+
+	if (!new_next_decoder->is_initialized())
+		throw std::runtime_error("created decoder is invalid -> not setting it as next decoder");
+
+	return new_next_decoder;
+}
+
+
+void backend::set_next_resource(params_t const &params)
+{
+	if (!current_sink)
+		throw std::runtime_error("no sink initialized");
+
+	if (params.empty())
+		throw std::invalid_argument("no URL specified");
+
+	decoder_construction_job job;
+	job.type = decoder_construction_job::set_next_resource_job;
+	job.params = params;
 
+	job.uri_str[0] = params[0];
+	if (params.size() >= 2) { job.metadata[0] = checked_parse_metadata(params[1], "metadata is not a valid JSON object"); job.decoder_type[0] = job.metadata[0].get("decoder_type", "").asString(); }
 
-	ion::uri uri_(uri_str[0]);
-	decoder_ptr_t new_current_decoder = create_new_decoder(uri_, decoder_type[0], metadata[0]);
+	enqueue_decoder_construction_job(job);
+}
+
+
+void backend::clear_next_resource()
+{
+	if (!current_sink)
+		throw std::runtime_error("no sink initialized");
+
+	decoder_ptr_t old_next_decoder;
+
+	{
+		boost::lock_guard < boost::mutex > lock(decoder_mutex);
+
+		// pending set_next_resource requests are superseded by this one
+		++next_resource_generation;
+
+		old_next_decoder = next_decoder;
+		next_decoder = decoder_ptr_t();
+
+		current_sink->clear_next_decoder();
+	}
+}
+
+
+void backend::stop_playback()
+{
+	if (current_sink)
+		current_sink->stop(); // this notifies about the stop (stop has a boolean parameter, which defaults true)
+
+	decoder_ptr_t old_current_decoder, old_next_decoder;
+
+	{
+		boost::lock_guard < boost::mutex > lock(decoder_mutex);
+
+		// pending play and set_next_resource requests are superseded by this one
+		++playback_generation;
+		++next_resource_generation;
+
+		old_current_decoder = current_decoder;
+		old_next_decoder = next_decoder;
+		current_decoder = decoder_ptr_t();
+		next_decoder = decoder_ptr_t();
+	}
+}
+
+
+void backend::enqueue_decoder_construction_job(decoder_construction_job job)
+{
+	// Parse the URIs here already, so invalid ones are reported right away, as a response to the command
+	for (unsigned int i = 0; i < 2; ++i)
+	{
+		if (!job.uri_str[i].empty())
+			job.uri_str[i] = ion::uri(job.uri_str[i]).get_full();
+	}
+
+	{
+		boost::lock_guard < boost::mutex > lock(decoder_mutex);
+
+		// A play request supersedes all pending requests, a set_next_resource request supersedes pending set_next_resource requests
+		if (job.type == decoder_construction_job::play_job)
+			++playback_generation;
+		++next_resource_generation;
+
+		job.playback_generation = playback_generation;
+		job.next_resource_generation = next_resource_generation;
+
+		for (unsigned int i = 0; i < 2; ++i)
+		{
+			if (!job.uri_str[i].empty())
+				uris_under_construction.insert(job.uri_str[i]);
+		}
+	}
+
+	{
+		boost::lock_guard < boost::mutex > lock(decoder_construction_mutex);
+
+		decoder_construction_jobs.push_back(job);
+
+		if (!decoder_construction_thread_running)
+		{
+			decoder_construction_thread_running = true;
+			decoder_construction_thread = boost::thread(boost::phoenix::bind(&backend::decoder_construction_loop, this));
+		}
+	}
+
+	decoder_construction_condition.notify_one();
+}
+
+
+void backend::decoder_construction_loop()
+{
+	while (true)
+	{
+		decoder_construction_job job;
+
+		{
+			boost::unique_lock < boost::mutex > lock(decoder_construction_mutex);
+			while (decoder_construction_thread_running && decoder_construction_jobs.empty())
+				decoder_construction_condition.wait(lock);
+
+			if (!decoder_construction_thread_running)
+				return;
+
+			job = decoder_construction_jobs.front();
+			decoder_construction_jobs.pop_front();
+		}
+
+		// Errors are reported as events, just like exec_command() would report them as responses
+		std::string command = (job.type == decoder_construction_job::play_job) ? "play" : "set_next_resource";
+
+		try
+		{
+			if (job.type == decoder_construction_job::play_job)
+				run_play_job(job);
+			else
+				run_set_next_resource_job(job);
+		}
+		catch (resource_not_found const &exc)
+		{
+			send_event_callback("resource_not_found", boost::assign::list_of(exc.what()));
+		}
+		catch (unrecognized_resource const &exc)
+		{
+			send_event_callback("unrecognized_resource", boost::assign::list_of(exc.what()));
+		}
+		catch (ion::uri::invalid_uri const &exc)
+		{
+			send_event_callback("invalid_uri", boost::assign::list_of(exc.what()));
+		}
+		catch (std::exception const &exc)
+		{
+			params_t event_params;
+			event_params.push_back(exc.what());
+			event_params.push_back(command);
+			BOOST_FOREACH(param_t const &param, job.params)
+			{
+				event_params.push_back(param);
+			}
+
+			send_event_callback("error", event_params);
+		}
+
+		finish_decoder_construction_job(job);
+	}
+}
+
+
+void backend::run_play_job(decoder_construction_job const &job)
+{
+	{
+		boost::lock_guard < boost::mutex > lock(decoder_mutex);
+		if (job.playback_generation != playback_generation)
+			return; // superseded by a later play or stop command -> do not bother constructing decoders
+	}
+
+	// The decoders are constructed without holding the decoder mutex
+	// The old decoders are destroyed after the mutex is unlocked, since decoder destruction can take a while too
+
+	decoder_ptr_t new_current_decoder, new_next_decoder, old_current_decoder, old_next_decoder;
+
+	ion::uri uri_(job.uri_str[0]);
+	new_current_decoder = create_new_decoder(uri_, job.decoder_type[0], job.metadata[0], true);
 	if (!new_current_decoder)
 		throw unrecognized_resource(uri_.get_full());
 
 	if (!new_current_decoder->is_initialized())
 		throw std::runtime_error("succeeded, but created invalid decoder");
 
-	decoder_ptr_t old_current_decoder = current_decoder;
-	decoder_ptr_t old_next_decoder = next_decoder;
-
 	// This seemingly duplicate try-catch block exists, because an invalid next resource is not a fatal error for the play command - the next resource just isnt set then
 	try
 	{
-		set_next_decoder(uri_str[1], decoder_type[1], metadata[1]);
+		new_next_decoder = create_next_decoder(job.uri_str[1], job.decoder_type[1], job.metadata[1]);
 	}
 	catch (unrecognized_resource const &exc)
 	{
-		next_decoder = decoder_ptr_t();
-		send_event_callback("unrecognized_resource", boost::assign::list_of(uri_str[1]));
+		send_event_callback("unrecognized_resource", boost::assign::list_of(job.uri_str[1]));
 	}
 	catch (resource_not_found const &exc)
 	{
-		next_decoder = decoder_ptr_t();
-		send_event_callback("resource_not_found", boost::assign::list_of(uri_str[1]));
+		send_event_callback("resource_not_found", boost::assign::list_of(job.uri_str[1]));
 	}
 	catch (std::runtime_error const &exc)
 	{
-		next_decoder = decoder_ptr_t();
-
 		params_t response_params;
 
-		response_params.clear();
 		response_params.push_back(exc.what());
 		response_params.push_back("play");
-		BOOST_FOREACH(param_t const &param, params)
+		BOOST_FOREACH(param_t const &param, job.params)
 		{
 			response_params.push_back(param);
 		}
@@ -376,8 +813,20 @@ void backend::start_playback(params_t const &params)
 		send_event_callback("error", response_params);
 	}
 
-	// this assignment happens -after- the set_next_decoder() call in case the function throws an unhandled exception
+	boost::lock_guard < boost::mutex > lock(decoder_mutex);
+
+	if (job.playback_generation != playback_generation)
+		return;
+
+	apply_pending_metadata_updates(new_current_decoder, job.uri_str[0]);
+	apply_pending_metadata_updates(new_next_decoder, job.uri_str[1]);
+
+	old_current_decoder = current_decoder;
+	old_next_decoder = next_decoder;
+
 	current_decoder = new_current_decoder;
+	// if a set_next_resource or clear_next_resource command came in after the play command, the next decoder is left to that command
+	next_decoder = (job.next_resource_generation == next_resource_generation) ? new_next_decoder : decoder_ptr_t();
 
 	try
 	{
@@ -387,84 +836,81 @@ void backend::start_playback(params_t const &params)
 	{
 		current_decoder = old_current_decoder;
 		next_decoder = old_next_decoder;
-		throw exc;
+		throw;
 	}
 }
 
 
-void backend::set_next_decoder(std::string const &uri_str, std::string const &decoder_type, metadata_t const &metadata)
+void backend::run_set_next_resource_job(decoder_construction_job const &job)
 {
-	decoder_ptr_t new_next_decoder;
-	if (uri_str.empty())
+	bool is_playing;
+
 	{
-		send_event_callback("info", boost::assign::list_of("no next decoder given -> not setting a next decoder"));
-		next_decoder = decoder_ptr_t();
-		return;
+		boost::lock_guard < boost::mutex > lock(decoder_mutex);
+		if (job.next_resource_generation != next_resource_generation)
+			return; // superseded by a later command -> do not bother constructing a decoder
+		is_playing = bool(current_decoder);
 	}
 
-	uri uri_(uri_str);
-	new_next_decoder = create_new_decoder(uri_, decoder_type, metadata);
-
-	if (!new_next_decoder)
-		throw unrecognized_resource(uri_.get_full());
-
-	if (new_next_decoder && !new_next_decoder->is_initialized())
-		throw std::runtime_error("created decoder is invalid -> not setting it as next decoder");
+	// if nothing is playing, this is handled like a play request (without a next resource)
+	if (!is_playing)
+	{
+		run_play_job(job);
+		return;
+	}
 
-	next_decoder = new_next_decoder;
-}
+	decoder_ptr_t new_next_decoder, old_next_decoder;
 
+	// in case of failure, an exception is thrown inside create_next_decoder(), this function exits, and the next decoder isn't set
+	new_next_decoder = create_next_decoder(job.uri_str[0], job.decoder_type[0], job.metadata[0]);
 
-void backend::set_next_resource(params_t const &params)
-{
-	if (!current_sink)
-		throw std::runtime_error("no sink initialized");
+	{
+		boost::lock_guard < boost::mutex > lock(decoder_mutex);
 
-	if (params.empty())
-		throw std::invalid_argument("no URL specified");
+		if (job.next_resource_generation != next_resource_generation)
+			return;
 
-	decoder_mutex.lock();
+		apply_pending_metadata_updates(new_next_decoder, job.uri_str[0]);
 
-	if (!current_decoder)
-	{
-		decoder_mutex.unlock();
-		start_playback(params);
-		return;
+		old_next_decoder = next_decoder;
+		next_decoder = new_next_decoder;
+		current_sink->set_next_decoder(next_decoder);
 	}
 
-	boost::unique_lock < boost::mutex > lock(decoder_mutex, boost::adopt_lock_t());
-
-	std::string uri_str = params[0], decoder_type;
-	metadata_t metadata;
-	if (params.size() >= 2) { metadata = checked_parse_metadata(params[1], "metadata is not a valid JSON object"); decoder_type = metadata.get("decoder_type", "").asString(); }
-
-	// in case of failure, an exception is thrown inside set_next_decoder(), this function exits, and the next decoder isn't set
-	set_next_decoder(uri_str, decoder_type, metadata);
-	current_sink->set_next_decoder(next_decoder);
+	if (new_next_decoder)
+		send_event_callback("next_resource_set", boost::assign::list_of(job.uri_str[0]));
 }
 
 
-void backend::clear_next_resource()
+void backend::finish_decoder_construction_job(decoder_construction_job const &job)
 {
-	if (!current_sink)
-		throw std::runtime_error("no sink initialized");
-
 	boost::lock_guard < boost::mutex > lock(decoder_mutex);
-	next_decoder = decoder_ptr_t();
 
-	current_sink->clear_next_decoder();
+	for (unsigned int i = 0; i < 2; ++i)
+	{
+		if (job.uri_str[i].empty())
+			continue;
+
+		uris_t::iterator iter = uris_under_construction.find(job.uri_str[i]);
+		if (iter != uris_under_construction.end())
+			uris_under_construction.erase(iter);
+
+		if (uris_under_construction.find(job.uri_str[i]) == uris_under_construction.end())
+			pending_metadata_updates.erase(job.uri_str[i]);
+	}
 }
 
 
-void backend::stop_playback()
+void backend::apply_pending_metadata_updates(decoder_ptr_t const &decoder_, std::string const &uri_str)
 {
-	if (current_sink)
-		current_sink->stop(); // this notifies about the stop (stop has a boolean parameter, which defaults true)
+	// pre: decoder_mutex is locked
 
-	boost::lock_guard < boost::mutex > lock(decoder_mutex);
+	if (!decoder_)
+		return;
 
-	current_decoder = decoder_ptr_t();
-	next_decoder = decoder_ptr_t();
+	metadata_updates_t::iterator iter = pending_metadata_updates.find(uri_str);
+	if (iter != pending_metadata_updates.end())
+		decoder_->update_metadata(iter->second);
 }
 
 
@@ -578,25 +1024,36 @@ void backend::resource_finished_callback()
 
 metadata_t backend::update_metadata(ion::uri const &uri_, metadata_t const &metadata_updates)
 {
-	// locking down for both the loaded and the not yet loaded decoders, since it may happen that a decoder is get loaded just when the control flow
-	// reaches the create_new_decoder() call below
-	boost::lock_guard < boost::mutex > lock(decoder_mutex);
-
-	// try the already loaded decoders
-	if (current_decoder)
 	{
-		if (current_decoder->get_uri() == uri_)
-			return update_metadata_impl(*current_decoder, metadata_updates);
-	}
+		boost::lock_guard < boost::mutex > lock(decoder_mutex);
 
-	if (next_decoder)
-	{
-		if (next_decoder->get_uri() == uri_)
-			return update_metadata_impl(*next_decoder, metadata_updates);
+		// a decoder for this URI may be under construction right now; record the updates, so they can be applied to it once it is constructed
+		if (uris_under_construction.find(uri_.get_full()) != uris_under_construction.end())
+		{
+			metadata_t &pending_updates = pending_metadata_updates[uri_.get_full()];
+			BOOST_FOREACH(std::string const &name, metadata_updates.getMemberNames())
+			{
+				pending_updates[name] = metadata_updates[name];
+			}
+		}
+
+		// try the already loaded decoders
+		if (current_decoder)
+		{
+			if (current_decoder->get_uri() == uri_)
+				return update_metadata_impl(*current_decoder, metadata_updates);
+		}
+
+		if (next_decoder)
+		{
+			if (next_decoder->get_uri() == uri_)
+				return update_metadata_impl(*next_decoder, metadata_updates);
+		}
 	}
 
 	// at this point, it became clear that no matching decoder is loaded
-	decoder_ptr_t temp_decoder = create_new_decoder(uri_, "", empty_metadata());
+	// (the temporary decoder is constructed without holding the decoder mutex, to not block playback commands and the sink)
+	decoder_ptr_t temp_decoder = create_new_decoder(uri_, "", empty_metadata(), false);
 	if (temp_decoder)
 		return update_metadata_impl(*temp_decoder, metadata_updates);
 	else
@@ -627,27 +1084,56 @@ metadata_t backend::checked_parse_metadata(std::string const &metadata_str, std:
 }
 
 
-source_ptr_t backend::create_new_source(ion::uri const &uri_)
+source_ptr_t backend::create_new_source(ion::uri const &uri_, bool const for_playback)
 {
 	source_creators_t::ordered_t::iterator source_creator_iter = source_creators.get < source_creators_t::ordered_tag > ().find(uri_.get_type());
 	if (source_creator_iter == source_creators.get < source_creators_t::ordered_tag > ().end())
 		return source_ptr_t();
 
-	return (*source_creator_iter)->create(uri_);
+	// Temporary decoders (for metadata) only read a few headers; let the creator know when the whole resource is going to be read
+	source_ptr_t new_source = for_playback ? (*source_creator_iter)->create_for_playback(uri_, send_event_callback) : (*source_creator_iter)->create(uri_, send_event_callback);
+
+	// Keep potentially blocking I/O away from the playback thread
+	if (new_source && new_source->may_block() && (read_ahead_settings.prefetch_depth > 0))
+		new_source = source_ptr_t(new read_ahead_source(new_source, read_ahead_settings, send_event_callback));
+
+	return new_source;
+}
+
+
+decoder_ptr_t backend::try_decoder_creator(decoder_creator &decoder_creator_, source_ptr_t const &source_, metadata_t const &metadata)
+{
+	try
+	{
+		source_->reset();
+		return decoder_creator_.create(source_, metadata, send_event_callback);
+	}
+	catch (std::exception const &exc)
+	{
+		std::cerr << "Exception thrown while trying out decoder creator " << decoder_creator_.get_type() << ": " << exc.what() << std::endl;
+		return decoder_ptr_t();
+	}
 }
 
 
-decoder_ptr_t backend::create_new_decoder(ion::uri const &uri_, std::string const &decoder_type, metadata_t const &metadata)
+decoder_ptr_t backend::create_new_decoder(ion::uri const &uri_, std::string const &decoder_type, metadata_t const &metadata, bool const for_playback)
 {
 	// Read uri and try creating a new source for the decoder
-	source_ptr_t new_source = create_new_source(uri_);
+	source_ptr_t new_source = create_new_source(uri_, for_playback);
 	if (!new_source)
 		throw resource_not_found(uri_.get_full()); // no suitable source found -> throw
 
+	// Read the header once; the decoder creators' probes look at it, and the creators themselves are served
+	// from it when they read the beginning of the resource again, so trying several creators is cheap
+	boost::shared_ptr < header_cached_source > cached_source(new header_cached_source(new_source, probe_header_size));
+	header_cached_source::header_t const &header = cached_source->get_header();
+	uint8_t const *header_data = header.empty() ? 0 : &header[0];
+
 
 	// The actual decoder creation
 
 	decoder_ptr_t new_decoder;
+	decoder_creator *hinted_decoder_creator = 0, *cached_decoder_creator = 0;
 
 	// Try the given decoder type first
 	if (!decoder_type.empty())
@@ -655,28 +1141,59 @@ decoder_ptr_t backend::create_new_decoder(ion::uri const &uri_, std::string cons
 		decoder_creators_t::ordered_t::iterator iter = decoder_creators.get < decoder_creators_t::ordered_tag > ().find(decoder_type);
 		if (iter != decoder_creators.get < decoder_creators_t::ordered_tag > ().end())
 		{
-			new_decoder = (*iter)->create(new_source, metadata, send_event_callback);
+			hinted_decoder_creator = *iter;
+			new_decoder = hinted_decoder_creator->create(cached_source, metadata, send_event_callback);
 		}
 	}
 
-	// If the given decoder type was not set, or invalid, or the creator failed, try all decoder creators
+	// Next, try the decoder type that accepted this resource the last time (if it is a file that has been seen before)
+	probe_cache::entry cache_entry;
+	if (!new_decoder && probe_cache_.lookup(uri_, cache_entry) && (cache_entry.decoder_type != decoder_type))
+	{
+		decoder_creators_t::ordered_t::iterator iter = decoder_creators.get < decoder_creators_t::ordered_tag > ().find(cache_entry.decoder_type);
+		if (iter != decoder_creators.get < decoder_creators_t::ordered_tag > ().end())
+		{
+			cached_decoder_creator = *iter;
+			new_decoder = try_decoder_creator(*cached_decoder_creator, cached_source, metadata);
+		}
+
+		if (!new_decoder)
+			probe_cache_.forget(uri_);
+	}
+
+	// If the given decoder type was not set, or invalid, or the creator failed, try the decoder creators whose
+	// probes did not rule out the resource; creators with matching signatures are tried first
 	if (!new_decoder)
 	{
+		typedef std::pair < int, decoder_creator* > scored_creator_t;
+		typedef std::vector < scored_creator_t > scored_creators_t;
+		scored_creators_t scored_creators;
+
 		BOOST_FOREACH(decoder_creator *decoder_creator_, decoder_creators.get < decoder_creators_t::sequence_tag > ())
 		{
-			try
-			{
-				new_source->reset();
+			if ((decoder_creator_ == hinted_decoder_creator) || (decoder_creator_ == cached_decoder_creator))
+				continue;
 
-				new_decoder = decoder_creator_->create(new_source, metadata, send_event_callback);
-				if (new_decoder)
-					break;
-			}
-			catch (std::exception const &exc)
-			{
-				std::cerr << "Exception thrown while trying out decoder creator " << decoder_creator_->get_type() << ": " << exc.what() << std::endl;
-			}
+			int score = decoder_creator_->probe(header_data, header.size(), uri_);
+			if (score != decoder_creator::probe_score_no_match)
+				scored_creators.push_back(scored_creator_t(-score, decoder_creator_));
 		}
+
+		// stable sort to keep the registration order among creators with equal scores
+		std::stable_sort(scored_creators.begin(), scored_creators.end(), compare_scored_creators());
+
+		BOOST_FOREACH(scored_creator_t const &scored_creator, scored_creators)
+		{
+			new_decoder = try_decoder_creator(*(scored_creator.second), cached_source, metadata);
+			if (new_decoder)
+				break;
+		}
+	}
+
+	if (new_decoder)
+	{
+		cache_entry.decoder_type = new_decoder->get_type();
+		probe_cache_.store(uri_, cache_entry);
 	}
 
 
@@ -684,13 +1201,18 @@ decoder_ptr_t backend::create_new_decoder(ion::uri const &uri_, std::string cons
 }
 
 
-
 void set_send_event_callback(backend &backend_, send_event_callback_t const &new_send_event_callback)
 {
 	backend_.set_send_event_callback(new_send_event_callback);
 }
 
 
+void set_metadata_encoding(backend &backend_, metadata_encoding const new_encoding)
+{
+	backend_.set_metadata_encoding(new_encoding);
+}
+
+
 std::string get_backend_type(backend const &backend_)
 {
 	return backend_.get_type();
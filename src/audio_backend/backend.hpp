@@ -22,7 +22,12 @@
 #ifndef ION_AUDIO_BACKEND_BACKEND_HPP
 #define ION_AUDIO_BACKEND_BACKEND_HPP
 
+#include <deque>
+#include <map>
+#include <set>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <ion/uri.hpp>
 #include <ion/metadata.hpp>
@@ -31,6 +36,8 @@
 #include "source_creator.hpp"
 #include "decoder_creator.hpp"
 #include "sink_creator.hpp"
+#include "probe_cache.hpp"
+#include "read_ahead_source.hpp"
 
 
 namespace ion
@@ -57,6 +64,11 @@ public:
 
 	void set_send_event_callback(send_event_callback_t const &new_send_event_callback);
 
+	// Sets the encoding of the metadata in metadata events sent as response to get_metadata and update_metadata. Default is JSON.
+	// pre: nothing.
+	// post: responses to subsequent commands use the given encoding.
+	void set_metadata_encoding(metadata_encoding const new_encoding) { response_metadata_encoding = new_encoding; }
+
 
 	// Retrieves a type identifier for this backend, this identifier being "ion_audio".
 	// pre: nothing.
@@ -73,6 +85,23 @@ public:
 	// post: does not affect backend states.
 	std::string get_metadata_as_string(std::string const &uri_str);
 
+	// Retrieves metadata for the given resource, and stores the corresponding metadata_result event in the last two arguments.
+	// See the get_metadata_batch command in designdoc.txt for the event.
+	// pre: nothing. Errors (including invalid URIs) are reported in the event, not thrown.
+	// post: does not affect backend states.
+	void get_metadata_result(std::string const &uri_str, metadata_encoding const encoding, std::string &event_command, params_t &event_params);
+
+	// Queues metadata requests for the given URIs. See the get_metadata_batch command in designdoc.txt for details.
+	// The requests are processed in the metadata batch thread, in order, which sends one metadata_result event per URI; other commands are not blocked by them.
+	// pre: nothing.
+	// post: the URIs are queued behind any previously queued ones.
+	void queue_metadata_batch(params_t const &uris);
+
+	// Waits until the metadata batch thread processed all queued requests.
+	// pre: nothing.
+	// post: the metadata_result events for all previously queued URIs were sent.
+	void wait_for_metadata_batches();
+
 	void exec_command(std::string const &command, params_t const &params, std::string &response_command, params_t &response_params);
 
 
@@ -80,23 +109,32 @@ public:
 	sink_creators_t::creators_t    & get_sink_creators()    { return sink_creators; }
 	source_creators_t::creators_t  & get_source_creators()  { return source_creators; }
 
+	// The cache of decoder types that accepted previously seen files. It is memory-only unless probe_cache::open() is called.
+	probe_cache & get_probe_cache() { return probe_cache_; }
+
+	// Settings for the read_ahead_source instances that wrap sources whose I/O may block (see source::may_block()).
+	// Setting the prefetch depth to 0 disables read-ahead. Changes apply to sources created afterwards.
+	read_ahead_source::settings & get_read_ahead_settings() { return read_ahead_settings; }
+
 
 	// Starts playback with the given params. See the play command in audio.txt for details.
 	// Internally, a decoder is created for the given uri. (If a next uri is given, it will also get a decoder; this facilitates preload and subsequently gapless playback.)
+	// The decoders are created asynchronously by the decoder construction thread; this function returns right after the params were checked.
 	// pre: Params must be valid. Invalid params cause an exception to be thrown. A valid sink must have been set before.
-	// post: If the given first uri is valid, its playback will commence immediately. Any current playback will cease.
-	// Note that no notification will be sent in this case.
-	// If the first uri is invalid, this function does not alter any internal states.
+	// post: If the given first uri is valid, its playback will commence once its decoder is constructed (the sink then sends a started event).
+	// Any current playback will cease then. If another play or stop command comes in before this happens, this request is discarded.
+	// If the first uri is invalid, an error event is sent, and internal states are not altered.
 	// If a second uri is given, and it is found valid, it will be the new next uri. If it is found invalid, or if it is not given,
 	// any previously set next resource will be removed.
 	void start_playback(params_t const &params);
 
 	// Sets the next resource, replacing any previously set resource. See the set_next_resource command in audio.txt for details.
+	// Like start_playback(), this only queues the request; the decoder is constructed asynchronously.
 	// pre: Params must be valid. Invalid params cause an exception to be thrown. A valid sink must have been set before.
-	// post: if nothing is playing at time of this call, this function will call start_playback(), passing its params, and then exit.
+	// post: if nothing is playing at the time the request is processed, the request is handled like a play request.
 	// (Note: paused playback does not count as "no playback".)
-	// If something is already playing, it will set a new next song if the given uri is found to be valid. If the given uri is invalid,
-	// this function does not set anything.
+	// If something is already playing, it will set a new next song if the given uri is found to be valid, and send a next_resource_set event.
+	// If the given uri is invalid, an error event is sent, and nothing is set.
 	void set_next_resource(params_t const &params);
 
 	// Clears the next resource. If any playback is happening, its ending will not trigger a transition anymore; instead, resource_finished will be triggered,
@@ -121,9 +159,39 @@ public:
 
 
 protected:
-	void set_next_decoder(std::string const &uri_str, std::string const &decoder_type, metadata_t const &metadata);
-	source_ptr_t create_new_source(ion::uri const &uri_);
-	decoder_ptr_t create_new_decoder(ion::uri const &uri_, std::string const &decoder_type, metadata_t const &metadata);
+	struct decoder_construction_job
+	{
+		enum job_type
+		{
+			play_job,
+			set_next_resource_job
+		};
+
+		job_type type;
+		params_t params; // the parameters of the command that caused this job, for error reports
+		std::string uri_str[2], decoder_type[2];
+		metadata_t metadata[2];
+		unsigned long playback_generation, next_resource_generation;
+	};
+
+	typedef std::deque < decoder_construction_job > decoder_construction_jobs_t;
+	typedef std::deque < std::pair < std::string, metadata_encoding > > metadata_batch_requests_t;
+	typedef std::multiset < std::string > uris_t;
+	typedef std::map < std::string, metadata_t > metadata_updates_t;
+
+
+	void enqueue_decoder_construction_job(decoder_construction_job job);
+	void decoder_construction_loop();
+	void run_play_job(decoder_construction_job const &job);
+	void run_set_next_resource_job(decoder_construction_job const &job);
+	void finish_decoder_construction_job(decoder_construction_job const &job);
+	void apply_pending_metadata_updates(decoder_ptr_t const &decoder_, std::string const &uri_str);
+	void metadata_batch_loop();
+
+	decoder_ptr_t create_next_decoder(std::string const &uri_str, std::string const &decoder_type, metadata_t const &metadata);
+	source_ptr_t create_new_source(ion::uri const &uri_, bool const for_playback);
+	decoder_ptr_t create_new_decoder(ion::uri const &uri_, std::string const &decoder_type, metadata_t const &metadata, bool const for_playback);
+	decoder_ptr_t try_decoder_creator(decoder_creator &decoder_creator_, source_ptr_t const &source_, metadata_t const &metadata);
 	void resource_finished_callback();
 	metadata_t update_metadata(ion::uri const &uri_, metadata_t const &metadata_updates);
 	metadata_t update_metadata_impl(decoder &decoder_, metadata_t const &metadata_updates);
@@ -132,20 +200,47 @@ protected:
 
 
 	send_event_callback_t send_event_callback;
+	metadata_encoding response_metadata_encoding;
 
 	decoder_creators_t::creators_t decoder_creators;
 	sink_creators_t::creators_t    sink_creators;
 	source_creators_t::creators_t  source_creators;
 
+	probe_cache probe_cache_;
+	read_ahead_source::settings read_ahead_settings;
+
 	decoder_ptr_t current_decoder, next_decoder;
 	sink_ptr_t current_sink;
 
 	boost::mutex decoder_mutex;
+
+	// These are guarded by decoder_mutex as well.
+	// The generations are incremented by commands that supersede pending decoder construction jobs (for example, stop supersedes any pending play job);
+	// jobs whose recorded generations differ from the current ones are discarded.
+	// Metadata updates for URIs whose decoders are being constructed are recorded, and applied to the decoders once they are constructed.
+	unsigned long playback_generation, next_resource_generation;
+	uris_t uris_under_construction;
+	metadata_updates_t pending_metadata_updates;
+
+	// Decoders are constructed in this thread, so that slow decoder initializations do not block other commands
+	boost::thread decoder_construction_thread;
+	boost::mutex decoder_construction_mutex;
+	boost::condition_variable decoder_construction_condition;
+	decoder_construction_jobs_t decoder_construction_jobs;
+	bool decoder_construction_thread_running;
+
+	// Metadata batch requests are processed in this thread, so that large batches do not block other commands
+	boost::thread metadata_batch_thread;
+	boost::mutex metadata_batch_mutex;
+	boost::condition_variable metadata_batch_condition, metadata_batch_idle_condition;
+	metadata_batch_requests_t metadata_batch_requests;
+	bool metadata_batch_thread_running, metadata_batch_busy;
 };
 
 
 
 void set_send_event_callback(backend &backend_, send_event_callback_t const &new_send_event_callback);
+void set_metadata_encoding(backend &backend_, metadata_encoding const new_encoding);
 std::string get_backend_type(backend const &backend_);
 void execute_command(backend &backend_, std::string const &command, params_t const &parameters, std::string &response_command, params_t &response_parameters);
 
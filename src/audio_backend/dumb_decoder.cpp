@@ -31,6 +31,7 @@
 #include <boost/spirit/home/phoenix/core/argument.hpp>
 
 #include "dumb_decoder.hpp"
+#include "source_block_reader.hpp"
 
 
 
@@ -38,43 +39,47 @@
 extern "C"
 {
 
+// The DUMBFILE handles are block readers on top of the source, so that the per-byte getc() calls
+// made by the module loaders do not turn into one source read each
+
 static void* custom_dumb_stream_open(char const * source_ptr)
 {
-        return (void*)(source_ptr);
+	ion::audio_common::source *source_ = reinterpret_cast < ion::audio_common::source* > (const_cast < char* > (source_ptr));
+	return new ion::audio_common::source_block_reader(*source_);
 }
 
 static int custom_dumb_stream_skip(void *f, long n)
 {
-        ion::audio_common::source *source_ = reinterpret_cast < ion::audio_common::source* > (f);
-        source_->seek(n, ion::audio_common::source::seek_relative);
-        return 0;
+	ion::audio_common::source_block_reader *reader = reinterpret_cast < ion::audio_common::source_block_reader* > (f);
+	reader->seek(n, ion::audio_common::source::seek_relative);
+	return 0;
 }
 
 static int custom_dumb_stream_getc(void *f)
 {
-        ion::audio_common::source *source_ = reinterpret_cast < ion::audio_common::source* > (f);
-        uint8_t b;
-        source_->read(reinterpret_cast < char* > (&b), 1);
-        return int(b);
+	ion::audio_common::source_block_reader *reader = reinterpret_cast < ion::audio_common::source_block_reader* > (f);
+	return reader->get_byte();
 }
 
 static long custom_dumb_stream_getnc(char *ptr, long n, void *f)
 {
-        ion::audio_common::source *source_ = reinterpret_cast < ion::audio_common::source* > (f);
-        source_->read(ptr, n);
-        return n;
+	ion::audio_common::source_block_reader *reader = reinterpret_cast < ion::audio_common::source_block_reader* > (f);
+	return reader->read(ptr, n);
 }
 
 static void custom_dumb_stream_close(void *f)
 {
-        ion::audio_common::source *source_ = reinterpret_cast < ion::audio_common::source* > (f);
-        source_->seek(0, ion::audio_common::source::seek_absolute);
+	ion::audio_common::source_block_reader *reader = reinterpret_cast < ion::audio_common::source_block_reader* > (f);
+	ion::audio_common::source &source_ = reader->get_source();
+	delete reader;
+	source_.seek(0, ion::audio_common::source::seek_absolute);
 }
 
 }
 
 
 
+
 namespace ion
 {
 namespace audio_backend
@@ -109,10 +114,10 @@ DUH* read_module(source &source_, long const filesize, dumb_decoder::module_type
 
 	typedef std::map < dumb_decoder::module_type, dumb_read_function_entry_t > read_funcs_t;
 	read_funcs_t read_funcs;
-	read_funcs[dumb_decoder::module_type_xm] = dumb_read_function_entry_t(boost::phoenix::bind(&dumb_load_xm, boost::phoenix::arg_names::arg1), "xm");
-	read_funcs[dumb_decoder::module_type_it] = dumb_read_function_entry_t(boost::phoenix::bind(&dumb_load_it, boost::phoenix::arg_names::arg1), "it");
-	read_funcs[dumb_decoder::module_type_s3m] = dumb_read_function_entry_t(boost::phoenix::bind(&dumb_load_s3m, boost::phoenix::arg_names::arg1), "s3m");
-	read_funcs[dumb_decoder::module_type_mod] = dumb_read_function_entry_t(boost::phoenix::bind(&dumb_load_mod, boost::phoenix::arg_names::arg1), "mod");
+	read_funcs[dumb_decoder::module_type_xm] = dumb_read_function_entry_t(boost::phoenix::bind(&dumb_load_xm_quick, boost::phoenix::arg_names::arg1), "xm");
+	read_funcs[dumb_decoder::module_type_it] = dumb_read_function_entry_t(boost::phoenix::bind(&dumb_load_it_quick, boost::phoenix::arg_names::arg1), "it");
+	read_funcs[dumb_decoder::module_type_s3m] = dumb_read_function_entry_t(boost::phoenix::bind(&dumb_load_s3m_quick, boost::phoenix::arg_names::arg1), "s3m");
+	read_funcs[dumb_decoder::module_type_mod] = dumb_read_function_entry_t(boost::phoenix::bind(&dumb_load_mod_quick, boost::phoenix::arg_names::arg1), "mod");
 
 	{
 		read_funcs_t::iterator read_func_iter = read_funcs.find(module_type_);
@@ -140,6 +145,22 @@ DUH* read_module(source &source_, long const filesize, dumb_decoder::module_type
 }
 
 
+// Distance between two seek checkpoints, in ticks (65536 ticks per second).
+// The modules are loaded with the _quick functions, which skip DUMB's own
+// runthrough (that one places checkpoints only every 30 seconds). The single
+// runthrough done here instead places them every few seconds, so seeking only
+// has to render the short gap between the nearest checkpoint and the target.
+long const checkpoint_interval = 4 * 65536;
+
+
+void build_checkpoints(DUH *duh)
+{
+	DUMB_IT_SIGDATA *sigdata = duh_get_it_sigdata(duh);
+	if (sigdata != 0)
+		duh_set_length(duh, dumb_it_build_checkpoints_at_interval(sigdata, checkpoint_interval));
+}
+
+
 }
 
 
@@ -160,6 +181,8 @@ dumb_decoder::dumb_decoder(send_event_callback_t const send_event_callback, sour
 	playback_properties_.num_channels = 0;
 
 	duh = read_module(*source_, filesize, this->module_type_);
+	if (duh != 0)
+		build_checkpoints(duh);
 }
 
 
@@ -198,6 +221,7 @@ long dumb_decoder::set_current_position(long const new_position)
 	boost::lock_guard < boost::mutex > lock(mutex_);
 
 	// DUMB does not reset the position when looping - compensate
+	// (the new sigrenderer resumes from the nearest checkpoint before new_position)
 	reinitialize_sigrenderer(playback_properties_.num_channels, new_position);
 
 	return duh_sigrenderer_get_position(duh_sigrenderer);
@@ -500,12 +524,28 @@ module_ui dumb_decoder_creator::get_ui() const
 }
 
 
+int dumb_decoder_creator::probe(uint8_t const *header, unsigned long const header_size, ion::uri const &) const
+{
+	return (identify_module_header(header, header_size) != dumb_decoder::module_type_unknown) ? probe_score_match : probe_score_no_match;
+}
+
+
 dumb_decoder::module_type dumb_decoder_creator::test_if_module_file(source_ptr_t source_)
 {
 	if (!source_->can_seek(source::seek_absolute))
 		return dumb_decoder::module_type_unknown;
 
+	source_->seek(0, source::seek_absolute);
+	uint8_t header[module_header_test_size];
+	long num_read_bytes = source_->read(header, module_header_test_size);
+	source_->seek(0, source::seek_absolute);
+
+	return identify_module_header(header, std::max(num_read_bytes, 0L));
+}
+
 
+dumb_decoder::module_type dumb_decoder_creator::identify_module_header(uint8_t const *header, unsigned long const header_size)
+{
 	typedef boost::array < uint8_t, 4 > fourcc_t;
 
 	struct fourcc_entry
@@ -547,14 +587,12 @@ dumb_decoder::module_type dumb_decoder_creator::test_if_module_file(source_ptr_t
 
 	for (fourcc_entry const *fourcc_entry_ = fourcc_entries; fourcc_entry_->offset >= 0; ++fourcc_entry_)
 	{
-		source_->seek(fourcc_entry_->offset, source::seek_absolute);
-		fourcc_t read_fourcc;
-		source_->read(&read_fourcc[0], 4);
-		if (read_fourcc == fourcc_entry_->fourcc)
-		{
-			source_->seek(0, source::seek_absolute);
+		unsigned long offset = fourcc_entry_->offset;
+		if ((offset + 4) > header_size)
+			continue;
+
+		if (std::equal(fourcc_entry_->fourcc.begin(), fourcc_entry_->fourcc.end(), header + offset))
 			return fourcc_entry_->module_type_;
-		}
 	}
 
 
@@ -110,6 +110,7 @@ class dumb_decoder_creator:
 public:
 	explicit dumb_decoder_creator();
 
+	virtual int probe(uint8_t const *header, unsigned long const header_size, uri const &uri_) const;
 	virtual decoder_ptr_t create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback);
 	virtual std::string get_type() const { return "dumb"; }
 
@@ -119,6 +120,10 @@ public:
 protected:
 	Json::Value get_properties_as_json() const;
 	dumb_decoder::module_type test_if_module_file(source_ptr_t source_);
+	static dumb_decoder::module_type identify_module_header(uint8_t const *header, unsigned long const header_size);
+
+	// The fourccs identify_module_header() checks are located within the first module_header_test_size bytes
+	enum { module_header_test_size = 1084 };
 
 
 	DUMBFILE_SYSTEM fs;
@@ -19,10 +19,12 @@
 **************************************************************************/
 
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <boost/thread/locks.hpp>
 #include "faad_decoder.hpp"
+#include "source_block_reader.hpp"
 
 
 namespace ion
@@ -31,11 +33,123 @@ namespace audio_backend
 {
 
 
+namespace
+{
+
+
+// Size of the input buffer, and the minimum amount of unconsumed input that is kept in it before decoding a frame
+// (ADTS frames are at most 8191 bytes long)
+unsigned long const in_buffer_size = 65536;
+unsigned long const min_in_buffer_fill = 16384;
+
+// One AAC frame contains 1024 samples per channel (2048 with SBR)
+int64_t const num_samples_per_aac_frame = 1024;
+
+unsigned int const adts_sample_rates[] = {
+	96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+
+// Test found in libmagic's animation file
+bool is_aac_header(uint8_t const *header, unsigned long const header_size)
+{
+	if (header_size < 4)
+		return false;
+
+	// check if this is an AAC file in ADIF format
+	if ((header[0] == 'A') && (header[1] == 'D') && (header[2] == 'I') && (header[3] == 'F'))
+		return true;
+
+	// check if this is an AAC file in ADTS format
+	return (header[0] == 0xff) && ((header[1] & 0xf6) == 0xf0);
+}
+
+
+}
+
+
+
+
+faad_decoder::output_ring::output_ring():
+	read_pos(0),
+	num_values(0)
+{
+}
+
+
+void faad_decoder::output_ring::clear()
+{
+	read_pos = 0;
+	num_values = 0;
+}
+
+
+void faad_decoder::output_ring::reserve(unsigned long const min_capacity)
+{
+	unsigned long capacity = buffer.size();
+	if (min_capacity <= capacity)
+		return;
+
+	std::vector < int16_t > new_buffer(std::max(min_capacity, capacity * 2));
+	unsigned long num_stored_values = num_values;
+	read(num_stored_values, &new_buffer[0]);
+
+	buffer.swap(new_buffer);
+	read_pos = 0;
+	num_values = num_stored_values;
+}
+
+
+unsigned long faad_decoder::output_ring::read(unsigned long const max_num_values, void *dest)
+{
+	unsigned long num_values_to_read = std::min(max_num_values, num_values);
+	if (num_values_to_read == 0)
+		return 0;
+
+	unsigned long first_part = std::min(num_values_to_read, buffer.size() - read_pos);
+	int16_t *dest_values = reinterpret_cast < int16_t* > (dest);
+	std::memcpy(dest_values, &buffer[read_pos], first_part * sizeof(int16_t));
+	if (first_part < num_values_to_read)
+		std::memcpy(dest_values + first_part, &buffer[0], (num_values_to_read - first_part) * sizeof(int16_t));
+
+	read_pos = (read_pos + num_values_to_read) % buffer.size();
+	num_values -= num_values_to_read;
+
+	return num_values_to_read;
+}
+
+
+void faad_decoder::output_ring::write(int16_t const *src, unsigned long const num_values_to_write)
+{
+	reserve(num_values + num_values_to_write);
+
+	unsigned long write_pos = (read_pos + num_values) % buffer.size();
+	unsigned long first_part = std::min(num_values_to_write, buffer.size() - write_pos);
+	std::memcpy(&buffer[write_pos], src, first_part * sizeof(int16_t));
+	if (first_part < num_values_to_write)
+		std::memcpy(&buffer[0], src + first_part, (num_values_to_write - first_part) * sizeof(int16_t));
+
+	num_values += num_values_to_write;
+}
+
+
+
+
 faad_decoder::faad_decoder(send_event_callback_t const send_event_callback, source_ptr_t source_):
 	decoder(send_event_callback),
 	source_(source_),
 	initialized(false),
-	current_position(0)
+	decoder_sample_rate(0),
+	frequency(48000),
+	num_channels(0),
+	in_buffer(in_buffer_size),
+	in_buffer_start(0),
+	in_buffer_end(0),
+	num_values_to_skip(0),
+	current_position(0),
+	adts_sample_rate(0),
+	adts_num_samples(0),
+	adts_index_built(false)
 {
 	// Misc checks & initializations
 
@@ -46,14 +160,80 @@ faad_decoder::faad_decoder(send_event_callback_t const send_event_callback, sour
 	if (source_size == 0)
 		return; // 0 bytes? we cannot use this.
 
-	initialized = initialize(48000);
+	initialized = initialize(frequency, 0);
+}
+
+
+void faad_decoder::build_adts_index() const
+{
+	// Walks over the ADTS frame headers and records where each frame starts; this is what makes seeking possible,
+	// since ADTS has no index of its own. Only the 7 byte headers are read, through a block reader, but this still
+	// touches the whole file, so it is done only once the index is actually needed: for the first seek, or when the
+	// length is queried (for metadata scans, for example). Playback from the beginning does not need it.
+	// ADIF files are not indexed (and therefore not seekable).
+	// The caller must hold the decoder mutex. The source's position is restored afterwards, so decoding can continue.
+
+	if (adts_index_built)
+		return;
+	adts_index_built = true;
+
+	adts_frames.clear();
+	adts_num_samples = 0;
+
+	long source_size = source_->get_size();
+	if ((source_size <= 0) || !source_->can_seek(source::seek_absolute))
+		return;
+
+	long decoding_position = source_->get_position();
+	source_->reset();
+
+	{
+		source_block_reader reader(*source_);
+		long byte_offset = 0;
+
+		while ((byte_offset + 7) <= source_size)
+		{
+			uint8_t header[7];
+			reader.seek(byte_offset, source::seek_absolute);
+			if (reader.read(header, 7) != 7)
+				break;
+
+			// syncword, layer 0
+			if ((header[0] != 0xff) || ((header[1] & 0xf6) != 0xf0))
+				break;
+
+			unsigned int sample_rate_index = (header[2] >> 2) & 0x0f;
+			long frame_length = (long(header[3] & 0x03) << 11) | (long(header[4]) << 3) | (long(header[5]) >> 5);
+			unsigned int num_raw_data_blocks = (header[6] & 0x03) + 1;
+
+			if ((sample_rate_index >= (sizeof(adts_sample_rates) / sizeof(adts_sample_rates[0]))) || (frame_length < 7) || ((byte_offset + frame_length) > source_size))
+				break;
+
+			if (adts_frames.empty())
+				adts_sample_rate = adts_sample_rates[sample_rate_index];
+
+			adts_frame frame;
+			frame.byte_offset = byte_offset;
+			frame.sample_offset = adts_num_samples;
+			adts_frames.push_back(frame);
+
+			adts_num_samples += num_raw_data_blocks * num_samples_per_aac_frame;
+			byte_offset += frame_length;
+		}
+	}
+
+	source_->reset();
+	if (decoding_position > 0)
+		source_->seek(decoding_position, source::seek_absolute);
 }
 
 
-bool faad_decoder::initialize(unsigned int const frequency)
+bool faad_decoder::initialize(unsigned int const frequency, long const byte_offset)
 {
 	close();
 
+	this->frequency = frequency;
+
 	long ret;
 
 	faad_handle = faacDecOpen();
@@ -61,19 +241,24 @@ bool faad_decoder::initialize(unsigned int const frequency)
 	faacDecConfigurationPtr conf = faacDecGetCurrentConfiguration(*faad_handle);
 	conf->defSampleRate = frequency;
 	conf->outputFormat = FAAD_FMT_16BIT;
+	conf->downMatrix = 1; // the sinks handle up to two channels
 	faacDecSetConfiguration(*faad_handle, conf);
 
 	unsigned long sample_rate;
 	unsigned char channels;
 
 	source_->reset();
-	in_buffer.resize(32768);
-	long num_read_bytes = source_->read(&in_buffer[0], 32768);
-	if (num_read_bytes <= 0)
+	if (byte_offset > 0)
+		source_->seek(byte_offset, source::seek_absolute);
+
+	in_buffer_start = in_buffer_end = 0;
+	out_ring.clear();
+	num_values_to_skip = 0;
+
+	if (!fill_in_buffer())
 		return false;
-	in_buffer.resize(num_read_bytes);
 
-	ret = faacDecInit(*faad_handle, &in_buffer[0], in_buffer.size(), &sample_rate, &channels);
+	ret = faacDecInit(*faad_handle, &in_buffer[0], in_buffer_end, &sample_rate, &channels);
 	if (ret < 0)
 	{
 		std::cerr << "faacDecInit failed" << std::endl;
@@ -83,16 +268,44 @@ bool faad_decoder::initialize(unsigned int const frequency)
 	else
 	{
 		decoder_sample_rate = sample_rate;
-		if (ret > 0)
-		{
-			std::memmove(&in_buffer[0], &in_buffer[ret], in_buffer.size() - ret);
-			in_buffer.resize(in_buffer.size() - ret);
-		}
-		return true;
+		num_channels = channels;
+		in_buffer_start = ret;
+		return (num_channels > 0);
 	}
 }
 
 
+bool faad_decoder::fill_in_buffer()
+{
+	// compact only if the space behind the unconsumed data is too small; the unconsumed data is
+	// less than min_in_buffer_fill bytes at this point, so this moves little data, and rarely
+	if ((in_buffer.size() - in_buffer_end) < min_in_buffer_fill)
+	{
+		unsigned long num_unconsumed_bytes = in_buffer_end - in_buffer_start;
+		std::memmove(&in_buffer[0], &in_buffer[in_buffer_start], num_unconsumed_bytes);
+		in_buffer_start = 0;
+		in_buffer_end = num_unconsumed_bytes;
+	}
+
+	if (!source_->can_read())
+		return false;
+
+	long num_read_bytes = source_->read(&in_buffer[in_buffer_end], in_buffer.size() - in_buffer_end);
+	if (num_read_bytes <= 0)
+		return false;
+
+	in_buffer_end += num_read_bytes;
+	return true;
+}
+
+
+int64_t faad_decoder::adts_to_output_samples(int64_t const num_adts_samples) const
+{
+	// with SBR, the decoder outputs at twice the sample rate given in the ADTS header
+	return (adts_sample_rate > 0) ? (num_adts_samples * decoder_sample_rate / adts_sample_rate) : num_adts_samples;
+}
+
+
 void faad_decoder::close()
 {
 	if (faad_handle)
@@ -121,16 +334,57 @@ bool faad_decoder::can_playback() const
 }
 
 
-long faad_decoder::set_current_position(long const)
+namespace
+{
+
+struct adts_frame_sample_offset_less
+{
+	template < typename Frame >
+	bool operator()(int64_t const sample_offset, Frame const &frame) const
+	{
+		return sample_offset < frame.sample_offset;
+	}
+};
+
+}
+
+
+long faad_decoder::set_current_position(long const new_position)
 {
-	// It generally does not seem to be possible to seek in AAC songs with FAAD
+	if (!is_initialized())
+		return -1;
+
+	boost::lock_guard < boost::mutex > lock(mutex_);
+
+	build_adts_index();
+	if (adts_frames.empty() || (new_position < 0) || (new_position >= get_num_ticks_impl()))
+		return -1;
+
+	// find the frame that contains the new position
+	int64_t adts_position = int64_t(new_position) * adts_sample_rate / decoder_sample_rate;
+	adts_frames_t::const_iterator frame_iter = std::upper_bound(adts_frames.begin(), adts_frames.end(), adts_position, adts_frame_sample_offset_less());
+	if (frame_iter != adts_frames.begin())
+		--frame_iter;
+
+	// Restart the decoder at that frame. FAAD does not output anything for the first frame it decodes, and the output
+	// of each following frame starts where the previous frame started, so the decoder is exactly at the beginning of
+	// the frame afterwards, just like during regular playback. The remainder up to the new position is skipped.
+	if (!initialize(frequency, frame_iter->byte_offset))
+	{
+		initialized = false;
+		return -1;
+	}
+
+	num_values_to_skip = (new_position - adts_to_output_samples(frame_iter->sample_offset)) * num_channels;
+	current_position = new_position;
+
 	return current_position;
 }
 
 
 long faad_decoder::get_current_position() const
 {
-	// It generally does not seem to be possible to retrieve the current position with FAAD
+	boost::lock_guard < boost::mutex > lock(mutex_);
 	return current_position;
 }
 
@@ -156,7 +410,19 @@ uri faad_decoder::get_uri() const
 
 long faad_decoder::get_num_ticks() const
 {
-	return 0;
+	if (!is_initialized())
+		return 0;
+
+	boost::lock_guard < boost::mutex > lock(mutex_);
+	build_adts_index();
+	return get_num_ticks_impl();
+}
+
+
+long faad_decoder::get_num_ticks_impl() const
+{
+	// the first decoded frame yields no output, so the output ends where the last frame starts
+	return adts_frames.empty() ? 0 : long(adts_to_output_samples(adts_frames.back().sample_offset));
 }
 
 
@@ -174,13 +440,14 @@ void faad_decoder::set_playback_properties(playback_properties const &new_playba
 	boost::lock_guard < boost::mutex > lock(mutex_);
 
 	playback_properties_ = new_playback_properties;
-	initialize(playback_properties_.frequency);
+	initialized = initialize(playback_properties_.frequency, 0);
+	current_position = 0;
 }
 
 
 decoder_properties faad_decoder::get_decoder_properties() const
 {
-	return decoder_properties(decoder_sample_rate, playback_properties_.num_channels, playback_properties_.sample_type_);
+	return decoder_properties(decoder_sample_rate, num_channels, audio_common::sample_s16);
 }
 
 
@@ -189,52 +456,43 @@ unsigned int faad_decoder::update(void *dest, unsigned int const num_samples_to_
 	if (!is_initialized())
 		return 0;
 
-	unsigned int multiplier = playback_properties_.num_channels * get_sample_size(playback_properties_.sample_type_);
+	boost::lock_guard < boost::mutex > lock(mutex_);
+
+	unsigned long num_values_to_write = num_samples_to_write * num_channels;
 
 	faacDecFrameInfo info;
-	while (out_buffer.size() < (num_samples_to_write * multiplier))
+	while (out_ring.get_num_values() < num_values_to_write)
 	{
-		size_t actual_in_size = in_buffer.size();
+		if ((in_buffer_end - in_buffer_start) < min_in_buffer_fill)
+			fill_in_buffer();
 
-		if (actual_in_size < 32768)
-		{
-			size_t old_in_size = actual_in_size;
-			in_buffer.resize(old_in_size + 32768);
-			long num_read_bytes = source_->read(&in_buffer[old_in_size], 32768);
-			if (num_read_bytes <= 0)
-				break;
-			actual_in_size = old_in_size + num_read_bytes;
-		}
+		if (in_buffer_end == in_buffer_start)
+			break; // end of data
 
-		void *output_samples = faacDecDecode(*faad_handle, &info, reinterpret_cast < unsigned char* > (&in_buffer[0]), actual_in_size);
-		unsigned int num_remaining_bytes = actual_in_size;
+		void *output_samples = faacDecDecode(*faad_handle, &info, &in_buffer[in_buffer_start], in_buffer_end - in_buffer_start);
+		in_buffer_start += std::min(info.bytesconsumed, in_buffer_end - in_buffer_start);
 
-		num_remaining_bytes -= info.bytesconsumed;
-		std::memmove(&in_buffer[0], &in_buffer[info.bytesconsumed], num_remaining_bytes);
-		in_buffer.resize(num_remaining_bytes);
-
-		if ((output_samples == 0) || (info.error != 0) || (info.channels == 0))
+		if ((info.error != 0) || (info.bytesconsumed == 0))
 		{
 			initialized = false;
 			break;
 		}
 
-		if (info.samples > 0)
-		{
-			size_t old_out_size = out_buffer.size();
-			out_buffer.resize(old_out_size + info.samples * playback_properties_.num_channels);
-			std::memcpy(&out_buffer[old_out_size], output_samples, info.samples * playback_properties_.num_channels);
-		}
-	}
+		if ((output_samples == 0) || (info.samples == 0))
+			continue;
 
-	size_t num_bytes_to_copy = std::min(size_t(num_samples_to_write * multiplier), out_buffer.size());
-	std::memcpy(dest, &out_buffer[0], num_bytes_to_copy);
-	if (out_buffer.size() > num_bytes_to_copy)
-		std::memmove(&out_buffer[0], &out_buffer[num_bytes_to_copy], out_buffer.size() - num_bytes_to_copy);
-	out_buffer.resize(out_buffer.size() - num_bytes_to_copy);
+		int16_t const *output_values = reinterpret_cast < int16_t const * > (output_samples);
+		unsigned long num_output_values = info.samples;
 
-	current_position += num_bytes_to_copy / multiplier;
-	return num_bytes_to_copy / multiplier;
+		unsigned long num_skipped_values = std::min(num_values_to_skip, num_output_values);
+		num_values_to_skip -= num_skipped_values;
+
+		out_ring.write(output_values + num_skipped_values, num_output_values - num_skipped_values);
+	}
+
+	unsigned long num_samples_written = out_ring.read(num_values_to_write, dest) / num_channels;
+	current_position += num_samples_written;
+	return num_samples_written;
 }
 
 
@@ -245,22 +503,22 @@ faad_decoder_creator::faad_decoder_creator()
 }
 
 
+int faad_decoder_creator::probe(uint8_t const *header, unsigned long const header_size, ion::uri const &) const
+{
+	return is_aac_header(header, header_size) ? probe_score_match : probe_score_no_match;
+}
+
+
 decoder_ptr_t faad_decoder_creator::create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback)
 {
-	// Test found in libmagic's animation file
 	{
 		uint8_t bytes[4];
 		source_->reset();
-		source_->read(bytes, 4);
+		long num_read_bytes = source_->read(bytes, 4);
 		source_->reset();
 
-		// check if this is an AAC file in ADIF format
-		if ((bytes[0] != 'A') || (bytes[1] != 'D') || (bytes[2] != 'I') || (bytes[3] != 'F'))
-		{
-			// check if this is an AAC file in ADTS format
-			if ((bytes[0] != 0xff) || ((bytes[1] & 0xf6) != 0xf0))
-				return decoder_ptr_t();
-		}
+		if (!is_aac_header(bytes, std::max(num_read_bytes, 0L)))
+			return decoder_ptr_t();
 	}
 
 	faad_decoder *faad_decoder_ = new faad_decoder(send_event_callback, source_);
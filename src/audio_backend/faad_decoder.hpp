@@ -85,8 +85,42 @@ protected:
 	typedef boost::optional < faacDecHandle > faad_handle_optional_t;
 	typedef std::vector < uint8_t > buffer_t;
 
-	bool initialize(unsigned int const frequency);
+	// Position of one ADTS frame; sample_offset is the number of samples (per channel, at the ADTS header's sample rate) that precede the frame
+	struct adts_frame
+	{
+		long byte_offset;
+		int64_t sample_offset;
+	};
+	typedef std::vector < adts_frame > adts_frames_t;
+
+
+	/*
+	* Ring for the decoded 16-bit samples. Decoded frames are appended; update() copies out of it, so no
+	* data has to be moved around after partial reads.
+	*/
+	class output_ring
+	{
+	public:
+		output_ring();
+
+		void clear();
+		void reserve(unsigned long const min_capacity);
+		unsigned long get_num_values() const { return num_values; }
+		unsigned long read(unsigned long const max_num_values, void *dest);
+		void write(int16_t const *src, unsigned long const num_values_to_write);
+
+	protected:
+		std::vector < int16_t > buffer;
+		unsigned long read_pos, num_values;
+	};
+
+
+	bool initialize(unsigned int const frequency, long const byte_offset);
 	void close();
+	void build_adts_index() const;
+	bool fill_in_buffer();
+	int64_t adts_to_output_samples(int64_t const num_adts_samples) const;
+	long get_num_ticks_impl() const;
 
 
 	mutable boost::mutex mutex_;
@@ -94,12 +128,23 @@ protected:
 	faad_handle_optional_t faad_handle;
 	bool initialized;
 	playback_properties playback_properties_;
-	unsigned int decoder_sample_rate;
-	buffer_t in_buffer, out_buffer;
+	unsigned int decoder_sample_rate, frequency;
+	unsigned char num_channels;
+
+	// Input buffer; faacDecDecode() needs each frame in contiguous memory, so this is a sliding window
+	// that is only compacted when the space behind the unconsumed data gets too small for another read
+	buffer_t in_buffer;
+	unsigned long in_buffer_start, in_buffer_end;
+
+	output_ring out_ring;
+	unsigned long num_values_to_skip;
 	long current_position;
 
-	unsigned long sample_rate;
-	unsigned char channels;
+	// The index is built on demand (see build_adts_index()); these are mutable, since get_num_ticks() may have to build it
+	mutable adts_frames_t adts_frames;
+	mutable unsigned int adts_sample_rate;
+	mutable int64_t adts_num_samples;
+	mutable bool adts_index_built;
 };
 
 
@@ -111,6 +156,7 @@ class faad_decoder_creator:
 public:
 	explicit faad_decoder_creator();
 
+	virtual int probe(uint8_t const *header, unsigned long const header_size, uri const &uri_) const;
 	virtual decoder_ptr_t create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback);
 	virtual std::string get_type() const { return "faad"; }
 };
@@ -19,7 +19,11 @@
 **************************************************************************/
 
 
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
 #include "file_source.hpp"
+#include "mmap_source.hpp"
 
 
 namespace ion
@@ -31,17 +35,67 @@ namespace audio_backend
 using namespace audio_common;
 
 
+bool is_on_network_filesystem(std::string const &path)
+{
+#ifdef __linux__
+	struct statfs fs_info;
+	if (statfs(path.c_str(), &fs_info) != 0)
+		return false;
+
+	// filesystem magic numbers, as listed in linux/magic.h
+	switch ((unsigned long)(fs_info.f_type) & 0xFFFFFFFFUL)
+	{
+		case 0x6969UL: // NFS
+		case 0x517BUL: // SMB
+		case 0xFF534D42UL: // CIFS
+		case 0xFE534D42UL: // SMB2
+		case 0x73757245UL: // Coda
+		case 0x5346414FUL: // AFS
+		case 0x01021997UL: // 9P
+		case 0x00C36400UL: // Ceph
+		case 0x65735546UL: // FUSE (sshfs, ...)
+			return true;
+		default:
+			return false;
+	}
+#else
+	return false;
+#endif
+}
+
+
+
+
 file_source::file_source(uri const &uri_):
-	uri_(uri_)
+	uri_(uri_),
+	size(-1),
+	on_network_filesystem(is_on_network_filesystem(uri_.get_path()))
 {
-	file.open(uri_.get_path().c_str(), std::ios::binary);
+	open_file();
 }
 
 
 void file_source::reset()
 {
 	file.close();
+	open_file();
+}
+
+
+void file_source::open_file()
+{
+	file.clear();
 	file.open(uri_.get_path().c_str(), std::ios::binary);
+
+	// the size is determined once here, instead of seeking to the end each time get_size() is called
+	if (file.good())
+	{
+		file.seekg(0, std::ios::end);
+		size = long(file.tellg());
+		file.seekg(0, std::ios::beg);
+	}
+	else
+		size = -1;
 }
 
 
@@ -105,26 +159,91 @@ long file_source::get_position() const
 
 long file_source::get_size() const
 {
-	std::streampos old_pos = file.tellg();
-	file.seekg(0, std::ios::end);
-	std::streampos new_pos = file.tellg();
-	file.seekg(old_pos, std::ios::beg);
-	return long(new_pos);
+	return size;
+}
+
+
+
+
+source_ptr_t file_source_creator::create(ion::uri const &uri_, send_event_callback_t const &)
+{
+	return create_source(uri_, false);
+}
+
+
+source_ptr_t file_source_creator::create_for_playback(ion::uri const &uri_, send_event_callback_t const &)
+{
+	return create_source(uri_, true);
+}
+
+
+bool file_source_creator::get_member_uris(ion::uri const &uri_, std::vector < ion::uri > &member_uris)
+{
+	if (uri_.get_options().find("archive_member") != uri_.get_options().end())
+		return false;
+
+	archive_cache::member_names_t member_names;
+	if (!archive_cache_.get_member_names(uri_.get_path(), member_names) || member_names.empty())
+		return false;
+
+	member_uris.clear();
+	for (archive_cache::member_names_t::const_iterator iter = member_names.begin(); iter != member_names.end(); ++iter)
+	{
+		ion::uri member_uri = uri_;
+		member_uri.get_options()["archive_member"] = *iter;
+		member_uris.push_back(member_uri);
+	}
+
+	return true;
 }
 
 
+Json::Value file_source_creator::get_statistics() const
+{
+	content_cache::stats content_cache_stats = content_cache_.get_stats();
+	archive_cache::stats archive_cache_stats = archive_cache_.get_stats();
+
+	Json::Value content_cache_value(Json::objectValue);
+	content_cache_value["num_hits"] = Json::Value::UInt(content_cache_stats.num_hits);
+	content_cache_value["num_misses"] = Json::Value::UInt(content_cache_stats.num_misses);
+	content_cache_value["num_entries"] = Json::Value::UInt(content_cache_stats.num_entries);
+	content_cache_value["num_cached_bytes"] = Json::Value::UInt(content_cache_stats.num_cached_bytes);
+
+	Json::Value archive_cache_value(Json::objectValue);
+	archive_cache_value["num_archive_opens"] = Json::Value::UInt(archive_cache_stats.num_archive_opens);
+	archive_cache_value["num_member_hits"] = Json::Value::UInt(archive_cache_stats.num_member_hits);
+	archive_cache_value["num_member_misses"] = Json::Value::UInt(archive_cache_stats.num_member_misses);
+	archive_cache_value["num_cached_bytes"] = Json::Value::UInt(archive_cache_stats.num_cached_bytes);
+
+	Json::Value statistics(Json::objectValue);
+	statistics["content_cache"] = content_cache_value;
+	statistics["archive_cache"] = archive_cache_value;
+	return statistics;
+}
 
 
-source_ptr_t file_source_creator::create(ion::uri const &uri_)
+source_ptr_t file_source_creator::create_source(ion::uri const &uri_, bool const fill_cache)
 {
-	std::string filename = uri_.get_path();
+	if (uri_.get_options().find("archive_member") != uri_.get_options().end())
+		return archive_cache_.create_source(uri_);
 
-	std::ifstream f(filename.c_str());
-	bool exists = f.good();
-	f.close();
+	// Prefer cached contents, then memory mapped access; fall back to stream I/O for files that cannot be mapped (empty files, special files etc.)
+	// Files on network filesystems are not read in one go here, since this could block for a long time (see read_ahead_source instead)
+	source_ptr_t new_source;
+	if (!is_on_network_filesystem(uri_.get_path()))
+	{
+		content_cache::content_ptr_t content = fill_cache ? content_cache_.get(uri_.get_path()) : content_cache_.lookup(uri_.get_path());
+		if (content)
+			return source_ptr_t(new memory_source(content, uri_));
+
+		new_source = source_ptr_t(new mmap_source(uri_));
+		if (new_source->is_ok())
+			return new_source;
+	}
 
-	if (exists)
-		return source_ptr_t(new file_source(uri_));
+	new_source = source_ptr_t(new file_source(uri_));
+	if (new_source->is_ok())
+		return new_source;
 	else
 		return source_ptr_t();
 }
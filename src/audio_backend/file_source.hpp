@@ -24,6 +24,8 @@
 
 #include <fstream>
 #include <ion/uri.hpp>
+#include "archive_cache.hpp"
+#include "content_cache.hpp"
 #include "source.hpp"
 #include "source_creator.hpp"
 
@@ -59,20 +61,51 @@ public:
 
 	virtual uri get_uri() const { return uri_; }
 
+	virtual bool may_block() const { return on_network_filesystem; }
+
 protected:
+	void open_file();
+
 	mutable std::ifstream file;
 	uri uri_;
+	long size;
+	bool on_network_filesystem;
 };
 
 
 
 
+// Returns true if the given file resides on a network filesystem (NFS, SMB/CIFS, ...), where I/O may block for long periods of time
+bool is_on_network_filesystem(std::string const &path);
+
+
+// Creates mmap_source instances for files that can be memory mapped, and file_source instances otherwise.
+// Files on network filesystems always get a file_source; a stalled network share would block page faults in an mmap_source,
+// which cannot be moved to an I/O thread like file_source's reads can (see read_ahead_source).
+// Local files that are small enough are served from a content_cache instead. Only create_for_playback() fills the cache,
+// since probing and metadata scans only read a few headers; reading the whole file for them would be wasteful.
+// (Playlist scans run in a separate process, so they never benefit from this cache anyway.)
+// URIs with an archive_member option refer to a member of a zip or gzip archive; these are served by an archive_cache.
 class file_source_creator:
 	public source_creator
 {
 public:
-	virtual source_ptr_t create(ion::uri const &uri_);
+	virtual source_ptr_t create(ion::uri const &uri_, send_event_callback_t const &send_event_callback);
+	virtual source_ptr_t create_for_playback(ion::uri const &uri_, send_event_callback_t const &send_event_callback);
+	// Lists the members of zip and gzip archives; members of archives are not expanded any further
+	virtual bool get_member_uris(ion::uri const &uri_, std::vector < ion::uri > &member_uris);
 	virtual std::string get_type() const { return "file"; }
+	// Reports the archive_cache and content_cache stats
+	virtual Json::Value get_statistics() const;
+
+	archive_cache & get_archive_cache() { return archive_cache_; }
+	content_cache & get_content_cache() { return content_cache_; }
+
+protected:
+	archive_cache archive_cache_;
+	content_cache content_cache_;
+
+	source_ptr_t create_source(ion::uri const &uri_, bool const fill_cache);
 };
 
 
@@ -21,8 +21,12 @@
 
 #include <FLAC++/decoder.h>
 #include "flac_decoder.hpp"
+#include <assert.h>
 #include <stdint.h>
+#include <algorithm>
+#include <cstring>
 #include <vector>
+#include <boost/assign/list_of.hpp>
 
 
 namespace ion
@@ -34,7 +38,272 @@ namespace audio_backend
 using namespace audio_common;
 
 
-// TODO: clean up this code, rewrite it if necessary & extract metadata from flac
+namespace
+{
+
+
+bool is_flac_header(uint8_t const *header, unsigned long const header_size)
+{
+	return (header_size >= 4) && (std::memcmp(header, "fLaC", 4) == 0);
+}
+
+
+
+// samples are output at the stream's native depth: up to 16 bit as s16, anything above as s32
+// sample values are left-aligned, so that for example a 24-bit stream uses the upper 24 bits of the s32 values
+sample_type get_flac_sample_type(unsigned int const bits_per_sample)
+{
+	if ((bits_per_sample == 0) || (bits_per_sample > 32))
+		return sample_unknown;
+	else if (bits_per_sample <= 16)
+		return sample_s16;
+	else
+		return sample_s32;
+}
+
+
+unsigned int get_flac_sample_shift(unsigned int const bits_per_sample)
+{
+	return (bits_per_sample <= 16) ? (16 - bits_per_sample) : (32 - bits_per_sample);
+}
+
+
+
+/*
+Minimal walker for the FLAC metadata blocks that precede the audio frames. Only STREAMINFO and VORBIS_COMMENT are parsed;
+other blocks (pictures, seektables, padding ...) are skipped, using seeking if the source supports it.
+This reads only a few KB even for files with large embedded pictures, and does not need a stream decoder.
+*/
+struct flac_header_info
+{
+	FLAC__uint64 total_samples;
+	unsigned int sample_rate, channels, bps;
+	metadata_t tags;
+
+	flac_header_info():
+		total_samples(0),
+		sample_rate(0),
+		channels(0),
+		bps(0),
+		tags(empty_metadata())
+	{
+	}
+};
+
+
+enum
+{
+	flac_block_type_streaminfo = 0,
+	flac_block_type_vorbis_comment = 4,
+
+	flac_streaminfo_size = 34,
+	max_vorbis_comment_block_size = 1024 * 1024
+};
+
+
+bool read_fully(source &source_, void *dest, unsigned long const num_bytes)
+{
+	uint8_t *dest_bytes = reinterpret_cast < uint8_t* > (dest);
+	unsigned long num_read_bytes = 0;
+
+	while (num_read_bytes < num_bytes)
+	{
+		long l = source_.read(dest_bytes + num_read_bytes, num_bytes - num_read_bytes);
+		if (l <= 0)
+			return false;
+		num_read_bytes += l;
+	}
+
+	return true;
+}
+
+
+bool skip_bytes(source &source_, unsigned long const num_bytes)
+{
+	if (source_.can_seek(source::seek_relative))
+	{
+		source_.seek(num_bytes, source::seek_relative);
+		return source_.is_ok();
+	}
+
+	uint8_t buf[4096];
+	unsigned long num_remaining_bytes = num_bytes;
+	while (num_remaining_bytes > 0)
+	{
+		unsigned long num_bytes_to_read = std::min(num_remaining_bytes, (unsigned long)(sizeof(buf)));
+		if (!read_fully(source_, buf, num_bytes_to_read))
+			return false;
+		num_remaining_bytes -= num_bytes_to_read;
+	}
+
+	return true;
+}
+
+
+inline uint32_t read_le32(uint8_t const *ptr)
+{
+	return uint32_t(ptr[0]) | (uint32_t(ptr[1]) << 8) | (uint32_t(ptr[2]) << 16) | (uint32_t(ptr[3]) << 24);
+}
+
+
+void parse_vorbis_comment_block(uint8_t const *block, unsigned long const block_size, metadata_t &tags)
+{
+	// VORBIS_COMMENT layout (all lengths little endian): vendor length, vendor string, number of comments, then for each comment its length and "NAME=value" string
+
+	uint8_t const *end = block + block_size;
+	uint8_t const *ptr = block;
+
+	if ((end - ptr) < 4)
+		return;
+	uint32_t vendor_length = read_le32(ptr);
+	ptr += 4;
+	if (uint32_t(end - ptr) < vendor_length)
+		return;
+	ptr += vendor_length;
+
+	if ((end - ptr) < 4)
+		return;
+	uint32_t num_comments = read_le32(ptr);
+	ptr += 4;
+
+	for (uint32_t comment_nr = 0; comment_nr < num_comments; ++comment_nr)
+	{
+		if ((end - ptr) < 4)
+			return;
+		uint32_t comment_length = read_le32(ptr);
+		ptr += 4;
+		if (uint32_t(end - ptr) < comment_length)
+			return;
+
+		char const *comment = reinterpret_cast < char const * > (ptr);
+		char const *comment_end = comment + comment_length;
+		ptr += comment_length;
+
+		char const *separator = std::find(comment, comment_end, '=');
+		if (separator == comment_end)
+			continue;
+
+		// field names are case insensitive; the same fields as in the vorbis decoder are used
+		std::string field_name(comment, separator);
+		std::transform(field_name.begin(), field_name.end(), field_name.begin(), ::tolower);
+		if ((field_name != "title") && (field_name != "artist") && (field_name != "album"))
+			continue;
+
+		// the first occurrence of a field wins
+		if (get_metadata_value < std::string > (tags, field_name, "").empty())
+			set_metadata_value(tags, field_name, std::string(separator + 1, comment_end));
+	}
+}
+
+
+bool read_flac_header(source &source_, flac_header_info &info)
+{
+	uint8_t buf[flac_streaminfo_size];
+
+	if (!read_fully(source_, buf, 4) || (std::memcmp(buf, "fLaC", 4) != 0))
+		return false;
+
+	bool streaminfo_found = false, vorbis_comment_found = false;
+
+	while (true)
+	{
+		if (!read_fully(source_, buf, 4))
+			return streaminfo_found;
+
+		bool is_last_block = (buf[0] & 0x80) != 0;
+		unsigned int block_type = buf[0] & 0x7f;
+		unsigned long block_size = (unsigned long)(buf[1]) << 16 | (unsigned long)(buf[2]) << 8 | (unsigned long)(buf[3]);
+
+		if ((block_type == flac_block_type_streaminfo) && (block_size == flac_streaminfo_size))
+		{
+			if (!read_fully(source_, buf, flac_streaminfo_size))
+				return false;
+
+			// STREAMINFO layout (big endian bit fields): 16 bit min blocksize, 16 bit max blocksize, 24 bit min framesize, 24 bit max framesize,
+			// 20 bit sample rate, 3 bit (channels - 1), 5 bit (bits per sample - 1), 36 bit total samples, 128 bit MD5 signature
+			info.sample_rate = (unsigned int)(buf[10]) << 12 | (unsigned int)(buf[11]) << 4 | (unsigned int)(buf[12] >> 4);
+			info.channels = ((buf[12] >> 1) & 0x07) + 1;
+			info.bps = (((buf[12] & 0x01) << 4) | (buf[13] >> 4)) + 1;
+			info.total_samples =
+				(FLAC__uint64(buf[13] & 0x0f) << 32) |
+				(FLAC__uint64(buf[14]) << 24) |
+				(FLAC__uint64(buf[15]) << 16) |
+				(FLAC__uint64(buf[16]) << 8) |
+				FLAC__uint64(buf[17]);
+
+			streaminfo_found = true;
+		}
+		else if ((block_type == flac_block_type_vorbis_comment) && (block_size <= max_vorbis_comment_block_size))
+		{
+			std::vector < uint8_t > block(block_size);
+			if ((block_size > 0) && !read_fully(source_, &block[0], block_size))
+				return false;
+			if (block_size > 0)
+				parse_vorbis_comment_block(&block[0], block_size, info.tags);
+
+			vorbis_comment_found = true;
+		}
+		else if (!skip_bytes(source_, block_size))
+			return false;
+
+		// both blocks of interest found - no need to walk the rest of the metadata
+		if (is_last_block || (streaminfo_found && vorbis_comment_found))
+			return streaminfo_found;
+	}
+}
+
+
+
+/*
+Interleaves num_samples samples from the planar FLAC channel buffers (starting at sample first_sample) into dest.
+Each sample value is multiplied by 2^shift to scale it from the stream's bit depth to the width of SampleType. This is a multiplication
+and not a left shift, since shifting negative values left is undefined behavior; compilers turn it into a shift anyway.
+Mono and stereo - by far the most common cases - get dedicated loops without any per-sample channel indexing,
+which allows the compiler to vectorize them; other channel counts are written one channel at a time with a fixed stride.
+*/
+template < typename SampleType >
+void interleave_flac_channels(FLAC__int32 const * const channels[], unsigned int const num_channels, unsigned int const shift, unsigned long const first_sample, unsigned long const num_samples, SampleType *dest)
+{
+	FLAC__int32 const factor = FLAC__int32(1) << shift;
+
+	switch (num_channels)
+	{
+		case 1:
+		{
+			FLAC__int32 const *src = channels[0] + first_sample;
+			for (unsigned long i = 0; i < num_samples; ++i)
+				dest[i] = SampleType(src[i] * factor);
+			break;
+		}
+
+		case 2:
+		{
+			FLAC__int32 const *src_left = channels[0] + first_sample;
+			FLAC__int32 const *src_right = channels[1] + first_sample;
+			for (unsigned long i = 0; i < num_samples; ++i)
+			{
+				dest[i * 2 + 0] = SampleType(src_left[i] * factor);
+				dest[i * 2 + 1] = SampleType(src_right[i] * factor);
+			}
+			break;
+		}
+
+		default:
+		{
+			for (unsigned int channel_nr = 0; channel_nr < num_channels; ++channel_nr)
+			{
+				FLAC__int32 const *src = channels[channel_nr] + first_sample;
+				SampleType *channel_dest = dest + channel_nr;
+				for (unsigned long i = 0; i < num_samples; ++i)
+					channel_dest[i * num_channels] = SampleType(src[i] * factor);
+			}
+			break;
+		}
+	}
+}
+
+
+}
 
 
 class flac_decoder::custom_flac_decoder:
@@ -47,24 +316,125 @@ public:
 		unsigned int sample_rate;
 		unsigned int channels;
 		unsigned int bps;
+		unsigned int max_blocksize;
 
 
 		flac_metadata():
 			total_samples(0),
 			sample_rate(0),
 			channels(0),
-			bps(0)
+			bps(0),
+			max_blocksize(0)
 		{
 		}
 	};
 
-	typedef std::vector < int16_t > sample_buffer_t;
+	/*
+	Ring buffer for decoded, interleaved samples. One entry ("frame") contains one sample value for each channel.
+	The buffer is allocated once the stream's properties are known, and is only ever enlarged if a caller requests
+	more samples at once than it can hold; in steady-state playback, no allocations and no memmoves occur.
+	*/
+	class sample_ring
+	{
+	public:
+		sample_ring():
+			frame_size(0),
+			capacity(0),
+			read_pos(0),
+			num_frames(0)
+		{
+		}
+
+
+		void setup(unsigned int const new_frame_size, unsigned long const new_capacity)
+		{
+			frame_size = new_frame_size;
+			capacity = new_capacity;
+			read_pos = 0;
+			num_frames = 0;
+			buffer.resize(frame_size * capacity);
+		}
+
+
+		void clear()
+		{
+			read_pos = 0;
+			num_frames = 0;
+		}
+
+
+		// Ensures the ring can hold at least min_capacity frames; existing frames are retained
+		void reserve(unsigned long const min_capacity)
+		{
+			if (min_capacity <= capacity)
+				return;
+
+			unsigned long new_capacity = std::max(min_capacity, capacity * 2);
+			buffer_t new_buffer(frame_size * new_capacity);
+			unsigned long num_stored_frames = num_frames;
+			read(num_stored_frames, &new_buffer[0]);
+
+			buffer.swap(new_buffer);
+			capacity = new_capacity;
+			read_pos = 0;
+			num_frames = num_stored_frames;
+		}
+
+
+		unsigned long get_num_frames() const { return num_frames; }
+		unsigned long get_num_free_frames() const { return capacity - num_frames; }
+
+
+		// Copies up to max_num_frames frames to dest, and removes them from the ring; returns the number of copied frames
+		unsigned long read(unsigned long const max_num_frames, void *dest)
+		{
+			unsigned long num_frames_to_read = std::min(max_num_frames, num_frames);
+			unsigned long first_part = std::min(num_frames_to_read, capacity - read_pos);
+
+			uint8_t *dest_bytes = reinterpret_cast < uint8_t* > (dest);
+			std::memcpy(dest_bytes, &buffer[read_pos * frame_size], first_part * frame_size);
+			if (first_part < num_frames_to_read)
+				std::memcpy(dest_bytes + first_part * frame_size, &buffer[0], (num_frames_to_read - first_part) * frame_size);
+
+			read_pos = (read_pos + num_frames_to_read) % capacity;
+			num_frames -= num_frames_to_read;
+
+			return num_frames_to_read;
+		}
+
+
+		// Interleaves num_samples samples from the planar channel buffers into the ring's free space
+		// The caller must make sure enough free space is available (see reserve())
+		template < typename SampleType >
+		void write(FLAC__int32 const * const channels[], unsigned int const num_channels, unsigned int const shift, unsigned long const num_samples)
+		{
+			assert(num_samples <= get_num_free_frames());
+
+			unsigned long write_pos = (read_pos + num_frames) % capacity;
+			unsigned long first_part = std::min(num_samples, capacity - write_pos);
+
+			interleave_flac_channels < SampleType > (channels, num_channels, shift, 0, first_part, reinterpret_cast < SampleType* > (&buffer[write_pos * frame_size]));
+			if (first_part < num_samples)
+				interleave_flac_channels < SampleType > (channels, num_channels, shift, first_part, num_samples - first_part, reinterpret_cast < SampleType* > (&buffer[0]));
+
+			num_frames += num_samples;
+		}
+
+
+	protected:
+		typedef std::vector < uint8_t > buffer_t;
+		buffer_t buffer;
+		unsigned int frame_size;
+		unsigned long capacity, read_pos, num_frames;
+	};
 
 
 
 	explicit custom_flac_decoder(source& source_):
 		source_(source_),
-		ok(true)
+		ok(true),
+		sample_type_(sample_unknown),
+		sample_shift(0)
 	{
 		FLAC__StreamDecoderInitStatus init_status = init();
 		switch (init_status)
@@ -91,7 +461,8 @@ public:
 
 	flac_metadata const & get_flac_metadata() const { return flac_metadata_; }
 	bool is_ok() const { return ok; }
-	sample_buffer_t & get_sample_buffer() { return sample_buffer; }
+	sample_ring & get_sample_ring() { return sample_ring_; }
+	sample_type get_sample_type() const { return sample_type_; }
 
 
 	bool end_of_stream() const
@@ -171,23 +542,20 @@ protected:
 
 	virtual ::FLAC__StreamDecoderWriteStatus write_callback(::FLAC__Frame const *frame, const FLAC__int32 * const buffer[])
 	{
-		if (end_of_stream())
-		{
-			std::cerr << sample_buffer.size() << ' ' << frame->header.blocksize << ' ' << frame->header.channels << std::endl;
+		if (end_of_stream() || (sample_type_ == sample_unknown))
 			return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
-		}
 
-		unsigned long sample_offset = sample_buffer.size();
-		sample_buffer.resize(sample_offset + frame->header.blocksize * frame->header.channels);
+		// the frame's channel count must match the one from the STREAMINFO block, since the ring's frame size depends on it
+		if (frame->header.channels != flac_metadata_.channels)
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 
-		int16_t *buf_pos = &sample_buffer[sample_offset];
-		for (unsigned long sample_nr = 0; sample_nr < frame->header.blocksize; ++sample_nr)
-		{
-			for (unsigned long channel_nr = 0; channel_nr < frame->header.channels; ++channel_nr)
-			{
-				*buf_pos++ = buffer[channel_nr][sample_nr];
-			}
-		}
+		// usually a no-op, since the ring is preallocated; only frames larger than the STREAMINFO maximum blocksize (= broken streams) cause an enlargement
+		sample_ring_.reserve(sample_ring_.get_num_frames() + frame->header.blocksize);
+
+		if (sample_type_ == sample_s16)
+			sample_ring_.write < int16_t > (buffer, frame->header.channels, sample_shift, frame->header.blocksize);
+		else
+			sample_ring_.write < int32_t > (buffer, frame->header.channels, sample_shift, frame->header.blocksize);
 
 		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 	}
@@ -201,6 +569,20 @@ protected:
 			flac_metadata_.sample_rate = metadata->data.stream_info.sample_rate;
 			flac_metadata_.channels = metadata->data.stream_info.channels;
 			flac_metadata_.bps = metadata->data.stream_info.bits_per_sample;
+			flac_metadata_.max_blocksize = metadata->data.stream_info.max_blocksize;
+
+			sample_type_ = get_flac_sample_type(flac_metadata_.bps);
+			if ((sample_type_ == sample_unknown) || (flac_metadata_.channels == 0))
+			{
+				sample_type_ = sample_unknown;
+				return;
+			}
+			sample_shift = get_flac_sample_shift(flac_metadata_.bps);
+
+			// preallocate room for two maximum-sized blocks; update() reserves additional room for the requested samples
+			if (flac_metadata_.max_blocksize == 0)
+				flac_metadata_.max_blocksize = 65535; // the largest blocksize the FLAC format allows
+			sample_ring_.setup(flac_metadata_.channels * get_sample_size(sample_type_), flac_metadata_.max_blocksize * 2);
 		}
 	}
 
@@ -215,7 +597,9 @@ protected:
 	source& source_;
 	flac_metadata flac_metadata_;
 	bool ok;
-	sample_buffer_t sample_buffer;
+	sample_ring sample_ring_;
+	sample_type sample_type_;
+	unsigned int sample_shift;
 };
 
 
@@ -225,8 +609,14 @@ flac_decoder::flac_decoder(send_event_callback_t const send_event_callback, sour
 	decoder(send_event_callback),
 	source_(source_),
 	custom_flac_decoder_(0),
+	stream_decoder_failed(false),
 	current_position(0),
-	initialized(false)
+	initialized(false),
+	num_total_samples(0),
+	sample_rate(0),
+	num_channels(0),
+	sample_type_(sample_unknown),
+	metadata(empty_metadata())
 {
 	// Misc checks & initializations
 
@@ -237,10 +627,22 @@ flac_decoder::flac_decoder(send_event_callback_t const send_event_callback, sour
 	if (source_size == 0)
 		return; // 0 bytes? we cannot use this.
 
-	custom_flac_decoder_ = new custom_flac_decoder(*source_);
-	if (!custom_flac_decoder_->is_ok())
+	// Parse the metadata blocks directly; the stream decoder is created on demand (see create_stream_decoder())
+	flac_header_info header_info;
+	bool header_ok = read_flac_header(*source_, header_info);
+	source_->reset();
+	if (!header_ok)
+		return;
+
+	sample_type_ = get_flac_sample_type(header_info.bps);
+	if ((sample_type_ == sample_unknown) || (header_info.sample_rate == 0))
 		return;
 
+	num_total_samples = long(header_info.total_samples);
+	sample_rate = header_info.sample_rate;
+	num_channels = header_info.channels;
+	metadata = header_info.tags;
+
 	initialized = true;
 }
 
@@ -273,6 +675,11 @@ long flac_decoder::set_current_position(long const new_position)
 
 	boost::lock_guard < boost::mutex > lock(mutex_);
 
+	if (!create_stream_decoder())
+		return -1;
+
+	// discard any samples decoded before the seek; the decoder writes the frame at the new position into the ring
+	custom_flac_decoder_->get_sample_ring().clear();
 	custom_flac_decoder_->seek_absolute(new_position);
 	current_position = new_position;
 
@@ -289,7 +696,7 @@ long flac_decoder::get_current_position() const
 
 metadata_t flac_decoder::get_metadata() const
 {
-	return empty_metadata();
+	return metadata;
 }
 
 
@@ -307,13 +714,13 @@ uri flac_decoder::get_uri() const
 
 long flac_decoder::get_num_ticks() const
 {
-	return custom_flac_decoder_->get_flac_metadata().total_samples;
+	return num_total_samples;
 }
 
 
 long flac_decoder::get_num_ticks_per_second() const
 {
-	return custom_flac_decoder_->get_flac_metadata().sample_rate;
+	return sample_rate;
 }
 
 
@@ -330,7 +737,7 @@ void flac_decoder::set_playback_properties(playback_properties const &new_playba
 
 decoder_properties flac_decoder::get_decoder_properties() const
 {
-	return decoder_properties(custom_flac_decoder_->get_flac_metadata().sample_rate, playback_properties_.num_channels, playback_properties_.sample_type_);
+	return decoder_properties(sample_rate, num_channels, sample_type_);
 }
 
 
@@ -339,49 +746,65 @@ unsigned int flac_decoder::update(void *dest, unsigned int const num_samples_to_
 	if (!is_initialized())
 		return 0;
 
-	while (custom_flac_decoder_->is_ok() && !custom_flac_decoder_->end_of_stream() && (custom_flac_decoder_->get_sample_buffer().size() < (num_samples_to_write * playback_properties_.num_channels)))
+	boost::lock_guard < boost::mutex > lock(mutex_);
+
+	if (!create_stream_decoder())
+		return 0;
+
+	custom_flac_decoder::sample_ring &sample_ring_ = custom_flac_decoder_->get_sample_ring();
+
+	// make sure the ring can hold the requested samples plus one additional block without reallocating inside the write callback
+	// after the first update() call, this does not allocate anymore, since the sink always requests the same amount of samples
+	sample_ring_.reserve(num_samples_to_write + custom_flac_decoder_->get_flac_metadata().max_blocksize);
+
+	while (custom_flac_decoder_->is_ok() && !custom_flac_decoder_->end_of_stream() && (sample_ring_.get_num_frames() < num_samples_to_write))
 	{
 		if (!custom_flac_decoder_->process_single())
 			break;
 	}
 
-	long num_samples_to_return = std::min(
-		long(custom_flac_decoder_->get_sample_buffer().size() / playback_properties_.num_channels),
-		long(num_samples_to_write)
-	);
+	if (!custom_flac_decoder_->is_ok())
+		return 0;
+
+	unsigned long num_samples_returned = sample_ring_.read(num_samples_to_write, dest);
+	current_position += num_samples_returned;
 
-/*	std::cerr
-		<< (custom_flac_decoder_->end_of_stream() ? 'Y' : 'N') << ' '
-		<< custom_flac_decoder_->get_sample_buffer().size() << ' '
-		<< num_samples_to_write << ' '
-		<< playback_properties_.num_channels << ' '
-		<< (num_samples_to_write * playback_properties_.num_channels) << ' '
-		<< num_samples_to_return << ' '
-		<< (long(custom_flac_decoder_->get_sample_buffer().size()) - long(num_samples_to_write * playback_properties_.num_channels)) << std::endl;*/
+	return num_samples_returned;
+}
 
-	current_position += num_samples_to_return;
 
-	if (custom_flac_decoder_->is_ok())
+bool flac_decoder::create_stream_decoder()
+{
+	if (stream_decoder_failed)
+		return false;
+
+	// the stream decoder parses STREAMINFO again; if its values differ from the ones in the header walker, it is recreated once
+	// from the beginning of the source, in case the source was not positioned at the beginning; if they still differ, the stream
+	// is considered broken, and no further attempts are made
+	for (int attempt = 0; (custom_flac_decoder_ == 0) && (attempt < 2); ++attempt)
 	{
-		long remaining_size = long(custom_flac_decoder_->get_sample_buffer().size()) - long(num_samples_to_return * playback_properties_.num_channels);
-		std::memcpy(dest, &custom_flac_decoder_->get_sample_buffer()[0], num_samples_to_return * playback_properties_.num_channels * get_sample_size(playback_properties_.sample_type_));
-		if (remaining_size > 0)
-		{
-			std::memmove(
-				&custom_flac_decoder_->get_sample_buffer()[0],
-				&custom_flac_decoder_->get_sample_buffer()[num_samples_to_write * playback_properties_.num_channels],
-				remaining_size * get_sample_size(playback_properties_.sample_type_)
-			);
+		if (attempt > 0)
+			source_->reset();
+
+		custom_flac_decoder_ = new custom_flac_decoder(*source_);
 
-			custom_flac_decoder_->get_sample_buffer().resize(remaining_size);
+		custom_flac_decoder::flac_metadata const &flac_metadata_ = custom_flac_decoder_->get_flac_metadata();
+		if ((flac_metadata_.sample_rate != sample_rate) || (flac_metadata_.channels != num_channels) || (custom_flac_decoder_->get_sample_type() != sample_type_))
+		{
+			delete custom_flac_decoder_;
+			custom_flac_decoder_ = 0;
 		}
-		else
-			custom_flac_decoder_->get_sample_buffer().resize(0);
+	}
 
-		return num_samples_to_return;
+	if (custom_flac_decoder_ == 0)
+	{
+		stream_decoder_failed = true;
+		if (send_event_callback)
+			send_event_callback("error", boost::assign::list_of(std::string("FLAC stream parameters do not match the STREAMINFO block -> not playing ") + get_uri().get_full()));
+		return false;
 	}
-	else
-		return 0;
+
+	return custom_flac_decoder_->is_ok();
 }
 
 
@@ -392,12 +815,18 @@ flac_decoder_creator::flac_decoder_creator()
 }
 
 
+int flac_decoder_creator::probe(uint8_t const *header, unsigned long const header_size, ion::uri const &) const
+{
+	return is_flac_header(header, header_size) ? probe_score_match : probe_score_no_match;
+}
+
+
 decoder_ptr_t flac_decoder_creator::create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback)
 {
 	{
-		char buf[4];
-		source_->read(buf, 4);
-		if ((buf[0] == 'f') && (buf[1] == 'L') && (buf[2] == 'a') && (buf[3] == 'C'))
+		uint8_t buf[4];
+		long num_read_bytes = source_->read(buf, 4);
+		if (is_flac_header(buf, std::max(num_read_bytes, 0L)))
 			source_->reset();
 		else
 			return decoder_ptr_t();
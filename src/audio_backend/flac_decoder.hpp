@@ -68,13 +68,33 @@ public:
 
 
 protected:
+	/*
+	Creates the FLAC++ stream decoder if it has not been created yet. The stream decoder is only needed for actual decoding; metadata,
+	length and decoder properties are taken from the STREAMINFO and VORBIS_COMMENT blocks, which are parsed directly in the constructor.
+	This way, scanning a FLAC file does not require setting up a full stream decoder.
+	If the stream decoder's stream parameters do not match the ones from the constructor even after recreating it once, an error
+	event is sent, and the stream decoder is not created again.
+	Must be called with the mutex locked. Returns true if the stream decoder is available and operational.
+	*/
+	bool create_stream_decoder();
+
+
 	mutable boost::mutex mutex_;
 	source_ptr_t source_;
 	class custom_flac_decoder;
 	custom_flac_decoder *custom_flac_decoder_;
+	bool stream_decoder_failed;
 	long current_position;
 	bool initialized;
 	playback_properties playback_properties_;
+
+	// values from the STREAMINFO block
+	long num_total_samples;
+	unsigned int sample_rate, num_channels;
+	sample_type sample_type_;
+
+	// values from the VORBIS_COMMENT block
+	metadata_t metadata;
 };
 
 
@@ -86,6 +106,7 @@ class flac_decoder_creator:
 public:
 	explicit flac_decoder_creator();
 
+	virtual int probe(uint8_t const *header, unsigned long const header_size, uri const &uri_) const;
 	virtual decoder_ptr_t create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback);
 	virtual std::string get_type() const { return "flac"; }
 };
@@ -21,13 +21,19 @@
 
 #include <assert.h>
 #include <iostream>
+#include <map>
 #include <stdint.h>
+#include <sys/stat.h>
+#include <vector>
 
 #include "gme_decoder.hpp"
 #include <gme/gme.h>
-#include <gme/Data_Reader.h>
 #include <gme/Music_Emu.h>
 
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 
 
@@ -45,50 +51,162 @@ namespace
 {
 
 
-class source_reader:
-	public Data_Reader
+// In-memory image of a file. The data is either a view of the source's data (if the source provides one, see source::get_contiguous_view();
+// the source is then kept alive by the image), or a copy of it.
+struct file_image_t
+{
+	std::vector < uint8_t > copy;
+	source_ptr_t viewed_source;
+	uint8_t const *data;
+	long size;
+};
+
+typedef boost::shared_ptr < file_image_t const > file_image_ptr_t;
+
+
+/*
+Registry for in-memory images of the files that are currently being used by gme decoders.
+Game music files typically contain many sub-tracks, and each sub-track is a separate resource with its own decoder
+(for example, the current and the next decoder during playback, or the temporary decoders used for scanning). With this registry,
+such decoders share one image of the file, which is read from the source only once. Emulators are then created by loading from
+this image, so sub-track and playback property changes do not touch the source at all.
+The registry only holds weak references; an image is freed as soon as the last decoder using it is destroyed.
+Images are read without holding the registry's lock, so reading a large file does not block decoders for other files. While an image
+is being read, a placeholder is registered for it; other decoders for the same file wait for the read to finish instead of reading it too.
+*/
+class file_image_registry
 {
 public:
-	explicit source_reader(source &source_):
-		source_(source_)
+	file_image_ptr_t get_image(source_ptr_t const &source_)
 	{
-	}
+		long source_size = source_->get_size();
+		if (source_size <= 0)
+			return file_image_ptr_t();
 
+		std::string key = get_key(source_->get_uri(), source_size);
 
-	virtual long read_avail(void *dest, long n)
-	{
-		if (source_.can_read())
-			return source_.read(dest, n);
-		else
-			return -1;
+		boost::unique_lock < boost::mutex > lock(mutex_);
+
+		images_t::iterator iter = images.find(key);
+		if (iter != images.end())
+		{
+			file_image_ptr_t image = iter->second.lock();
+			if (image)
+				return image;
+		}
+
+		pending_images_t::iterator pending_iter = pending_images.find(key);
+		if (pending_iter != pending_images.end())
+		{
+			pending_image_ptr_t pending = pending_iter->second;
+			while (!pending->done)
+				image_read.wait(lock);
+			return pending->image;
+		}
+
+		pending_image_ptr_t pending(new pending_image);
+		pending_images[key] = pending;
+
+		lock.unlock();
+		file_image_ptr_t image = read_image(source_, source_size);
+		lock.lock();
+
+		pending_images.erase(key);
+		pending->image = image;
+		pending->done = true;
+		image_read.notify_all();
+
+		if (!image)
+			return image;
+
+		// drop entries whose images are not used anymore
+		for (images_t::iterator cleanup_iter = images.begin(); cleanup_iter != images.end();)
+		{
+			if (cleanup_iter->second.expired())
+				images.erase(cleanup_iter++);
+			else
+				++cleanup_iter;
+		}
+
+		images[key] = image;
+		return image;
 	}
 
-	
-	virtual long remain() const
+
+protected:
+	/*
+	The key is the full URI without the sub_resource_index option, so all sub-tracks of a file share one image, while resources that only
+	differ in other options (for example, different members of the same archive, see archive_cache) do not.
+	The size and the modification time are part of the key, to catch files that were replaced while an image of their previous version
+	is still in use. (For archive members, the modification time is the archive's.)
+	*/
+	static std::string get_key(uri const &uri_, long const source_size)
 	{
-		long ret = long(source_.get_size()) - long(source_.get_position());
-		assert(ret >= 0);
-		return ret;
+		uri image_uri(uri_);
+		image_uri.get_options().erase("sub_resource_index");
+
+		long modification_time = 0;
+		struct stat stat_;
+		if ((image_uri.get_type() == "file") && (stat(image_uri.get_path().c_str(), &stat_) == 0))
+			modification_time = stat_.st_mtime;
+
+		return image_uri.get_full() + "#" + boost::lexical_cast < std::string > (source_size) + "#" + boost::lexical_cast < std::string > (modification_time);
 	}
 
 
-	virtual blargg_err_t skip(long count)
+	static file_image_ptr_t read_image(source_ptr_t const &source_, long const source_size)
 	{
-		if (source_.can_seek(source::seek_relative))
+		boost::shared_ptr < file_image_t > image(new file_image_t);
+		image->size = source_size;
+
+		// no need to copy anything if the source can provide its data directly
+		image->data = reinterpret_cast < uint8_t const * > (source_->get_contiguous_view(0, source_size));
+		if (image->data != 0)
 		{
-			source_.seek(count, source::seek_relative);
-			return 0;
+			image->viewed_source = source_;
+			return image;
 		}
-		else
-			return Data_Reader::skip(count);
+
+		image->copy.resize(source_size);
+		image->data = &(image->copy[0]);
+
+		source_->reset();
+		long num_read_bytes = 0;
+		while (num_read_bytes < source_size)
+		{
+			long l = source_->read(&(image->copy[num_read_bytes]), source_size - num_read_bytes);
+			if (l <= 0)
+				return file_image_ptr_t();
+			num_read_bytes += l;
+		}
+
+		return image;
 	}
 
 
-protected:
-	source &source_;
+	// Placeholder for an image that is currently being read by some decoder
+	struct pending_image
+	{
+		bool done;
+		file_image_ptr_t image;
+
+		pending_image(): done(false) {}
+	};
+	typedef boost::shared_ptr < pending_image > pending_image_ptr_t;
+
+
+	typedef std::map < std::string, boost::weak_ptr < file_image_t const > > images_t;
+	typedef std::map < std::string, pending_image_ptr_t > pending_images_t;
+	images_t images;
+	pending_images_t pending_images;
+	boost::mutex mutex_;
+	boost::condition_variable image_read;
 };
 
 
+file_image_registry file_image_registry_;
+
+
 }
 
 
@@ -96,10 +214,13 @@ struct gme_decoder::internal_data
 {
 	Music_Emu *emu;
 	track_info_t track_info_;
+	file_image_ptr_t file_image;
+	unsigned int sample_rate;
 
 
 	explicit internal_data():
-		emu(0)
+		emu(0),
+		sample_rate(0)
 	{
 	}
 
@@ -188,37 +309,88 @@ long gme_decoder::get_current_position() const
 }
 
 
-metadata_t gme_decoder::get_metadata() const
+namespace
 {
-	metadata_t metadata_ = empty_metadata();
-	if (!is_initialized())
-		return metadata_;
 
+
+// GME does not always know the length of a track; in that case, it is estimated from the intro and loop lengths
+long get_track_length(track_info_t const &track_info_)
+{
+	long length = track_info_.length;
+	if (length <= 0)
+		length = track_info_.intro_length + track_info_.loop_length * 2;
+	return std::max(length, long(0));
+}
+
+
+void set_metadata_from_track_info(metadata_t &metadata_, track_info_t const &track_info_)
+{
 	{
-		std::string str(internal_data_->track_info_.song);
+		std::string str(track_info_.song);
 		if (!str.empty())
 		set_metadata_value(metadata_, "title", str);
 	}
 
 	{
-		std::string str(internal_data_->track_info_.author);
+		std::string str(track_info_.author);
 		if (!str.empty())
 		set_metadata_value(metadata_, "artist", str);
 	}
 
 	{
-		std::string str(internal_data_->track_info_.game);
+		std::string str(track_info_.game);
 		if (!str.empty())
 		set_metadata_value(metadata_, "album", str);
 	}
 
-	if (internal_data_->track_info_.track_count > 1)
-		set_metadata_value(metadata_, "num_sub_resources", int(internal_data_->track_info_.track_count));
+	if (track_info_.track_count > 1)
+		set_metadata_value(metadata_, "num_sub_resources", int(track_info_.track_count));
+}
+
+
+}
+
+
+metadata_t gme_decoder::get_metadata() const
+{
+	metadata_t metadata_ = empty_metadata();
+	if (!is_initialized())
+		return metadata_;
+
+	set_metadata_from_track_info(metadata_, internal_data_->track_info_);
 
 	return metadata_;
 }
 
 
+metadata_t gme_decoder::get_sub_resources_metadata() const
+{
+	metadata_t sub_resources(Json::arrayValue);
+	if (!is_initialized())
+		return sub_resources;
+
+	boost::lock_guard < boost::mutex > lock(mutex_);
+
+	// the track info of all tracks is available from the already loaded emulator; no further loads are necessary
+	int num_tracks = internal_data_->emu->track_count();
+	for (int i = 0; i < num_tracks; ++i)
+	{
+		track_info_t track_info_;
+		if (internal_data_->emu->track_info(&track_info_, i))
+			return metadata_t(Json::arrayValue); // an error occurred; let the tracks be scanned individually
+
+		metadata_t metadata_ = empty_metadata();
+		set_metadata_from_track_info(metadata_, track_info_);
+		set_metadata_value(metadata_, "sub_resource_index", i);
+		set_metadata_value(metadata_, "num_ticks", int(get_track_length(track_info_)));
+		set_metadata_value(metadata_, "num_ticks_per_second", int(get_num_ticks_per_second()));
+		sub_resources.append(metadata_);
+	}
+
+	return sub_resources;
+}
+
+
 std::string gme_decoder::get_type() const
 {
 	return "gme";
@@ -254,7 +426,11 @@ void gme_decoder::set_playback_properties(playback_properties const &new_playbac
 	boost::lock_guard < boost::mutex > lock(mutex_);
 
 	playback_properties_ = new_playback_properties;
-	reset_emu(playback_properties_.frequency);
+
+	// the emulator's sample rate can only be set before loading, so a new one is needed if the frequency changed
+	// (this does not touch the source - the emulator is loaded from the in-memory file image)
+	if (internal_data_->sample_rate != playback_properties_.frequency)
+		reset_emu(playback_properties_.frequency);
 }
 
 
@@ -262,21 +438,32 @@ bool gme_decoder::reset_emu(unsigned int const sample_rate)
 {
 	blargg_err_t error;
 
-	source_->reset();
-	source_reader reader(*source_);
-
 	if (internal_data_->emu != 0)
 	{
 		delete internal_data_->emu;
 		internal_data_->emu = 0;
 	}
 
-	uint8_t header[4];
+	if (!internal_data_->file_image)
+	{
+		// check the header before reading the whole file into memory, since this decoder gets tried for many files which are not game music
+		uint8_t header[4];
+		source_->reset();
+		if (source_->read(header, sizeof(header)) != long(sizeof(header)))
+			return false;
+		if (!gme_identify_extension(gme_identify_header(header)))
+			return false;
+
+		internal_data_->file_image = file_image_registry_.get_image(source_);
+		if (!internal_data_->file_image)
+			return false;
+	}
 
-	if (reader.read(header, sizeof(header)) != 0)
+	file_image_t const &file_image = *(internal_data_->file_image);
+	if (file_image.size < 4)
 		return false;
 
-	gme_type_t file_type = gme_identify_extension(gme_identify_header(header));
+	gme_type_t file_type = gme_identify_extension(gme_identify_header(file_image.data));
 	if (!file_type)
 		return false;
 
@@ -287,8 +474,8 @@ bool gme_decoder::reset_emu(unsigned int const sample_rate)
 	error = new_emu->set_sample_rate(sample_rate);
 	if (error) { delete new_emu; return false; }
 
-	Remaining_Reader remaining_reader(header, sizeof(header), &reader);
-	error = new_emu->load(remaining_reader);
+	// the file image outlives the emulator, since internal_data holds a reference to it
+	error = new_emu->load_mem(file_image.data, file_image.size);
 	if (error) { delete new_emu; return false; }
 
 	error = new_emu->start_track(track_nr);
@@ -302,12 +489,10 @@ bool gme_decoder::reset_emu(unsigned int const sample_rate)
 		<< internal_data_->track_info_.intro_length << " "
 		<< internal_data_->track_info_.loop_length << std::endl;*/
 
-	if (internal_data_->track_info_.length <= 0)
-		internal_data_->track_info_.length = internal_data_->track_info_.intro_length + internal_data_->track_info_.loop_length * 2;
-	if (internal_data_->track_info_.length <= 0)
-		internal_data_->track_info_.length = 0;
+	internal_data_->track_info_.length = get_track_length(internal_data_->track_info_);
 
 	internal_data_->emu = new_emu;
+	internal_data_->sample_rate = sample_rate;
 	set_fade();
 
 	return true;
@@ -358,6 +543,15 @@ gme_decoder_creator::gme_decoder_creator()
 }
 
 
+int gme_decoder_creator::probe(uint8_t const *header, unsigned long const header_size, ion::uri const &) const
+{
+	if (header_size < 4)
+		return probe_score_no_match;
+
+	return gme_identify_extension(gme_identify_header(header)) ? probe_score_match : probe_score_no_match;
+}
+
+
 decoder_ptr_t gme_decoder_creator::create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback)
 {
 	gme_decoder *gme_decoder_ = new gme_decoder(send_event_callback, source_);
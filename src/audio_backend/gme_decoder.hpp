@@ -51,6 +51,7 @@ public:
 	virtual long get_current_position() const;
 
 	virtual metadata_t get_metadata() const;
+	virtual metadata_t get_sub_resources_metadata() const;
 
 	virtual std::string get_type() const;
 
@@ -89,6 +90,7 @@ class gme_decoder_creator:
 public:
 	explicit gme_decoder_creator();
 
+	virtual int probe(uint8_t const *header, unsigned long const header_size, uri const &uri_) const;
 	virtual decoder_ptr_t create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback);
 	virtual std::string get_type() const { return "gme"; }
 };
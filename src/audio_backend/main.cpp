@@ -23,9 +23,9 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <ion/backend_main_loop.hpp>
-#include <ion/resource_exceptions.hpp>
 #include "backend.hpp"
 #include "file_source.hpp"
+#include "http_source.hpp"
 #ifdef WITH_DUMB_DECODER
 #include "dumb_decoder.hpp"
 #endif
@@ -59,7 +59,8 @@
 The backend can be called in these ways:
 1. Without arguments: the backend starts normally, listens to stdin for command lines, and outputs events to stdout
 2. With the -id argument: the backend outputs its type ID to stdout (this is *not* the C++ typeid, but the get_backend_type() result!)
-3. With the -info argument and one or more URIs: the backend then scans each URI for metadata, and outputs said metadata to stdout, formatted like a metadata event
+3. With the -info argument and one or more URIs: the backend then scans each URI for metadata, and outputs one metadata_result event per URI to stdout,
+   just like it does for a get_metadata_batch command
 3. With the -scan argument: similar to (1), the backend listens to stdin, but only for get_metadata command lines - no sink is initialized, no playback is possible
 */
 
@@ -76,10 +77,12 @@ struct creators
 	ion::audio_backend::alsa_sink_creator alsa_sink_creator_;
 #endif
 	ion::audio_backend::file_source_creator file_source_creator_;
+	ion::audio_common::http_source_creator http_source_creator_;
 
 	explicit creators(ion::audio_backend::backend &backend_, bool const with_sinks)
 	{
 		backend_.get_source_creators().push_back(&file_source_creator_);
+		backend_.get_source_creators().push_back(&http_source_creator_);
 
 		if (with_sinks)
 		{
@@ -123,6 +126,13 @@ struct creators
 typedef boost::shared_ptr < creators > creators_ptr_t;
 
 
+// Used as the send event callback in the -info mode
+void print_event(std::string const &command, ion::params_t const &params)
+{
+	std::cout << ion::recombine_command_line(command, params) << std::endl;
+}
+
+
 
 
 int main(int argc, char **argv)
@@ -158,8 +168,18 @@ int main(int argc, char **argv)
 		return -1;
 
 
-	ion::audio_backend::backend backend_;
+	// The creators are declared before the backend, so they are destroyed after it; the backend's destructor waits for
+	// its decoder construction thread, which may still be using decoder creators at that point
 	creators_ptr_t creators_;
+	ion::audio_backend::backend backend_;
+
+	// The id mode does not create decoders, so it does not need the probe cache
+	if (run_mode != print_id_mode)
+	{
+		std::string probe_cache_filename = ion::audio_common::probe_cache::get_default_filename();
+		if (!probe_cache_filename.empty())
+			backend_.get_probe_cache().open(probe_cache_filename);
+	}
 
 
 	switch (run_mode)
@@ -193,31 +213,10 @@ int main(int argc, char **argv)
 		{
 			creators_ = creators_ptr_t(new creators(backend_, false));
 
-			for (unsigned int i = 1; i < params.size(); ++i)
-			{
-				try
-				{
-					std::string const &url = params[i];
-					std::string metadata_str = backend_.get_metadata_as_string(url);
-					std::cout << ion::recombine_command_line("metadata", boost::assign::list_of(url)(metadata_str)) << std::endl;
-				}
-				catch (ion::unrecognized_resource const &exc)
-				{
-					std::cout << ion::recombine_command_line("unrecognized_resource", boost::assign::list_of(exc.what())) << std::endl;
-				}
-				catch (ion::resource_not_found const &exc)
-				{
-					std::cout << ion::recombine_command_line("resource_not_found", boost::assign::list_of(exc.what())) << std::endl;
-				}
-				catch (ion::resource_corrupted const &exc)
-				{
-					std::cout << ion::recombine_command_line("resource_corrupted", boost::assign::list_of(exc.what())) << std::endl;
-				}
-				catch (ion::uri::invalid_uri const &exc)
-				{
-					std::cout << ion::recombine_command_line("invalid_uri", boost::assign::list_of(exc.what())) << std::endl;
-				}
-			}
+			// The URIs are processed as one batch; print_event is called by the metadata batch thread
+			backend_.set_send_event_callback(&print_event);
+			backend_.queue_metadata_batch(ion::params_t(params.begin() + 1, params.end()));
+			backend_.wait_for_metadata_batches();
 			break;
 		}
 
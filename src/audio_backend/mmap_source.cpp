@@ -0,0 +1,171 @@
+/**************************************************************************
+
+    Copyright (C) 2010  Carlos Rafael Giani
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+**************************************************************************/
+
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mmap_source.hpp"
+
+
+namespace ion
+{
+namespace audio_backend
+{
+
+
+using namespace audio_common;
+
+
+mmap_source::mmap_source(uri const &uri_):
+	uri_(uri_),
+	data(0),
+	size(0),
+	position(0),
+	end_of_data(false)
+{
+	int fd = open(uri_.get_path().c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat stat_;
+	if ((fstat(fd, &stat_) == 0) && S_ISREG(stat_.st_mode) && (stat_.st_size > 0))
+	{
+		void *mapping = mmap(0, stat_.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED)
+		{
+			data = reinterpret_cast < uint8_t* > (mapping);
+			size = stat_.st_size;
+			madvise(data, size, MADV_SEQUENTIAL);
+		}
+	}
+
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+}
+
+
+mmap_source::~mmap_source()
+{
+	if (data != 0)
+		munmap(data, size);
+}
+
+
+void mmap_source::reset()
+{
+	position = 0;
+	end_of_data = false;
+}
+
+
+long mmap_source::read(void *dest, long const num_bytes)
+{
+	if ((data == 0) || end_of_data || (num_bytes <= 0))
+		return 0;
+
+	long num_read_bytes = std::min(num_bytes, size - position);
+	std::memcpy(dest, data + position, num_read_bytes);
+	position += num_read_bytes;
+
+	// like a file stream, enter the end-of-data state once a read hits the end
+	if (num_read_bytes < num_bytes)
+		end_of_data = true;
+
+	return num_read_bytes;
+}
+
+
+bool mmap_source::can_read() const
+{
+	return (data != 0) && !end_of_data;
+}
+
+
+bool mmap_source::end_of_data_reached() const
+{
+	return end_of_data;
+}
+
+
+bool mmap_source::is_ok() const
+{
+	return data != 0;
+}
+
+
+void mmap_source::seek(long const num_bytes, seek_type const type)
+{
+	long new_position;
+
+	switch (type)
+	{
+		case seek_absolute: new_position = num_bytes; break;
+		case seek_relative: new_position = position + num_bytes; break;
+		case seek_from_end: new_position = size + num_bytes; break;
+		default: return;
+	}
+
+	position = std::max(0L, std::min(new_position, size));
+	end_of_data = false;
+}
+
+
+bool mmap_source::can_seek(seek_type const) const
+{
+	return true;
+}
+
+
+long mmap_source::get_position() const
+{
+	return position;
+}
+
+
+long mmap_source::get_size() const
+{
+	return size;
+}
+
+
+void const * mmap_source::get_contiguous_view(long const offset, long const num_bytes)
+{
+	if ((data == 0) || (offset < 0) || (num_bytes < 0) || (num_bytes > (size - offset)))
+		return 0;
+
+	// madvise() needs a page aligned start address
+	if (num_bytes > 0)
+	{
+		long page_size = sysconf(_SC_PAGESIZE);
+		long aligned_offset = (page_size > 0) ? (offset - (offset % page_size)) : 0;
+		madvise(data + aligned_offset, num_bytes + (offset - aligned_offset), MADV_WILLNEED);
+	}
+
+	return data + offset;
+}
+
+
+}
+}
+
@@ -0,0 +1,85 @@
+/**************************************************************************
+
+    Copyright (C) 2010  Carlos Rafael Giani
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+**************************************************************************/
+
+
+#ifndef ION_AUDIO_BACKEND_MMAP_SOURCE_HPP
+#define ION_AUDIO_BACKEND_MMAP_SOURCE_HPP
+
+#include <stdint.h>
+#include <ion/uri.hpp>
+#include "source.hpp"
+
+
+namespace ion
+{
+namespace audio_backend
+{
+
+
+using namespace audio_common;
+
+
+/*
+Source for local files that maps the whole file into memory. Reads are plain memory copies, get_size() does not touch the file,
+and get_contiguous_view() hands out pointers into the mapping, so decoders that need the whole file in memory do not have to copy it.
+The mapping is advised for sequential access (the common case during playback); views additionally advise the kernel to read
+their range ahead.
+Note that truncating a file while it is mapped causes accesses to the truncated part to fail with SIGBUS; this is the usual caveat
+of memory mapped I/O. Empty files cannot be mapped; is_ok() returns false for them.
+*/
+class mmap_source:
+	public source
+{
+public:
+	explicit mmap_source(uri const &uri_);
+	~mmap_source();
+
+
+	virtual void reset();
+
+	virtual long read(void *dest, long const num_bytes);
+	virtual bool can_read() const;
+	virtual bool end_of_data_reached() const;
+	virtual bool is_ok() const;
+
+	virtual void seek(long const num_bytes, seek_type const type);
+	virtual bool can_seek(seek_type const type) const;
+
+	virtual long get_position() const;
+	virtual long get_size() const;
+
+	virtual uri get_uri() const { return uri_; }
+
+	virtual void const * get_contiguous_view(long const offset, long const num_bytes);
+
+protected:
+	uri uri_;
+	uint8_t *data;
+	long size, position;
+	bool end_of_data;
+};
+
+
+}
+}
+
+
+#endif
+
@@ -19,6 +19,7 @@
 **************************************************************************/
 
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <boost/thread/locks.hpp>
@@ -34,6 +35,62 @@ namespace audio_backend
 using namespace audio_common;
 
 
+namespace
+{
+
+
+// Number of bytes is_mp3_header() looks at
+unsigned long const mp3_header_test_size = 22;
+
+
+bool is_mp3_header(uint8_t const *header, unsigned long const header_size)
+{
+	// Try if it starts with an ID3 tag
+	if ((header_size >= 3) && (header[0] == 'I') && (header[1] == 'D') && (header[2] == '3'))
+		return true;
+
+	// Try if this is a RIFF (AVI) file with MP3 embedded
+	if ((header_size >= 12) && (std::memcmp(header, "RIFF", 4) == 0))
+	{
+		// Either it is MP3 data directly embedded in the RIFF container
+		if (std::memcmp(header + 8, "RMP3", 4) == 0)
+			return true;
+		else if ((std::memcmp(header + 8, "WAVE", 4) == 0) && (header_size >= 22)) // or it is a WAVE stream, which itself is a container
+		{
+			// the two bytes form up a little-endian signed 16bit value - this value identifies the wave contents; 85 means "MP3"
+			if ((header[20] == 85) && (header[21] == 0))
+				return true;
+		}
+	}
+
+	// Try a different test found in libmagic's animation file for ADTS files
+	if ((header_size >= 3) && (header[0] == 0xff))
+	{
+		int second_byte = (header[1] & 0xfe);
+		switch (second_byte)
+		{
+			case 0xe2:
+			case 0xf2:
+			case 0xf4:
+			case 0xf6:
+			case 0xfa:
+			case 0xfc:
+			{
+				int third_byte_nibble = header[2] >> 4;
+				return (third_byte_nibble >= 1) && (third_byte_nibble <= 0xE);
+			}
+			default:
+				break;
+		}
+	}
+
+	return false;
+}
+
+
+}
+
+
 mpg123_decoder::mpg123_decoder(send_event_callback_t const send_event_callback, source_ptr_t source_):
 	decoder(send_event_callback),
 	source_(source_),
@@ -109,8 +166,7 @@ mpg123_decoder::mpg123_decoder(send_event_callback_t const send_event_callback,
 			{
 				// mpg123 needs more input data, lets deliver some
 				unsigned long read_size = 0;
-				if (source_->can_read())
-					read_size = source_->read(&in_buffer[0], in_buffer_size);			
+				uint8_t const *input = fetch_input(read_size);
 				if (read_size == 0) // the source could not deliver data; this is the case (1) mentioned above
 				{
 					std::cerr << "Could not read from MP3 source" << std::endl;
@@ -120,7 +176,7 @@ mpg123_decoder::mpg123_decoder(send_event_callback_t const send_event_callback,
 					return;
 				}
 
-				last_read_return_value = mpg123_decode(mpg123_handle_, &in_buffer[0], read_size, &out_buffer[out_buffer_offset], out_buffer_pad_size, &decoded_size);
+				last_read_return_value = mpg123_decode(mpg123_handle_, input, read_size, &out_buffer[out_buffer_offset], out_buffer_pad_size, &decoded_size);
 			}
 			else
 			{
@@ -373,15 +429,14 @@ unsigned int mpg123_decoder::update(void *dest, unsigned int const num_samples_t
 		{
 			// mpg123 needs more input data, lets deliver some
 			unsigned long read_size = 0;
-			if (source_->can_read())
-				read_size = source_->read(&in_buffer[0], in_buffer_size);
+			uint8_t const *input = fetch_input(read_size);
 			if (read_size == 0) // the source could not deliver data, no further input possible
 			{
 				out_buffer.resize(out_buffer_offset); // revert to old size
 				break;
 			}
 
-			last_read_return_value = mpg123_decode(mpg123_handle_, &in_buffer[0], read_size, &out_buffer[out_buffer_offset], out_buffer_pad_size, &decoded_size);
+			last_read_return_value = mpg123_decode(mpg123_handle_, input, read_size, &out_buffer[out_buffer_offset], out_buffer_pad_size, &decoded_size);
 		}
 		else
 		{
@@ -418,6 +473,32 @@ unsigned int mpg123_decoder::update(void *dest, unsigned int const num_samples_t
 }
 
 
+uint8_t const * mpg123_decoder::fetch_input(unsigned long &num_bytes)
+{
+	num_bytes = 0;
+	if (!source_->can_read())
+		return 0;
+
+	// If the source can provide its data directly (for example, because it is memory mapped), feed mpg123 from there, instead of copying into in_buffer first
+	long position = source_->get_position(), size = source_->get_size();
+	if ((position >= 0) && (size >= 0))
+	{
+		long num_view_bytes = std::min(long(in_buffer_size), size - position);
+		void const *view = (num_view_bytes > 0) ? source_->get_contiguous_view(position, num_view_bytes) : 0;
+		if (view != 0)
+		{
+			source_->seek(num_view_bytes, source::seek_relative);
+			num_bytes = num_view_bytes;
+			return reinterpret_cast < uint8_t const * > (view);
+		}
+	}
+
+	long num_read_bytes = source_->read(&in_buffer[0], in_buffer_size);
+	num_bytes = std::max(num_read_bytes, 0L);
+	return &in_buffer[0];
+}
+
+
 
 
 mpg123_decoder_creator::mpg123_decoder_creator()
@@ -432,75 +513,22 @@ mpg123_decoder_creator::~mpg123_decoder_creator()
 }
 
 
-decoder_ptr_t mpg123_decoder_creator::create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback)
+int mpg123_decoder_creator::probe(uint8_t const *header, unsigned long const header_size, ion::uri const &) const
 {
-	// Testing out whether or not this is an MP3
-
-	bool recognized = false;
-
-	// Try if it starts with an ID3 tag
-	if (!recognized)
-	{
-		source_->reset();
-
-		char buf[3];
-		source_->read(buf, 3);
-		recognized = (buf[0] == 'I') && (buf[1] == 'D') && (buf[2] == '3');
-	}
+	return is_mp3_header(header, header_size) ? probe_score_match : probe_score_no_match;
+}
 
-	// Try if this is a RIFF (AVI) file with MP3 embedded
-	{
-		source_->reset();
 
-		char buf[4];
-		source_->read(buf, 4);
-		if ((buf[0] == 'R') && (buf[1] == 'I') && (buf[2] == 'F') && (buf[3] == 'F'))
-		{
-			source_->seek(4, source::seek_relative);
-			source_->read(buf, 4);
+decoder_ptr_t mpg123_decoder_creator::create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback)
+{
+	// Testing out whether or not this is an MP3
 
-			// Either it is MP3 data directly embedded in the RIFF container
-			if ((buf[0] == 'R') && (buf[1] == 'M') && (buf[2] == 'P') && (buf[3] == '3'))
-				recognized = true;
-			else if ((buf[0] == 'W') && (buf[1] == 'A') && (buf[2] == 'V') && (buf[3] == 'E')) // or it is a WAVE stream, which itself is a container
-			{
-				source_->seek(8, source::seek_relative);
-				uint8_t bytes[2];
-				source_->read(bytes, 2);
-				// the two bytes form up a little-endian signed 16bit value - this value identifies the wave contents; 85 means "MP3"
-				recognized = (bytes[0] == 85) && (bytes[1] == 0);
-			}
-		}
-	}
+	source_->reset();
 
-	// Try a different test found in libmagic's animation file for ADTS files
-	if (!recognized)
-	{
-		source_->reset();
+	uint8_t header[mp3_header_test_size];
+	long num_read_bytes = source_->read(header, mp3_header_test_size);
+	bool recognized = is_mp3_header(header, std::max(num_read_bytes, 0L));
 
-		uint8_t bytes[2];
-		source_->read(bytes, 2);
-		if (bytes[0] == 0xff)
-		{
-			int second_byte = (bytes[1] & 0xfe);
-			switch (second_byte)
-			{
-				case 0xe2:
-				case 0xf2:
-				case 0xf4:
-				case 0xf6:
-				case 0xfa:
-				case 0xfc:
-					source_->read(&bytes[0], 1);
-					bytes[0] >>= 4;
-					recognized = (bytes[0] >= 1) && (bytes[0] <= 0xE);
-					break;
-				default:
-					break;
-			}
-		}
-	}
-	
 	if (!recognized) // All tests failed - it seems this is not an MP3
 		return decoder_ptr_t();
 
@@ -74,6 +74,8 @@ public:
 protected:
 	typedef std::vector < uint8_t > buffer_t;
 
+	uint8_t const * fetch_input(unsigned long &num_bytes);
+
 	mutable boost::mutex mutex_;
 	playback_properties playback_properties_;
 	unsigned int src_frequency, src_num_channels;
@@ -97,6 +99,7 @@ public:
 	explicit mpg123_decoder_creator();
 	~mpg123_decoder_creator();
 
+	virtual int probe(uint8_t const *header, unsigned long const header_size, uri const &uri_) const;
 	virtual decoder_ptr_t create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback);
 	virtual std::string get_type() const { return "mpg123"; }
 };
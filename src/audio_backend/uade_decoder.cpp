@@ -26,7 +26,12 @@
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <poll.h>
 #include <signal.h>
+#include <unistd.h>
+#include <boost/foreach.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "uade_decoder.hpp"
 
@@ -57,6 +62,255 @@ namespace audio_backend
 using namespace audio_common;
 
 
+
+namespace
+{
+
+
+/*
+* Pool of idle uadecore processes. Spawning a uadecore and waiting for it to boot is what dominates the cost of creating
+* a UADE decoder, so cores are not killed once a decoder is done with them; instead, they are rebooted (which readies them
+* for a new song) and kept here, up to a limit. Acquiring a core also keeps one spare core booting in the background, so
+* that the next decoder (for example the one for the gapless transition to the next track) finds a warm core.
+* Idle cores are checked for being alive before they are handed out.
+*/
+class uade_core_pool
+{
+public:
+	enum { max_num_idle_cores = 2 };
+
+
+	~uade_core_pool()
+	{
+		boost::lock_guard < boost::mutex > lock(mutex_);
+		BOOST_FOREACH(core &core_, idle_cores)
+			terminate(core_.ipc, core_.pid);
+		idle_cores.clear();
+	}
+
+
+	void acquire(struct uade_state &state, std::string const &uade_name, std::string const &config_name)
+	{
+		boost::lock_guard < boost::mutex > lock(mutex_);
+
+		state.pid = 0;
+		while (!idle_cores.empty() && (state.pid <= 0))
+		{
+			core core_ = idle_cores.back();
+			idle_cores.pop_back();
+
+			if (is_alive(core_.pid))
+			{
+				state.ipc = core_.ipc;
+				state.pid = core_.pid;
+			}
+			else
+				terminate(core_.ipc, core_.pid);
+		}
+
+		if (state.pid <= 0)
+			uade_spawn(&state, uade_name.c_str(), config_name.c_str());
+
+		if (idle_cores.empty())
+		{
+			core spare_core;
+			spawn(spare_core, uade_name, config_name);
+			idle_cores.push_back(spare_core);
+		}
+	}
+
+
+	/*
+	* Returns the core of the given state to the pool. reusable must only be true if the core is idle, that is,
+	* it is waiting for a new song, and the IPC is in the S state.
+	*/
+	void release(struct uade_state &state, bool const reusable)
+	{
+		if (state.pid <= 0)
+			return;
+
+		boost::lock_guard < boost::mutex > lock(mutex_);
+
+		if (reusable && (idle_cores.size() < max_num_idle_cores) && is_alive(state.pid))
+		{
+			core core_;
+			core_.ipc = state.ipc;
+			core_.pid = state.pid;
+			idle_cores.push_back(core_);
+		}
+		else
+			terminate(state.ipc, state.pid);
+
+		state.pid = 0;
+	}
+
+
+protected:
+	struct core
+	{
+		struct uade_ipc ipc;
+		pid_t pid;
+	};
+
+	typedef std::vector < core > cores_t;
+
+
+	static void spawn(core &core_, std::string const &uade_name, std::string const &config_name)
+	{
+		struct uade_state spawn_state;
+		std::memset(&spawn_state, 0, sizeof(spawn_state));
+		uade_spawn(&spawn_state, uade_name.c_str(), config_name.c_str());
+		core_.ipc = spawn_state.ipc;
+		core_.pid = spawn_state.pid;
+	}
+
+	static bool is_alive(pid_t const pid)
+	{
+		return waitpid(pid, 0, WNOHANG) == 0;
+	}
+
+	static void terminate(struct uade_ipc const &ipc, pid_t const pid)
+	{
+		kill(pid, SIGTERM);
+		waitpid(pid, 0, 0);
+		// the core was spawned with one socket that is used for both directions
+		close(int(intptr_t(ipc.input)));
+	}
+
+
+	boost::mutex mutex_;
+	cores_t idle_cores;
+};
+
+
+uade_core_pool uade_core_pool_;
+
+
+
+/*
+* Ring of interleaved 16-bit sample values. Audio payloads of the core's data messages are byte-swapped straight into
+* the ring's free space ("staged"), and committed once the frontend side of the protocol decided how many of them are
+* to be played (after the effects were run on them in place). This avoids intermediate copies as well as moving the
+* remaining samples to the front after each update() call.
+*/
+class uade_sample_ring
+{
+public:
+	explicit uade_sample_ring(unsigned long const initial_capacity):
+		buffer(initial_capacity),
+		read_pos(0),
+		num_values(0),
+		num_staged_values(0)
+	{
+	}
+
+
+	void clear()
+	{
+		read_pos = num_values = num_staged_values = 0;
+	}
+
+
+	// Ensures the ring can hold at least min_capacity values; committed and staged values are retained
+	void reserve(unsigned long const min_capacity)
+	{
+		unsigned long capacity = buffer.size();
+		if (min_capacity <= capacity)
+			return;
+
+		buffer_t new_buffer(std::max(min_capacity, capacity * 2));
+		unsigned long num_stored_values = num_values + num_staged_values;
+		copy_out(read_pos, num_stored_values, &new_buffer[0]);
+
+		buffer.swap(new_buffer);
+		read_pos = 0;
+	}
+
+
+	unsigned long get_num_values() const { return num_values; }
+	unsigned long get_num_free_values() const { return buffer.size() - num_values - num_staged_values; }
+
+
+	// Copies up to max_num_values values to dest, and removes them from the ring; returns the number of copied values
+	unsigned long read(unsigned long const max_num_values, void *dest)
+	{
+		unsigned long num_values_to_read = std::min(max_num_values, num_values);
+		copy_out(read_pos, num_values_to_read, reinterpret_cast < int16_t* > (dest));
+		discard(num_values_to_read);
+		return num_values_to_read;
+	}
+
+
+	// Removes up to max_num_values values without copying them; returns the number of removed values
+	unsigned long discard(unsigned long const max_num_values)
+	{
+		unsigned long num_values_to_discard = std::min(max_num_values, num_values);
+		read_pos = (read_pos + num_values_to_discard) % buffer.size();
+		num_values -= num_values_to_discard;
+		return num_values_to_discard;
+	}
+
+
+	// Byte-swaps num_values_to_stage big endian values from src into the free space, replacing any previously staged values
+	// The caller must make sure enough free space is available (see reserve())
+	void stage_from_network_order(uint16_t const *src, unsigned long const num_values_to_stage)
+	{
+		num_staged_values = 0;
+		assert(num_values_to_stage <= get_num_free_values());
+
+		unsigned long write_pos = (read_pos + num_values) % buffer.size();
+		unsigned long first_part = std::min(num_values_to_stage, buffer.size() - write_pos);
+
+		for (unsigned long i = 0; i < first_part; ++i)
+			buffer[write_pos + i] = int16_t(ntohs(src[i]));
+		for (unsigned long i = first_part; i < num_values_to_stage; ++i)
+			buffer[i - first_part] = int16_t(ntohs(src[i]));
+
+		num_staged_values = num_values_to_stage;
+	}
+
+
+	// Runs the effects on the first num_values_to_commit staged values in place, and commits them; remaining staged values are dropped
+	void commit_staged(struct uade_effect *ue, unsigned long num_values_to_commit)
+	{
+		num_values_to_commit = std::min(num_values_to_commit, num_staged_values);
+
+		unsigned long write_pos = (read_pos + num_values) % buffer.size();
+		unsigned long first_part = std::min(num_values_to_commit, buffer.size() - write_pos);
+
+		// the effects process whole frames; staged values always start at a frame boundary, and the capacity is a multiple of the frame size
+		if (first_part > 0)
+			uade_effect_run(ue, &buffer[write_pos], first_part / UADE_CHANNELS);
+		if (first_part < num_values_to_commit)
+			uade_effect_run(ue, &buffer[0], (num_values_to_commit - first_part) / UADE_CHANNELS);
+
+		num_values += num_values_to_commit;
+		num_staged_values = 0;
+	}
+
+
+protected:
+	typedef std::vector < int16_t > buffer_t;
+
+
+	void copy_out(unsigned long const start_pos, unsigned long const num_values_to_copy, int16_t *dest) const
+	{
+		unsigned long first_part = std::min(num_values_to_copy, buffer.size() - start_pos);
+		std::memcpy(dest, &buffer[start_pos], first_part * sizeof(int16_t));
+		if (first_part < num_values_to_copy)
+			std::memcpy(dest + first_part, &buffer[0], (num_values_to_copy - first_part) * sizeof(int16_t));
+	}
+
+
+	buffer_t buffer;
+	unsigned long read_pos, num_values, num_staged_values;
+};
+
+
+}
+
+
+
 struct uade_decoder::internal_data
 {
 	struct uade_state state;
@@ -64,40 +318,46 @@ struct uade_decoder::internal_data
 	std::string config_name, player_name, score_name, uade_name;
 	std::string module_name, song_name;
 	std::string title;
-	bool uadeconf_loaded, spawned, file_loaded, subsong_ended, subsong_info_read, manual_songend;
+	bool uadeconf_loaded, configured, file_loaded, subsong_ended, subsong_info_read, manual_songend;
+	bool song_initialized, reboot_sent, core_failed, playback_ended;
 
 	struct uade_ipc *ipc;
 	struct uade_song *us;
 	struct uade_effect *ue;
 	struct uade_config *uc;
 
-	uint8_t sample_data[UADE_MAX_MESSAGE_SIZE];
 	uint8_t space[UADE_MAX_MESSAGE_SIZE];
 	struct uade_msg *um;
 
 	enum uade_control_state control_state;
 	int const framesize;
-	uint16_t *sm;
 	int left;
 	int what_was_left;
 	int tailbytes;
 	int playbytes;
 	int64_t subsong_bytes;
 
-	typedef std::vector < int16_t > sample_buffer_t;
-	sample_buffer_t sample_buffer;
+	uade_sample_ring sample_ring;
+
+	// the largest amount of sample values a single data message can carry
+	enum { max_num_message_values = UADE_MAX_MESSAGE_SIZE / UADE_BYTES_PER_SAMPLE };
 
 
 
 	explicit internal_data():
-		spawned(false),
+		configured(false),
 		file_loaded(false),
+		song_initialized(false),
+		reboot_sent(false),
+		core_failed(false),
+		playback_ended(false),
 		control_state(UADE_S_STATE),
 		framesize(UADE_BYTES_PER_SAMPLE * UADE_CHANNELS),
 		left(0),
 		what_was_left(0),
 		tailbytes(0),
-		subsong_bytes(0)
+		subsong_bytes(0),
+		sample_ring(65536)
 	{
 		playbytes = 0;
 		manual_songend = false;
@@ -107,6 +367,7 @@ struct uade_decoder::internal_data
 		ue = &state.effects;
 		uc = &state.config;
 		um = (struct uade_msg*)space;	
+		state.pid = 0;
 	}
 
 	~internal_data()
@@ -115,7 +376,7 @@ struct uade_decoder::internal_data
 	}
 
 
-	void spawn_core(unsigned int const frequency)
+	void setup_config(unsigned int const frequency)
 	{
 		cleanup();
 
@@ -142,9 +403,7 @@ struct uade_decoder::internal_data
 		/*state.config.headphones2 = 1;
 		state.config.headphones2_set = 1;*/
 
-		uade_spawn(&state, uade_name.c_str(), config_name.c_str());
-
-		spawned = true;
+		configured = true;
 	}
 
 
@@ -152,47 +411,78 @@ struct uade_decoder::internal_data
 	{
 		if (file_loaded)
 		{
-			if (control_state == UADE_R_STATE)
-			{
-				do
-				{
-					uade_receive_message(um, sizeof(space), ipc);
-				}
-				while (um->msgtype != UADE_COMMAND_TOKEN);
-			}
-
 			uade_unalloc_song(&state);
 			file_loaded = false;
 		}
 	}
 
 
-	void cleanup()
+	// Brings the core back into its idle state (waiting for a new song, IPC in S state); returns false if this failed
+	bool reset_core()
 	{
-		if (spawned)
+		if (core_failed)
+			return false;
+
+		// a core that never received a song (or refused to play it) is still idle
+		if (!song_initialized)
+			return true;
+		song_initialized = false;
+
+		if (control_state == UADE_R_STATE)
 		{
-			unalloc_song();
-			spawned = false;
+			do
+			{
+				if (uade_receive_message(um, sizeof(space), ipc) <= 0)
+					return false;
+			}
+			while (um->msgtype != UADE_COMMAND_TOKEN);
+			control_state = UADE_S_STATE;
 		}
 
-		control_state = UADE_S_STATE;
-		sample_buffer.clear();
+		if (!reboot_sent && uade_send_short_message(UADE_COMMAND_REBOOT, ipc))
+			return false;
+		reboot_sent = false;
+
+		if (uade_send_short_message(UADE_COMMAND_TOKEN, ipc))
+			return false;
+
+		do
+		{
+			if (uade_receive_message(um, sizeof(space), ipc) <= 0)
+				return false;
+		}
+		while (um->msgtype != UADE_COMMAND_TOKEN);
 
-		if ((state.pid != 0) && (state.pid != -1))
+		return true;
+	}
+
+
+	void cleanup()
+	{
+		if (state.pid > 0)
 		{
-			pid_t pid = state.pid;
-			kill(pid, SIGTERM);
-			waitpid(pid, 0, 0);
+			bool reusable = reset_core();
+			uade_core_pool_.release(state, reusable);
 		}
 
-		//um->size = 0;
-		//uade_send_message(um, ipc);
+		unalloc_song();
+
+		song_initialized = false;
+		reboot_sent = false;
+		core_failed = false;
+		playback_ended = false;
+		control_state = UADE_S_STATE;
+		sample_ring.clear();
+		subsong_ended = false;
+		subsong_info_read = false;
+		manual_songend = false;
+		left = what_was_left = tailbytes = playbytes = 0;
 	}
 
 
 	void try_load_file(std::string const &filename, int const cur_subsong)
 	{
-		assert(spawned);
+		assert(configured);
 		unalloc_song();
 
 		state.song = 0;
@@ -240,15 +530,21 @@ struct uade_decoder::internal_data
 			if (!f.good())
 				return;
 		}
+
+		// only now that the file is known to be playable, a core is needed
+		if (state.pid <= 0)
+			uade_core_pool_.acquire(state, uade_name, config_name);
 		
 		int ret = uade_song_initialization(score_name.c_str(), player_name.c_str(), module_name.c_str(), &state);
 
 		switch (ret)
 		{
 			case UADECORE_INIT_OK:
+				song_initialized = true;
 				break;
 
 			case UADECORE_INIT_ERROR:
+				core_failed = true;
 				uade_unalloc_song(&state);
 				return;
 
@@ -257,9 +553,19 @@ struct uade_decoder::internal_data
 				return;
 
 			default:
+				core_failed = true;
 				return;
 		}
 
+		// uade_song_initialization() omits the frequency if it is the default one; a pooled core may still be set
+		// to the frequency of its previous song, so always send it
+		if ((state.config.frequency == UADE_DEFAULT_FREQUENCY) && uade_send_u32(UADE_COMMAND_SET_FREQUENCY, state.config.frequency, ipc))
+		{
+			core_failed = true;
+			uade_unalloc_song(&state);
+			return;
+		}
+
 		us = state.song;
 
 		uade_effect_reset_internals();
@@ -288,6 +594,62 @@ struct uade_decoder::internal_data
 	}
 
 
+	void restart(std::string const &filename, int const cur_subsong)
+	{
+		// keep the frequency the core is currently configured with
+		setup_config(state.config.frequency);
+		try_load_file(filename, cur_subsong);
+	}
+
+
+	/*
+	* Lets the emulator produce the given amount of samples (per channel) and discards them. The core emulates as fast
+	* as it can, since no sink is throttling it. Returns false if the song ended or an error occurred before all samples
+	* were skipped.
+	*/
+	bool skip_samples(int64_t num_samples)
+	{
+		int64_t num_values_to_skip = num_samples * UADE_CHANNELS;
+
+		while (num_values_to_skip > 0)
+		{
+			if ((sample_ring.get_num_values() == 0) && !iterate_into_ring())
+				return false;
+
+			num_values_to_skip -= sample_ring.discard(std::min(num_values_to_skip, int64_t(sample_ring.get_num_values())));
+		}
+
+		return true;
+	}
+
+
+	// Like iterate(), but first makes sure the ring can accept the payload of another data message
+	bool iterate_into_ring()
+	{
+		sample_ring.reserve(sample_ring.get_num_values() + max_num_message_values);
+		return iterate();
+	}
+
+
+	/*
+	* Returns true if iterate() can be called without blocking on the core: in the S state, the frontend only sends,
+	* while in the R state a message must already be buffered or waiting on the socket.
+	*/
+	bool core_output_available()
+	{
+		if (control_state != UADE_R_STATE)
+			return true;
+		if (ipc->inputbytes > 0)
+			return true;
+
+		struct pollfd pfd;
+		pfd.fd = int(intptr_t(ipc->input));
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		return poll(&pfd, 1, 0) > 0;
+	}
+
+
 	bool iterate()
 	{
 		bool retval = iterate_impl();
@@ -297,8 +659,10 @@ struct uade_decoder::internal_data
 			if (uade_send_short_message(UADE_COMMAND_REBOOT, ipc))
 			{
 				std::cerr << "Cannot send reboot" << std::endl;
+				core_failed = true;
 				return false;
 			}
+			reboot_sent = true;
 		}
 
 		return retval;
@@ -318,6 +682,7 @@ struct uade_decoder::internal_data
 				if (uade_send_short_message(UADE_COMMAND_TOKEN, ipc))
 				{
 					std::cerr << "Cannot send token" << std::endl;
+					core_failed = true;
 					return false;
 				}
 
@@ -335,10 +700,7 @@ struct uade_decoder::internal_data
 
 					us->out_bytes += playbytes;
 
-					uade_effect_run(ue, (int16_t *)sample_data, playbytes / framesize);
-					unsigned long offset = sample_buffer.size();
-					sample_buffer.resize(offset + playbytes / 2);
-					std::memcpy(&sample_buffer[offset], sample_data, playbytes);
+					sample_ring.commit_staged(ue, playbytes / UADE_BYTES_PER_SAMPLE);
 
 					// TODO: timeout
 					//if ((us->out_bytes / (UADE_BYTES_PER_FRAME * state.config.frequency)) >= 4)
@@ -356,6 +718,7 @@ struct uade_decoder::internal_data
 				if (uade_receive_message(um, sizeof(space), ipc) <= 0)
 				{
 					std::cerr << "Cannot receive messages from core" << std::endl;
+					core_failed = true;
 					return false;
 				}
 
@@ -367,16 +730,8 @@ struct uade_decoder::internal_data
 
 					case UADE_REPLY_DATA:
 					{
-						sm = (uint16_t*)(um->data);
-						for (unsigned int i = 0; i < um->size; i += 2)
-						{
-							*sm = ntohs(*sm);
-							++sm;
-						}
-
 						assert(left == int(um->size));
-						assert(sizeof(sample_data) >= um->size);
-						std::memcpy(sample_data, um->data, um->size);
+						sample_ring.stage_from_network_order(reinterpret_cast < uint16_t const * > (um->data), um->size / UADE_BYTES_PER_SAMPLE);
 
 						what_was_left = left;
 						left = 0;
@@ -446,6 +801,7 @@ uade_decoder::uade_decoder(send_event_callback_t const send_event_callback, sour
 	source_(source_),
 	subsong_nr(-1),
 	current_position(0),
+	seek_to(-1),
 	internal_data_(0)
 {
 	internal_data_ = new internal_data;
@@ -464,7 +820,7 @@ uade_decoder::uade_decoder(send_event_callback_t const send_event_callback, sour
 	{
 	}
 
-	internal_data_->spawn_core(48000);
+	internal_data_->setup_config(48000);
 	internal_data_->try_load_file(source_->get_uri().get_path(), subsong_nr);
 }
 
@@ -477,7 +833,7 @@ uade_decoder::~uade_decoder()
 
 bool uade_decoder::is_initialized() const
 {
-	return internal_data_->spawned && internal_data_->file_loaded;
+	return internal_data_->configured && internal_data_->file_loaded;
 }
 
 
@@ -487,14 +843,21 @@ bool uade_decoder::can_playback() const
 }
 
 
-long uade_decoder::set_current_position(long const)
+long uade_decoder::set_current_position(long const new_position)
 {
-	return current_position;
+	if (!is_initialized() || (new_position < 0))
+		return -1;
+
+	// the actual seek is done in update(), since fast-forwarding the emulator can take a while
+	boost::lock_guard < boost::mutex > lock(mutex_);
+	seek_to = new_position;
+	return new_position;
 }
 
 
 long uade_decoder::get_current_position() const
 {
+	boost::lock_guard < boost::mutex > lock(mutex_);
 	return current_position;
 }
 
@@ -520,6 +883,27 @@ metadata_t uade_decoder::get_metadata() const
 }
 
 
+metadata_t uade_decoder::get_sub_resources_metadata() const
+{
+	metadata_t sub_resources(Json::arrayValue);
+	if (!is_initialized())
+		return sub_resources;
+
+	// UADE only knows the subsong range and the song title, and these are the same for all subsongs;
+	// delivering them here spares the scanner from spawning a uadecore process for each subsong
+	metadata_t metadata_ = get_metadata();
+	for (int subsong = internal_data_->us->min_subsong; subsong <= internal_data_->us->max_subsong; ++subsong)
+	{
+		set_metadata_value(metadata_, "sub_resource_index", subsong);
+		set_metadata_value(metadata_, "num_ticks", int(get_num_ticks()));
+		set_metadata_value(metadata_, "num_ticks_per_second", int(get_num_ticks_per_second()));
+		sub_resources.append(metadata_);
+	}
+
+	return sub_resources;
+}
+
+
 std::string uade_decoder::get_type() const
 {
 	return "uade";
@@ -552,7 +936,7 @@ void uade_decoder::set_playback_properties(playback_properties const &new_playba
 	boost::lock_guard < boost::mutex > lock(mutex_);
 
 	playback_properties_ = new_playback_properties;
-	internal_data_->spawn_core(playback_properties_.frequency);
+	internal_data_->setup_config(playback_properties_.frequency);
 	internal_data_->try_load_file(source_->get_uri().get_path(), subsong_nr);
 }
 
@@ -563,6 +947,15 @@ decoder_properties uade_decoder::get_decoder_properties() const
 }
 
 
+namespace
+{
+
+// Upper bound for the read-ahead done in update(), in sample values (a quarter second of stereo audio at 48 kHz)
+unsigned long const read_ahead_num_values = 24000;
+
+}
+
+
 unsigned int uade_decoder::update(void *dest, unsigned int const num_samples_to_write)
 {
 	if (!is_initialized())
@@ -570,40 +963,74 @@ unsigned int uade_decoder::update(void *dest, unsigned int const num_samples_to_
 
 	boost::lock_guard < boost::mutex > lock(mutex_);
 
-	while ((num_samples_to_write * 2) > internal_data_->sample_buffer.size())
+	if (seek_to != -1)
 	{
-		if (!internal_data_->iterate())
+		if (!seek(seek_to))
 		{
 			internal_data_->cleanup();
 			return 0;
 		}
 	}
 
-	long num_samples_to_return = std::min(
-		long(internal_data_->sample_buffer.size() / playback_properties_.num_channels),
-		long(num_samples_to_write)
-	);
+	unsigned long num_values_to_write = num_samples_to_write * UADE_CHANNELS;
 
-	long remaining_size = long(internal_data_->sample_buffer.size()) - long(num_samples_to_return * playback_properties_.num_channels);
-	std::memcpy(dest, &internal_data_->sample_buffer[0], num_samples_to_return * playback_properties_.num_channels * get_sample_size(playback_properties_.sample_type_));
-	if (remaining_size > 0)
+	if (!internal_data_->playback_ended)
 	{
-		std::memmove(
-			&internal_data_->sample_buffer[0],
-			&internal_data_->sample_buffer[num_samples_to_write * playback_properties_.num_channels],
-			remaining_size * get_sample_size(playback_properties_.sample_type_)
-		);
+		while (internal_data_->sample_ring.get_num_values() < num_values_to_write)
+		{
+			if (!internal_data_->iterate_into_ring())
+			{
+				internal_data_->playback_ended = true;
+				break;
+			}
+		}
+
+		// Read ahead, but only what the core already produced, so this never waits on the core
+		// This keeps the core busy emulating while the sink plays the current block
+		while (!internal_data_->playback_ended && (internal_data_->sample_ring.get_num_values() < (num_values_to_write + read_ahead_num_values)) && internal_data_->core_output_available())
+		{
+			if (!internal_data_->iterate_into_ring())
+				internal_data_->playback_ended = true;
+		}
+	}
 
-		internal_data_->sample_buffer.resize(remaining_size);
+	long num_samples_to_return = internal_data_->sample_ring.read(num_values_to_write, dest) / UADE_CHANNELS;
+	if ((num_samples_to_return == 0) && internal_data_->playback_ended)
+	{
+		internal_data_->cleanup();
+		return 0;
 	}
-	else
-		internal_data_->sample_buffer.resize(0);
 
 	current_position += num_samples_to_return * 50000 / playback_properties_.frequency;
 	return num_samples_to_return;
 }
 
 
+bool uade_decoder::seek(long const new_position)
+{
+	// UADE cannot save and restore the emulator state, and the protocol has no seek command. Seeking is therefore
+	// done by letting the core emulate up to the new position and discarding the output. Forward seeks continue from
+	// the current position; backward seeks restart the song (on a warm core from the pool) and skip from its beginning.
+
+	seek_to = -1;
+
+	if (new_position < current_position)
+	{
+		internal_data_->restart(source_->get_uri().get_path(), subsong_nr);
+		current_position = 0;
+		if (!is_initialized())
+			return false;
+	}
+
+	unsigned int frequency = internal_data_->state.config.frequency;
+	int64_t num_samples_to_skip = int64_t(new_position - current_position) * frequency / 50000;
+	bool ok = internal_data_->skip_samples(num_samples_to_skip);
+	current_position = new_position;
+
+	return ok;
+}
+
+
 
 
 uade_decoder_creator::uade_decoder_creator()
@@ -611,6 +1038,14 @@ uade_decoder_creator::uade_decoder_creator()
 }
 
 
+int uade_decoder_creator::probe(uint8_t const *, unsigned long const, ion::uri const &uri_) const
+{
+	// Amiga music formats are identified by uadecore's own file type detection, which needs the full file;
+	// non-local resources can be rejected up front though
+	return (uri_.get_type() == "file") ? probe_score_unknown : probe_score_no_match;
+}
+
+
 decoder_ptr_t uade_decoder_creator::create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback)
 {
 	// UADE cannot handle any I/O other than local files
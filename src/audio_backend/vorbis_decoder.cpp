@@ -19,7 +19,8 @@
 **************************************************************************/
 
 
-#include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <boost/thread/locks.hpp>
 #include "vorbis_decoder.hpp"
 
@@ -37,6 +38,16 @@ namespace
 {
 
 
+// "OggS" capture pattern, followed by the "vorbis" identification header packet signature at offset 29
+unsigned long const ogg_vorbis_header_test_size = 35;
+
+
+bool is_ogg_vorbis_header(uint8_t const *header, unsigned long const header_size)
+{
+	return (header_size >= ogg_vorbis_header_test_size) && (std::memcmp(header, "OggS", 4) == 0) && (std::memcmp(header + 29, "vorbis", 6) == 0);
+}
+
+
 size_t vorbis_read_func(void *ptr, size_t size, size_t nmemb, void *datasource)
 {
 	source *source_ = reinterpret_cast < source* > (datasource);
@@ -255,7 +266,9 @@ void vorbis_decoder::set_playback_properties(playback_properties const &new_play
 
 decoder_properties vorbis_decoder::get_decoder_properties() const
 {
-	return decoder_properties(info->rate, info->channels, playback_properties_.sample_type_);
+	// libvorbis decodes to float internally; handing these floats to the sink directly avoids
+	// a float->s16->float round trip when resampling, and does not clip the decoded signal prematurely
+	return decoder_properties(info->rate, info->channels, sample_float32);
 }
 
 
@@ -264,16 +277,11 @@ unsigned int vorbis_decoder::update(void *dest, unsigned int const num_samples_t
 	if (!is_initialized())
 		return 0;
 
-	int bytes_per_tick = 0;
-
-	{
-		boost::lock_guard < boost::mutex > lock(mutex_);
-		bytes_per_tick = info->channels * get_sample_size(playback_properties_.sample_type_);
-	}
+	boost::lock_guard < boost::mutex > lock(mutex_);
 
-#if 1
-	uint8_t *buf = reinterpret_cast < uint8_t* > (dest);
+	float *buf = reinterpret_cast < float* > (dest);
 	long remaining_samples = num_samples_to_write;
+	unsigned int num_channels = info->channels;
 
 	// TODO: re-read vorbis info when the section changes
 	// since each section can have a different number of channels & different samplerate
@@ -281,47 +289,45 @@ unsigned int vorbis_decoder::update(void *dest, unsigned int const num_samples_t
 
 	while (remaining_samples > 0)
 	{
-		long num_read_bytes = ov_read(&vorbis_file, reinterpret_cast < char* > (buf), remaining_samples * bytes_per_tick, 0, 2, 1, &current_section);
-		bool continue_loop = true;
+		float **pcm;
+		long num_read_samples = ov_read_float(&vorbis_file, &pcm, remaining_samples, &current_section);
 
-		switch (num_read_bytes)
+		if (num_read_samples <= 0) // 0 = end of stream, <0 = OV_HOLE, OV_EBADLINK, OV_EINVAL
+			break;
+
+		// ov_read_float() returns planar data, which is interleaved here
+		switch (num_channels)
 		{
-			case OV_HOLE:
-			case OV_EBADLINK:
-			case OV_EINVAL:
-			case 0:
-				continue_loop = false;
+			case 1:
+				std::memcpy(buf, pcm[0], num_read_samples * sizeof(float));
+				break;
+
+			case 2:
+			{
+				float const *left = pcm[0], *right = pcm[1];
+				for (long i = 0; i < num_read_samples; ++i)
+				{
+					buf[i * 2 + 0] = left[i];
+					buf[i * 2 + 1] = right[i];
+				}
 				break;
+			}
+
 			default:
+				for (unsigned int channel_nr = 0; channel_nr < num_channels; ++channel_nr)
+				{
+					float const *src = pcm[channel_nr];
+					for (long i = 0; i < num_read_samples; ++i)
+						buf[i * num_channels + channel_nr] = src[i];
+				}
 				break;
 		}
 
-		if (!continue_loop)
-			break;
-
-		long num_read_samples = num_read_bytes / bytes_per_tick;
 		remaining_samples -= num_read_samples;
-		buf += num_read_bytes;
+		buf += num_read_samples * num_channels;
 	}
 
 	return num_samples_to_write - remaining_samples;
-#else
-	long num_read_bytes = ov_read(&vorbis_file, reinterpret_cast < char* > (dest), num_samples_to_write * bytes_per_tick, 0, 2, 1, &current_section);
-	std::cerr << (num_read_bytes / bytes_per_tick) << ' ' << num_samples_to_write << std::endl;
-
-	switch (num_read_bytes)
-	{
-		case OV_HOLE:
-		case OV_EBADLINK:
-		case OV_EINVAL:
-		case 0:
-			return 0;
-		default:
-			break;
-	}
-
-	return num_read_bytes / bytes_per_tick;
-#endif
 }
 
 
@@ -332,19 +338,18 @@ vorbis_decoder_creator::vorbis_decoder_creator()
 }
 
 
+int vorbis_decoder_creator::probe(uint8_t const *header, unsigned long const header_size, ion::uri const &) const
+{
+	return is_ogg_vorbis_header(header, header_size) ? probe_score_match : probe_score_no_match;
+}
+
+
 decoder_ptr_t vorbis_decoder_creator::create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback)
 {
 	{
-		std::string magic_id;
-		magic_id.resize(4);
-		source_->read(&magic_id[0], 4);
-		if (magic_id != "OggS")
-			return decoder_ptr_t();
-
-		source_->seek(25, source::seek_relative);
-		magic_id.resize(6);
-		source_->read(&magic_id[0], 6);
-		if (magic_id != "vorbis")
+		uint8_t header[ogg_vorbis_header_test_size];
+		long num_read_bytes = source_->read(header, ogg_vorbis_header_test_size);
+		if (!is_ogg_vorbis_header(header, std::max(num_read_bytes, 0L)))
 			return decoder_ptr_t();
 
 		source_->reset();
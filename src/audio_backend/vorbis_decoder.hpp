@@ -92,6 +92,7 @@ class vorbis_decoder_creator:
 public:
 	explicit vorbis_decoder_creator();
 
+	virtual int probe(uint8_t const *header, unsigned long const header_size, uri const &uri_) const;
 	virtual decoder_ptr_t create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback);
 	virtual std::string get_type() const { return "vorbis"; }
 };
@@ -0,0 +1,565 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <boost/thread/locks.hpp>
+#include "archive_cache.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+struct archive_cache::archive
+{
+	struct member
+	{
+		long offset; // of the local file header in zip archives
+		unsigned long compressed_size, size;
+		unsigned int method;
+		uint32_t crc;
+	};
+
+	typedef std::map < std::string, member > members_t;
+
+
+	archive():
+		fd(-1),
+		size(0),
+		modification_time(0),
+		is_gzip(false)
+	{
+	}
+
+	~archive()
+	{
+		if (fd != -1)
+			close(fd);
+	}
+
+
+	std::string path;
+	int fd;
+	long size, modification_time;
+	bool is_gzip;
+	members_t members;
+};
+
+
+namespace
+{
+
+
+// Larger members are rejected instead of trying to allocate memory for them
+unsigned long const max_member_size = 256 * 1024 * 1024;
+
+unsigned int const zip_method_stored = 0;
+unsigned int const zip_method_deflate = 8;
+
+uint32_t const zip_local_header_signature = 0x04034b50;
+uint32_t const zip_central_header_signature = 0x02014b50;
+uint32_t const zip_end_of_central_directory_signature = 0x06054b50;
+long const zip_local_header_size = 30;
+long const zip_central_header_size = 46;
+long const zip_end_of_central_directory_size = 22;
+
+
+inline unsigned int read_u16(uint8_t const *data)
+{
+	return (unsigned int)(data[0]) | ((unsigned int)(data[1]) << 8);
+}
+
+
+inline uint32_t read_u32(uint8_t const *data)
+{
+	return uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24);
+}
+
+
+bool read_at(int const fd, long const offset, uint8_t *dest, long const num_bytes)
+{
+	long num_read_bytes = 0;
+	while (num_read_bytes < num_bytes)
+	{
+		ssize_t ret = pread(fd, dest + num_read_bytes, num_bytes - num_read_bytes, offset + num_read_bytes);
+		if (ret <= 0)
+			return false;
+		num_read_bytes += ret;
+	}
+	return true;
+}
+
+
+bool read_zip_index(archive_cache::archive &archive_)
+{
+	// The end of central directory record is at the end of the file, followed by a comment of up to 65535 bytes
+	long tail_size = std::min(archive_.size, zip_end_of_central_directory_size + 65535L);
+	if (tail_size < zip_end_of_central_directory_size)
+		return false;
+
+	std::vector < uint8_t > tail(tail_size);
+	if (!read_at(archive_.fd, archive_.size - tail_size, &tail[0], tail_size))
+		return false;
+
+	long eocd_pos = tail_size - zip_end_of_central_directory_size;
+	while ((eocd_pos >= 0) && (read_u32(&tail[eocd_pos]) != zip_end_of_central_directory_signature))
+		--eocd_pos;
+	if (eocd_pos < 0)
+		return false;
+
+	uint8_t const *eocd = &tail[eocd_pos];
+	unsigned int num_entries = read_u16(eocd + 10);
+	uint32_t directory_size = read_u32(eocd + 12);
+	uint32_t directory_offset = read_u32(eocd + 16);
+
+	// ZIP64 archives store 0xFFFF / 0xFFFFFFFF here, and the real values in an extra record
+	if ((num_entries == 0xFFFF) || (directory_size == 0xFFFFFFFF) || (directory_offset == 0xFFFFFFFF))
+		return false;
+	if ((long(directory_offset) + long(directory_size)) > archive_.size)
+		return false;
+
+	std::vector < uint8_t > directory(directory_size);
+	if ((directory_size > 0) && !read_at(archive_.fd, directory_offset, &directory[0], directory_size))
+		return false;
+
+	long pos = 0;
+	for (unsigned int i = 0; i < num_entries; ++i)
+	{
+		if ((pos + zip_central_header_size) > long(directory_size))
+			return false;
+
+		uint8_t const *header = &directory[pos];
+		if (read_u32(header) != zip_central_header_signature)
+			return false;
+
+		unsigned int flags = read_u16(header + 8);
+		unsigned int name_length = read_u16(header + 28);
+		long entry_size = zip_central_header_size + name_length + read_u16(header + 30) + read_u16(header + 32);
+		if ((pos + entry_size) > long(directory_size))
+			return false;
+
+		std::string name(reinterpret_cast < char const * > (header + zip_central_header_size), name_length);
+		pos += entry_size;
+
+		// Skip directories and encrypted members
+		if (name.empty() || (name[name.length() - 1] == '/') || ((flags & 1) != 0))
+			continue;
+
+		archive_cache::archive::member member_;
+		member_.method = read_u16(header + 10);
+		member_.crc = read_u32(header + 16);
+		member_.compressed_size = read_u32(header + 20);
+		member_.size = read_u32(header + 24);
+		member_.offset = read_u32(header + 42);
+		archive_.members[name] = member_;
+	}
+
+	return true;
+}
+
+
+bool read_gzip_index(archive_cache::archive &archive_)
+{
+	uint8_t header[10];
+	if ((archive_.size < 18) || !read_at(archive_.fd, 0, header, 10) || (header[2] != 8)) // 8 = deflate
+		return false;
+
+	unsigned int flags = header[3];
+	long pos = 10;
+	std::string name;
+
+	if ((flags & 0x04) != 0) // FEXTRA
+	{
+		uint8_t extra_length[2];
+		if (!read_at(archive_.fd, pos, extra_length, 2))
+			return false;
+		pos += 2 + read_u16(extra_length);
+	}
+
+	if ((flags & 0x08) != 0) // FNAME
+	{
+		uint8_t c;
+		while ((pos < archive_.size) && read_at(archive_.fd, pos++, &c, 1) && (c != 0))
+			name += char(c);
+	}
+
+	// Without a stored name, the member is named after the archive
+	if (name.empty())
+	{
+		std::string::size_type slash_pos = archive_.path.find_last_of('/');
+		name = (slash_pos == std::string::npos) ? archive_.path : archive_.path.substr(slash_pos + 1);
+		if ((name.length() > 3) && (name.compare(name.length() - 3, 3, ".gz") == 0))
+			name.erase(name.length() - 3);
+	}
+
+	// The trailer holds the size of the uncompressed data (modulo 2^32); it is only used as a hint
+	uint8_t trailer[4];
+	if (!read_at(archive_.fd, archive_.size - 4, trailer, 4))
+		return false;
+
+	archive_cache::archive::member member_;
+	member_.offset = 0;
+	member_.compressed_size = archive_.size;
+	member_.size = read_u32(trailer);
+	member_.method = zip_method_deflate;
+	member_.crc = 0;
+	archive_.members[name] = member_;
+
+	archive_.is_gzip = true;
+	return true;
+}
+
+
+// window_bits is passed to inflateInit2(); -MAX_WBITS selects raw deflate data (zip), 16 + MAX_WBITS gzip data
+bool inflate_data(uint8_t const *compressed_data, unsigned long const compressed_size, int const window_bits, archive_cache::member_data_t &data)
+{
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, window_bits) != Z_OK)
+		return false;
+
+	stream.next_in = const_cast < Bytef* > (compressed_data);
+	stream.avail_in = compressed_size;
+
+	unsigned long num_inflated_bytes = 0;
+	int ret = Z_OK;
+	while (ret == Z_OK)
+	{
+		if (num_inflated_bytes == data.size())
+		{
+			if (data.size() >= max_member_size)
+				break;
+			data.resize(std::min(std::max(data.size() * 2, 4096UL), max_member_size));
+		}
+
+		stream.next_out = &data[num_inflated_bytes];
+		stream.avail_out = data.size() - num_inflated_bytes;
+		ret = inflate(&stream, Z_NO_FLUSH);
+		num_inflated_bytes = data.size() - stream.avail_out;
+
+		if ((ret == Z_BUF_ERROR) && (stream.avail_out != 0)) // truncated input
+			break;
+		else if (ret == Z_BUF_ERROR)
+			ret = Z_OK;
+	}
+
+	inflateEnd(&stream);
+	data.resize(num_inflated_bytes);
+	return ret == Z_STREAM_END;
+}
+
+
+archive_cache::member_data_ptr_t extract_member(archive_cache::archive const &archive_, archive_cache::archive::member const &member_)
+{
+	if ((member_.size > max_member_size) || (member_.compressed_size > max_member_size))
+		return archive_cache::member_data_ptr_t();
+
+	try
+	{
+		boost::shared_ptr < archive_cache::member_data_t > data(new archive_cache::member_data_t);
+		std::vector < uint8_t > compressed_data(member_.compressed_size);
+
+		if (archive_.is_gzip)
+		{
+			if (!read_at(archive_.fd, 0, &compressed_data[0], compressed_data.size()))
+				return archive_cache::member_data_ptr_t();
+
+			// gzip streams carry their own checksum, which inflate() verifies
+			data->reserve(std::min(std::max(member_.size, 1UL), max_member_size));
+			if (!inflate_data(&compressed_data[0], compressed_data.size(), 16 + MAX_WBITS, *data))
+				return archive_cache::member_data_ptr_t();
+			return data;
+		}
+
+		uint8_t local_header[zip_local_header_size];
+		if (!read_at(archive_.fd, member_.offset, local_header, zip_local_header_size) || (read_u32(local_header) != zip_local_header_signature))
+			return archive_cache::member_data_ptr_t();
+
+		long data_offset = member_.offset + zip_local_header_size + read_u16(local_header + 26) + read_u16(local_header + 28);
+		if (!compressed_data.empty() && !read_at(archive_.fd, data_offset, &compressed_data[0], compressed_data.size()))
+			return archive_cache::member_data_ptr_t();
+
+		switch (member_.method)
+		{
+			case zip_method_stored:
+				if (member_.compressed_size != member_.size)
+					return archive_cache::member_data_ptr_t();
+				data->swap(compressed_data);
+				break;
+
+			case zip_method_deflate:
+				data->resize(member_.size);
+				if (!inflate_data(compressed_data.empty() ? 0 : &compressed_data[0], compressed_data.size(), -MAX_WBITS, *data) || (data->size() != member_.size))
+					return archive_cache::member_data_ptr_t();
+				break;
+
+			default:
+				return archive_cache::member_data_ptr_t();
+		}
+
+		uint32_t crc = crc32(0, Z_NULL, 0);
+		if (!data->empty())
+			crc = crc32(crc, &((*data)[0]), data->size());
+		if (crc != member_.crc)
+			return archive_cache::member_data_ptr_t();
+
+		return data;
+	}
+	catch (std::bad_alloc const &)
+	{
+		return archive_cache::member_data_ptr_t();
+	}
+}
+
+
+bool get_archive_file_id(std::string const &archive_path, long &size, long &modification_time)
+{
+	struct stat stat_;
+	if ((stat(archive_path.c_str(), &stat_) != 0) || !S_ISREG(stat_.st_mode))
+		return false;
+
+	size = stat_.st_size;
+	modification_time = stat_.st_mtime;
+	return true;
+}
+
+
+}
+
+
+
+
+bool archive_cache::member_key::operator < (member_key const &other) const
+{
+	if (archive_path != other.archive_path)
+		return archive_path < other.archive_path;
+	else if (member_name != other.member_name)
+		return member_name < other.member_name;
+	else if (archive_size != other.archive_size)
+		return archive_size < other.archive_size;
+	else
+		return archive_modification_time < other.archive_modification_time;
+}
+
+
+archive_cache::archive_cache(unsigned long const max_num_cached_bytes, std::size_t const max_num_open_archives):
+	max_num_cached_bytes(max_num_cached_bytes),
+	max_num_open_archives(std::max(max_num_open_archives, std::size_t(1)))
+{
+}
+
+
+archive_cache::~archive_cache()
+{
+}
+
+
+source_ptr_t archive_cache::create_source(uri const &uri_)
+{
+	uri::options_t::const_iterator member_iter = uri_.get_options().find("archive_member");
+	if (member_iter == uri_.get_options().end())
+		return source_ptr_t();
+
+	member_data_ptr_t data = get_member(uri_.get_path(), member_iter->second);
+	if (!data)
+		return source_ptr_t();
+
+	return source_ptr_t(new memory_source(data, uri_));
+}
+
+
+archive_cache::member_data_ptr_t archive_cache::get_member(std::string const &archive_path, std::string const &member_name)
+{
+	member_key_t key;
+	key.archive_path = archive_path;
+	key.member_name = member_name;
+	if (!get_archive_file_id(archive_path, key.archive_size, key.archive_modification_time))
+		return member_data_ptr_t();
+
+	boost::unique_lock < boost::mutex > lock(mutex);
+
+	cached_member_map_t::iterator cached_iter = cached_member_map.find(key);
+	if (cached_iter != cached_member_map.end())
+	{
+		++stats_.num_member_hits;
+		cached_members.splice(cached_members.begin(), cached_members, cached_iter->second);
+		return cached_iter->second->second;
+	}
+
+	// Another thread is inflating this member already; wait for its result instead of inflating it again
+	pending_members_t::iterator pending_iter = pending_members.find(key);
+	if (pending_iter != pending_members.end())
+	{
+		++stats_.num_member_hits;
+		pending_member_ptr_t pending = pending_iter->second;
+		while (!pending->done)
+			member_extracted.wait(lock);
+		return pending->data;
+	}
+
+	++stats_.num_member_misses;
+
+	archive_ptr_t archive_ = get_archive(archive_path, key.archive_size, key.archive_modification_time);
+	if (!archive_)
+		return member_data_ptr_t();
+
+	archive::members_t::const_iterator member_iter = archive_->members.find(member_name);
+	if (member_iter == archive_->members.end())
+		return member_data_ptr_t();
+
+	// Inflate without holding the lock; the archive (and its file descriptor) stays valid while archive_ refers to it,
+	// even if it is closed in the meantime
+	pending_member_ptr_t pending(new pending_member);
+	pending_members[key] = pending;
+	archive::member member_ = member_iter->second;
+
+	lock.unlock();
+	member_data_ptr_t data = extract_member(*archive_, member_);
+	lock.lock();
+
+	pending_members.erase(key);
+	if (data)
+		cache_member(key, data);
+
+	pending->data = data;
+	pending->done = true;
+	member_extracted.notify_all();
+
+	return data;
+}
+
+
+bool archive_cache::get_member_names(std::string const &archive_path, member_names_t &member_names)
+{
+	long archive_size, archive_modification_time;
+	if (!get_archive_file_id(archive_path, archive_size, archive_modification_time))
+		return false;
+
+	boost::lock_guard < boost::mutex > lock(mutex);
+
+	archive_ptr_t archive_ = get_archive(archive_path, archive_size, archive_modification_time);
+	if (!archive_)
+		return false;
+
+	member_names.clear();
+	member_names.reserve(archive_->members.size());
+	for (archive::members_t::const_iterator iter = archive_->members.begin(); iter != archive_->members.end(); ++iter)
+		member_names.push_back(iter->first);
+
+	return true;
+}
+
+
+archive_cache::stats archive_cache::get_stats() const
+{
+	boost::lock_guard < boost::mutex > lock(mutex);
+	return stats_;
+}
+
+
+archive_cache::archive_ptr_t archive_cache::get_archive(std::string const &archive_path, long const archive_size, long const archive_modification_time)
+{
+	for (open_archives_t::iterator iter = open_archives.begin(); iter != open_archives.end(); ++iter)
+	{
+		if ((*iter)->path != archive_path)
+			continue;
+
+		if (((*iter)->size == archive_size) && ((*iter)->modification_time == archive_modification_time))
+		{
+			open_archives.splice(open_archives.begin(), open_archives, iter);
+			return open_archives.front();
+		}
+
+		// The archive was modified since it was opened; its index is outdated
+		open_archives.erase(iter);
+		break;
+	}
+
+	archive_ptr_t archive_(new archive);
+	archive_->path = archive_path;
+	archive_->fd = open(archive_path.c_str(), O_RDONLY);
+	if (archive_->fd == -1)
+		return archive_ptr_t();
+
+	++stats_.num_archive_opens;
+
+	struct stat stat_;
+	if (fstat(archive_->fd, &stat_) != 0)
+		return archive_ptr_t();
+	archive_->size = stat_.st_size;
+	archive_->modification_time = stat_.st_mtime;
+
+	uint8_t magic[4];
+	if (!read_at(archive_->fd, 0, magic, std::min(archive_->size, 4L)))
+		return archive_ptr_t();
+
+	bool index_read = false;
+	if ((archive_->size >= 2) && (magic[0] == 0x1f) && (magic[1] == 0x8b))
+		index_read = read_gzip_index(*archive_);
+	else if ((archive_->size >= 4) && (magic[0] == 'P') && (magic[1] == 'K'))
+		index_read = read_zip_index(*archive_);
+
+	if (!index_read)
+		return archive_ptr_t();
+
+	open_archives.push_front(archive_);
+	while (open_archives.size() > max_num_open_archives)
+		open_archives.pop_back();
+
+	return archive_;
+}
+
+
+void archive_cache::cache_member(member_key_t const &key, member_data_ptr_t const &data)
+{
+	if (data->size() > max_num_cached_bytes)
+		return;
+
+	cached_members.push_front(cached_member_t(key, data));
+	cached_member_map[key] = cached_members.begin();
+	stats_.num_cached_bytes += data->size();
+
+	while (stats_.num_cached_bytes > max_num_cached_bytes)
+	{
+		cached_member_t const &least_recently_used = cached_members.back();
+		stats_.num_cached_bytes -= least_recently_used.second->size();
+		cached_member_map.erase(least_recently_used.first);
+		cached_members.pop_back();
+	}
+}
+
+
+}
+}
+
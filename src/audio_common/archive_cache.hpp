@@ -0,0 +1,163 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_AUDIO_COMMON_ARCHIVE_CACHE_HPP
+#define ION_AUDIO_COMMON_ARCHIVE_CACHE_HPP
+
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <ion/uri.hpp>
+#include "memory_source.hpp"
+#include "source.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+/**
+* Gives access to the members of zip and gzip archives, without unpacking them to disk.
+* Archive members are addressed by file URIs with an archive_member option, for example:  file://modules.zip?archive_member=songs/foo.mod
+* (gzip files contain one member; its name is the original filename stored in the gzip header, or the archive's filename without the .gz suffix).
+* The index of an archive (the zip central directory) is read once, when the archive is first accessed; the archive stays open afterwards,
+* so scanning all members of an archive opens it only once. A limited number of archives is kept open, the least recently used one is closed first.
+* Members are inflated into memory on demand, and kept in a LRU cache with a configurable maximum total size. Sources for members
+* are memory_source instances. Members are inflated without holding the cache's lock; threads requesting a member that is
+* currently being inflated wait for it instead of inflating it again.
+* Only the "stored" and "deflate" zip compression methods are supported; encrypted members and ZIP64 archives are not.
+* This class is thread safe.
+*/
+class archive_cache:
+	private boost::noncopyable
+{
+public:
+	typedef memory_source::data_t member_data_t;
+	typedef memory_source::data_ptr_t member_data_ptr_t;
+	typedef std::vector < std::string > member_names_t;
+
+	struct stats
+	{
+		unsigned long num_archive_opens, num_member_hits, num_member_misses, num_cached_bytes;
+
+		stats():
+			num_archive_opens(0),
+			num_member_hits(0),
+			num_member_misses(0),
+			num_cached_bytes(0)
+		{
+		}
+	};
+
+
+	explicit archive_cache(unsigned long const max_num_cached_bytes = 64 * 1024 * 1024, std::size_t const max_num_open_archives = 8);
+	~archive_cache();
+
+	/**
+	* Creates a source for the archive member the given URI refers to.
+	* @return the new source, or a null pointer if the URI has no archive_member option, or the member could not be extracted
+	*/
+	source_ptr_t create_source(uri const &uri_);
+
+	/**
+	* Returns the contents of the given member, extracting it if it is not in the cache.
+	* @return the member's data, or a null pointer if the archive or the member could not be read
+	*/
+	member_data_ptr_t get_member(std::string const &archive_path, std::string const &member_name);
+
+	/**
+	* Retrieves the names of all members in the given archive.
+	* @return true if the archive could be read, false otherwise
+	*/
+	bool get_member_names(std::string const &archive_path, member_names_t &member_names);
+
+	stats get_stats() const;
+
+
+	struct archive;
+	typedef boost::shared_ptr < archive > archive_ptr_t;
+
+
+protected:
+	// The archive's size and modification time are part of the key, so members of modified archives are never returned;
+	// their outdated entries just drop out of the cache eventually
+	struct member_key
+	{
+		std::string archive_path, member_name;
+		long archive_size, archive_modification_time;
+
+		bool operator < (member_key const &other) const;
+	};
+
+	typedef member_key member_key_t;
+	typedef std::pair < member_key_t, member_data_ptr_t > cached_member_t;
+	typedef std::list < cached_member_t > cached_members_t; // most recently used member first
+	typedef std::map < member_key_t, cached_members_t::iterator > cached_member_map_t;
+	typedef std::list < archive_ptr_t > open_archives_t; // most recently used archive first
+
+	// Placeholder for a member that is currently being inflated by some thread
+	struct pending_member
+	{
+		bool done;
+		member_data_ptr_t data;
+
+		pending_member(): done(false) {}
+	};
+	typedef boost::shared_ptr < pending_member > pending_member_ptr_t;
+	typedef std::map < member_key_t, pending_member_ptr_t > pending_members_t;
+
+
+	archive_ptr_t get_archive(std::string const &archive_path, long const archive_size, long const archive_modification_time);
+	void cache_member(member_key_t const &key, member_data_ptr_t const &data);
+
+
+	mutable boost::mutex mutex;
+	boost::condition_variable member_extracted;
+	unsigned long const max_num_cached_bytes;
+	std::size_t const max_num_open_archives;
+	open_archives_t open_archives;
+	cached_members_t cached_members;
+	cached_member_map_t cached_member_map;
+	pending_members_t pending_members;
+	stats stats_;
+};
+
+
+}
+}
+
+
+#endif
+
@@ -30,8 +30,8 @@ namespace audio_common
 {
 
 
-audio_frontend::audio_frontend(send_line_to_backend_callback_t const &send_line_to_backend_callback, pong_callback_t const &pong_callback):
-	base_t(send_line_to_backend_callback, pong_callback),
+audio_frontend::audio_frontend(send_to_backend_callback_t const &send_to_backend_callback, pong_callback_t const &pong_callback):
+	base_t(send_to_backend_callback, pong_callback),
 	paused(false),
 	current_position(0)
 {
@@ -45,7 +45,7 @@ void audio_frontend::pause(bool const set)
 
 	paused = set;
 
-	send_line_to_backend_callback(paused ? "pause" : "resume");
+	send_command(paused ? "pause" : "resume");
 }
 
 
@@ -57,20 +57,20 @@ bool audio_frontend::is_paused() const
 
 void audio_frontend::set_current_volume(long const new_volume)
 {
-	send_line_to_backend_callback(recombine_command_line("set_current_volume", boost::assign::list_of(boost::lexical_cast < std::string > (new_volume))));
+	send_command("set_current_volume", boost::assign::list_of(boost::lexical_cast < std::string > (new_volume)));
 }
 
 
 void audio_frontend::set_current_position(unsigned int const new_position)
 {
 	current_position = new_position;
-	send_line_to_backend_callback(recombine_command_line("set_current_position", boost::assign::list_of(boost::lexical_cast < std::string > (new_position))));
+	send_command("set_current_position", boost::assign::list_of(boost::lexical_cast < std::string > (new_position)));
 }
 
 
 void audio_frontend::issue_get_position_command()
 {
-	send_line_to_backend_callback("get_current_position");
+	send_command("get_current_position");
 }
 
 
@@ -94,7 +94,7 @@ void audio_frontend::stop()
 
 void audio_frontend::update_module_entries()
 {
-	send_line_to_backend_callback("get_modules");
+	send_command("get_modules");
 }
 
 
@@ -150,7 +150,7 @@ void audio_frontend::parse_modules_list(params_t const &event_params)
 			{
 				id = param;			
 				module_entries.push_back(module_entry(type, id));
-				send_line_to_backend_callback(recombine_command_line("get_module_ui", boost::assign::list_of(id)));
+				send_command("get_module_ui", boost::assign::list_of(id));
 			}
 			first_from_pair = true;
 		}
@@ -175,7 +175,7 @@ void audio_frontend::update_module_properties(std::string const &module_id, Json
 	module_entries_by_id.replace(iter, entry);
 
 	std::string json_string = Json::FastWriter().write(ui_properties);
-	send_line_to_backend_callback(recombine_command_line("set_module_properties", boost::assign::list_of(module_id)(json_string)));
+	send_command("set_module_properties", boost::assign::list_of(module_id)(json_string));
 }
 
 
@@ -183,7 +183,7 @@ void audio_frontend::set_loop_mode(uri const &uri_, int const loop_mode)
 {
 	metadata_t loopmode_metadata = empty_metadata();
 	set_metadata_value(loopmode_metadata, "loop_mode", loop_mode);
-	send_line_to_backend_callback(recombine_command_line("update_metadata", boost::assign::list_of(uri_.get_full())(get_metadata_string(loopmode_metadata))));
+	send_command("update_metadata", boost::assign::list_of(uri_.get_full())(get_metadata_string(loopmode_metadata, channel.get_metadata_encoding())));
 }
 
 
@@ -60,6 +60,12 @@ public:
 	{
 		return module_ui("<html><head></head><body>No user interface for this module available.</body></html>", Json::Value(Json::objectValue));
 	}
+
+	// Run-time statistics of the module (for example, cache hit and miss counts), as a JSON object. Modules without statistics return an empty object.
+	virtual Json::Value get_statistics() const
+	{
+		return Json::Value(Json::objectValue);
+	}
 };
 
 
@@ -0,0 +1,216 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <new>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include "content_cache.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+namespace
+{
+
+
+content_cache::content_ptr_t read_file(std::string const &path, unsigned long const size)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return content_cache::content_ptr_t();
+
+	boost::shared_ptr < memory_source::data_t > content;
+	try
+	{
+		content = boost::shared_ptr < memory_source::data_t > (new memory_source::data_t(size));
+	}
+	catch (std::bad_alloc const &)
+	{
+		close(fd);
+		return content_cache::content_ptr_t();
+	}
+
+	unsigned long num_read_bytes = 0;
+	while (num_read_bytes < size)
+	{
+		ssize_t ret = ::read(fd, &((*content)[num_read_bytes]), size - num_read_bytes);
+		if ((ret < 0) && (errno == EINTR))
+			continue;
+		else if (ret <= 0)
+			break;
+		num_read_bytes += ret;
+	}
+
+	close(fd);
+
+	// A short read means the file was truncated in the meantime
+	if (num_read_bytes != size)
+		return content_cache::content_ptr_t();
+
+	return content;
+}
+
+
+}
+
+
+
+
+bool content_cache::file_id::operator == (file_id const &other) const
+{
+	return (size == other.size) && (modification_time == other.modification_time) && (inode == other.inode);
+}
+
+
+content_cache::content_cache(unsigned long const max_num_cached_bytes, unsigned long const max_entry_size):
+	max_num_cached_bytes(max_num_cached_bytes),
+	max_entry_size(std::min(max_entry_size, max_num_cached_bytes))
+{
+}
+
+
+content_cache::content_ptr_t content_cache::get(std::string const &path)
+{
+	file_id id;
+	content_ptr_t content;
+	if (!find(path, id, content) || content)
+		return content;
+
+	// Read the file without holding the lock, so other threads are not blocked by the I/O
+	content = read_file(path, id.size);
+	if (!content)
+		return content_ptr_t();
+
+	boost::lock_guard < boost::mutex > lock(mutex);
+
+	// Another thread may have read the same file in the meantime
+	entries_t::iterator iter = entries.find(path);
+	if (iter != entries.end())
+		erase(iter);
+
+	lru_list.push_front(path);
+	entry &new_entry = entries[path];
+	new_entry.id = id;
+	new_entry.content = content;
+	new_entry.lru_iterator = lru_list.begin();
+	++stats_.num_entries;
+	stats_.num_cached_bytes += content->size();
+
+	while (stats_.num_cached_bytes > max_num_cached_bytes)
+		erase(entries.find(lru_list.back()));
+
+	return content;
+}
+
+
+content_cache::content_ptr_t content_cache::lookup(std::string const &path)
+{
+	file_id id;
+	content_ptr_t content;
+	find(path, id, content);
+	return content;
+}
+
+
+void content_cache::clear()
+{
+	boost::lock_guard < boost::mutex > lock(mutex);
+
+	entries.clear();
+	lru_list.clear();
+	stats_.num_entries = 0;
+	stats_.num_cached_bytes = 0;
+}
+
+
+content_cache::stats content_cache::get_stats() const
+{
+	boost::lock_guard < boost::mutex > lock(mutex);
+	return stats_;
+}
+
+
+bool content_cache::find(std::string const &path, file_id &id, content_ptr_t &content)
+{
+	if (!get_file_id(path, id) || (id.size <= 0) || ((unsigned long)(id.size) > max_entry_size))
+		return false;
+
+	boost::lock_guard < boost::mutex > lock(mutex);
+
+	entries_t::iterator iter = entries.find(path);
+	if (iter != entries.end())
+	{
+		if (iter->second.id == id)
+		{
+			++stats_.num_hits;
+			lru_list.splice(lru_list.begin(), lru_list, iter->second.lru_iterator);
+			content = iter->second.content;
+			return true;
+		}
+		else
+			erase(iter);
+	}
+
+	++stats_.num_misses;
+	return true;
+}
+
+
+bool content_cache::get_file_id(std::string const &path, file_id &id)
+{
+	struct stat stat_;
+	if ((stat(path.c_str(), &stat_) != 0) || !S_ISREG(stat_.st_mode))
+		return false;
+
+	id.size = stat_.st_size;
+	id.modification_time = stat_.st_mtime;
+	id.inode = stat_.st_ino;
+	return true;
+}
+
+
+void content_cache::erase(entries_t::iterator const &iter)
+{
+	stats_.num_cached_bytes -= iter->second.content->size();
+	--stats_.num_entries;
+	lru_list.erase(iter->second.lru_iterator);
+	entries.erase(iter);
+}
+
+
+}
+}
+
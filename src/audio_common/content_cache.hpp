@@ -0,0 +1,133 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_AUDIO_COMMON_CONTENT_CACHE_HPP
+#define ION_AUDIO_COMMON_CONTENT_CACHE_HPP
+
+#include <list>
+#include <map>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "memory_source.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+/**
+* Keeps the contents of recently played files in memory, so that playing a file again (or creating a temporary decoder
+* for it, for example to update its metadata) does not read it from disk again (see file_source_creator).
+* Only get() reads files into the cache; lookup() only returns contents that are already cached, and is meant for
+* accesses that do not justify reading the whole file, like probing and metadata scans, which only look at a few headers.
+* Entries are keyed by path, and are only valid as long as the file's size, modification time and inode stay the same.
+* The total size of the cached contents is limited; the least recently used entries are dropped first. Files larger
+* than the maximum entry size are not cached at all.
+* This class is thread safe.
+*/
+class content_cache:
+	private boost::noncopyable
+{
+public:
+	typedef memory_source::data_ptr_t content_ptr_t;
+
+	struct stats
+	{
+		unsigned long num_hits, num_misses, num_entries, num_cached_bytes;
+
+		stats():
+			num_hits(0),
+			num_misses(0),
+			num_entries(0),
+			num_cached_bytes(0)
+		{
+		}
+	};
+
+
+	explicit content_cache(unsigned long const max_num_cached_bytes = 64 * 1024 * 1024, unsigned long const max_entry_size = 8 * 1024 * 1024);
+
+	/**
+	* Returns the contents of the given file, reading the file if its contents are not cached (or outdated).
+	* @return the file's contents, or a null pointer if the file is not a regular file, is larger than the maximum entry size, or could not be read
+	*/
+	content_ptr_t get(std::string const &path);
+	/**
+	* Returns the contents of the given file if they are cached and up to date. The file is never read.
+	* @return the file's contents, or a null pointer if they are not cached
+	*/
+	content_ptr_t lookup(std::string const &path);
+
+	void clear();
+
+	unsigned long get_max_entry_size() const { return max_entry_size; }
+	stats get_stats() const;
+
+
+protected:
+	struct file_id
+	{
+		long size, modification_time;
+		unsigned long inode;
+
+		bool operator == (file_id const &other) const;
+	};
+
+	typedef std::list < std::string > lru_list_t; // most recently used path first
+
+	struct entry
+	{
+		file_id id;
+		content_ptr_t content;
+		lru_list_t::iterator lru_iterator;
+	};
+
+	typedef std::map < std::string, entry > entries_t;
+
+
+	// Returns false if the file cannot be cached at all; otherwise, content is set to the cached contents if there are any
+	bool find(std::string const &path, file_id &id, content_ptr_t &content);
+	static bool get_file_id(std::string const &path, file_id &id);
+	void erase(entries_t::iterator const &iter);
+
+
+	mutable boost::mutex mutex;
+	unsigned long const max_num_cached_bytes, max_entry_size;
+	entries_t entries;
+	lru_list_t lru_list;
+	stats stats_;
+};
+
+
+}
+}
+
+
+#endif
+
@@ -135,6 +135,19 @@ public:
 	{
 	}
 
+	/**
+	* Gets the metadata of all sub-resources this resource contains, in one call. Formats with many sub-resources (for example game music files
+	* with dozens of tracks) can implement this to deliver the metadata of all tracks from one single load, instead of requiring one decoder
+	* construction per sub-resource when scanning. Each array entry must contain the metadata get_metadata() would return for the corresponding
+	* sub-resource, plus the "sub_resource_index" value identifying it; "num_ticks" and "num_ticks_per_second" should be included if known.
+	* Default implementation returns an empty array, meaning that sub-resources have to be scanned individually.
+	* @return JSON array with one metadata object per sub-resource, or an empty array if this is not supported
+	*/
+	virtual metadata_t get_sub_resources_metadata() const
+	{
+		return metadata_t(Json::arrayValue);
+	}
+
 	/**
 	* Gets the type of this decoder. This is used for an RTTI like functionality.
 	* @return The type of this decoder, as a string (this type does not have to equal the C++ type name, an unambigous type identification is enough)
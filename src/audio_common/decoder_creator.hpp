@@ -28,6 +28,7 @@ freely, subject to the following restrictions:
 #define ION_AUDIO_COMMON_DECODER_CREATOR_HPP
 
 #include <string>
+#include <stdint.h>
 #include <ion/uri.hpp>
 #include <ion/metadata.hpp>
 #include "send_event_callback.hpp"
@@ -46,6 +47,25 @@ class decoder_creator:
 	public component_creator
 {
 public:
+	enum probe_score
+	{
+		probe_score_no_match = 0, // the resource certainly cannot be played by this decoder
+		probe_score_unknown = 1,  // no signature check available; decoder has to be tried
+		probe_score_match = 2     // the signature matches
+	};
+
+
+	/**
+	* Cheap format check performed before any decoder is constructed.
+	* header contains the first header_size bytes of the resource (fewer than usual if the resource is small).
+	* The backend tries creators in descending score order, and skips creators that return probe_score_no_match.
+	* The default implementation returns probe_score_unknown.
+	*/
+	virtual int probe(uint8_t const * /*header*/, unsigned long const /*header_size*/, uri const &/*uri_*/) const
+	{
+		return probe_score_unknown;
+	}
+
 	virtual decoder_ptr_t create(source_ptr_t source_, metadata_t const &metadata, send_event_callback_t const &send_event_callback) = 0;
 };
 
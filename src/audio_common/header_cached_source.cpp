@@ -0,0 +1,232 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <algorithm>
+#include <cstring>
+#include "header_cached_source.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+header_cached_source::header_cached_source(source_ptr_t const &wrapped_source, unsigned long const max_header_size):
+	wrapped_source(wrapped_source),
+	position(0),
+	wrapped_position(0),
+	size(wrapped_source->get_size()),
+	end_of_data(false),
+	pass_through(false)
+{
+	// Do not read past the end if the size is known; sources such as file_source would enter the end-of-data state
+	// otherwise, and could not be repositioned without reopening them
+	long header_size = max_header_size;
+	if (size >= 0)
+		header_size = std::min(header_size, size);
+
+	header.resize(header_size);
+	long num_read_bytes = (header_size > 0) ? wrapped_source->read(&header[0], header_size) : 0;
+	header.resize(std::max(num_read_bytes, 0L));
+	wrapped_position = header.size();
+}
+
+
+void header_cached_source::reset()
+{
+	// The header cannot be served from memory anymore if the wrapped source moved past it and cannot be repositioned
+	if (!pass_through && (wrapped_position != long(header.size())) && !wrapped_source->can_seek(seek_absolute))
+		pass_through = true;
+
+	if (pass_through)
+	{
+		wrapped_source->reset();
+		return;
+	}
+
+	position = 0;
+	end_of_data = false;
+}
+
+
+long header_cached_source::read(void *dest, long const num_bytes)
+{
+	if (pass_through)
+		return wrapped_source->read(dest, num_bytes);
+
+	if (end_of_data || (num_bytes <= 0))
+		return 0;
+
+	uint8_t *dest_bytes = reinterpret_cast < uint8_t* > (dest);
+	long num_read_bytes = 0;
+
+	// serve what is possible from the cached header
+	if (position < long(header.size()))
+	{
+		num_read_bytes = std::min(num_bytes, long(header.size()) - position);
+		std::memcpy(dest_bytes, &header[position], num_read_bytes);
+		position += num_read_bytes;
+	}
+
+	if (num_read_bytes == num_bytes)
+		return num_read_bytes;
+
+	// the rest comes from the wrapped source
+	if ((size >= 0) && (position >= size))
+	{
+		end_of_data = true;
+		return num_read_bytes;
+	}
+
+	if (wrapped_source->end_of_data_reached() || !wrapped_source->is_ok())
+	{
+		wrapped_source->reset();
+		wrapped_position = 0;
+	}
+
+	if (wrapped_position != position)
+	{
+		wrapped_source->seek(position, seek_absolute);
+		wrapped_position = wrapped_source->get_position();
+		if (wrapped_position != position)
+		{
+			end_of_data = true;
+			return num_read_bytes;
+		}
+	}
+
+	long num_bytes_left = num_bytes - num_read_bytes;
+	long num_wrapped_read_bytes = wrapped_source->can_read() ? wrapped_source->read(dest_bytes + num_read_bytes, num_bytes_left) : 0;
+	num_wrapped_read_bytes = std::max(num_wrapped_read_bytes, 0L);
+
+	position += num_wrapped_read_bytes;
+	wrapped_position += num_wrapped_read_bytes;
+	num_read_bytes += num_wrapped_read_bytes;
+
+	if (num_wrapped_read_bytes < num_bytes_left)
+		end_of_data = true;
+
+	return num_read_bytes;
+}
+
+
+bool header_cached_source::can_read() const
+{
+	if (pass_through)
+		return wrapped_source->can_read();
+	else if (end_of_data)
+		return false;
+	else if (position < long(header.size()))
+		return true;
+	else if (size >= 0)
+		return position < size;
+	else
+		return wrapped_source->can_read() || (wrapped_position != position);
+}
+
+
+bool header_cached_source::end_of_data_reached() const
+{
+	return pass_through ? wrapped_source->end_of_data_reached() : end_of_data;
+}
+
+
+bool header_cached_source::is_ok() const
+{
+	if (pass_through)
+		return wrapped_source->is_ok();
+	else
+		return wrapped_source->is_ok() || wrapped_source->end_of_data_reached();
+}
+
+
+void header_cached_source::seek(long const new_position, seek_type const type)
+{
+	if (pass_through)
+	{
+		wrapped_source->seek(new_position, type);
+		return;
+	}
+
+	long base = 0;
+
+	switch (type)
+	{
+		case seek_absolute: base = 0; break;
+		case seek_relative: base = position; break;
+		case seek_from_end:
+			if (size < 0)
+				return;
+			base = size;
+			break;
+		default:
+			return;
+	}
+
+	if (!wrapped_source->can_seek(seek_absolute))
+		return;
+
+	position = std::max(base + new_position, 0L);
+	if (size >= 0)
+		position = std::min(position, size);
+	end_of_data = false;
+}
+
+
+bool header_cached_source::can_seek(seek_type const type) const
+{
+	return wrapped_source->can_seek(seek_absolute) && ((type != seek_from_end) || (size >= 0));
+}
+
+
+long header_cached_source::get_position() const
+{
+	return pass_through ? wrapped_source->get_position() : position;
+}
+
+
+long header_cached_source::get_size() const
+{
+	return pass_through ? wrapped_source->get_size() : size;
+}
+
+
+uri header_cached_source::get_uri() const
+{
+	return wrapped_source->get_uri();
+}
+
+
+void const * header_cached_source::get_contiguous_view(long const offset, long const num_bytes)
+{
+	return wrapped_source->get_contiguous_view(offset, num_bytes);
+}
+
+
+}
+}
+
@@ -0,0 +1,90 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_AUDIO_COMMON_HEADER_CACHED_SOURCE_HPP
+#define ION_AUDIO_COMMON_HEADER_CACHED_SOURCE_HPP
+
+#include <stdint.h>
+#include <vector>
+#include "source.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+/**
+* Source wrapper that reads the first bytes of another source once, and keeps them in memory.
+* This is meant for format probing: the cached header can be inspected directly (see get_header()), and decoders
+* that read the beginning of the resource again (or call reset()) are served from memory instead of from the
+* wrapped source. In particular, reset() does not reset the wrapped source unless the wrapped source reached its
+* end or failed, so trying several decoders does not reopen the resource each time.
+* Seeking is lazy; the wrapped source is only repositioned when data beyond the header is read.
+* If the wrapped source cannot seek (live streams for example), the data after the header cannot be read again once it
+* has been read. Resetting after that resets the wrapped source as well, and from then on, all calls are passed through
+* to it directly; get_header() still returns the header read initially.
+*/
+class header_cached_source:
+	public source
+{
+public:
+	typedef std::vector < uint8_t > header_t;
+
+
+	explicit header_cached_source(source_ptr_t const &wrapped_source, unsigned long const max_header_size);
+
+	header_t const & get_header() const { return header; }
+	source_ptr_t get_wrapped_source() const { return wrapped_source; }
+
+	virtual void reset();
+	virtual long read(void *dest, long const num_bytes);
+	virtual bool can_read() const;
+	virtual bool end_of_data_reached() const;
+	virtual bool is_ok() const;
+	virtual void seek(long const new_position, seek_type const type);
+	virtual bool can_seek(seek_type const type) const;
+	virtual long get_position() const;
+	virtual long get_size() const;
+	virtual uri get_uri() const;
+	virtual void const * get_contiguous_view(long const offset, long const num_bytes);
+
+
+protected:
+	source_ptr_t wrapped_source;
+	header_t header;
+	long position, wrapped_position, size;
+	bool end_of_data, pass_through;
+};
+
+
+}
+}
+
+
+#endif
+
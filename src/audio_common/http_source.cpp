@@ -0,0 +1,604 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <boost/lexical_cast.hpp>
+#include <ion/metadata.hpp>
+#include "http_source.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+namespace
+{
+
+
+std::size_t const max_response_header_size = 16384;
+
+
+std::string to_lower(std::string str)
+{
+	for (std::string::iterator iter = str.begin(); iter != str.end(); ++iter)
+		*iter = std::tolower(*iter);
+	return str;
+}
+
+
+std::string trim(std::string const &str)
+{
+	std::string::size_type begin = str.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos)
+		return "";
+	std::string::size_type end = str.find_last_not_of(" \t\r\n");
+	return str.substr(begin, end - begin + 1);
+}
+
+
+// Splits  host[:port]/path  (with IPv6 addresses enclosed in brackets) into its parts
+bool split_http_location(std::string const &location, std::string &host, std::string &port, std::string &path)
+{
+	std::string::size_type path_pos = location.find('/');
+	std::string authority = location.substr(0, path_pos);
+	path = (path_pos == std::string::npos) ? std::string("/") : location.substr(path_pos);
+	port = "80";
+
+	std::string::size_type port_pos = authority.find_last_of(':');
+	std::string::size_type bracket_pos = authority.find_last_of(']');
+	if ((port_pos != std::string::npos) && ((bracket_pos == std::string::npos) || (port_pos > bracket_pos)))
+	{
+		port = authority.substr(port_pos + 1);
+		authority.erase(port_pos);
+	}
+
+	if ((authority.length() >= 2) && (authority[0] == '[') && (authority[authority.length() - 1] == ']'))
+		authority = authority.substr(1, authority.length() - 2);
+
+	host = authority;
+	return !host.empty() && !port.empty();
+}
+
+
+void set_socket_timeouts(int const socket_fd)
+{
+	struct timeval timeout;
+	timeout.tv_sec = http_source::io_timeout;
+	timeout.tv_usec = 0;
+	setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(socket_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)); // also applies to connect()
+}
+
+
+}
+
+
+
+
+http_source::http_source(uri const &uri_, send_event_callback_t const &send_event_callback):
+	uri_(uri_),
+	send_event_callback(send_event_callback),
+	socket_fd(-1),
+	received_data_offset(0),
+	position(0),
+	size(-1),
+	seekable(false),
+	end_of_data(false),
+	ok(false),
+	icy_metadata_interval(0),
+	num_bytes_until_icy_metadata(0)
+{
+	if (!split_http_location(uri_.get_path(), host, port, path))
+		return;
+
+	// The URI options are the query string of the HTTP URL
+	for (uri::options_t::const_iterator iter = uri_.get_options().begin(); iter != uri_.get_options().end(); ++iter)
+		path += ((iter == uri_.get_options().begin()) ? "?" : "&") + iter->first + "=" + iter->second;
+
+	ok = connect(0);
+}
+
+
+http_source::~http_source()
+{
+	disconnect();
+}
+
+
+void http_source::reset()
+{
+	disconnect();
+	position = 0;
+	end_of_data = false;
+	ok = true;
+}
+
+
+long http_source::read(void *dest, long const num_bytes)
+{
+	if (end_of_data || !ok || (num_bytes <= 0))
+		return 0;
+
+	if ((size >= 0) && (position >= size))
+	{
+		end_of_data = true;
+		return 0;
+	}
+
+	if ((socket_fd == -1) && !connect(position))
+	{
+		ok = false;
+		return 0;
+	}
+
+	uint8_t *dest_bytes = reinterpret_cast < uint8_t* > (dest);
+	long num_read_bytes = 0;
+
+	while (num_read_bytes == 0)
+	{
+		if ((icy_metadata_interval > 0) && (num_bytes_until_icy_metadata == 0))
+		{
+			if (!read_icy_metadata())
+			{
+				end_of_data = true;
+				break;
+			}
+			continue;
+		}
+
+		long num_bytes_to_read = num_bytes;
+		if (icy_metadata_interval > 0)
+			num_bytes_to_read = std::min(num_bytes_to_read, long(num_bytes_until_icy_metadata));
+
+		long ret = receive(dest_bytes, num_bytes_to_read);
+		if (ret == 0)
+		{
+			end_of_data = true;
+			break;
+		}
+		else if (ret < 0)
+		{
+			ok = false;
+			break;
+		}
+
+		num_read_bytes = ret;
+		position += ret;
+		if (icy_metadata_interval > 0)
+			num_bytes_until_icy_metadata -= ret;
+	}
+
+	if ((size >= 0) && (position >= size))
+		end_of_data = true;
+
+	return num_read_bytes;
+}
+
+
+bool http_source::can_read() const
+{
+	return !end_of_data && ok;
+}
+
+
+bool http_source::end_of_data_reached() const
+{
+	return end_of_data;
+}
+
+
+bool http_source::is_ok() const
+{
+	return ok;
+}
+
+
+void http_source::seek(long const new_position, seek_type const type)
+{
+	if (!seekable)
+		return;
+
+	long target = 0;
+	switch (type)
+	{
+		case seek_absolute: target = new_position; break;
+		case seek_relative: target = position + new_position; break;
+		case seek_from_end: target = size + new_position; break;
+		default: return;
+	}
+
+	target = std::max(0L, std::min(target, size));
+	if (target == position)
+		return;
+
+	// The next read() requests the data starting at the new position
+	disconnect();
+	position = target;
+	end_of_data = false;
+}
+
+
+bool http_source::can_seek(seek_type const) const
+{
+	return seekable;
+}
+
+
+long http_source::get_position() const
+{
+	return position;
+}
+
+
+long http_source::get_size() const
+{
+	return size;
+}
+
+
+uri http_source::get_uri() const
+{
+	return uri_;
+}
+
+
+bool http_source::may_block() const
+{
+	return true;
+}
+
+
+bool http_source::connect(long const start_position)
+{
+	for (int num_redirects = 0; num_redirects <= max_num_redirects; ++num_redirects)
+	{
+		response response_;
+		if (!send_request(host, port, path, start_position, response_))
+		{
+			disconnect();
+			return false;
+		}
+
+		switch (response_.status)
+		{
+			case 301: case 302: case 303: case 307: case 308:
+			{
+				disconnect();
+
+				// Redirects are followed as long as they stay with HTTP; the new location is also used for subsequent requests
+				std::string const http_prefix = "http://";
+				if (response_.location.compare(0, http_prefix.length(), http_prefix) == 0)
+				{
+					if (!split_http_location(response_.location.substr(http_prefix.length()), host, port, path))
+						return false;
+				}
+				else if (!response_.location.empty() && (response_.location[0] == '/'))
+					path = response_.location;
+				else
+					return false;
+
+				continue;
+			}
+
+			case 200:
+			case 206:
+				break;
+
+			default:
+				disconnect();
+				return false;
+		}
+
+		if (start_position == 0)
+		{
+			if (response_.status == 206)
+				size = response_.total_size;
+			else
+				size = response_.content_length;
+
+			icy_metadata_interval = response_.icy_metadata_interval;
+			num_bytes_until_icy_metadata = icy_metadata_interval;
+			seekable = response_.accepts_ranges && (size >= 0) && (icy_metadata_interval == 0);
+		}
+		else if ((response_.status != 206) || (response_.range_start != start_position))
+		{
+			disconnect();
+			return false;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+
+bool http_source::send_request(std::string const &host, std::string const &port, std::string const &path, long const start_position, response &response_)
+{
+	disconnect();
+
+	struct addrinfo hints, *addresses = 0;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+		return false;
+
+	for (struct addrinfo *address = addresses; address != 0; address = address->ai_next)
+	{
+		socket_fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (socket_fd == -1)
+			continue;
+
+		set_socket_timeouts(socket_fd);
+		if (::connect(socket_fd, address->ai_addr, address->ai_addrlen) == 0)
+			break;
+
+		close(socket_fd);
+		socket_fd = -1;
+	}
+
+	freeaddrinfo(addresses);
+	if (socket_fd == -1)
+		return false;
+
+	// HTTP/1.0 is used, so servers do not use chunked transfer encoding
+	std::string request =
+		"GET " + path + " HTTP/1.0\r\n"
+		"Host: " + ((host.find(':') != std::string::npos) ? ("[" + host + "]") : host) + ((port != "80") ? (":" + port) : std::string()) + "\r\n"
+		"User-Agent: ion_player\r\n"
+		"Icy-MetaData: 1\r\n"
+		"Connection: close\r\n";
+	if (start_position > 0)
+		request += "Range: bytes=" + boost::lexical_cast < std::string > (start_position) + "-\r\n";
+	request += "\r\n";
+
+	std::size_t num_sent_bytes = 0;
+	while (num_sent_bytes < request.length())
+	{
+		ssize_t ret = send(socket_fd, request.c_str() + num_sent_bytes, request.length() - num_sent_bytes, MSG_NOSIGNAL);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		num_sent_bytes += ret;
+	}
+
+	return receive_response_header(response_);
+}
+
+
+bool http_source::receive_response_header(response &response_)
+{
+	response_.status = 0;
+	response_.content_length = -1;
+	response_.range_start = 0;
+	response_.total_size = -1;
+	response_.accepts_ranges = false;
+	response_.icy_metadata_interval = 0;
+	response_.location = "";
+
+	std::string header;
+	std::string::size_type header_end = std::string::npos;
+	char buffer[4096];
+
+	while (header_end == std::string::npos)
+	{
+		if (header.length() > max_response_header_size)
+			return false;
+
+		ssize_t ret = recv(socket_fd, buffer, sizeof(buffer), 0);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		else if (ret == 0)
+			return false;
+
+		header.append(buffer, ret);
+		header_end = header.find("\r\n\r\n");
+	}
+
+	// Whatever was received after the header belongs to the body
+	received_data.assign(header.begin() + header_end + 4, header.end());
+	received_data_offset = 0;
+	header.erase(header_end);
+
+	std::string::size_type line_begin = 0;
+	bool first_line = true;
+	while (line_begin < header.length())
+	{
+		std::string::size_type line_end = header.find("\r\n", line_begin);
+		if (line_end == std::string::npos)
+			line_end = header.length();
+		std::string line = header.substr(line_begin, line_end - line_begin);
+		line_begin = line_end + 2;
+
+		if (first_line)
+		{
+			// Status line; SHOUTcast servers reply with "ICY 200 OK" instead of "HTTP/1.x 200 OK"
+			first_line = false;
+			std::string::size_type space_pos = line.find(' ');
+			if ((space_pos == std::string::npos) || ((line.compare(0, 5, "HTTP/") != 0) && (line.compare(0, 4, "ICY ") != 0)))
+				return false;
+			response_.status = std::atoi(line.c_str() + space_pos + 1);
+			continue;
+		}
+
+		std::string::size_type colon_pos = line.find(':');
+		if (colon_pos == std::string::npos)
+			continue;
+
+		std::string name = to_lower(trim(line.substr(0, colon_pos)));
+		std::string value = trim(line.substr(colon_pos + 1));
+
+		if (name == "content-length")
+			response_.content_length = std::atol(value.c_str());
+		else if (name == "accept-ranges")
+			response_.accepts_ranges = (to_lower(value) == "bytes");
+		else if (name == "content-range")
+		{
+			// bytes <first>-<last>/<total>
+			std::string::size_type dash_pos = value.find('-'), slash_pos = value.find('/');
+			std::string::size_type number_pos = value.find_first_of("0123456789");
+			if ((number_pos != std::string::npos) && (dash_pos != std::string::npos))
+				response_.range_start = std::atol(value.c_str() + number_pos);
+			if ((slash_pos != std::string::npos) && (value[slash_pos + 1] != '*'))
+				response_.total_size = std::atol(value.c_str() + slash_pos + 1);
+
+			// A server that answers a range request supports range requests
+			response_.accepts_ranges = true;
+		}
+		else if (name == "location")
+			response_.location = value;
+		else if (name == "icy-metaint")
+			response_.icy_metadata_interval = std::strtoul(value.c_str(), 0, 10);
+	}
+
+	return response_.status != 0;
+}
+
+
+void http_source::disconnect()
+{
+	if (socket_fd != -1)
+	{
+		close(socket_fd);
+		socket_fd = -1;
+	}
+
+	received_data.clear();
+	received_data_offset = 0;
+}
+
+
+long http_source::receive(uint8_t *dest, long const num_bytes)
+{
+	if (received_data_offset < received_data.size())
+	{
+		long num_bytes_to_copy = std::min(num_bytes, long(received_data.size() - received_data_offset));
+		std::memcpy(dest, &received_data[received_data_offset], num_bytes_to_copy);
+		received_data_offset += num_bytes_to_copy;
+		return num_bytes_to_copy;
+	}
+
+	while (true)
+	{
+		ssize_t ret = recv(socket_fd, dest, num_bytes, 0);
+		if ((ret < 0) && (errno == EINTR))
+			continue;
+		return ret;
+	}
+}
+
+
+bool http_source::receive_all(uint8_t *dest, long const num_bytes)
+{
+	long num_received_bytes = 0;
+	while (num_received_bytes < num_bytes)
+	{
+		long ret = receive(dest + num_received_bytes, num_bytes - num_received_bytes);
+		if (ret <= 0)
+			return false;
+		num_received_bytes += ret;
+	}
+	return true;
+}
+
+
+bool http_source::read_icy_metadata()
+{
+	// The metadata block is prefixed with its length, in units of 16 bytes; most blocks are empty
+	uint8_t length;
+	if (!receive_all(&length, 1))
+		return false;
+
+	std::vector < char > metadata_block(long(length) * 16 + 1, 0);
+	if ((length > 0) && !receive_all(reinterpret_cast < uint8_t* > (&metadata_block[0]), long(length) * 16))
+		return false;
+
+	num_bytes_until_icy_metadata = icy_metadata_interval;
+
+	// The block looks like this:  StreamTitle='<title>';StreamUrl='<url>';  (padded with null bytes)
+	std::string metadata(&metadata_block[0]);
+	std::string const title_prefix = "StreamTitle='";
+	std::string::size_type title_begin = metadata.find(title_prefix);
+	if (title_begin == std::string::npos)
+		return true;
+	title_begin += title_prefix.length();
+
+	std::string::size_type title_end = metadata.find("';", title_begin);
+	std::string title = metadata.substr(title_begin, (title_end == std::string::npos) ? std::string::npos : (title_end - title_begin));
+	if (title == stream_title)
+		return true;
+
+	stream_title = title;
+
+	if (send_event_callback)
+	{
+		metadata_t new_metadata = empty_metadata();
+		set_metadata_value(new_metadata, "title", stream_title);
+
+		params_t event_params;
+		event_params.push_back(uri_.get_full());
+		event_params.push_back(get_metadata_string(new_metadata));
+		send_event_callback("metadata", event_params);
+	}
+
+	return true;
+}
+
+
+
+
+source_ptr_t http_source_creator::create(ion::uri const &uri_, send_event_callback_t const &send_event_callback)
+{
+	source_ptr_t new_source(new http_source(uri_, send_event_callback));
+	if (new_source->is_ok())
+		return new_source;
+	else
+		return source_ptr_t();
+}
+
+
+}
+}
+
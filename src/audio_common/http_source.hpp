@@ -0,0 +1,131 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_AUDIO_COMMON_HTTP_SOURCE_HPP
+#define ION_AUDIO_COMMON_HTTP_SOURCE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <ion/uri.hpp>
+#include "send_event_callback.hpp"
+#include "source.hpp"
+#include "source_creator.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+/**
+* Source for resources that are downloaded via HTTP. URIs look like  http://host[:port]/path ; the URI options are sent as the query string.
+* Two kinds of resources are handled:
+* - Regular files (progressive download). If the server supports range requests, seeking is possible; a seek closes the connection,
+*   and the next read() requests the data starting at the new position.
+* - Icecast/SHOUTcast live streams. These have no size, and cannot be seeked. The stream metadata that is interleaved with the audio data
+*   (ICY metadata) is removed from the data; whenever the stream title changes, a metadata event with the new title is sent.
+* read() returns as soon as some data was received, which may be less than requested; end-of-data is only reported once the server closed
+* the connection. Network I/O may block for a long time, so this source reports may_block() == true (the backend then wraps it in a
+* read_ahead_source, whose buffer also serves as the jitter buffer for live streams). Socket operations time out after io_timeout seconds,
+* after which the source is no longer OK.
+* HTTPS is not supported.
+*/
+class http_source:
+	public source
+{
+public:
+	enum { io_timeout = 30, max_num_redirects = 5 };
+
+
+	explicit http_source(uri const &uri_, send_event_callback_t const &send_event_callback = send_event_callback_t());
+	~http_source();
+
+	bool is_live_stream() const { return icy_metadata_interval > 0; }
+	std::string const & get_stream_title() const { return stream_title; }
+
+	virtual void reset();
+	virtual long read(void *dest, long const num_bytes);
+	virtual bool can_read() const;
+	virtual bool end_of_data_reached() const;
+	virtual bool is_ok() const;
+	virtual void seek(long const new_position, seek_type const type);
+	virtual bool can_seek(seek_type const type) const;
+	virtual long get_position() const;
+	virtual long get_size() const;
+	virtual uri get_uri() const;
+	virtual bool may_block() const;
+
+
+protected:
+	struct response
+	{
+		int status;
+		long content_length, range_start, total_size;
+		bool accepts_ranges;
+		unsigned long icy_metadata_interval;
+		std::string location;
+	};
+
+
+	bool connect(long const start_position);
+	bool send_request(std::string const &host, std::string const &port, std::string const &path, long const start_position, response &response_);
+	bool receive_response_header(response &response_);
+	void disconnect();
+	long receive(uint8_t *dest, long const num_bytes);
+	bool receive_all(uint8_t *dest, long const num_bytes);
+	bool read_icy_metadata();
+
+
+	uri uri_;
+	send_event_callback_t send_event_callback;
+	std::string host, port, path;
+	int socket_fd;
+	std::vector < uint8_t > received_data; // data that was received along with the response header
+	unsigned long received_data_offset;
+	long position, size;
+	bool seekable, end_of_data, ok;
+	unsigned long icy_metadata_interval, num_bytes_until_icy_metadata;
+	std::string stream_title;
+};
+
+
+class http_source_creator:
+	public source_creator
+{
+public:
+	virtual source_ptr_t create(ion::uri const &uri_, send_event_callback_t const &send_event_callback);
+	virtual std::string get_type() const { return "http"; }
+};
+
+
+}
+}
+
+
+#endif
+
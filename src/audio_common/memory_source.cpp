@@ -0,0 +1,142 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <algorithm>
+#include <cstring>
+#include "memory_source.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+memory_source::memory_source(data_ptr_t const &data, uri const &uri_):
+	data(data),
+	uri_(uri_),
+	position(0),
+	end_of_data(false)
+{
+}
+
+
+void memory_source::reset()
+{
+	position = 0;
+	end_of_data = false;
+}
+
+
+long memory_source::read(void *dest, long const num_bytes)
+{
+	if (end_of_data || (num_bytes <= 0))
+		return 0;
+
+	long num_read_bytes = std::min(num_bytes, long(data->size()) - position);
+	if (num_read_bytes > 0)
+		std::memcpy(dest, &((*data)[position]), num_read_bytes);
+	num_read_bytes = std::max(num_read_bytes, 0L);
+	position += num_read_bytes;
+
+	if (num_read_bytes < num_bytes)
+		end_of_data = true;
+
+	return num_read_bytes;
+}
+
+
+bool memory_source::can_read() const
+{
+	return !end_of_data;
+}
+
+
+bool memory_source::end_of_data_reached() const
+{
+	return end_of_data;
+}
+
+
+bool memory_source::is_ok() const
+{
+	return true;
+}
+
+
+void memory_source::seek(long const new_position, seek_type const type)
+{
+	long base = 0;
+
+	switch (type)
+	{
+		case seek_absolute: base = 0; break;
+		case seek_relative: base = position; break;
+		case seek_from_end: base = data->size(); break;
+		default: return;
+	}
+
+	position = std::max(0L, std::min(long(data->size()), base + new_position));
+	end_of_data = false;
+}
+
+
+bool memory_source::can_seek(seek_type const) const
+{
+	return true;
+}
+
+
+long memory_source::get_position() const
+{
+	return position;
+}
+
+
+long memory_source::get_size() const
+{
+	return data->size();
+}
+
+
+uri memory_source::get_uri() const
+{
+	return uri_;
+}
+
+
+void const * memory_source::get_contiguous_view(long const offset, long const num_bytes)
+{
+	if ((offset < 0) || (num_bytes < 0) || ((offset + num_bytes) > long(data->size())) || data->empty())
+		return 0;
+	else
+		return &((*data)[offset]);
+}
+
+
+}
+}
+
@@ -0,0 +1,83 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_AUDIO_COMMON_MEMORY_SOURCE_HPP
+#define ION_AUDIO_COMMON_MEMORY_SOURCE_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <ion/uri.hpp>
+#include "source.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+/**
+* Source over data in memory, such as extracted archive members (see archive_cache) or cached file contents (see content_cache).
+* The data is shared, not copied, and provided as one contiguous view.
+*/
+class memory_source:
+	public source
+{
+public:
+	typedef std::vector < uint8_t > data_t;
+	typedef boost::shared_ptr < data_t const > data_ptr_t;
+
+
+	explicit memory_source(data_ptr_t const &data, uri const &uri_);
+
+	virtual void reset();
+	virtual long read(void *dest, long const num_bytes);
+	virtual bool can_read() const;
+	virtual bool end_of_data_reached() const;
+	virtual bool is_ok() const;
+	virtual void seek(long const new_position, seek_type const type);
+	virtual bool can_seek(seek_type const type) const;
+	virtual long get_position() const;
+	virtual long get_size() const;
+	virtual uri get_uri() const;
+	virtual void const * get_contiguous_view(long const offset, long const num_bytes);
+
+
+protected:
+	data_ptr_t data;
+	uri uri_;
+	long position;
+	bool end_of_data;
+};
+
+
+}
+}
+
+
+#endif
+
@@ -0,0 +1,279 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/locks.hpp>
+#include <ion/command_line_tools.hpp>
+#include "probe_cache.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+namespace
+{
+
+
+// The journal is rewritten when opened if it has this many more lines than there are valid entries
+std::size_t const num_excess_lines_for_compaction = 256;
+
+
+template < typename T >
+bool parse_number(std::string const &str, T &value)
+{
+	try
+	{
+		value = boost::lexical_cast < T > (str);
+		return true;
+	}
+	catch (boost::bad_lexical_cast const &)
+	{
+		return false;
+	}
+}
+
+
+}
+
+
+probe_cache::probe_cache()
+{
+}
+
+
+bool probe_cache::open(std::string const &filename)
+{
+	boost::lock_guard < boost::mutex > lock(mutex);
+
+	if (journal.is_open())
+		journal.close();
+
+	std::size_t num_lines = 0;
+
+	{
+		std::ifstream in(filename.c_str());
+		std::string line;
+		while (std::getline(in, line))
+		{
+			if (parse_line(line))
+				++num_lines;
+		}
+	}
+
+	// Too many outdated lines -> write the current entries into a new file, and replace the old one with it
+	if (num_lines > (records.size() + num_excess_lines_for_compaction))
+	{
+		std::string temp_filename = filename + ".tmp";
+
+		{
+			std::ofstream out(temp_filename.c_str(), std::ios::out | std::ios::trunc);
+			for (records_t::const_iterator iter = records.begin(); iter != records.end(); ++iter)
+				write_record(out, iter->first, iter->second);
+		}
+
+		std::rename(temp_filename.c_str(), filename.c_str());
+	}
+
+	journal.open(filename.c_str(), std::ios::out | std::ios::app);
+	return journal.is_open();
+}
+
+
+bool probe_cache::lookup(uri const &uri_, entry &entry_) const
+{
+	file_id id;
+	if (!get_file_id(uri_, id))
+		return false;
+
+	boost::lock_guard < boost::mutex > lock(mutex);
+
+	records_t::const_iterator iter = records.find(uri_.get_path());
+	if ((iter == records.end()) || !(iter->second.id == id))
+		return false;
+
+	entry_ = iter->second.entry_;
+	return true;
+}
+
+
+void probe_cache::store(uri const &uri_, entry const &entry_)
+{
+	record new_record;
+	if (!get_file_id(uri_, new_record.id))
+		return;
+	new_record.entry_ = entry_;
+
+	boost::lock_guard < boost::mutex > lock(mutex);
+
+	// Do not append lines for unchanged entries
+	records_t::iterator iter = records.find(uri_.get_path());
+	if (iter != records.end())
+	{
+		record const &old_record = iter->second;
+		if (
+			(old_record.id == new_record.id) &&
+			(old_record.entry_.decoder_type == entry_.decoder_type)
+		)
+			return;
+	}
+
+	records[uri_.get_path()] = new_record;
+
+	if (journal.is_open())
+		write_record(journal, uri_.get_path(), new_record);
+}
+
+
+void probe_cache::forget(uri const &uri_)
+{
+	if (!is_cacheable(uri_))
+		return;
+
+	boost::lock_guard < boost::mutex > lock(mutex);
+
+	if (records.erase(uri_.get_path()) == 0)
+		return;
+
+	if (journal.is_open())
+	{
+		params_t params;
+		params.push_back(uri_.get_path());
+		journal << recombine_command_line("forget", params) << std::endl;
+	}
+}
+
+
+std::size_t probe_cache::get_num_entries() const
+{
+	boost::lock_guard < boost::mutex > lock(mutex);
+	return records.size();
+}
+
+
+std::string probe_cache::get_default_filename()
+{
+	std::string cache_dir;
+
+	char const *xdg_cache_home = std::getenv("XDG_CACHE_HOME");
+	if ((xdg_cache_home != 0) && (xdg_cache_home[0] != 0))
+	{
+		cache_dir = xdg_cache_home;
+	}
+	else
+	{
+		char const *home = std::getenv("HOME");
+		if ((home == 0) || (home[0] == 0))
+			return "";
+		cache_dir = std::string(home) + "/.cache";
+		mkdir(cache_dir.c_str(), 0700);
+	}
+
+	cache_dir += "/ion_player";
+	mkdir(cache_dir.c_str(), 0700);
+
+	return cache_dir + "/audio_backend_probe_cache";
+}
+
+
+bool probe_cache::is_cacheable(uri const &uri_)
+{
+	// Archive members share the path (and the file ID) of their archive, so they cannot be told apart here
+	return (uri_.get_type() == "file") && (uri_.get_options().find("archive_member") == uri_.get_options().end());
+}
+
+
+bool probe_cache::get_file_id(uri const &uri_, file_id &id)
+{
+	if (!is_cacheable(uri_))
+		return false;
+
+	struct stat stat_;
+	if (stat(uri_.get_path().c_str(), &stat_) != 0)
+		return false;
+
+	id.size = stat_.st_size;
+	id.modification_time = stat_.st_mtime;
+	id.inode = stat_.st_ino;
+	return true;
+}
+
+
+bool probe_cache::parse_line(std::string const &line)
+{
+	std::string command;
+	params_t params;
+	split_command_line(line, command, params);
+
+	// Lines written by older versions have additional parameters after the decoder type; these are ignored
+	if ((command == "entry") && (params.size() >= 5))
+	{
+		record new_record;
+
+		if (
+			!parse_number(params[1], new_record.id.size) ||
+			!parse_number(params[2], new_record.id.modification_time) ||
+			!parse_number(params[3], new_record.id.inode)
+		)
+			return false;
+
+		new_record.entry_.decoder_type = params[4];
+		records[params[0]] = new_record;
+		return true;
+	}
+	else if ((command == "forget") && (params.size() >= 1))
+	{
+		records.erase(params[0]);
+		return true;
+	}
+	else
+		return false;
+}
+
+
+void probe_cache::write_record(std::ostream &out, std::string const &path, record const &record_) const
+{
+	params_t params;
+	params.push_back(path);
+	params.push_back(boost::lexical_cast < std::string > (record_.id.size));
+	params.push_back(boost::lexical_cast < std::string > (record_.id.modification_time));
+	params.push_back(boost::lexical_cast < std::string > (record_.id.inode));
+	params.push_back(record_.entry_.decoder_type);
+
+	// std::endl flushes, so the line is in the file even if the process gets killed afterwards
+	out << recombine_command_line("entry", params) << std::endl;
+}
+
+
+}
+}
+
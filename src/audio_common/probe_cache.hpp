@@ -0,0 +1,126 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_AUDIO_COMMON_PROBE_CACHE_HPP
+#define ION_AUDIO_COMMON_PROBE_CACHE_HPP
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <ion/uri.hpp>
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+/**
+* Remembers which decoder creator accepted a local file.
+* The backend tries the remembered creator first instead of probing all of them.
+* Entries are keyed by path, and are only valid as long as the file's size, modification time and inode stay the same.
+* The cache can be made persistent by calling open(); changes are then appended to the given file right away (as
+* command lines, see command_line_tools.hpp), so they survive the backend being killed. Several processes may share
+* the same file; a lost entry merely means the file gets probed again.
+* This class is thread-safe.
+*/
+class probe_cache:
+	private boost::noncopyable
+{
+public:
+	struct entry
+	{
+		std::string decoder_type;
+	};
+
+
+	explicit probe_cache();
+
+	/**
+	* Loads the entries stored in the given file, and appends all future changes to it. The file is compacted
+	* first if it contains many outdated lines. If the file does not exist, it is created.
+	* @return true if the file could be opened for writing; if false is returned, the cache is not persistent
+	*/
+	bool open(std::string const &filename);
+
+	/**
+	* Looks up the entry for the given resource. Only URIs of type "file" are cached (archive members excepted).
+	* @return true if an entry exists and the file was not modified since the entry was stored, false otherwise
+	*/
+	bool lookup(uri const &uri_, entry &entry_) const;
+
+	void store(uri const &uri_, entry const &entry_);
+	void forget(uri const &uri_);
+
+	std::size_t get_num_entries() const;
+
+	// Returns $XDG_CACHE_HOME/ion_player/audio_backend_probe_cache (with ~/.cache as fallback for XDG_CACHE_HOME),
+	// creating the directories if necessary. An empty string is returned if no such location is available.
+	static std::string get_default_filename();
+
+
+protected:
+	struct file_id
+	{
+		boost::int64_t size, modification_time, inode;
+
+		bool operator == (file_id const &other) const
+		{
+			return (size == other.size) && (modification_time == other.modification_time) && (inode == other.inode);
+		}
+	};
+
+	struct record
+	{
+		file_id id;
+		entry entry_;
+	};
+
+	typedef std::map < std::string, record > records_t;
+
+
+	static bool is_cacheable(uri const &uri_);
+	static bool get_file_id(uri const &uri_, file_id &id);
+	bool parse_line(std::string const &line);
+	void write_record(std::ostream &out, std::string const &path, record const &record_) const;
+
+
+	mutable boost::mutex mutex;
+	records_t records;
+	std::ofstream journal;
+};
+
+
+}
+}
+
+
+#endif
+
@@ -0,0 +1,477 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include "read_ahead_source.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+struct read_ahead_source::shared_state
+{
+	shared_state(source_ptr_t const &wrapped_source, unsigned long const prefetch_depth):
+		wrapped_source(wrapped_source),
+		ring(std::max(prefetch_depth, 1UL)),
+		ring_start(0),
+		ring_fill(0),
+		position(std::max(wrapped_source->get_position(), 0L)),
+		generation(0),
+		reposition_requested(false),
+		reset_requested(false),
+		reposition_target(0),
+		io_end_of_data(false),
+		io_failed(false),
+		io_busy(false),
+		stall_reported(false),
+		quit(false)
+	{
+	}
+
+
+	void push(uint8_t const *data, unsigned long const num_bytes)
+	{
+		unsigned long end = (ring_start + ring_fill) % ring.size();
+		unsigned long first_part = std::min(num_bytes, ring.size() - end);
+		std::memcpy(&ring[end], data, first_part);
+		std::memcpy(&ring[0], data + first_part, num_bytes - first_part);
+		ring_fill += num_bytes;
+	}
+
+
+	void pop(uint8_t *dest, unsigned long const num_bytes)
+	{
+		if (dest != 0)
+		{
+			unsigned long first_part = std::min(num_bytes, ring.size() - ring_start);
+			std::memcpy(dest, &ring[ring_start], first_part);
+			std::memcpy(dest + first_part, &ring[0], num_bytes - first_part);
+		}
+
+		ring_start = (ring_start + num_bytes) % ring.size();
+		ring_fill -= num_bytes;
+		position += num_bytes;
+	}
+
+
+	boost::mutex mutex;
+	boost::condition_variable data_condition; // signaled by the I/O thread (new data, end-of-data, failure, finished repositioning)
+	boost::condition_variable request_condition; // signaled by the reader (free space, reposition request, quit)
+
+	source_ptr_t wrapped_source;
+
+	std::vector < uint8_t > ring;
+	unsigned long ring_start, ring_fill;
+	long position; // position of the first buffered byte, which is the current position of the read_ahead_source
+
+	// Incremented with each reposition request; the I/O thread discards the results of reads that were started
+	// before the most recent request
+	unsigned long generation;
+	bool reposition_requested, reset_requested;
+	long reposition_target;
+
+	bool io_end_of_data, io_failed;
+	bool io_busy; // true while the I/O thread is inside a call of the wrapped source
+	boost::posix_time::ptime io_start_time;
+	bool stall_reported;
+
+	bool quit;
+};
+
+
+namespace
+{
+
+
+void io_thread_main(read_ahead_source::shared_state_ptr_t const state, unsigned long const block_size)
+{
+	std::vector < uint8_t > block(block_size);
+	source &wrapped_source = *(state->wrapped_source);
+
+	boost::unique_lock < boost::mutex > lock(state->mutex);
+
+	while (!state->quit)
+	{
+		if (state->reposition_requested)
+		{
+			bool do_reset = state->reset_requested;
+			long target = state->reposition_target;
+			unsigned long generation = state->generation;
+			state->reposition_requested = false;
+			state->reset_requested = false;
+			state->io_busy = true;
+			state->io_start_time = boost::posix_time::microsec_clock::universal_time();
+			lock.unlock();
+
+			// Sources may not be able to seek once they reached their end or failed, so reset them first in these cases
+			if (do_reset || wrapped_source.end_of_data_reached() || !wrapped_source.is_ok())
+				wrapped_source.reset();
+			if ((target != 0) || (wrapped_source.get_position() > 0))
+				wrapped_source.seek(target, source::seek_absolute);
+			bool ok = wrapped_source.is_ok();
+
+			lock.lock();
+			state->io_busy = false;
+			state->stall_reported = false;
+			if (generation == state->generation)
+				state->io_failed = !ok;
+			state->data_condition.notify_all();
+			continue;
+		}
+
+		unsigned long num_free_bytes = state->ring.size() - state->ring_fill;
+		if (state->io_end_of_data || state->io_failed || (num_free_bytes == 0))
+		{
+			state->request_condition.wait(lock);
+			continue;
+		}
+
+		unsigned long num_bytes_to_read = std::min(num_free_bytes, block_size);
+		unsigned long generation = state->generation;
+		state->io_busy = true;
+		state->io_start_time = boost::posix_time::microsec_clock::universal_time();
+		lock.unlock();
+
+		long num_read_bytes = wrapped_source.read(&block[0], num_bytes_to_read);
+		bool end_of_data = wrapped_source.end_of_data_reached();
+		bool ok = wrapped_source.is_ok();
+
+		lock.lock();
+		state->io_busy = false;
+		state->stall_reported = false;
+
+		// A reposition was requested while reading; the data belongs to the old position
+		if (generation != state->generation)
+			continue;
+
+		if (num_read_bytes > 0)
+			state->push(&block[0], num_read_bytes);
+
+		if (num_read_bytes < long(num_bytes_to_read))
+		{
+			if (end_of_data)
+				state->io_end_of_data = true;
+			else if (!ok)
+				state->io_failed = true;
+			else if (num_read_bytes <= 0) // no progress, but no error either; treat like the end of the data, otherwise this would spin
+				state->io_end_of_data = true;
+		}
+
+		state->data_condition.notify_all();
+	}
+}
+
+
+}
+
+
+
+
+read_ahead_source::read_ahead_source(source_ptr_t const &wrapped_source, settings const &settings_, send_event_callback_t const &send_event_callback):
+	state(new shared_state(wrapped_source, settings_.prefetch_depth)),
+	settings_(settings_),
+	send_event_callback(send_event_callback),
+	uri_(wrapped_source->get_uri()),
+	size(wrapped_source->get_size()),
+	seekable(wrapped_source->can_seek(seek_absolute)),
+	end_of_data(false),
+	failed(false),
+	prebuffering((size < 0) && (settings_.prebuffer_size > 0))
+{
+	io_thread = boost::thread(&io_thread_main, state, std::max(settings_.block_size, 1UL));
+}
+
+
+read_ahead_source::~read_ahead_source()
+{
+	bool io_busy;
+
+	{
+		boost::lock_guard < boost::mutex > lock(state->mutex);
+		state->quit = true;
+		io_busy = state->io_busy;
+		state->request_condition.notify_all();
+	}
+
+	// If the I/O thread is blocked inside the wrapped source, do not wait for it; the thread holds a reference
+	// to the shared state, and finishes once the blocked call returns
+	if (io_busy)
+		io_thread.detach();
+	else
+		io_thread.join();
+}
+
+
+unsigned long read_ahead_source::get_num_buffered_bytes() const
+{
+	boost::lock_guard < boost::mutex > lock(state->mutex);
+	return state->ring_fill;
+}
+
+
+void read_ahead_source::reposition(long const new_position, bool const reset_wrapped_source)
+{
+	boost::lock_guard < boost::mutex > lock(state->mutex);
+
+	++state->generation;
+	state->reposition_requested = true;
+	state->reset_requested = state->reset_requested || reset_wrapped_source;
+	state->reposition_target = new_position;
+	state->ring_start = 0;
+	state->ring_fill = 0;
+	state->position = new_position;
+	state->io_end_of_data = false;
+	state->io_failed = false;
+	state->request_condition.notify_all();
+
+	prebuffering = (size < 0) && (settings_.prebuffer_size > 0);
+
+	// If the I/O thread is still inside a call that belongs to the old position, the deadlines apply from now on
+	if (state->io_busy)
+	{
+		state->io_start_time = boost::posix_time::microsec_clock::universal_time();
+		state->stall_reported = false;
+	}
+
+	end_of_data = false;
+}
+
+
+void read_ahead_source::reset()
+{
+	failed = false;
+	reposition(0, true);
+}
+
+
+long read_ahead_source::read(void *dest, long const num_bytes)
+{
+	if (end_of_data || failed || (num_bytes <= 0))
+		return 0;
+
+	uint8_t *dest_bytes = reinterpret_cast < uint8_t* > (dest);
+	long num_read_bytes = 0;
+	bool send_stall_event = false, send_failure_event = false;
+	unsigned long num_buffered_bytes = 0;
+
+	{
+		boost::unique_lock < boost::mutex > lock(state->mutex);
+
+		boost::posix_time::time_duration const read_deadline = boost::posix_time::milliseconds(settings_.read_deadline);
+		boost::posix_time::time_duration const failure_timeout = boost::posix_time::milliseconds(settings_.failure_timeout);
+
+		while (true)
+		{
+			boost::posix_time::time_duration io_duration;
+			if (state->io_busy)
+			{
+				io_duration = boost::posix_time::microsec_clock::universal_time() - state->io_start_time;
+
+				// Report the stall while the buffer (hopefully) still contains data; with a prefetch depth that covers
+				// more than the read deadline's worth of playback, this happens before the buffer runs dry
+				if ((io_duration >= read_deadline) && !state->stall_reported)
+				{
+					state->stall_reported = true;
+					send_stall_event = true;
+					num_buffered_bytes = state->ring_fill;
+				}
+			}
+
+			if (num_read_bytes == num_bytes)
+				break;
+
+			if (prebuffering && ((state->ring_fill >= std::min(settings_.prebuffer_size, state->ring.size())) || state->io_end_of_data || state->io_failed))
+				prebuffering = false;
+
+			if ((state->ring_fill > 0) && !prebuffering)
+			{
+				unsigned long num_bytes_to_copy = std::min((unsigned long)(num_bytes - num_read_bytes), state->ring_fill);
+				state->pop(dest_bytes + num_read_bytes, num_bytes_to_copy);
+				num_read_bytes += num_bytes_to_copy;
+				state->request_condition.notify_all();
+				continue;
+			}
+
+			if (!state->reposition_requested)
+			{
+				if (state->io_end_of_data)
+				{
+					end_of_data = true;
+					break;
+				}
+				else if (state->io_failed)
+				{
+					failed = true;
+					send_failure_event = true;
+					break;
+				}
+			}
+
+			// Refill the jitter buffer of live streams once it ran dry
+			if (state->ring_fill == 0)
+				prebuffering = (size < 0) && (settings_.prebuffer_size > 0);
+
+			// The buffer is empty (or still prebuffering); wait for the I/O thread, but never longer than the failure timeout
+			boost::posix_time::time_duration wait_duration = failure_timeout;
+			if (state->io_busy)
+			{
+				if (io_duration >= failure_timeout)
+				{
+					failed = true;
+					send_failure_event = true;
+					break;
+				}
+
+				wait_duration = failure_timeout - io_duration;
+				if (!state->stall_reported)
+					wait_duration = std::min(wait_duration, read_deadline - io_duration);
+			}
+
+			state->data_condition.timed_wait(lock, wait_duration);
+		}
+	}
+
+	// Send the events without holding the lock, since sending them may block as well
+	if (send_event_callback)
+	{
+		if (send_stall_event)
+		{
+			params_t event_params;
+			event_params.push_back(uri_.get_full());
+			event_params.push_back(boost::lexical_cast < std::string > (num_buffered_bytes));
+			event_params.push_back(boost::lexical_cast < std::string > (settings_.read_deadline));
+			send_event_callback("source_stalled", event_params);
+		}
+
+		if (send_failure_event)
+		{
+			params_t event_params;
+			event_params.push_back(uri_.get_full());
+			send_event_callback("data_source_failure", event_params);
+		}
+	}
+
+	return num_read_bytes;
+}
+
+
+bool read_ahead_source::can_read() const
+{
+	return !end_of_data && !failed;
+}
+
+
+bool read_ahead_source::end_of_data_reached() const
+{
+	return end_of_data;
+}
+
+
+bool read_ahead_source::is_ok() const
+{
+	return !failed;
+}
+
+
+void read_ahead_source::seek(long const new_position, seek_type const type)
+{
+	if (!can_seek(type))
+		return;
+
+	long current_position;
+	{
+		boost::lock_guard < boost::mutex > lock(state->mutex);
+		current_position = state->position;
+	}
+
+	long target = 0;
+	switch (type)
+	{
+		case seek_absolute: target = new_position; break;
+		case seek_relative: target = current_position + new_position; break;
+		case seek_from_end: target = size + new_position; break;
+		default: return;
+	}
+
+	target = std::max(target, 0L);
+	if (size >= 0)
+		target = std::min(target, size);
+
+	{
+		boost::lock_guard < boost::mutex > lock(state->mutex);
+
+		// Forward seeks within the buffered data do not involve the wrapped source
+		if (!state->reposition_requested && (target >= state->position) && (target <= long(state->position + state->ring_fill)))
+		{
+			state->pop(0, target - state->position);
+			state->request_condition.notify_all();
+			end_of_data = false;
+			return;
+		}
+	}
+
+	reposition(target, false);
+}
+
+
+bool read_ahead_source::can_seek(seek_type const type) const
+{
+	return seekable && ((type != seek_from_end) || (size >= 0));
+}
+
+
+long read_ahead_source::get_position() const
+{
+	boost::lock_guard < boost::mutex > lock(state->mutex);
+	return state->position;
+}
+
+
+long read_ahead_source::get_size() const
+{
+	return size;
+}
+
+
+uri read_ahead_source::get_uri() const
+{
+	return uri_;
+}
+
+
+}
+}
+
@@ -0,0 +1,121 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_AUDIO_COMMON_READ_AHEAD_SOURCE_HPP
+#define ION_AUDIO_COMMON_READ_AHEAD_SOURCE_HPP
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include "send_event_callback.hpp"
+#include "source.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+/**
+* Source wrapper that performs the I/O of another source in a separate thread.
+* The I/O thread reads ahead of the current position into a bounded ring buffer; read() is served from this buffer,
+* so a slow read from the wrapped source (typically on a network filesystem) does not block the caller as long as
+* enough data has been prefetched. If a single read of the wrapped source takes longer than the read deadline, a
+* "source_stalled" event is sent, while the buffer still contains data. If the buffer runs dry and the wrapped source
+* does not deliver data within the failure timeout, a "data_source_failure" event is sent, and the read_ahead_source
+* behaves like a source that failed: read() returns what is available, is_ok() returns false.
+* Seeking inside the buffered range just discards data; other seeks flush the buffer and reposition the wrapped source
+* in the I/O thread.
+* Sources of unknown size are typically live streams, whose data arrives at the rate it is played. For these, the buffer
+* also acts as a jitter buffer: at the beginning, and whenever the buffer ran dry, read() waits until prebuffer_size
+* bytes are buffered.
+*/
+class read_ahead_source:
+	public source
+{
+public:
+	struct settings
+	{
+		unsigned long prefetch_depth; // size of the ring buffer, in bytes
+		unsigned long block_size; // maximum amount of bytes the I/O thread reads from the wrapped source at once
+		long read_deadline; // in milliseconds; wrapped source reads that take longer cause a source_stalled event
+		long failure_timeout; // in milliseconds; how long read() waits for data with an empty buffer before giving up
+		unsigned long prebuffer_size; // in bytes; only used for sources of unknown size (live streams), see below
+
+		settings():
+			prefetch_depth(1024 * 1024),
+			block_size(64 * 1024),
+			read_deadline(2000),
+			failure_timeout(10000),
+			prebuffer_size(64 * 1024)
+		{
+		}
+	};
+
+
+	explicit read_ahead_source(source_ptr_t const &wrapped_source, settings const &settings_, send_event_callback_t const &send_event_callback = send_event_callback_t());
+	~read_ahead_source();
+
+	settings const & get_settings() const { return settings_; }
+	unsigned long get_num_buffered_bytes() const;
+
+	virtual void reset();
+	virtual long read(void *dest, long const num_bytes);
+	virtual bool can_read() const;
+	virtual bool end_of_data_reached() const;
+	virtual bool is_ok() const;
+	virtual void seek(long const new_position, seek_type const type);
+	virtual bool can_seek(seek_type const type) const;
+	virtual long get_position() const;
+	virtual long get_size() const;
+	virtual uri get_uri() const;
+
+
+	struct shared_state;
+	typedef boost::shared_ptr < shared_state > shared_state_ptr_t;
+
+
+protected:
+	void reposition(long const new_position, bool const reset_wrapped_source);
+
+	// The state is shared with the I/O thread, which keeps it alive even if the thread is still blocked inside
+	// the wrapped source when this source is destroyed (the thread is detached then)
+	shared_state_ptr_t state;
+	boost::thread io_thread;
+	settings settings_;
+	send_event_callback_t send_event_callback;
+	uri uri_;
+	long size;
+	bool seekable, end_of_data, failed, prebuffering;
+};
+
+
+}
+}
+
+
+#endif
+
@@ -162,6 +162,34 @@ public:
 	* @return The uri for this source
 	*/
 	virtual uri get_uri() const = 0;
+
+	/*
+	* Returns a pointer to the data in the range [offset, offset + num_bytes), if the source can provide this range without copying it
+	* (for example, because the data is memory mapped). This is optional; the default implementation returns a null pointer, in which
+	* case the caller has to fall back to read().
+	* The returned pointer stays valid for the lifetime of the source. Calling this function does not affect the current position.
+	*
+	* @param offset position of the first byte of the range, in bytes from the beginning of the data
+	* @param num_bytes length of the range, in bytes
+	* @return pointer to the range's first byte, or a null pointer if the range cannot be provided this way (or lies outside of the data)
+	*/
+	virtual void const * get_contiguous_view(long const /*offset*/, long const /*num_bytes*/)
+	{
+		return 0;
+	}
+
+	/*
+	* Determines whether or not read() and seek() calls may block for long or unpredictable periods of time, for example because
+	* the data resides on a network filesystem. The backend does not let decoders access such sources directly; instead, it wraps
+	* them in a read_ahead_source, which performs the actual I/O in a separate thread. The default implementation returns false.
+	* The return value does not differ over time.
+	*
+	* @return true if I/O calls may block, false otherwise
+	*/
+	virtual bool may_block() const
+	{
+		return false;
+	}
 };
 
 typedef boost::shared_ptr < source > source_ptr_t;
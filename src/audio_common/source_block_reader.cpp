@@ -0,0 +1,228 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <algorithm>
+#include <cstring>
+#include "source_block_reader.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+source_block_reader::source_block_reader(source &source_, unsigned int const block_size):
+	source_(source_),
+	view(0),
+	block(0),
+	buffer_pos(0),
+	buffer_fill(0),
+	source_position(source_.get_position()),
+	source_size(source_.get_size()),
+	end_of_data(false)
+{
+	if ((source_size > 0) && (source_position >= 0))
+		view = reinterpret_cast < uint8_t const * > (source_.get_contiguous_view(0, source_size));
+
+	if (view != 0)
+	{
+		// the view is one block covering the entire data; the "source position" is then its end
+		block = view;
+		buffer_fill = source_size;
+		buffer_pos = std::min(source_position, source_size);
+		source_position = source_size;
+	}
+	else
+	{
+		buffer.resize(std::max(block_size, 1u));
+		block = &buffer[0];
+	}
+}
+
+
+long source_block_reader::read(void *dest, long const num_bytes)
+{
+	uint8_t *dest_bytes = reinterpret_cast < uint8_t* > (dest);
+	long num_read = 0;
+
+	while (num_read < num_bytes)
+	{
+		long num_left = num_bytes - num_read;
+
+		if (buffer_pos < buffer_fill)
+		{
+			long num_to_copy = std::min(num_left, long(buffer_fill - buffer_pos));
+			std::memcpy(dest_bytes + num_read, block + buffer_pos, num_to_copy);
+			buffer_pos += num_to_copy;
+			num_read += num_to_copy;
+		}
+		else if ((view == 0) && (num_left >= long(buffer.size())))
+		{
+			// the buffer is empty, and the remaining request covers at least one full block -> read directly into dest
+
+			long num_bytes_left_in_source = get_num_bytes_left_in_source();
+			if (num_bytes_left_in_source >= 0)
+				num_left = std::min(num_left, num_bytes_left_in_source);
+
+			long num_direct_read = (source_.can_read() && (num_left > 0)) ? source_.read(dest_bytes + num_read, num_left) : 0;
+			if (num_direct_read <= 0)
+			{
+				end_of_data = true;
+				break;
+			}
+
+			if (source_position >= 0)
+				source_position += num_direct_read;
+			num_read += num_direct_read;
+		}
+		else if (!fill_buffer())
+			break;
+	}
+
+	return num_read;
+}
+
+
+void source_block_reader::seek(long const new_position, source::seek_type const type)
+{
+	end_of_data = false;
+
+	if (view != 0)
+	{
+		long base;
+		switch (type)
+		{
+			case source::seek_absolute: base = 0; break;
+			case source::seek_relative: base = buffer_pos; break;
+			case source::seek_from_end: base = source_size; break;
+			default: return;
+		}
+
+		buffer_pos = std::max(0L, std::min(base + new_position, source_size));
+		return;
+	}
+
+	switch (type)
+	{
+		case source::seek_absolute:
+		{
+			long buffer_start = source_position - long(buffer_fill);
+			if ((source_position >= 0) && (new_position >= buffer_start) && (new_position <= source_position))
+			{
+				buffer_pos = new_position - buffer_start;
+				return;
+			}
+
+			discard_buffer();
+			source_.seek(new_position, source::seek_absolute);
+			break;
+		}
+
+		case source::seek_relative:
+		{
+			long new_buffer_pos = long(buffer_pos) + new_position;
+			if ((new_buffer_pos >= 0) && (new_buffer_pos <= long(buffer_fill)))
+			{
+				buffer_pos = new_buffer_pos;
+				return;
+			}
+
+			// the source is ahead of the logical position by the amount of unconsumed buffered bytes - compensate
+			long offset = new_position - long(buffer_fill - buffer_pos);
+			discard_buffer();
+			source_.seek(offset, source::seek_relative);
+			break;
+		}
+
+		case source::seek_from_end:
+			discard_buffer();
+			source_.seek(new_position, source::seek_from_end);
+			break;
+
+		default:
+			return;
+	}
+
+	source_position = source_.get_position();
+}
+
+
+long source_block_reader::get_position() const
+{
+	return (source_position >= 0) ? (source_position - long(buffer_fill - buffer_pos)) : -1;
+}
+
+
+bool source_block_reader::fill_buffer()
+{
+	if (view != 0)
+	{
+		// the view already covers everything
+		end_of_data = true;
+		return false;
+	}
+
+	buffer_pos = buffer_fill = 0;
+
+	long num_to_read = long(buffer.size());
+	long num_bytes_left_in_source = get_num_bytes_left_in_source();
+	if (num_bytes_left_in_source >= 0)
+		num_to_read = std::min(num_to_read, num_bytes_left_in_source);
+
+	long num_read = (source_.can_read() && (num_to_read > 0)) ? source_.read(&buffer[0], num_to_read) : 0;
+	if (num_read <= 0)
+	{
+		end_of_data = true;
+		return false;
+	}
+
+	buffer_fill = num_read;
+	if (source_position >= 0)
+		source_position += num_read;
+
+	return true;
+}
+
+
+long source_block_reader::get_num_bytes_left_in_source() const
+{
+	if ((source_size < 0) || (source_position < 0))
+		return -1;
+	else
+		return std::max(source_size - source_position, 0L);
+}
+
+
+void source_block_reader::discard_buffer()
+{
+	buffer_pos = buffer_fill = 0;
+}
+
+
+}
+}
+
@@ -0,0 +1,120 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_AUDIO_COMMON_SOURCE_BLOCK_READER_HPP
+#define ION_AUDIO_COMMON_SOURCE_BLOCK_READER_HPP
+
+#include <stdint.h>
+#include <vector>
+#include "source.hpp"
+
+
+namespace ion
+{
+namespace audio_common
+{
+
+
+/**
+* Read-through block buffer on top of a source. Byte-wise readers (such as the DUMBFILE and binistream adapters of the
+* module decoders) fetch their data from this buffer instead of issuing one source read() call per byte. The source is
+* read in blocks of block_size bytes; bulk reads larger than one block bypass the buffer entirely.
+* If the source has a known size and position, reads never extend past the end of the source, so the source does not
+* enter its end-of-data state and remains seekable.
+* Seeks that stay within the buffered block do not touch the source at all.
+* If the source can provide a contiguous view of its entire data (see source::get_contiguous_view()), the view is used as one
+* big block instead, and no data is copied into the buffer at all.
+*
+* Only one reader should be active for a given source at a time, since the reader assumes it is the only one moving the
+* source's read position.
+*/
+class source_block_reader
+{
+public:
+	enum { default_block_size = 65536 };
+
+
+	explicit source_block_reader(source &source_, unsigned int const block_size = default_block_size);
+
+
+	/**
+	* Reads one byte.
+	* @return the byte value (0-255), or -1 if no more data could be read
+	*/
+	inline int get_byte()
+	{
+		if ((buffer_pos >= buffer_fill) && !fill_buffer())
+			return -1;
+		return block[buffer_pos++];
+	}
+
+	/**
+	* Reads up to num_bytes bytes to dest.
+	* @return the amount of bytes actually read; less than num_bytes only if the end of data was reached
+	*/
+	long read(void *dest, long const num_bytes);
+
+	/**
+	* Seeks like source::seek(). Seeks within the currently buffered block are handled without accessing the source.
+	*/
+	void seek(long const new_position, source::seek_type const type);
+
+	/**
+	* Returns the logical read position (that is, the source position minus the not yet consumed buffered bytes), or -1
+	* if the source has no notion of a current position.
+	*/
+	long get_position() const;
+
+	/**
+	* Returns true if a read attempt hit the end of the source. Seeking clears this flag.
+	*/
+	bool end_of_data_reached() const { return end_of_data; }
+
+	source& get_source() { return source_; }
+
+
+protected:
+	bool fill_buffer();
+	long get_num_bytes_left_in_source() const;
+	void discard_buffer();
+
+
+	source &source_;
+	std::vector < uint8_t > buffer;
+	uint8_t const *view; // view of the entire source data, or null if the source provides none
+	uint8_t const *block; // points to either the buffer or the view
+	unsigned long buffer_pos, buffer_fill;
+	long source_position, source_size;
+	bool end_of_data;
+};
+
+
+}
+}
+
+
+#endif
+
@@ -27,7 +27,9 @@ freely, subject to the following restrictions:
 #ifndef ION_AUDIO_COMMON_SOURCE_CREATOR_HPP
 #define ION_AUDIO_COMMON_SOURCE_CREATOR_HPP
 
+#include <vector>
 #include <ion/uri.hpp>
+#include "send_event_callback.hpp"
 #include "component_creator.hpp"
 #include "source.hpp"
 
@@ -42,7 +44,13 @@ class source_creator:
 	public component_creator
 {
 public:
-	virtual source_ptr_t create(ion::uri const &uri_) = 0;
+	virtual source_ptr_t create(ion::uri const &uri_, send_event_callback_t const &send_event_callback) = 0;
+	// Like create(), but the source is going to be used for playback, meaning that it will be read entirely.
+	// Creators can use this as a hint for caching; by default, this just calls create().
+	virtual source_ptr_t create_for_playback(ion::uri const &uri_, send_event_callback_t const &send_event_callback) { return create(uri_, send_event_callback); }
+	// Lists the URIs of the resources contained in the given one, such as the members of an archive.
+	// Returns false if the resource does not contain other resources; by default, no resource does.
+	virtual bool get_member_uris(ion::uri const &/*uri_*/, std::vector < ion::uri > &/*member_uris*/) { return false; }
 };
 
 
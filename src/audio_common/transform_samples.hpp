@@ -252,7 +252,7 @@ struct transform_samples
 						set_sample_value(
 							output, i,
 							adjust_sample_volume(
-								get_sample_value(resampler_output, i, resampler_output_type),
+								convert_sample_value(get_sample_value(resampler_output, i, resampler_output_type), resampler_output_type, output_type),
 								volume, max_volume
 							),
 							output_type
@@ -266,7 +266,7 @@ struct transform_samples
 				{
 					// conversion without volume adjustment
 					for (unsigned long i = 0; i < num_retrieved_samples * num_output_channels; ++i)
-						set_sample_value(output, i, get_sample_value(resampler_output, i, output_type), output_type);
+						set_sample_value(output, i, convert_sample_value(get_sample_value(resampler_output, i, resampler_output_type), resampler_output_type, output_type), output_type);
 				}
 			}
 		}
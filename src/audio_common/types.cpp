@@ -43,11 +43,34 @@ unsigned int get_sample_size(sample_type const &type)
 		case sample_s24_x8_lsb: return 4;
 		case sample_s24_x8_msb: return 4;
 		case sample_s32: return 4;
+		case sample_float32: return 4;
 		default: return 0;
 	}
 }
 
 
+namespace
+{
+
+
+float const float_sample_scale = 2147483648.0f;
+
+
+inline long float_to_s32_value(float const value)
+{
+	float scaled_value = value * float_sample_scale;
+	if (scaled_value >= float_sample_scale)
+		return 2147483647L;
+	else if (scaled_value < -float_sample_scale)
+		return -2147483647L - 1;
+	else
+		return long(scaled_value);
+}
+
+
+}
+
+
 long get_sample_value(void const *src, unsigned int const sample_value_index, sample_type const type)
 {
 	uint8_t const *ptr = reinterpret_cast < uint8_t const * > (src) + get_sample_size(type) * sample_value_index;
@@ -56,6 +79,7 @@ long get_sample_value(void const *src, unsigned int const sample_value_index, sa
 	{
 		case sample_s16: return *(reinterpret_cast < int16_t const * > (ptr));
 		case sample_s32: return *(reinterpret_cast < int32_t const * > (ptr));
+		case sample_float32: return float_to_s32_value(*(reinterpret_cast < float const * > (ptr)));
 		default: return 0;
 	}
 }
@@ -69,6 +93,7 @@ void set_sample_value(void *dest, unsigned int const sample_value_index, long co
 	{
 		case sample_s16: *(reinterpret_cast < int16_t* > (ptr)) = value; break;
 		case sample_s32: *(reinterpret_cast < int32_t* > (ptr)) = value; break;
+		case sample_float32: *(reinterpret_cast < float* > (ptr)) = float(value) / float_sample_scale; break;
 		default: break;
 	}
 }
@@ -84,15 +109,22 @@ long convert_sample_value(long const value, sample_type const input_type, sample
 		case sample_s16:
 			switch (output_type)
 			{
-				case sample_s32: return value << 16;
+				case sample_s32:
+				case sample_float32:
+					return value * 65536; // not value << 16, since shifting negative values left is undefined
 				default: return 0;
 			}
 			break;
 
+		// float sample values are exchanged in the s32 range (see get_sample_value()), so they are converted like s32 ones
 		case sample_s32:
+		case sample_float32:
 			switch (output_type)
 			{
 				case sample_s16: return value >> 16;
+				case sample_s32:
+				case sample_float32:
+					return value;
 				default: return 0;
 			}
 			break;
@@ -51,10 +51,17 @@ enum sample_type
 	sample_s24_x8_lsb, // 24-bit integer sample, 8 bit of padding (-> 32 bit total); these 8 bit are the LSB; bitmask  MSB xxxxxxxxxxxxxxxxxxxxxxxx00000000 LSB  (x = sample bit)
 	sample_s24_x8_msb, // 24-bit integer sample, 8 bit of padding (-> 32 bit total); these 8 bit are the MSB; bitmask  MSB 00000000xxxxxxxxxxxxxxxxxxxxxxxx LSB  (x = sample bit)
 	sample_s32,        // 32-bit integer sample, no padding (-> 32 bit total)
+	sample_float32,    // 32-bit IEEE floating point sample, nominal range -1.0 .. 1.0 (values outside of this range are allowed, and get clipped when converted to an integer type)
 	sample_unknown
 };
 
 
+/*
+The sample value functions below exchange sample values as long integers. For integer sample types, this is simply the sample value.
+For sample_float32, the long value is the sample value scaled to the 32-bit integer range (= the value a sample_s32 sample would have),
+clipped if it is outside of the nominal range. This way, float samples can be mixed and volume-adjusted like s32 samples.
+*/
+
 unsigned int get_sample_size(sample_type const &type);
 long get_sample_value(void const *src, unsigned int const sample_value_index, sample_type const type);
 void set_sample_value(void *dest, unsigned int const sample_value_index, long const value, sample_type const type);
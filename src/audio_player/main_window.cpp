@@ -125,13 +125,15 @@ main_window::main_window(uri_optional_t const &command_line_uri):
 
 	audio_frontend_ = audio_frontend_ptr_t(
 		new audio_common::audio_frontend(
-			boost::phoenix::bind(&main_window::print_backend_line, this, boost::phoenix::arg_names::arg1),
+			boost::phoenix::bind(&main_window::write_to_backend, this, boost::phoenix::arg_names::arg1),
 			boost::phoenix::bind(&main_window::handle_backend_pong, this)
 		)
 	);
 	audio_frontend_->get_current_uri_changed_signal().connect(boost::phoenix::bind(&main_window::current_uri_changed, this, boost::phoenix::arg_names::arg1));
 	audio_frontend_->get_current_metadata_changed_signal().connect(boost::phoenix::bind(&main_window::current_metadata_changed, this, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2));
 	audio_frontend_->get_new_metadata_signal().connect(boost::phoenix::bind(&main_window::handle_new_metadata, this, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2));
+	audio_frontend_->get_command_sent_signal().connect(boost::phoenix::bind(&main_window::log_backend_command, this, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2));
+	audio_frontend_->get_event_received_signal().connect(boost::phoenix::bind(&main_window::log_backend_event, this, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2));
 
 
 	status_bar_ui_ = new status_bar_ui(this, main_window_ui.statusbar, *audio_frontend_);
@@ -391,13 +393,10 @@ void main_window::try_read_stdout_line()
 	if (!audio_frontend_)
 		return;
 
-	while (backend_process->canReadLine())
-	{
-		QString line = backend_process->readLine().trimmed();
-		if (!line.startsWith("current_position") && !line.startsWith("pong"))
-			backend_log_dialog_->add_line("stdout", line);
-		audio_frontend_->parse_incoming_line(line.toStdString());
-	}
+	// The data is not necessarily line based (see message_framing.hpp); the audio frontend takes care of splitting it into events
+	QByteArray data = backend_process->readAll();
+	if (!data.isEmpty())
+		audio_frontend_->parse_incoming_data(data.constData(), data.size());
 }
 
 
@@ -590,7 +589,7 @@ void main_window::stop_backend(bool const send_quit_message, bool const stop_sca
 		return;
 
 	if (send_quit_message)
-		print_backend_line("quit");
+		audio_frontend_->send_quit();
 
 	if (send_signals)
 	{
@@ -647,14 +646,25 @@ void main_window::change_backend()
 }
 
 
-void main_window::print_backend_line(std::string const &line)
+void main_window::write_to_backend(std::string const &data)
 {
 	if (backend_process != 0)
-	{
-		if ((line.find("get_current_position") != 0) && (line.find("ping") != 0))
-			backend_log_dialog_->add_line("stdin", line.c_str());
-		backend_process->write((line + "\n").c_str());
-	}
+		backend_process->write(data.data(), data.length());
+}
+
+
+void main_window::log_backend_command(std::string const &command, params_t const &params)
+{
+	// Messages are logged in the text protocol form regardless of the protocol actually in use
+	if ((command != "get_current_position") && (command != "ping"))
+		backend_log_dialog_->add_line("stdin", recombine_command_line(command, params).c_str());
+}
+
+
+void main_window::log_backend_event(std::string const &command, params_t const &params)
+{
+	if ((command != "current_position") && (command != "pong"))
+		backend_log_dialog_->add_line("stdout", recombine_command_line(command, params).c_str());
 }
 
 
@@ -111,7 +111,9 @@ protected:
 	void stop_backend(bool const send_quit_message = true, bool const stop_scanner = true, bool const send_signals = true);
 	void change_backend();
 
-	void print_backend_line(std::string const &line);
+	void write_to_backend(std::string const &data);
+	void log_backend_command(std::string const &command, params_t const &params);
+	void log_backend_event(std::string const &command, params_t const &params);
 	void handle_backend_pong();
 
 	std::string get_playlists_filename();
@@ -50,6 +50,9 @@ scanner::scanner(QObject *parent, playlists_t &playlists_, QString const &backen
 	scan_directory_timer.setSingleShot(false);
 	connect(&scan_directory_timer, SIGNAL(timeout()), this, SLOT(scan_directory_entry()));
 
+	// Scan results are received through shared memory if the backend supports it
+	use_shared_memory_transport(boost::phoenix::bind(&scanner::shared_memory_data_available, this));
+
 	start_backend();
 }
 
@@ -64,11 +67,13 @@ scanner::~scanner()
 
 	queue.clear();
 
-	backend_process.write("quit\n");
+	send_quit();
 
 	backend_process.waitForFinished(30000);
 	if (backend_process.state() != QProcess::NotRunning)
 		terminate_backend(true);
+
+	close_shared_memory_transport();
 }
 
 
@@ -101,9 +106,9 @@ bool scanner::is_scanning_directory() const
 }
 
 
-void scanner::send_to_backend(std::string const &command_line)
+void scanner::send_to_backend(std::string const &data)
 {
-	backend_process.write((command_line + "\n").c_str());
+	backend_process.write(data.data(), data.length());
 }
 
 
@@ -179,11 +184,9 @@ void scanner::cancel_scan_slot()
 
 void scanner::try_read_stdout_line()
 {
-	while (backend_process.canReadLine())
-	{
-		QString line = backend_process.readLine().trimmed();
-		parse_backend_event(line.toStdString());
-	}
+	QByteArray data = backend_process.readAll();
+	if (!data.isEmpty())
+		parse_backend_data(data.constData(), data.size());
 }
 
 
@@ -255,6 +258,7 @@ void scanner::start_backend()
 {
 	backend_process.start(backend_filepath, (QStringList() << "-scan"), QIODevice::ReadWrite);
 	backend_process.waitForStarted(30000);
+	backend_started();
 }
 
 
@@ -291,6 +295,19 @@ void scanner::watchdog_timeout()
 }
 
 
+void scanner::read_shared_memory()
+{
+	read_shared_memory_data();
+}
+
+
+void scanner::shared_memory_data_available()
+{
+	// Called by the shared memory reading thread; the data is read in the scanner's thread
+	QMetaObject::invokeMethod(this, "read_shared_memory", Qt::QueuedConnection);
+}
+
+
 }
 }
 
@@ -60,7 +60,7 @@ public:
 
 	// These functions are public only because the CRTP requires it (see scanner_base)
 	// TODO: use the protected-fail technique to get them back to protected access
-	void send_to_backend(std::string const &command_line);
+	void send_to_backend(std::string const &data);
 	void restart_watchdog_timer();
 	void stop_watchdog_timer();
 	void restart_backend();
@@ -94,9 +94,11 @@ protected slots:
 	void finished(int exit_code, QProcess::ExitStatus exit_status);
 	void scan_directory_entry();
 	void watchdog_timeout();
+	void read_shared_memory();
 
 
 protected:
+	void shared_memory_data_available();
 	void start_backend();
 	void terminate_backend(bool const do_wait = false);
 	void playlist_removed(playlist_t &playlist_);
@@ -29,13 +29,21 @@ freely, subject to the following restrictions:
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <boost/assign/list_of.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/spirit/home/phoenix/bind.hpp>
 #include <boost/spirit/home/phoenix/core/argument.hpp>
 
 #include <ion/command_line_tools.hpp>
+#include <ion/message_framing.hpp>
+#include <ion/metadata.hpp>
+#include <ion/shared_memory_transport.hpp>
 
 
 namespace ion
@@ -49,6 +57,18 @@ class (whose template typename is set to the backend type), the backend instance
 called.
 
 The backend type instance is created _first_, and _then_ an instance of this main loop class is created; the backend type instance is passed to its constructor.
+
+The main loop starts with the text protocol. The set_protocol command switches to another protocol (see message_framing.hpp); it is handled here,
+not by the backend. The answer to set_protocol is still sent using the old protocol, everything after it uses the new one. With the framed protocol,
+the backend is told to send metadata in the binary encoding.
+
+Events are not written by the threads that send them. Instead, they are queued, and a writer thread writes all events queued since its last wakeup
+at once, with one flush. The events are written in the order they were sent; the only exception is that of several current_position
+events that directly follow each other, only the last one is written.
+
+The set_transport command makes the main loop exchange messages through a shared memory segment instead of the given streams (see
+shared_memory_transport.hpp). Like set_protocol, its answer is still sent through the old transport. The given streams are used
+for the bootstrap, and stay in use if the segment cannot be opened.
 */
 
 // See Backend concept in docs/concepts.txt
@@ -75,14 +95,38 @@ public:
 	explicit backend_main_loop(std::istream &in, std::ostream &out, backend_t &backend_):
 		in(in),
 		out(out),
-		backend_(backend_)
+		transport_buf(transport),
+		transport_in(&transport_buf),
+		transport_out(&transport_buf),
+		current_in(&in),
+		current_out(&out),
+		backend_(backend_),
+		protocol(text_protocol),
+		writer_thread_running(true),
+		writer_busy(false)
 	{
+		writer_thread = boost::thread(boost::phoenix::bind(&self_t::writer_loop, this));
 		set_send_event_callback(backend_, boost::phoenix::bind(&self_t::send_response_command_params, this, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2));
 	}
 
 
 	/*
-	Starts the main loop, and exits as soon as the input stream is no longer able to receive new input.
+	The destructor writes all events that are still queued, and then shuts down the writer thread.
+	*/
+	~backend_main_loop()
+	{
+		{
+			boost::lock_guard < boost::mutex > lock(events_mutex);
+			writer_thread_running = false;
+		}
+		events_condition.notify_one();
+		writer_thread.join();
+	}
+
+
+	/*
+	Starts the main loop, and exits as soon as the input stream is no longer able to receive new input. Before exiting, it waits until all
+	queued events are written.
 	Internally, it calls iterate() within the loop. If the input stream is not ready to read when run() is called,
 	nothing happens - the function exits.
 	@post The backend will have its internal states shut down. The user has signalized that the backend shall be ended - exit the main() function as soon as possible
@@ -92,11 +136,25 @@ public:
 		if (in.bad() || in.fail())
 			return;
 
-		while (in.good())
+		while (current_in->good())
 		{
 			if (!iterate())
 				break;
 		}
+
+		flush_events();
+	}
+
+
+	/*
+	Blocks until all events queued so far are written to the output stream. Useful when using iterate() directly.
+	@post All events sent before this call are written and flushed
+	*/
+	void flush_events()
+	{
+		boost::unique_lock < boost::mutex > lock(events_mutex);
+		while (writer_busy || !pending_events.empty())
+			events_written_condition.wait(lock);
 	}
 
 
@@ -108,22 +166,48 @@ public:
 	*/
 	bool iterate()
 	{
-		std::string line;
-		std::getline(in, line);
-		if (line.empty())
+		// line, command and params are members, so their buffers are reused across iterations
+		if (!read_message(*current_in, protocol, command, params, line))
 			return true;
 
-		std::string command;
-		params_t params;
-
-		split_command_line(line, command, params);
-
 		if (command == "ping")
 		{
 			if (params.size() >= 1)
 				send_response_command_params("pong", boost::assign::list_of(params[0]));
 			else
-				send_response_line("pong");
+				send_response_command_params("pong", params_t());
+		}
+		else if (command == "set_protocol")
+		{
+			protocol_type new_protocol = protocol;
+			if (params.size() >= 1)
+				parse_protocol_name(params[0], new_protocol);
+
+			set_metadata_encoding(backend_, (new_protocol == framed_protocol) ? binary_metadata_encoding : json_metadata_encoding);
+
+			// The answer and the switch must not be interleaved with events sent by other threads
+			{
+				boost::lock_guard < boost::mutex > lock(events_mutex);
+				queue_event("protocol", boost::assign::list_of(get_protocol_name(new_protocol)));
+				protocol = new_protocol;
+			}
+			events_condition.notify_one();
+		}
+		else if (command == "set_transport")
+		{
+			// The pipes stay in use if the transport is unknown or the segment cannot be opened; switching more than once is not supported
+			bool use_shared_memory = (params.size() >= 2) && (params[0] == "shm") && (current_in == &in) && transport.open(params[1]);
+
+			{
+				boost::lock_guard < boost::mutex > lock(events_mutex);
+				queue_event("transport", boost::assign::list_of(use_shared_memory ? "shm" : "pipe"));
+				if (use_shared_memory)
+					current_out = &transport_out;
+			}
+			events_condition.notify_one();
+
+			if (use_shared_memory)
+				current_in = &transport_in;
 		}
 		else if (command == "get_backend_type")
 		{
@@ -148,17 +232,99 @@ public:
 
 
 protected:
-	// The send command callback the backend is given. Also used inside iterate() directly.
+	struct queued_event
+	{
+		std::string command;
+		params_t params;
+		protocol_type protocol;
+		std::ostream *out;
+	};
+
+	typedef std::vector < queued_event > queued_events_t;
+
+
+	// The send command callback the backend is given. Also used inside iterate() directly. This may be called from several threads.
 	void send_response_command_params(std::string const &command, params_t const &params)
 	{
-		out << ion::recombine_command_line(command, params) << std::endl;
+		{
+			boost::lock_guard < boost::mutex > lock(events_mutex);
+			queue_event(command, params);
+		}
+		events_condition.notify_one();
+	}
+
+
+	// events_mutex must be locked when calling this
+	void queue_event(std::string const &command, params_t const &params)
+	{
+		pending_events.push_back(queued_event());
+		queued_event &event = pending_events.back();
+		event.command = command;
+		event.params = params;
+		event.protocol = protocol;
+		event.out = current_out;
+	}
+
+
+	void writer_loop()
+	{
+		queued_events_t events;
+		std::string data;
+
+		while (true)
+		{
+			{
+				boost::unique_lock < boost::mutex > lock(events_mutex);
+
+				writer_busy = false;
+				if (pending_events.empty())
+					events_written_condition.notify_all();
+
+				while (writer_thread_running && pending_events.empty())
+					events_condition.wait(lock);
+
+				// Queued events are still written when shutting down
+				if (pending_events.empty())
+					return;
+
+				events.swap(pending_events);
+				writer_busy = true;
+			}
+
+			write_events(events, data);
+			events.clear();
+		}
 	}
 
 
-	// A variant of the send command callback that sends a line directly. Not used by the backend - in fact it is only used in iterate().
-	void send_response_line(std::string const &line)
+	// Writes the given events in order. Each run of events that use the same protocol and stream is written with one flush.
+	// A current_position event is skipped if the next event is a current_position event as well, since it is outdated then; the position
+	// carries no URI, so it must never be moved across other events (a position sent before a transition belongs to the previous resource).
+	static void write_events(queued_events_t const &events, std::string &data)
 	{
-		out << line << std::endl;
+		typename queued_events_t::const_iterator run_begin = events.begin();
+		while (run_begin != events.end())
+		{
+			typename queued_events_t::const_iterator run_end = run_begin + 1;
+			while ((run_end != events.end()) && (run_end->protocol == run_begin->protocol) && (run_end->out == run_begin->out))
+				++run_end;
+
+			data.clear();
+
+			for (typename queued_events_t::const_iterator iter = run_begin; iter != run_end; ++iter)
+			{
+				typename queued_events_t::const_iterator next_iter = iter + 1;
+				if ((iter->command == "current_position") && (next_iter != run_end) && (next_iter->command == "current_position"))
+					continue;
+
+				encode_message(iter->protocol, iter->command, iter->params, data);
+			}
+
+			run_begin->out->write(data.data(), data.length());
+			run_begin->out->flush();
+
+			run_begin = run_end;
+		}
 	}
 
 
@@ -167,7 +333,29 @@ protected:
 	std::istream &in;
 	std::ostream &out;
 
+	// After a set_transport command, messages are exchanged through these instead of in and out
+	shared_memory_transport transport;
+	shared_memory_streambuf transport_buf;
+	std::istream transport_in;
+	std::ostream transport_out;
+	// current_in is only used by iterate(); current_out is only modified by iterate() while events_mutex is locked
+	std::istream *current_in;
+	std::ostream *current_out;
+
 	backend_t &backend_;
+
+	// Only modified by iterate() while events_mutex is locked; queue_event() uses it for the events
+	protocol_type protocol;
+
+	std::string line, command;
+	params_t params;
+
+	// Events are queued in pending_events, and written by the writer thread
+	boost::thread writer_thread;
+	boost::mutex events_mutex;
+	boost::condition_variable events_condition, events_written_condition;
+	queued_events_t pending_events;
+	bool writer_thread_running, writer_busy;
 };
 
 
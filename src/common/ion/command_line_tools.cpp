@@ -24,9 +24,7 @@ freely, subject to the following restrictions:
 ****************************************************************************/
 
 
-//#include <iostream>
-#include <sstream>
-#include <boost/foreach.hpp>
+#include <cstring>
 #include "command_line_tools.hpp"
 
 
@@ -34,133 +32,187 @@ namespace ion
 {
 
 
-void split_command_line(std::string const &line, std::string &command, params_t &params)
+namespace
+{
+
+
+// Finds the next quote that is not escaped, that is, not preceded by an odd number of backslashes
+char const * find_unescaped_quote(char const *begin, char const *end)
 {
-	bool escaping = false, param_started = false;
-	param_t param;
+	char const *search_begin = begin;
+	while (search_begin != end)
+	{
+		char const *quote = reinterpret_cast < char const * > (std::memchr(search_begin, '"', end - search_begin));
+		if (quote == 0)
+			return end;
+
+		std::size_t num_backslashes = 0;
+		for (char const *c = quote; (c != begin) && (*(c - 1) == '\\'); --c)
+			++num_backslashes;
+
+		if ((num_backslashes % 2) == 0)
+			return quote;
+
+		search_begin = quote + 1;
+	}
+
+	return end;
+}
+
+
+}
+
 
-	// First, separate command and parameters in command and params_line
+void split_command_line(std::string const &line, std::string &command, params_t &params)
+{
+	// First, separate command and parameters
 	std::string::size_type cmd_end_pos = line.find_first_of(' ');
-	command = line.substr(0, cmd_end_pos);
-	std::string params_line;
-	if (cmd_end_pos != std::string::npos)
-		params_line = line.substr(cmd_end_pos + 1);
+	command.assign(line, 0, cmd_end_pos);
 
+	std::size_t num_params = 0;
 
-	// Now parse params_line, and extract parameters, taking escape characters into account
-	// Parsing works by assembling a parameter char-by-char, and pushing this parameter into the params sequence once it is fully read
-	BOOST_FOREACH(char const char_, params_line)
+	if (cmd_end_pos != std::string::npos)
 	{
-		if (escaping)
-		{
-			// Escape mode: do not interpret the next character, just add it to the current parameter
-			param += char_;
-			escaping = false;
-		}
-		else
+		char const *params_begin = line.data() + cmd_end_pos + 1;
+		char const *params_end = line.data() + line.length();
+
+		// Now extract the parameters. Each one is enclosed in quotes; quotes inside parameters are escaped. Anything outside of the quotes is ignored.
+		// An unterminated parameter at the end of the line is ignored as well.
+		char const *pos = params_begin;
+		while (true)
 		{
-			switch (char_)
-			{
-				case '\\': // \ (backslash) is the escape symbol -> switch to escape mode, add this backslash to the current parameter
-				           // (the escape mode exists here to avoid running into problems if the parameters contain an escaped quote)
-					param += "\\";
-					escaping = true;
-					break;
-
-				case '"':
-					// The quote signalizes start/end of a parameter. If a parameter was started before, unescape it and store it in params,
-					// thereby ending it. Otherwise, it means no parameter was started earlier, so one must be started right now.
-					if (param_started)
-					{
-						params.push_back(unescape_param(param));
-						param = "";
-						param_started = false;
-					}
-					else
-					{
-						param_started = true;
-					}
-					break;
-
-				default:
-					// Other symbols are simply added to the current parameter.
-					if (param_started)
-						param += char_;
-			}
+			char const *param_begin = find_unescaped_quote(pos, params_end);
+			if (param_begin == params_end)
+				break;
+			++param_begin;
+
+			char const *param_end = find_unescaped_quote(param_begin, params_end);
+			if (param_end == params_end)
+				break;
+
+			// Reuse the existing entries, so their memory is reused as well
+			if (num_params == params.size())
+				params.push_back(param_t());
+			param_t &param = params[num_params];
+			param.clear();
+			unescape_param(param_begin, param_end, param);
+			++num_params;
+
+			pos = param_end + 1;
 		}
 	}
+
+	params.resize(num_params);
 }
 
 
 std::string recombine_command_line(std::string const &command, params_t const &params)
 {
-	std::stringstream sstr;
-	sstr << command; // First store the command in the stringstream
+	std::string line;
+	recombine_command_line(command, params, line);
+	return line;
+}
+
+
+void recombine_command_line(std::string const &command, params_t const &params, std::string &line)
+{
+	// Reserve enough memory for the case where nothing needs to be escaped; each parameter adds a whitespace and two quotes
+	std::string::size_type min_length = command.length();
+	for (params_t::const_iterator iter = params.begin(); iter != params.end(); ++iter)
+		min_length += iter->length() + 3;
+
+	line.clear();
+	line.reserve(min_length);
+	line += command;
 
-	// Now for each parameter, escape it, put it inside quotes, and store it in the stringstream; the parameters are separated by a whitespace
-	BOOST_FOREACH(param_t const &param, params)
+	// Now escape each parameter, put it inside quotes, and append it; the parameters are separated by a whitespace
+	for (params_t::const_iterator iter = params.begin(); iter != params.end(); ++iter)
 	{
-		sstr << " \"" << escape_param(param) << '"';
+		line += " \"";
+		escape_param(iter->data(), iter->data() + iter->length(), line);
+		line += '"';
 	}
-
-	return sstr.str(); // Return the line
 }
 
 
 param_t escape_param(param_t const &unescaped_param)
 {
 	param_t result;
-	BOOST_FOREACH(char const char_, unescaped_param)
+	result.reserve(unescaped_param.length());
+	escape_param(unescaped_param.data(), unescaped_param.data() + unescaped_param.length(), result);
+	return result;
+}
+
+
+param_t unescape_param(param_t const &escaped_param)
+{
+	param_t result;
+	result.reserve(escaped_param.length());
+	unescape_param(escaped_param.data(), escaped_param.data() + escaped_param.length(), result);
+	return result;
+}
+
+
+void escape_param(char const *unescaped_begin, char const *unescaped_end, std::string &result)
+{
+	// Characters that do not need escaping are not appended individually; instead, the run of characters between two characters that
+	// need escaping is appended at once
+	char const *run_begin = unescaped_begin;
+	for (char const *c = unescaped_begin; c != unescaped_end; ++c)
 	{
-		// Go through each character, and escape it if necessary
-		switch (char_)
+		char const *escape_sequence;
+		switch (*c)
 		{
-			case '\\': result += "\\\\"; break;
-			case '"': result += "\\\""; break;
-			case '\n': result += "\\n"; break;
-			case '\r': result += "\\r"; break;
-			default: result += char_;
+			case '\\': escape_sequence = "\\\\"; break;
+			case '"': escape_sequence = "\\\""; break;
+			case '\n': escape_sequence = "\\n"; break;
+			case '\r': escape_sequence = "\\r"; break;
+			default: continue;
 		}
+
+		result.append(run_begin, c);
+		result.append(escape_sequence, 2);
+		run_begin = c + 1;
 	}
 
-	return result;
+	result.append(run_begin, unescaped_end);
 }
 
 
-param_t unescape_param(param_t const &escaped_param)
+void unescape_param(char const *escaped_begin, char const *escaped_end, std::string &result)
 {
-	param_t result;
-	bool escaping = false;
-	// This loop knows two modes: regular, and escaping. If a backslash (\) is encountered in regular mode, it switches to escaping mode (the backslash is then -not- added to the result).
-	// In escape mode, the next character will determine the output; for example, n means newline -> the \n character will be added to the result. The mode is then reset to regular.
-	BOOST_FOREACH(char const char_, escaped_param)
+	// A backslash starts an escape sequence; the next character determines the output. For example, n means newline -> the \n character
+	// will be added to the result. Unknown escape sequences are dropped. Everything between escape sequences is appended as-is.
+	char const *run_begin = escaped_begin;
+	while (run_begin != escaped_end)
 	{
-		if (escaping)
+		char const *backslash = reinterpret_cast < char const * > (std::memchr(run_begin, '\\', escaped_end - run_begin));
+		if (backslash == 0)
+			break;
+
+		result.append(run_begin, backslash);
+
+		char const *escaped_char = backslash + 1;
+		if (escaped_char == escaped_end)
 		{
-			switch (char_)
-			{
-				case '\\': result += '\\'; break;
-				case 'n': result += '\n'; break;
-				case 'r': result += '\r'; break;
-				case '"': result += '"'; break;
-				default: break;
-			}
-			escaping = false;
+			run_begin = escaped_end;
+			break;
 		}
-		else
+
+		switch (*escaped_char)
 		{
-			switch (char_)
-			{
-				case '\\': escaping = true; break;
-				default: result += char_; break;
-			}
+			case '\\': result += '\\'; break;
+			case 'n': result += '\n'; break;
+			case 'r': result += '\r'; break;
+			case '"': result += '"'; break;
+			default: break;
 		}
-	}
 
+		run_begin = escaped_char + 1;
+	}
 
-	return result;
+	result.append(run_begin, escaped_end);
 }
 
 
 }
-
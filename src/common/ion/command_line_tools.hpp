@@ -55,19 +55,30 @@ and is called inside split_command_line().
 split_command_line() takes a line and splits it in a command and zero or more parameters. recombine_command_line() does the opposite, it takes
 a command and zero or more parameters, and outputs a line.
 
+Every line that goes through the pipes between frontend and backend passes through these functions, and parameters can be large (metadata
+JSON objects, for instance). Therefore, they do not assemble strings character by character; instead, they scan for the next character that
+needs (un)escaping, and copy everything in between in one go. To avoid allocations altogether, loops can pass the same command, params and
+line objects again and again: split_command_line() replaces the contents of the given params sequence, reusing the memory of its existing
+entries, and the recombine_command_line() overload with the line argument reuses the memory of the given line. The pointer range variants of
+escape_param() and unescape_param() append to an existing string, and work on parts of larger strings without copying them first.
+
 The param_t parameter is used for storing a parameter value. params_t is a random access sequence of parameter values.
 */
 
 
-// TODO: turn param_t into a class, with lazy (un)escaping (only if it really pays off; this is far from being a bottleneck right now)
-
 typedef std::string param_t;
 typedef std::vector < param_t > params_t;
 
+// The previous contents of command and params are replaced.
 void split_command_line(std::string const &line, std::string &command, params_t &params);
 std::string recombine_command_line(std::string const &command, params_t const &params);
+// The previous contents of line are replaced.
+void recombine_command_line(std::string const &command, params_t const &params, std::string &line);
 param_t escape_param(param_t const &unescaped_param);
 param_t unescape_param(param_t const &escaped_param);
+// These append the result to the given string.
+void escape_param(char const *unescaped_begin, char const *unescaped_end, std::string &result);
+void unescape_param(char const *escaped_begin, char const *escaped_end, std::string &result);
 
 
 }
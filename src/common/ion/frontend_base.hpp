@@ -41,6 +41,7 @@ freely, subject to the following restrictions:
 
 #include "metadata.hpp"
 #include "command_line_tools.hpp"
+#include "message_channel.hpp"
 
 
 namespace ion
@@ -54,17 +55,19 @@ class frontend_base:
 {
 public:
 	typedef Playlist playlist_t;
-	typedef boost::function < void(std::string const &line) > send_line_to_backend_callback_t;
+	typedef message_channel::send_data_callback_t send_to_backend_callback_t;
 	typedef boost::function < void() > pong_callback_t;
 	typedef boost::signals2::signal < void(uri_optional_t const &new_current_uri) > current_uri_changed_signal_t;
 	typedef boost::signals2::signal < void(metadata_optional_t const &new_metadata, bool const reset_playback_position) > current_metadata_changed_signal_t;
 	typedef boost::signals2::signal < void(uri const &uri_, metadata_t const &uri_metadata) > new_metadata_signal_t;
+	typedef boost::signals2::signal < void(std::string const &command, params_t const &params) > backend_message_signal_t;
 	typedef frontend_base < Playlist > self_t;
 
 
-	// Constructor; the parameter is a callback that sends a line to the backend process' stdin.
-	explicit frontend_base(send_line_to_backend_callback_t const &send_line_to_backend_callback, pong_callback_t const &pong_callback):
-		send_line_to_backend_callback(send_line_to_backend_callback),
+	// Constructor; the first parameter is a callback that writes the given data as-is to the backend process' stdin.
+	// The data is encoded according to the protocol negotiated with the backend (see message_channel.hpp).
+	explicit frontend_base(send_to_backend_callback_t const &send_to_backend_callback, pong_callback_t const &pong_callback):
+		channel(send_to_backend_callback, boost::phoenix::bind(&self_t::handle_backend_event, this, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2)),
 		pong_callback(pong_callback),
 		current_playlist(0),
 		crash_count(0),
@@ -81,19 +84,15 @@ public:
 
 
 	/*
-	This function is called when the backend process' stdout sent a complete line.
-	These lines are events sent by the backend to the frontend. This function splits the line into event command name and parameters,
-	and then parses these using parse_command().
+	This function is called when data was read from the backend process' stdout. The data does not have to contain complete events; incomplete
+	ones are kept until the rest arrives. Each complete event is split into event command name and parameters, which are then parsed using parse_command().
 
-	@pre The line must be a valid command line.
-	@post If parsing is successful (and the command is known), the respective handler is invoked, otherwise nothing happens.
+	@pre The data must have been sent by the backend, in the order it was sent.
+	@post If parsing is successful (and the command is known), the respective handler is invoked for each complete event, otherwise nothing happens.
 	*/
-	void parse_incoming_line(std::string const &line)
+	void parse_incoming_data(char const *data, std::size_t const size)
 	{
-		std::string event_command_name;
-		params_t event_params;
-		split_command_line(line, event_command_name, event_params);
-		parse_command(event_command_name, event_params);
+		channel.feed(data, size);
 	}
 
 
@@ -144,7 +143,7 @@ public:
 		{
 			metadata_optional_t metadata_ = get_metadata_for(*current_playlist, uri_);
 			if (metadata_)
-				play_params.push_back(get_metadata_string(*metadata_));
+				play_params.push_back(get_metadata_string(*metadata_, channel.get_metadata_encoding()));
 			else
 				play_params.push_back(empty_metadata_string());
 		}
@@ -157,13 +156,13 @@ public:
 				play_params.push_back(new_next_uri->get_full());
 				metadata_optional_t metadata_ = get_metadata_for(*current_playlist, *new_next_uri);
 				if (metadata_)
-					play_params.push_back(get_metadata_string(*metadata_));
+					play_params.push_back(get_metadata_string(*metadata_, channel.get_metadata_encoding()));
 			}
 			else
 				candidate_for_next_uri = boost::none;
 		}
 
-		send_line_to_backend_callback(recombine_command_line("play", play_params));
+		send_command("play", play_params);
 	}
 
 
@@ -172,13 +171,19 @@ public:
 		if (backend_broken)
 			return;
 
-		send_line_to_backend_callback("stop");
+		send_command("stop");
 	}
 
 
 	void send_ping()
 	{
-		send_line_to_backend_callback("ping");
+		send_command("ping");
+	}
+
+
+	void send_quit()
+	{
+		send_command("quit");
 	}
 
 
@@ -209,9 +214,9 @@ public:
 		candidate_for_next_uri = next_uri;
 
 		if (next_uri)
-			send_line_to_backend_callback(recombine_command_line("set_next_resource", boost::assign::list_of(new_next_uri->get_full())));
+			send_command("set_next_resource", boost::assign::list_of(new_next_uri->get_full()));
 		else
-			send_line_to_backend_callback("clear_next_resource");
+			send_command("clear_next_resource");
 	}
 
 
@@ -255,6 +260,11 @@ public:
 	current_uri_changed_signal_t & get_current_uri_changed_signal() { return current_uri_changed_signal; }
 	current_metadata_changed_signal_t & get_current_metadata_changed_signal() { return current_metadata_changed_signal; }
 	new_metadata_signal_t & get_new_metadata_signal() { return new_metadata_signal; }
+	// These are emitted for each command sent to the backend, and for each event received from it. Useful for logging.
+	backend_message_signal_t & get_command_sent_signal() { return command_sent_signal; }
+	backend_message_signal_t & get_event_received_signal() { return event_received_signal; }
+
+	message_channel & get_message_channel() { return channel; }
 
 
 	uri_optional_t const & get_current_uri() const { return current_uri; }
@@ -270,9 +280,11 @@ public:
 	// Backend start/termination event handlers
 
 	// Backend just started; depending on the number of crashes, either restart playback, or mark the resource as incompatible with the backend and move
-	// to the next one.
+	// to the next one. The protocol is negotiated first; commands sent until the backend answers are queued by the message channel.
 	void backend_started(std::string const &backend_type)
 	{
+		channel.backend_started();
+
 		if (backend_type != current_backend_type)
 		{
 			crash_count = 0;
@@ -331,6 +343,20 @@ public:
 
 
 protected:
+	void send_command(std::string const &command, params_t const &params = params_t())
+	{
+		command_sent_signal(command, params);
+		channel.send_message(command, params);
+	}
+
+
+	void handle_backend_event(std::string const &event_command_name, params_t const &event_params)
+	{
+		event_received_signal(event_command_name, event_params);
+		parse_command(event_command_name, event_params);
+	}
+
+
 	virtual void parse_command(std::string const &event_command_name, params_t const &event_params)
 	{
 		if ((event_command_name == "transition") && (event_params.size() >= 2))
@@ -382,9 +408,9 @@ protected:
 					{
 						candidate_for_next_uri = get_succeeding_uri(*current_playlist, uri_);
 						if (candidate_for_next_uri)
-							send_line_to_backend_callback(recombine_command_line("set_next_resource", boost::assign::list_of(candidate_for_next_uri->get_full())));
+							send_command("set_next_resource", boost::assign::list_of(candidate_for_next_uri->get_full()));
 						else
-							send_line_to_backend_callback("clear_next_resource");
+							send_command("clear_next_resource");
 					}
 				}
 				else
@@ -430,7 +456,7 @@ protected:
 			{
 				next_uri = *actual_next_uri;
 				candidate_for_next_uri = next_uri;
-				send_line_to_backend_callback(recombine_command_line("set_next_resource", boost::assign::list_of(next_uri->get_full())));
+				send_command("set_next_resource", boost::assign::list_of(next_uri->get_full()));
 			}
 		}
 	}
@@ -479,9 +505,9 @@ protected:
 				next_uri = get_succeeding_uri(*current_playlist, *current_uri);
 				candidate_for_next_uri = next_uri;
 				if (next_uri)
-					send_line_to_backend_callback(recombine_command_line("set_next_resource", boost::assign::list_of(next_uri->get_full())));
+					send_command("set_next_resource", boost::assign::list_of(next_uri->get_full()));
 				else
-					send_line_to_backend_callback("clear_next_resource");
+					send_command("clear_next_resource");
 			}
 		}
 	}
@@ -495,7 +521,7 @@ protected:
 			next_uri = get_succeeding_uri(*current_playlist, new_uri);
 			candidate_for_next_uri = next_uri;
 			if (next_uri)
-				send_line_to_backend_callback(recombine_command_line("set_next_resource", boost::assign::list_of(next_uri->get_full())));
+				send_command("set_next_resource", boost::assign::list_of(next_uri->get_full()));
 			current_metadata = get_metadata_for(*current_playlist, new_uri);
 			current_uri_changed_signal(current_uri);
 			current_metadata_changed_signal(current_metadata, true);
@@ -543,7 +569,7 @@ protected:
 			next_uri = get_succeeding_uri(*current_playlist, current_uri_);
 			candidate_for_next_uri = next_uri;
 			if (next_uri)
-				send_line_to_backend_callback(recombine_command_line("set_next_resource", boost::assign::list_of(next_uri->get_full())));
+				send_command("set_next_resource", boost::assign::list_of(next_uri->get_full()));
 		}
 		else
 			next_uri = next_uri_;
@@ -579,12 +605,13 @@ protected:
 
 
 
-	// Callback & signals
-	send_line_to_backend_callback_t send_line_to_backend_callback;
+	// Channel, callback & signals
+	message_channel channel;
 	pong_callback_t pong_callback;
 	current_uri_changed_signal_t current_uri_changed_signal;
 	current_metadata_changed_signal_t current_metadata_changed_signal;
 	new_metadata_signal_t new_metadata_signal;
+	backend_message_signal_t command_sent_signal, event_received_signal;
 	boost::signals2::connection resource_added_signal_connection, resource_removed_signal_connection;
 
 	// URIs
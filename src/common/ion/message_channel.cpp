@@ -0,0 +1,189 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <boost/assign/list_of.hpp>
+#include "message_channel.hpp"
+
+
+namespace ion
+{
+
+
+message_channel::message_channel(send_data_callback_t const &send_data_callback, message_callback_t const &message_callback, protocol_type const preferred_protocol):
+	send_data_callback(send_data_callback),
+	message_callback(message_callback),
+	protocol(text_protocol),
+	preferred_protocol(preferred_protocol),
+	negotiating(false),
+	negotiating_transport(false)
+{
+}
+
+
+void message_channel::backend_started()
+{
+	protocol = text_protocol;
+	negotiating = false;
+	negotiating_transport = false;
+	pending_messages.clear();
+	decoder.reset(text_protocol);
+
+	if (preferred_protocol != text_protocol)
+	{
+		write_message("set_protocol", boost::assign::list_of(get_protocol_name(preferred_protocol)));
+		negotiating = true;
+	}
+	else
+		start_transport_negotiation();
+}
+
+
+void message_channel::send_message(std::string const &command, params_t const &params)
+{
+	if (negotiating)
+		pending_messages.push_back(std::make_pair(command, params));
+	else
+		write_message(command, params);
+}
+
+
+void message_channel::feed(char const *data, std::size_t const size)
+{
+	decoder.feed(data, size);
+
+	while (decoder.next_message(incoming_command, incoming_params))
+	{
+		if (negotiating_transport)
+		{
+			if (incoming_command == "transport")
+			{
+				finish_transport_negotiation(incoming_params.empty() ? std::string("pipe") : incoming_params[0]);
+				continue;
+			}
+			else if ((incoming_command == "unknown_command") && !incoming_params.empty() && (incoming_params[0] == "set_transport"))
+			{
+				finish_transport_negotiation("pipe");
+				continue;
+			}
+		}
+		else if (negotiating)
+		{
+			if (incoming_command == "protocol")
+			{
+				protocol_type new_protocol = text_protocol;
+				if (!incoming_params.empty())
+					parse_protocol_name(incoming_params[0], new_protocol);
+				finish_negotiation(new_protocol);
+				continue;
+			}
+			else if ((incoming_command == "unknown_command") && !incoming_params.empty() && (incoming_params[0] == "set_protocol"))
+			{
+				// the backend does not support protocol negotiation
+				finish_negotiation(text_protocol);
+				continue;
+			}
+		}
+
+		if (message_callback)
+			message_callback(incoming_command, incoming_params);
+	}
+}
+
+
+metadata_encoding message_channel::get_metadata_encoding() const
+{
+	// Messages queued during the negotiation may end up being sent with either protocol, so these must use JSON
+	return ((protocol == framed_protocol) && !negotiating) ? binary_metadata_encoding : json_metadata_encoding;
+}
+
+
+void message_channel::request_transport(std::string const &transport_name, std::string const &transport_address)
+{
+	requested_transport_name = transport_name;
+	requested_transport_address = transport_address;
+}
+
+
+void message_channel::finish_negotiation(protocol_type const new_protocol)
+{
+	// The backend sends everything after its answer using the new protocol, so the remaining data must be decoded with it
+	protocol = new_protocol;
+	decoder.set_protocol(new_protocol);
+	negotiating = false;
+
+	if (!start_transport_negotiation())
+		send_pending_messages();
+}
+
+
+bool message_channel::start_transport_negotiation()
+{
+	if (requested_transport_name.empty())
+		return false;
+
+	write_message("set_transport", boost::assign::list_of(requested_transport_name)(requested_transport_address));
+	requested_transport_name.clear();
+	requested_transport_address.clear();
+	negotiating = true;
+	negotiating_transport = true;
+
+	return true;
+}
+
+
+void message_channel::finish_transport_negotiation(std::string const &transport_name)
+{
+	negotiating = false;
+	negotiating_transport = false;
+
+	// The queued messages must already go through the new transport
+	if (transport_callback)
+		transport_callback(transport_name);
+
+	send_pending_messages();
+}
+
+
+void message_channel::send_pending_messages()
+{
+	pending_messages_t messages;
+	messages.swap(pending_messages);
+	for (pending_messages_t::const_iterator iter = messages.begin(); iter != messages.end(); ++iter)
+		write_message(iter->first, iter->second);
+}
+
+
+void message_channel::write_message(std::string const &command, params_t const &params)
+{
+	encoded_data.clear();
+	encode_message(protocol, command, params, encoded_data);
+	if (send_data_callback)
+		send_data_callback(encoded_data);
+}
+
+
+}
+
@@ -0,0 +1,124 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_MESSAGE_CHANNEL_HPP
+#define ION_MESSAGE_CHANNEL_HPP
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "command_line_tools.hpp"
+#include "message_framing.hpp"
+#include "metadata.hpp"
+
+
+namespace ion
+{
+
+
+/*
+Frontend side of the connection to a backend process. It encodes outgoing commands, decodes incoming events, and negotiates the protocol
+(see message_framing.hpp for the protocols and the negotiation).
+
+The channel does not perform any I/O itself. The send data callback is expected to write the given data as-is to the backend's stdin;
+the data already contains the line delimiters or frame headers. Whatever is read from the backend's stdout is passed to feed(), which
+invokes the message callback for each complete event.
+
+backend_started() must be called each time a backend process was started. It resets the channel to the text protocol, and if the preferred
+protocol is a different one, sends the set_protocol command. Until the backend answers, outgoing messages are queued; once the answer
+arrives, the queued messages are sent using the negotiated protocol. The protocol and unknown_command events that belong to the negotiation
+are handled internally and are not passed to the message callback.
+
+If a transport was requested with request_transport(), the set_transport command is sent after the protocol negotiation, and messages stay
+queued until the backend answered. The transport callback is then invoked with the name of the transport the backend uses from now on ("pipe"
+if it rejected the request or does not know set_transport), before the queued messages are sent. If the transport changed, the owner of the
+channel must redirect the send data callback's output, and feed the data received through the new transport. A transport request applies to
+the next backend_started() call only, since the address usually is only valid for one backend process.
+*/
+class message_channel:
+	private boost::noncopyable
+{
+public:
+	typedef boost::function < void(std::string const &data) > send_data_callback_t;
+	typedef boost::function < void(std::string const &command, params_t const &params) > message_callback_t;
+	typedef boost::function < void(std::string const &transport_name) > transport_callback_t;
+
+
+	explicit message_channel(send_data_callback_t const &send_data_callback, message_callback_t const &message_callback, protocol_type const preferred_protocol = framed_protocol);
+
+	void backend_started();
+
+	void send_message(std::string const &command, params_t const &params = params_t());
+	void feed(char const *data, std::size_t const size);
+
+	protocol_type get_protocol() const { return protocol; }
+	bool is_negotiating() const { return negotiating; }
+	// Metadata parameters should be encoded using this encoding; it depends on the current protocol.
+	metadata_encoding get_metadata_encoding() const;
+
+	// The new preferred protocol is used the next time backend_started() is called.
+	void set_preferred_protocol(protocol_type const new_preferred_protocol) { preferred_protocol = new_preferred_protocol; }
+	protocol_type get_preferred_protocol() const { return preferred_protocol; }
+
+	// The transport is requested the next time backend_started() is called (see shared_memory_transport.hpp for the "shm" transport).
+	void request_transport(std::string const &transport_name, std::string const &transport_address);
+	void set_transport_callback(transport_callback_t const &new_transport_callback) { transport_callback = new_transport_callback; }
+
+
+private:
+	typedef std::deque < std::pair < std::string, params_t > > pending_messages_t;
+
+
+	void finish_negotiation(protocol_type const new_protocol);
+	bool start_transport_negotiation();
+	void finish_transport_negotiation(std::string const &transport_name);
+	void send_pending_messages();
+	void write_message(std::string const &command, params_t const &params);
+
+
+	send_data_callback_t send_data_callback;
+	message_callback_t message_callback;
+	transport_callback_t transport_callback;
+	protocol_type protocol, preferred_protocol;
+	bool negotiating, negotiating_transport;
+	std::string requested_transport_name, requested_transport_address;
+	pending_messages_t pending_messages;
+	message_decoder decoder;
+
+	// Reused for each message, to avoid allocations
+	std::string encoded_data, incoming_command;
+	params_t incoming_params;
+};
+
+
+}
+
+
+#endif
+
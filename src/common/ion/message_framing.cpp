@@ -0,0 +1,306 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <istream>
+#include <boost/cstdint.hpp>
+#include "message_framing.hpp"
+
+
+namespace ion
+{
+
+
+namespace
+{
+
+
+std::size_t const frame_header_size = 4;
+
+
+void write_varint(boost::uint64_t value, std::string &out)
+{
+	while (value >= 0x80)
+	{
+		out += char((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	out += char(value);
+}
+
+
+bool read_varint(char const *&cur, char const *end, boost::uint64_t &value)
+{
+	value = 0;
+	for (unsigned int shift = 0; (cur != end) && (shift < 64); shift += 7)
+	{
+		unsigned char byte = *cur++;
+		value |= boost::uint64_t(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+
+bool read_length_prefixed_string(char const *&cur, char const *end, std::string &str)
+{
+	boost::uint64_t length;
+	if (!read_varint(cur, end, length) || (length > boost::uint64_t(end - cur)))
+		return false;
+	str.assign(cur, std::size_t(length));
+	cur += length;
+	return true;
+}
+
+
+std::size_t read_frame_header(char const *header)
+{
+	unsigned char const *bytes = reinterpret_cast < unsigned char const * > (header);
+	return (std::size_t(bytes[0]) << 24) | (std::size_t(bytes[1]) << 16) | (std::size_t(bytes[2]) << 8) | std::size_t(bytes[3]);
+}
+
+
+bool decode_frame_payload(char const *begin, char const *end, std::string &command, params_t &params)
+{
+	boost::uint64_t num_params;
+	if (!read_length_prefixed_string(begin, end, command))
+		return false;
+	// each parameter needs at least one byte for its length, which rejects bogus counts before anything is allocated
+	if (!read_varint(begin, end, num_params) || (num_params > boost::uint64_t(end - begin)))
+		return false;
+
+	params.resize(std::size_t(num_params));
+	for (params_t::iterator iter = params.begin(); iter != params.end(); ++iter)
+	{
+		if (!read_length_prefixed_string(begin, end, *iter))
+			return false;
+	}
+
+	return (begin == end) && !command.empty();
+}
+
+
+// Removes leading and trailing whitespace (including the \r of CRLF line endings)
+void trim_line(std::string &line)
+{
+	std::string::size_type last = line.find_last_not_of(" \t\r");
+	if (last == std::string::npos)
+	{
+		line.clear();
+		return;
+	}
+	line.erase(last + 1);
+	line.erase(0, line.find_first_not_of(" \t\r"));
+}
+
+
+}
+
+
+std::string get_protocol_name(protocol_type const protocol)
+{
+	switch (protocol)
+	{
+		case framed_protocol: return "framed";
+		default: return "text";
+	}
+}
+
+
+bool parse_protocol_name(std::string const &name, protocol_type &protocol)
+{
+	if (name == "text")
+		protocol = text_protocol;
+	else if (name == "framed")
+		protocol = framed_protocol;
+	else
+		return false;
+
+	return true;
+}
+
+
+void encode_message(protocol_type const protocol, std::string const &command, params_t const &params, std::string &data)
+{
+	if (protocol == framed_protocol)
+	{
+		std::string::size_type header_offset = data.length();
+		data.append(frame_header_size, '\0');
+
+		write_varint(command.length(), data);
+		data += command;
+		write_varint(params.size(), data);
+		for (params_t::const_iterator iter = params.begin(); iter != params.end(); ++iter)
+		{
+			write_varint(iter->length(), data);
+			data += *iter;
+		}
+
+		std::size_t payload_size = data.length() - header_offset - frame_header_size;
+		data[header_offset + 0] = char((payload_size >> 24) & 0xff);
+		data[header_offset + 1] = char((payload_size >> 16) & 0xff);
+		data[header_offset + 2] = char((payload_size >> 8) & 0xff);
+		data[header_offset + 3] = char(payload_size & 0xff);
+	}
+	else
+	{
+		data += recombine_command_line(command, params);
+		data += '\n';
+	}
+}
+
+
+bool read_message(std::istream &in, protocol_type const protocol, std::string &command, params_t &params, std::string &buffer)
+{
+	if (protocol == framed_protocol)
+	{
+		char header[frame_header_size];
+		if (!in.read(header, frame_header_size))
+			return false;
+
+		std::size_t payload_size = read_frame_header(header);
+		if (payload_size > max_message_frame_size)
+		{
+			// there is no way to find the next frame in a corrupt stream
+			in.setstate(std::ios_base::failbit);
+			return false;
+		}
+
+		buffer.resize(payload_size);
+		if ((payload_size > 0) && !in.read(&buffer[0], payload_size))
+			return false;
+
+		return decode_frame_payload(buffer.data(), buffer.data() + buffer.length(), command, params);
+	}
+	else
+	{
+		std::getline(in, buffer);
+		trim_line(buffer);
+		if (buffer.empty())
+			return false;
+
+		split_command_line(buffer, command, params);
+		return !command.empty();
+	}
+}
+
+
+
+
+message_decoder::message_decoder(protocol_type const protocol):
+	protocol(protocol),
+	read_offset(0)
+{
+}
+
+
+void message_decoder::set_protocol(protocol_type const new_protocol)
+{
+	protocol = new_protocol;
+}
+
+
+void message_decoder::reset(protocol_type const new_protocol)
+{
+	protocol = new_protocol;
+	buffer.clear();
+	read_offset = 0;
+}
+
+
+void message_decoder::feed(char const *data, std::size_t const size)
+{
+	compact_buffer();
+	buffer.append(data, size);
+}
+
+
+bool message_decoder::next_message(std::string &command, params_t &params)
+{
+	while (read_offset < buffer.length())
+	{
+		if (protocol == framed_protocol)
+		{
+			if ((buffer.length() - read_offset) < frame_header_size)
+				return false;
+
+			std::size_t payload_size = read_frame_header(buffer.data() + read_offset);
+			if (payload_size > max_message_frame_size)
+			{
+				reset(protocol);
+				return false;
+			}
+
+			if ((buffer.length() - read_offset - frame_header_size) < payload_size)
+				return false;
+
+			char const *payload = buffer.data() + read_offset + frame_header_size;
+			read_offset += frame_header_size + payload_size;
+
+			if (decode_frame_payload(payload, payload + payload_size, command, params))
+				return true;
+		}
+		else
+		{
+			std::string::size_type delimiter_pos = buffer.find('\n', read_offset);
+			if (delimiter_pos == std::string::npos)
+				return false;
+
+			line.assign(buffer, read_offset, delimiter_pos - read_offset);
+			read_offset = delimiter_pos + 1;
+
+			trim_line(line);
+			if (line.empty())
+				continue;
+
+			split_command_line(line, command, params);
+			if (!command.empty())
+				return true;
+		}
+	}
+
+	return false;
+}
+
+
+void message_decoder::compact_buffer()
+{
+	// Only move the remaining data to the front once the consumed part dominates the buffer; this avoids moving data for each message
+	if (read_offset == buffer.length())
+	{
+		buffer.clear();
+		read_offset = 0;
+	}
+	else if (read_offset > (buffer.length() / 2))
+	{
+		buffer.erase(0, read_offset);
+		read_offset = 0;
+	}
+}
+
+
+}
+
@@ -0,0 +1,116 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_MESSAGE_FRAMING_HPP
+#define ION_MESSAGE_FRAMING_HPP
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include "command_line_tools.hpp"
+
+
+namespace ion
+{
+
+
+/*
+Front- and backend exchange messages (a command plus zero or more parameters) using one of two protocols:
+
+- text_protocol: one message per line, as produced by recombine_command_line(). This is the protocol the backend starts with. It is
+  human-readable, which makes it useful for debugging, and it is the format used in the documentation and the replay logs in docs/.
+- framed_protocol: each message is a frame consisting of a 4-byte big-endian payload length, followed by the payload. The payload contains
+  the command and the parameters, each one prefixed with its length (an unsigned LEB128 varint); the number of parameters precedes the
+  parameters. Nothing is escaped, and no quotes need to be searched for, so the parameters are copied as-is. Metadata parameters
+  are sent in the binary metadata encoding (see metadata.hpp).
+
+The frontend negotiates the protocol right after starting the backend by sending the text command   set_protocol "framed"   . The backend
+answers with   protocol "<name>"   (still as a text line), and uses the named protocol for everything it sends and receives afterwards. A
+backend that does not know the set_protocol command answers with unknown_command instead; the frontend then keeps using the text protocol.
+See message_channel.hpp for the frontend side, and backend_main_loop.hpp for the backend side.
+
+encode_message() appends the encoded message to a string (a line including the newline delimiter, or a frame). message_decoder splits
+incoming data into messages; it is meant for event driven code that receives data in arbitrary pieces. read_message() reads one message
+from a blocking stream.
+*/
+
+
+enum protocol_type
+{
+	text_protocol,
+	framed_protocol
+};
+
+// Frames with larger payloads are considered corrupt.
+std::size_t const max_message_frame_size = 64 * 1024 * 1024;
+
+
+std::string get_protocol_name(protocol_type const protocol);
+// Returns false if the name is unknown. In that case, protocol is not modified.
+bool parse_protocol_name(std::string const &name, protocol_type &protocol);
+
+// Appends the encoded message to data.
+void encode_message(protocol_type const protocol, std::string const &command, params_t const &params, std::string &data);
+
+// Blocks until a message was read. Returns false if the stream ended, or if the message was invalid or empty; buffer is used for reading.
+bool read_message(std::istream &in, protocol_type const protocol, std::string &command, params_t &params, std::string &buffer);
+
+
+class message_decoder
+{
+public:
+	explicit message_decoder(protocol_type const protocol = text_protocol);
+
+	// Switches the protocol. Data that was already fed, but not yet decoded, is decoded using the new protocol.
+	void set_protocol(protocol_type const new_protocol);
+	protocol_type get_protocol() const { return protocol; }
+
+	// Discards any data that was not yet decoded, and switches the protocol.
+	void reset(protocol_type const new_protocol);
+
+	void feed(char const *data, std::size_t const size);
+
+	// Returns false if no complete message is available yet. The previous contents of command and params are replaced.
+	// Empty lines and frames with invalid payloads are skipped. If a frame header announces a payload larger than max_message_frame_size,
+	// the stream is considered corrupt, and all buffered data is discarded.
+	bool next_message(std::string &command, params_t &params);
+
+
+private:
+	void compact_buffer();
+
+
+	protocol_type protocol;
+	std::string buffer, line;
+	std::size_t read_offset;
+};
+
+
+}
+
+
+#endif
+
@@ -24,6 +24,8 @@ freely, subject to the following restrictions:
 ****************************************************************************/
 
 
+#include <cstring>
+#include <boost/cstdint.hpp>
 #include <json/reader.h>
 #include <json/writer.h>
 #include "metadata.hpp"
@@ -33,6 +35,232 @@ namespace ion
 {
 
 
+namespace
+{
+
+
+/*
+Binary metadata encoding. The string starts with binary_metadata_marker, followed by one encoded value. Each value starts with a type tag byte.
+Integers and lengths are stored as unsigned LEB128 varints (signed integers are zigzag-encoded first), reals as the big-endian bit pattern of
+the IEEE 754 double. Arrays and objects store their number of elements, followed by the elements; object elements are stored as key length, key,
+and value.
+*/
+
+char const binary_metadata_marker = '\x01';
+
+enum binary_value_tag
+{
+	binary_null_tag = 0,
+	binary_false_tag,
+	binary_true_tag,
+	binary_int_tag,
+	binary_uint_tag,
+	binary_real_tag,
+	binary_string_tag,
+	binary_array_tag,
+	binary_object_tag
+};
+
+// Corrupted input must not be able to exhaust the stack
+unsigned int const max_binary_nesting_depth = 64;
+
+
+void write_varint(boost::uint64_t value, std::string &out)
+{
+	while (value >= 0x80)
+	{
+		out += char((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	out += char(value);
+}
+
+
+bool read_varint(char const *&cur, char const *end, boost::uint64_t &value)
+{
+	value = 0;
+	for (unsigned int shift = 0; (cur != end) && (shift < 64); shift += 7)
+	{
+		unsigned char byte = *cur++;
+		value |= boost::uint64_t(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+
+void write_binary_value(Json::Value const &value, std::string &out)
+{
+	switch (value.type())
+	{
+		case Json::nullValue:
+			out += char(binary_null_tag);
+			break;
+
+		case Json::booleanValue:
+			out += char(value.asBool() ? binary_true_tag : binary_false_tag);
+			break;
+
+		case Json::intValue:
+		{
+			boost::int64_t int_value = value.asInt();
+			out += char(binary_int_tag);
+			write_varint((boost::uint64_t(int_value) << 1) ^ boost::uint64_t(int_value >> 63), out);
+			break;
+		}
+
+		case Json::uintValue:
+			out += char(binary_uint_tag);
+			write_varint(value.asUInt(), out);
+			break;
+
+		case Json::realValue:
+		{
+			double real_value = value.asDouble();
+			boost::uint64_t bits;
+			std::memcpy(&bits, &real_value, sizeof(bits));
+			out += char(binary_real_tag);
+			for (int shift = 56; shift >= 0; shift -= 8)
+				out += char((bits >> shift) & 0xff);
+			break;
+		}
+
+		case Json::stringValue:
+		{
+			char const *str = value.asCString();
+			std::size_t length = std::strlen(str);
+			out += char(binary_string_tag);
+			write_varint(length, out);
+			out.append(str, length);
+			break;
+		}
+
+		case Json::arrayValue:
+			out += char(binary_array_tag);
+			write_varint(value.size(), out);
+			for (Json::Value::ArrayIndex i = 0; i < value.size(); ++i)
+				write_binary_value(value[i], out);
+			break;
+
+		case Json::objectValue:
+			out += char(binary_object_tag);
+			write_varint(value.size(), out);
+			for (Json::Value::const_iterator iter = value.begin(); iter != value.end(); ++iter)
+			{
+				char const *name = iter.memberName();
+				std::size_t length = std::strlen(name);
+				write_varint(length, out);
+				out.append(name, length);
+				write_binary_value(*iter, out);
+			}
+			break;
+
+		default:
+			out += char(binary_null_tag);
+	}
+}
+
+
+bool read_binary_string(char const *&cur, char const *end, std::string &str)
+{
+	boost::uint64_t length;
+	if (!read_varint(cur, end, length) || (length > boost::uint64_t(end - cur)))
+		return false;
+	str.assign(cur, std::size_t(length));
+	cur += length;
+	return true;
+}
+
+
+bool read_binary_value(char const *&cur, char const *end, Json::Value &value, unsigned int const depth)
+{
+	if ((cur == end) || (depth > max_binary_nesting_depth))
+		return false;
+
+	boost::uint64_t number;
+
+	switch (*cur++)
+	{
+		case binary_null_tag:  value = Json::Value(); return true;
+		case binary_false_tag: value = false; return true;
+		case binary_true_tag:  value = true; return true;
+
+		case binary_int_tag:
+			if (!read_varint(cur, end, number))
+				return false;
+			value = Json::Value::Int(boost::int64_t((number >> 1) ^ (~(number & 1) + 1)));
+			return true;
+
+		case binary_uint_tag:
+			if (!read_varint(cur, end, number))
+				return false;
+			value = Json::Value::UInt(number);
+			return true;
+
+		case binary_real_tag:
+		{
+			if ((end - cur) < 8)
+				return false;
+			boost::uint64_t bits = 0;
+			for (int i = 0; i < 8; ++i)
+				bits = (bits << 8) | (unsigned char)(*cur++);
+			double real_value;
+			std::memcpy(&real_value, &bits, sizeof(real_value));
+			value = real_value;
+			return true;
+		}
+
+		case binary_string_tag:
+		{
+			std::string str;
+			if (!read_binary_string(cur, end, str))
+				return false;
+			value = str;
+			return true;
+		}
+
+		case binary_array_tag:
+		{
+			// each element needs at least one byte, which rejects bogus sizes before anything is allocated
+			if (!read_varint(cur, end, number) || (number > boost::uint64_t(end - cur)))
+				return false;
+			value = Json::Value(Json::arrayValue);
+			if (number > 0)
+				value.resize(Json::Value::ArrayIndex(number));
+			for (Json::Value::ArrayIndex i = 0; i < number; ++i)
+			{
+				if (!read_binary_value(cur, end, value[i], depth + 1))
+					return false;
+			}
+			return true;
+		}
+
+		case binary_object_tag:
+		{
+			if (!read_varint(cur, end, number) || (number > boost::uint64_t(end - cur)))
+				return false;
+			value = Json::Value(Json::objectValue);
+			std::string name;
+			for (boost::uint64_t i = 0; i < number; ++i)
+			{
+				if (!read_binary_string(cur, end, name))
+					return false;
+				if (!read_binary_value(cur, end, value[name], depth + 1))
+					return false;
+			}
+			return true;
+		}
+
+		default:
+			return false;
+	}
+}
+
+
+}
+
+
 metadata_t const & empty_metadata()
 {
 	static metadata_t const empty_metadata_(Json::objectValue);
@@ -58,6 +286,16 @@ metadata_optional_t parse_metadata(std::string const &metadata_str)
 	if (metadata_str.empty())
 		return empty_metadata();
 
+	if (metadata_str[0] == binary_metadata_marker)
+	{
+		Json::Value value;
+		char const *cur = metadata_str.data() + 1, *end = metadata_str.data() + metadata_str.length();
+		if (read_binary_value(cur, end, value, 0) && (cur == end) && is_valid(value))
+			return value;
+		else
+			return boost::none;
+	}
+
 	Json::Value value;
 	Json::Reader reader;
 	if (reader.parse(metadata_str, value))
@@ -77,6 +315,19 @@ std::string get_metadata_string(metadata_t const &metadata)
 }
 
 
+std::string get_metadata_string(metadata_t const &metadata, metadata_encoding const encoding)
+{
+	if (encoding == binary_metadata_encoding)
+	{
+		std::string result(1, binary_metadata_marker);
+		write_binary_value(metadata, result);
+		return result;
+	}
+	else
+		return get_metadata_string(metadata);
+}
+
+
 bool has_metadata_value(metadata_t const &metadata, std::string const &value_name)
 {
 	return metadata.isMember(value_name);
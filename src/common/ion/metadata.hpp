@@ -52,6 +52,11 @@ metadata_optional_t is a boost::optional <> version of metadata. If parsing fail
 
 To avoid unnecessary conversion work for empty objects, it is recommended to call empty_metadata_string() to get a JSON string representation of an empty object.
 
+get_metadata_string() can also produce a compact binary representation instead of JSON (see metadata_encoding). This is used by the framed
+front-/backend protocol (see message_framing.hpp), where metadata does not have to be human-readable and does not have to fit in one line.
+parse_metadata() recognizes both representations, so the receiving side does not need to know which one was used. Binary metadata strings
+start with a byte that cannot begin a JSON text, and may contain null bytes; they must not be sent over the line-based text protocol.
+
 
 TODO: since metadata_optional_t already allows for invalid values using boost::none, it is unnecessary to allow metadata_t to be a nullvalue (= an invalid value).
 Unfortunately, jsoncpp's Json::Value default constructor sets the value type to nullValue. Therefore, replace the metadata_t typedef with an inherited class;
@@ -63,11 +68,18 @@ empty_metadata() and empty_metadata_string() obsolete.
 typedef Json::Value metadata_t;
 typedef boost::optional < metadata_t > metadata_optional_t;
 
+enum metadata_encoding
+{
+	json_metadata_encoding,
+	binary_metadata_encoding
+};
+
 metadata_t const & empty_metadata();
 std::string const & empty_metadata_string();
 bool is_valid(metadata_t const &metadata);
 metadata_optional_t parse_metadata(std::string const &metadata_str);
 std::string get_metadata_string(metadata_t const &metadata);
+std::string get_metadata_string(metadata_t const &metadata, metadata_encoding const encoding);
 bool has_metadata_value(metadata_t const &metadata, std::string const &value_name);
 
 
@@ -31,8 +31,12 @@ freely, subject to the following restrictions:
 #include <deque>
 #include <iostream>
 #include <sstream>
+#include <boost/assign/list_of.hpp>
+#include <boost/foreach.hpp>
+#include <boost/function.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/signals2/connection.hpp>
 #include <boost/spirit/home/phoenix/bind.hpp>
 #include <boost/spirit/home/phoenix/core/argument.hpp>
@@ -41,7 +45,9 @@ freely, subject to the following restrictions:
 #include <boost/multi_index/random_access_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <ion/command_line_tools.hpp>
+#include <ion/message_channel.hpp>
 #include <ion/metadata.hpp>
+#include <ion/shared_memory_transport.hpp>
 #include <ion/uri.hpp>
 #include <ion/playlists_traits.hpp>
 
@@ -53,7 +59,7 @@ namespace ion
 /*
 functions the derived class must implement:
 
-void send_to_backend(std::string const &command_line)
+void send_to_backend(std::string const &data)   (writes the data as-is to the backend's stdin)
 void restart_watchdog_timer()
 void stop_watchdog_timer()
 void restart_backend()
@@ -68,9 +74,29 @@ void scanning_failed(ion::uri const &uri_, playlist_t &playlist_)
 
 functions from this base class the derived class can/should use:
 	void issue_scan_request(ion::uri const &uri_, playlist_t &playlist_)
+	void backend_started()   (must be called each time the backend process was started)
 	void backend_crashed()
 	void cancel_scan()
-	void parse_backend_event(std::string const &line)
+	void send_quit()
+	void parse_backend_data(char const *data, std::size_t const size)   (with data read from the backend's stdout)
+	void use_shared_memory_transport(boost::function < void() > const &data_available_callback)
+	void read_shared_memory_data()
+	void close_shared_memory_transport()
+
+The commands and events are passed through a message channel, which negotiates the protocol with the backend (see message_channel.hpp).
+
+Optionally, the scanner talks to the backend through shared memory instead of the pipes (see shared_memory_transport.hpp). To enable this,
+the derived class calls use_shared_memory_transport() before starting the backend. The given callback is invoked from another thread when
+data arrives; it must make the derived class' own thread call read_shared_memory_data(). The pipes are still used for starting up, and if the
+backend does not support the shared memory transport. Since the callback refers to the derived class, its destructor must call
+close_shared_memory_transport().
+
+Metadata is requested with get_metadata_batch commands, several entries at a time, so the scan rate is not bound by the
+round trip per entry. At most max_requests_in_flight entries are requested at the same time; once no more than
+request_refill_threshold of these are left, the next batch is sent. If the backend does not know get_metadata_batch,
+the scanner falls back to requesting one entry at a time with get_metadata.
+The watchdog timer is restarted with each result, so it acts as a per-entry timeout: if it expires, the derived class
+is expected to terminate the backend, and backend_crashed() then marks the entry the backend was working on as failed.
 */
 
 
@@ -92,15 +118,25 @@ public:
 	{
 		ion::uri uri_;
 		playlist_t *playlist_;
+		// 0 if no metadata request was sent for this entry yet; otherwise, the order in which the requests were sent
+		// (entries in the queue are const, and this is not part of any index, so it is mutable)
+		mutable unsigned long request_number;
 
-		entry(): playlist_(0) {}
+		entry(): playlist_(0), request_number(0) {}
 		entry(ion::uri const &uri_, playlist_t *playlist_):
 			uri_(uri_),
-			playlist_(playlist_)
+			playlist_(playlist_),
+			request_number(0)
 		{
 		}
 	};
 
+	enum
+	{
+		max_requests_in_flight = 64,
+		request_refill_threshold = 16
+	};
+
 	typedef boost::multi_index::multi_index_container <
 		entry,
 		boost::multi_index::indexed_by <
@@ -122,9 +158,19 @@ public:
 
 
 	explicit scanner_base(playlists_t &playlists_):
-		playlists_(playlists_)
+		channel(
+			boost::phoenix::bind(&self_t::send_data, this, boost::phoenix::arg_names::arg1),
+			boost::phoenix::bind(&self_t::parse_backend_event, this, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2)
+		),
+		playlists_(playlists_),
+		shared_memory_enabled(false),
+		shared_memory_active(false),
+		num_requests_in_flight(0),
+		next_request_number(1),
+		batch_requests_supported(true)
 	{
 		playlist_removed_connection = playlists_.get_playlist_removed_signal().connect(boost::phoenix::bind(&self_t::playlist_removed, this, boost::phoenix::arg_names::arg1));
+		channel.set_transport_callback(boost::phoenix::bind(&self_t::transport_switched, this, boost::phoenix::arg_names::arg1));
 	}
 
 
@@ -146,7 +192,7 @@ public:
 		{
 			get_derived().scanning_in_progress(true);
 			get_derived().restart_watchdog_timer();
-			request_next_metadata();
+			request_metadata();
 		}
 	}
 
@@ -167,27 +213,159 @@ protected:
 		queue_by_playlist_t &queue_by_playlist = queue.template get < playlist_tag > ();
 		queue_by_playlist.erase(queue_by_playlist.lower_bound(&playlist_), queue_by_playlist.upper_bound(&playlist_));
 
+		// Results for the removed entries are ignored, so they no longer count as in flight
+		num_requests_in_flight = 0;
+		BOOST_FOREACH(entry const &entry_, queue)
+		{
+			if (entry_.request_number != 0)
+				++num_requests_in_flight;
+		}
+
 		if (queue.empty())
 		{
 			get_derived().stop_watchdog_timer();
 			get_derived().scanning_in_progress(false);
 		}
+		else
+			request_metadata();
 	}
 
 
-	void request_next_metadata()
+	// Sends metadata requests for entries that have not been requested yet, unless enough requests are in flight already
+	void request_metadata()
 	{
-		if (queue.empty())
+		if (batch_requests_supported)
+		{
+			if (num_requests_in_flight > request_refill_threshold)
+				return;
+
+			params_t uris;
+			for (typename queue_sequence_t::iterator iter = queue.begin(); (iter != queue.end()) && (num_requests_in_flight < max_requests_in_flight); ++iter)
+			{
+				if (iter->request_number != 0)
+					continue;
+
+				iter->request_number = next_request_number++;
+				++num_requests_in_flight;
+				uris.push_back(iter->uri_.get_full());
+			}
+
+			if (!uris.empty())
+				channel.send_message("get_metadata_batch", uris);
+		}
+		else
+		{
+			if (num_requests_in_flight > 0)
+				return;
+
+			for (typename queue_sequence_t::iterator iter = queue.begin(); iter != queue.end(); ++iter)
+			{
+				if (iter->request_number != 0)
+					continue;
+
+				iter->request_number = next_request_number++;
+				++num_requests_in_flight;
+				channel.send_message("get_metadata", boost::assign::list_of(iter->uri_.get_full()));
+				break;
+			}
+		}
+	}
+
+
+	// Marks all entries as not requested; used when the requests in flight will never be answered
+	void reset_requests()
+	{
+		BOOST_FOREACH(entry const &entry_, queue)
+		{
+			entry_.request_number = 0;
+		}
+		num_requests_in_flight = 0;
+	}
+
+
+	void send_data(std::string const &data)
+	{
+		// If the write fails, the backend is gone; this is handled like with the pipes, by the derived class noticing the crash
+		if (shared_memory_active)
+			shared_memory_connection_->write(data);
+		else
+			get_derived().send_to_backend(data);
+	}
+
+
+	void backend_started()
+	{
+		// Each backend process gets a new segment
+		shared_memory_active = false;
+		if (shared_memory_enabled)
+		{
+			if (shared_memory_connection_->create())
+				channel.request_transport("shm", shared_memory_connection_->get_name());
+			else
+				std::cerr << "could not create shared memory segment; using pipes for scanning" << std::endl;
+		}
+
+		channel.backend_started();
+	}
+
+
+	void use_shared_memory_transport(boost::function < void() > const &data_available_callback)
+	{
+		shared_memory_connection_.reset(new shared_memory_connection(data_available_callback));
+		shared_memory_enabled = true;
+	}
+
+
+	void read_shared_memory_data()
+	{
+		if (!shared_memory_active)
+			return;
+
+		shared_memory_connection_->fetch_received_data(shared_memory_data);
+		if (!shared_memory_data.empty())
+			channel.feed(shared_memory_data.data(), shared_memory_data.length());
+	}
+
+
+	void close_shared_memory_transport()
+	{
+		shared_memory_active = false;
+		if (shared_memory_connection_)
+			shared_memory_connection_->close();
+	}
+
+
+	void transport_switched(std::string const &transport_name)
+	{
+		if (!shared_memory_enabled)
 			return;
 
-		entry front_entry = queue.front();
-		get_derived().send_to_backend(std::string("get_metadata \"") + front_entry.uri_.get_full() + '"');
+		if (transport_name == "shm")
+		{
+			shared_memory_active = true;
+			shared_memory_connection_->start_reading();
+		}
+		else
+			shared_memory_connection_->close();
+	}
+
+
+	void send_quit()
+	{
+		channel.send_message("quit");
+	}
+
+
+	void parse_backend_data(char const *data, std::size_t const size)
+	{
+		channel.feed(data, size);
 	}
 
 
 	void cancel_scan()
 	{
 		queue.clear();
+		num_requests_in_flight = 0;
 		get_derived().stop_watchdog_timer();
 		get_derived().scanning_in_progress(false);
 	}
@@ -196,19 +374,31 @@ protected:
 	// called by the derived class when the backend dies unexpectedly
 	void backend_crashed()
 	{
-		if (!queue.empty())
+		// The backend processes requests in the order they were sent, so the entry with the lowest request number
+		// is the one it was working on when it crashed (or when the watchdog terminated it)
+		typename queue_sequence_t::iterator culprit_iter = queue.end();
+		for (typename queue_sequence_t::iterator iter = queue.begin(); iter != queue.end(); ++iter)
 		{
-			entry front_entry = queue.front();
-			queue.pop_front();
-			get_derived().scanning_failed(front_entry.uri_, *(front_entry.playlist_));
+			if ((iter->request_number != 0) && ((culprit_iter == queue.end()) || (iter->request_number < culprit_iter->request_number)))
+				culprit_iter = iter;
 		}
 
+		if (culprit_iter != queue.end())
+		{
+			entry culprit_entry = *culprit_iter;
+			queue.erase(culprit_iter);
+			get_derived().scanning_failed(culprit_entry.uri_, *(culprit_entry.playlist_));
+		}
+
+		// The other requests in flight were lost with the backend, and are sent again to the new one
+		reset_requests();
+
 		get_derived().restart_backend();
 
 		if (!queue.empty())
 		{
 			get_derived().restart_watchdog_timer();
-			request_next_metadata();
+			request_metadata();
 		}
 		else
 		{
@@ -218,11 +408,16 @@ protected:
 	}
 
 
-	void parse_backend_event(std::string const &line)
+	void parse_backend_event(std::string const &command, params_t const &params)
 	{
-		std::string command;
-		params_t params;
-		split_command_line(line, command, params);
+		if ((command == "unknown_command") && (params.size() >= 1) && (params[0] == "get_metadata_batch"))
+		{
+			// older backend; no batch was processed, so request the entries again, one at a time
+			batch_requests_supported = false;
+			reset_requests();
+			request_metadata();
+			return;
+		}
 
 		queue_by_uri_t &queue_by_uri = queue.template get < uri_tag > ();
 		typename queue_by_uri_t::iterator resource_by_uri_iter = queue_by_uri.end();
@@ -235,13 +430,35 @@ protected:
 			uri uri_ = resource_by_uri_iter->uri_;
 			playlist_t *playlist_ = resource_by_uri_iter->playlist_;
 
+			if (resource_by_uri_iter->request_number != 0)
+				--num_requests_in_flight;
+
+			// metadata_result events (the answers to get_metadata_batch) are mapped to the events get_metadata produces
+			std::string result_command = command;
+			std::string const *metadata_str = 0;
+			if (command == "metadata_result")
+			{
+				std::string const status = (params.size() >= 2) ? params[1] : std::string("error");
+				if ((status == "ok") && (params.size() >= 3))
+				{
+					result_command = "metadata";
+					metadata_str = &params[2];
+				}
+				else if ((status == "resource_corrupted") || (status == "error"))
+					result_command = status;
+				else
+					result_command = "unrecognized_resource";
+			}
+			else if ((command == "metadata") && (params.size() >= 2))
+				metadata_str = &params[1];
+
 			bool playlist_exists = has_playlist(playlists_, *playlist_);
 
 			if (playlist_exists)
 			{
-				if ((command == "metadata") && (params.size() >= 2))
+				if ((result_command == "metadata") && (metadata_str != 0))
 				{
-					metadata_optional_t new_metadata = parse_metadata(params[1]);
+					metadata_optional_t new_metadata = parse_metadata(*metadata_str);
 
 					if (new_metadata)
 					{
@@ -250,7 +467,32 @@ protected:
 						uri::options_t::const_iterator uri_resource_index_iter = uri_.get_options().find("sub_resource_index");
 						bool has_resource_index = (uri_resource_index_iter != uri_.get_options().end());
 
-						if ((num_sub_resources > 1) && !has_resource_index)
+						metadata_t const &sub_resources = (*new_metadata)["sub_resources"];
+						metadata_t const &archive_members = (*new_metadata)["archive_members"];
+
+						if (archive_members.isArray() && (archive_members.size() > 0))
+						{
+							// the resource is an archive -> scan its members in its place
+							typename queue_sequence_t::iterator seq_iter = queue.template project < sequence_tag > (resource_by_uri_iter);
+							for (Json::Value::ArrayIndex i = 0; i < archive_members.size(); ++i)
+								queue.insert(seq_iter, entry(uri(archive_members[i].asString()), playlist_));
+						}
+						else if ((num_sub_resources > 1) && !has_resource_index && sub_resources.isArray() && (long(sub_resources.size()) == num_sub_resources))
+						{
+							// the backend delivered the metadata of all sub-resources along with the resource's metadata
+							// -> no need to request each sub-resource individually
+							for (Json::Value::ArrayIndex i = 0; i < sub_resources.size(); ++i)
+							{
+								metadata_t sub_resource_metadata = sub_resources[i];
+								long sub_resource_index = get_metadata_value < long > (sub_resource_metadata, "sub_resource_index", min_sub_resource_index + long(i));
+								uri sub_uri = uri_;
+								sub_uri.get_options()["sub_resource_index"] = boost::lexical_cast < std::string > (sub_resource_index);
+
+								add_sub_resource_number_to_title(sub_resource_metadata, sub_uri.get_options()["sub_resource_index"], min_sub_resource_index, num_sub_resources);
+								get_derived().resource_successfully_scanned(sub_uri, *playlist_, sub_resource_metadata);
+							}
+						}
+						else if ((num_sub_resources > 1) && !has_resource_index)
 						{
 							for (int i = 0; i < num_sub_resources; ++i)
 							{
@@ -265,25 +507,8 @@ protected:
 						}
 						else
 						{
-							if (has_metadata_value(*new_metadata, "title") && has_resource_index)
-							{
-								std::string title = get_metadata_value < std::string > (*new_metadata, "title", "");
-								std::stringstream sstr;
-								std::string resource_index_str = uri_resource_index_iter->second;
-
-								try
-								{
-									// This compensates for the 0-starting indices
-									int resource_index = boost::lexical_cast < int > (resource_index_str);
-									resource_index_str = boost::lexical_cast < std::string > (resource_index + 1 - min_sub_resource_index);
-								}
-								catch (boost::bad_lexical_cast const &)
-								{
-								}
-
-								sstr << title << " (" << resource_index_str << "/" << num_sub_resources << ")";
-								set_metadata_value(*new_metadata, "title", sstr.str());
-							}
+							if (has_resource_index)
+								add_sub_resource_number_to_title(*new_metadata, uri_resource_index_iter->second, min_sub_resource_index, num_sub_resources);
 
 							get_derived().resource_successfully_scanned(uri_, *playlist_, *new_metadata);
 						}
@@ -291,14 +516,18 @@ protected:
 					else
 						get_derived().unrecognized_resource(uri_, *playlist_);
 				}
-				else if (command == "resource_corrupted")
+				else if (result_command == "resource_corrupted")
 				{
 					get_derived().resource_corrupted(uri_, *playlist_);
 				}
-				else if (command == "unrecognized_resource")
+				else if (result_command == "unrecognized_resource")
 				{
 					get_derived().unrecognized_resource(uri_, *playlist_);
 				}
+				else if (result_command == "error")
+				{
+					get_derived().scanning_failed(uri_, *playlist_);
+				}
 				/*else if (command == "error")
 				{
 					get_derived().resource_scan_error(uri_, *playlist_, (params.size() >= 2) ? params[1] : boost::none);
@@ -325,15 +554,45 @@ protected:
 			else
 			{
 				get_derived().restart_watchdog_timer();
-				request_next_metadata();
+				request_metadata();
 			}
 		}
 	}
 
 
+	// appends " (<number>/<num_sub_resources>)" to the title, number being the 1-based position of the sub-resource
+	void add_sub_resource_number_to_title(metadata_t &metadata_, std::string resource_index_str, long const min_sub_resource_index, long const num_sub_resources)
+	{
+		if (!has_metadata_value(metadata_, "title"))
+			return;
+
+		std::string title = get_metadata_value < std::string > (metadata_, "title", "");
+		std::stringstream sstr;
+
+		try
+		{
+			// This compensates for the 0-starting indices
+			int resource_index = boost::lexical_cast < int > (resource_index_str);
+			resource_index_str = boost::lexical_cast < std::string > (resource_index + 1 - min_sub_resource_index);
+		}
+		catch (boost::bad_lexical_cast const &)
+		{
+		}
+
+		sstr << title << " (" << resource_index_str << "/" << num_sub_resources << ")";
+		set_metadata_value(metadata_, "title", sstr.str());
+	}
+
+
+	message_channel channel;
 	queue_t queue;
 	playlists_t &playlists_;
 	boost::signals2::connection playlist_removed_connection;
+	boost::scoped_ptr < shared_memory_connection > shared_memory_connection_;
+	bool shared_memory_enabled, shared_memory_active;
+	std::string shared_memory_data;
+	unsigned long num_requests_in_flight, next_request_number;
+	bool batch_requests_supported;
 };
 
 
@@ -0,0 +1,605 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/spirit/home/phoenix/bind.hpp>
+#include <boost/thread/locks.hpp>
+#include "shared_memory_transport.hpp"
+
+
+namespace ion
+{
+
+
+namespace detail
+{
+
+
+struct shared_memory_ring_header
+{
+	// Process-shared and robust; if a process dies while holding it, the next one locking it is told so (see ring_lock)
+	pthread_mutex_t mutex;
+	// Signaled when data or space becomes available, or when the transport is closed; uses the monotonic clock for timeouts
+	pthread_cond_t condition;
+	// Total number of bytes written and read; they wrap around, which is fine, since the ring size is a power of two
+	std::size_t write_count, read_count;
+	bool reader_waiting, writer_waiting, closed;
+
+	shared_memory_ring_header():
+		write_count(0),
+		read_count(0),
+		reader_waiting(false),
+		writer_waiting(false),
+		closed(false)
+	{
+	}
+
+	bool init_sync_objects()
+	{
+		pthread_mutexattr_t mutex_attr;
+		if (pthread_mutexattr_init(&mutex_attr) != 0)
+			return false;
+		bool mutex_ok =
+			(pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED) == 0) &&
+			(pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST) == 0) &&
+			(pthread_mutex_init(&mutex, &mutex_attr) == 0);
+		pthread_mutexattr_destroy(&mutex_attr);
+		if (!mutex_ok)
+			return false;
+
+		pthread_condattr_t condition_attr;
+		if (pthread_condattr_init(&condition_attr) != 0)
+			return false;
+		bool condition_ok =
+			(pthread_condattr_setpshared(&condition_attr, PTHREAD_PROCESS_SHARED) == 0) &&
+			(pthread_condattr_setclock(&condition_attr, CLOCK_MONOTONIC) == 0) &&
+			(pthread_cond_init(&condition, &condition_attr) == 0);
+		pthread_condattr_destroy(&condition_attr);
+		return condition_ok;
+	}
+};
+
+
+struct shared_memory_segment_header
+{
+	boost::uint32_t magic;
+	std::size_t ring_size;
+	// Process IDs of the frontend and the backend; 0 if not known yet
+	long pids[2];
+	// Start times of the processes (see get_process_start_time()); they tell a process apart from a later one that reuses its ID
+	boost::uint64_t start_times[2];
+	// rings[frontend_side] transports data from the frontend to the backend, rings[backend_side] the other way round
+	shared_memory_ring_header rings[2];
+};
+
+
+}
+
+
+namespace
+{
+
+
+boost::uint32_t const segment_magic = 0x696f6e32; // "ion2"
+
+// How often the process ID of the other side is checked while waiting, in milliseconds
+long const liveness_check_interval = 500;
+
+
+std::size_t get_ring_data_offset()
+{
+	// The ring data starts at a cache line boundary
+	return (sizeof(detail::shared_memory_segment_header) + 63) & ~std::size_t(63);
+}
+
+
+// Returns the start time of the given process, in clock ticks since boot, or 0 if it cannot be determined
+boost::uint64_t get_process_start_time(long const pid)
+{
+	std::stringstream filename;
+	filename << "/proc/" << pid << "/stat";
+	std::ifstream stat_file(filename.str().c_str());
+	std::string stat;
+	if (!std::getline(stat_file, stat))
+		return 0;
+
+	// The second field is the executable name in parentheses, which may contain spaces; the start time is the 20th field after it
+	std::string::size_type name_end = stat.rfind(')');
+	if (name_end == std::string::npos)
+		return 0;
+
+	std::istringstream fields(stat.substr(name_end + 1));
+	std::string field;
+	for (int i = 0; i < 19; ++i)
+		fields >> field;
+
+	boost::uint64_t start_time = 0;
+	fields >> start_time;
+	return fields ? start_time : 0;
+}
+
+
+bool is_process_alive(long const pid, boost::uint64_t const start_time)
+{
+	if (pid == 0)
+		return true;
+	if ((kill(pid_t(pid), 0) != 0) && (errno == ESRCH))
+		return false;
+
+	// The process ID may belong to another process by now
+	return (start_time == 0) || (get_process_start_time(pid) == start_time);
+}
+
+
+/*
+Scoped lock for a ring's mutex. If the process holding the mutex died, the lock is still acquired, but the ring is marked as closed,
+since the dead process may have left it in an inconsistent state. This way, no thread can be blocked forever by a crashed process.
+*/
+class ring_lock:
+	private boost::noncopyable
+{
+public:
+	explicit ring_lock(detail::shared_memory_ring_header &ring):
+		ring(ring),
+		locked(false)
+	{
+		handle_lock_result(pthread_mutex_lock(&ring.mutex));
+	}
+
+	~ring_lock()
+	{
+		if (locked)
+			pthread_mutex_unlock(&ring.mutex);
+	}
+
+	// Waits until the ring's condition is signaled or the timeout passed. Returns false if the timeout passed.
+	bool timed_wait(long const timeout)
+	{
+		if (!locked)
+			return false;
+
+		timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (timeout % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec += 1;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		int result = pthread_cond_timedwait(&ring.condition, &ring.mutex, &deadline);
+		handle_lock_result(result);
+		return result != ETIMEDOUT;
+	}
+
+
+private:
+	void handle_lock_result(int const result)
+	{
+		locked = (result == 0) || (result == EOWNERDEAD) || (result == ETIMEDOUT);
+		if (result == EOWNERDEAD)
+			pthread_mutex_consistent(&ring.mutex);
+		if (!locked || (result == EOWNERDEAD))
+			ring.closed = true;
+	}
+
+
+	detail::shared_memory_ring_header &ring;
+	bool locked;
+};
+
+
+// Waits until the condition is signaled or the check interval passed. Returns false if the other process is gone.
+bool wait_for_other_side(ring_lock &lock, bool &waiting_flag, long const other_pid, boost::uint64_t const other_start_time)
+{
+	waiting_flag = true;
+	bool signaled = lock.timed_wait(liveness_check_interval);
+	waiting_flag = false;
+	return signaled || is_process_alive(other_pid, other_start_time);
+}
+
+
+}
+
+
+shared_memory_transport::shared_memory_transport():
+	header(0),
+	side(frontend_side)
+{
+}
+
+
+shared_memory_transport::~shared_memory_transport()
+{
+	close();
+}
+
+
+bool shared_memory_transport::create(std::string const &new_name, std::size_t const ring_size)
+{
+	close();
+
+	std::size_t actual_ring_size = 4096;
+	while (actual_ring_size < ring_size)
+		actual_ring_size *= 2;
+
+	try
+	{
+		boost::interprocess::shared_memory_object::remove(new_name.c_str());
+		boost::interprocess::shared_memory_object shm(boost::interprocess::create_only, new_name.c_str(), boost::interprocess::read_write);
+		shm.truncate(get_ring_data_offset() + actual_ring_size * 2);
+		region.reset(new boost::interprocess::mapped_region(shm, boost::interprocess::read_write));
+	}
+	catch (boost::interprocess::interprocess_exception const &)
+	{
+		boost::interprocess::shared_memory_object::remove(new_name.c_str());
+		region.reset();
+		return false;
+	}
+
+	header = new (region->get_address()) detail::shared_memory_segment_header;
+	if (!header->rings[0].init_sync_objects() || !header->rings[1].init_sync_objects())
+	{
+		header = 0;
+		region.reset();
+		boost::interprocess::shared_memory_object::remove(new_name.c_str());
+		return false;
+	}
+
+	header->magic = segment_magic;
+	header->ring_size = actual_ring_size;
+	header->pids[frontend_side] = long(getpid());
+	header->pids[backend_side] = 0;
+	header->start_times[frontend_side] = get_process_start_time(getpid());
+	header->start_times[backend_side] = 0;
+
+	side = frontend_side;
+	name = new_name;
+
+	return true;
+}
+
+
+bool shared_memory_transport::open(std::string const &new_name)
+{
+	close();
+
+	try
+	{
+		boost::interprocess::shared_memory_object shm(boost::interprocess::open_only, new_name.c_str(), boost::interprocess::read_write);
+		region.reset(new boost::interprocess::mapped_region(shm, boost::interprocess::read_write));
+	}
+	catch (boost::interprocess::interprocess_exception const &)
+	{
+		region.reset();
+		return false;
+	}
+
+	detail::shared_memory_segment_header *new_header = static_cast < detail::shared_memory_segment_header* > (region->get_address());
+	if (
+		(region->get_size() < get_ring_data_offset()) ||
+		(new_header->magic != segment_magic) ||
+		(region->get_size() < (get_ring_data_offset() + new_header->ring_size * 2))
+	)
+	{
+		region.reset();
+		return false;
+	}
+
+	header = new_header;
+	header->start_times[backend_side] = get_process_start_time(getpid());
+	header->pids[backend_side] = long(getpid());
+
+	side = backend_side;
+	name = new_name;
+
+	// The mapping stays valid; removing the name right away ensures the segment does not outlive the two processes
+	boost::interprocess::shared_memory_object::remove(name.c_str());
+
+	return true;
+}
+
+
+void shared_memory_transport::shutdown()
+{
+	if (header == 0)
+		return;
+
+	for (int i = 0; i < 2; ++i)
+	{
+		detail::shared_memory_ring_header &ring = header->rings[i];
+		ring_lock lock(ring);
+		ring.closed = true;
+		pthread_cond_broadcast(&ring.condition);
+	}
+}
+
+
+void shared_memory_transport::close()
+{
+	if (header == 0)
+		return;
+
+	shutdown();
+
+	header = 0;
+	region.reset();
+
+	if (side == frontend_side)
+		boost::interprocess::shared_memory_object::remove(name.c_str());
+	name.clear();
+}
+
+
+bool shared_memory_transport::write(char const *data, std::size_t size)
+{
+	if (header == 0)
+		return false;
+
+	detail::shared_memory_ring_header &ring = header->rings[side];
+	char *ring_data = get_ring_data(side);
+	std::size_t const ring_size = header->ring_size;
+	long const other_pid = header->pids[1 - side];
+	boost::uint64_t const other_start_time = header->start_times[1 - side];
+
+	while (size > 0)
+	{
+		std::size_t write_count, num_free_bytes;
+
+		{
+			ring_lock lock(ring);
+
+			while (!ring.closed && ((ring.write_count - ring.read_count) == ring_size))
+			{
+				if (!wait_for_other_side(lock, ring.writer_waiting, other_pid, other_start_time))
+					return false;
+			}
+
+			if (ring.closed)
+				return false;
+
+			write_count = ring.write_count;
+			num_free_bytes = ring_size - (write_count - ring.read_count);
+		}
+
+		// Only this thread writes to the free part of the ring, so the data can be copied without holding the mutex
+		std::size_t num_bytes = std::min(size, num_free_bytes);
+		std::size_t offset = write_count & (ring_size - 1);
+		std::size_t num_bytes_until_end = std::min(num_bytes, ring_size - offset);
+		std::memcpy(ring_data + offset, data, num_bytes_until_end);
+		std::memcpy(ring_data, data + num_bytes_until_end, num_bytes - num_bytes_until_end);
+
+		{
+			ring_lock lock(ring);
+			ring.write_count = write_count + num_bytes;
+			if (ring.reader_waiting)
+				pthread_cond_broadcast(&ring.condition);
+		}
+
+		data += num_bytes;
+		size -= num_bytes;
+	}
+
+	return true;
+}
+
+
+std::size_t shared_memory_transport::read(char *buffer, std::size_t const max_size)
+{
+	if ((header == 0) || (max_size == 0))
+		return 0;
+
+	side_type const other_side = side_type(1 - side);
+	detail::shared_memory_ring_header &ring = header->rings[other_side];
+	char const *ring_data = get_ring_data(other_side);
+	std::size_t const ring_size = header->ring_size;
+	long const other_pid = header->pids[other_side];
+	boost::uint64_t const other_start_time = header->start_times[other_side];
+
+	std::size_t read_count, num_available_bytes;
+
+	{
+		ring_lock lock(ring);
+
+		while (!ring.closed && (ring.write_count == ring.read_count))
+		{
+			if (!wait_for_other_side(lock, ring.reader_waiting, other_pid, other_start_time))
+				return 0;
+		}
+
+		// Data written before the transport was closed is still delivered
+		read_count = ring.read_count;
+		num_available_bytes = ring.write_count - read_count;
+		if (num_available_bytes == 0)
+			return 0;
+	}
+
+	std::size_t num_bytes = std::min(max_size, num_available_bytes);
+	std::size_t offset = read_count & (ring_size - 1);
+	std::size_t num_bytes_until_end = std::min(num_bytes, ring_size - offset);
+	std::memcpy(buffer, ring_data + offset, num_bytes_until_end);
+	std::memcpy(buffer + num_bytes_until_end, ring_data, num_bytes - num_bytes_until_end);
+
+	{
+		ring_lock lock(ring);
+		ring.read_count = read_count + num_bytes;
+		if (ring.writer_waiting)
+			pthread_cond_broadcast(&ring.condition);
+	}
+
+	return num_bytes;
+}
+
+
+std::string shared_memory_transport::generate_name()
+{
+	static unsigned int counter = 0;
+	std::stringstream sstr;
+	sstr << "ion_transport_" << getpid() << "_" << (counter++);
+	return sstr.str();
+}
+
+
+char* shared_memory_transport::get_ring_data(side_type const ring_side)
+{
+	return static_cast < char* > (region->get_address()) + get_ring_data_offset() + header->ring_size * std::size_t(ring_side);
+}
+
+
+
+
+shared_memory_streambuf::shared_memory_streambuf(shared_memory_transport &transport, std::size_t const read_buffer_size):
+	transport(transport),
+	read_buffer(read_buffer_size)
+{
+}
+
+
+shared_memory_streambuf::int_type shared_memory_streambuf::underflow()
+{
+	if (gptr() < egptr())
+		return traits_type::to_int_type(*gptr());
+
+	std::size_t num_bytes = transport.read(&read_buffer[0], read_buffer.size());
+	if (num_bytes == 0)
+		return traits_type::eof();
+
+	setg(&read_buffer[0], &read_buffer[0], &read_buffer[0] + num_bytes);
+	return traits_type::to_int_type(*gptr());
+}
+
+
+shared_memory_streambuf::int_type shared_memory_streambuf::overflow(int_type c)
+{
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+
+	char ch = traits_type::to_char_type(c);
+	return transport.write(&ch, 1) ? c : traits_type::eof();
+}
+
+
+std::streamsize shared_memory_streambuf::xsputn(char const *s, std::streamsize n)
+{
+	return transport.write(s, std::size_t(n)) ? n : 0;
+}
+
+
+
+
+shared_memory_connection::shared_memory_connection(data_available_callback_t const &data_available_callback):
+	data_available_callback(data_available_callback)
+{
+}
+
+
+shared_memory_connection::~shared_memory_connection()
+{
+	close();
+}
+
+
+bool shared_memory_connection::create()
+{
+	close();
+	return transport.create(shared_memory_transport::generate_name());
+}
+
+
+void shared_memory_connection::start_reading()
+{
+	if (transport.is_open() && !reading_thread.joinable())
+		reading_thread = boost::thread(boost::phoenix::bind(&shared_memory_connection::reading_loop, this));
+}
+
+
+void shared_memory_connection::close()
+{
+	transport.shutdown();
+	if (reading_thread.joinable())
+		reading_thread.join();
+	reading_thread = boost::thread();
+	transport.close();
+
+	boost::lock_guard < boost::mutex > lock(received_data_mutex);
+	received_data.clear();
+}
+
+
+bool shared_memory_connection::write(std::string const &data)
+{
+	return transport.write(data.data(), data.length());
+}
+
+
+void shared_memory_connection::fetch_received_data(std::string &data)
+{
+	data.clear();
+	boost::lock_guard < boost::mutex > lock(received_data_mutex);
+	data.swap(received_data);
+}
+
+
+void shared_memory_connection::reading_loop()
+{
+	std::vector < char > buffer(64 * 1024);
+
+	while (true)
+	{
+		std::size_t num_bytes = transport.read(&buffer[0], buffer.size());
+		if (num_bytes == 0)
+			return;
+
+		bool was_empty;
+		{
+			boost::lock_guard < boost::mutex > lock(received_data_mutex);
+			was_empty = received_data.empty();
+			received_data.append(&buffer[0], num_bytes);
+		}
+
+		// The frontend fetches everything that was received so far, so it only needs to be notified once per fetch
+		if (was_empty && data_available_callback)
+			data_available_callback();
+	}
+}
+
+
+}
+
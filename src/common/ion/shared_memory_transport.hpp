@@ -0,0 +1,208 @@
+/****************************************************************************
+
+Copyright (c) 2010 Carlos Rafael Giani
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+
+****************************************************************************/
+
+
+#ifndef ION_SHARED_MEMORY_TRANSPORT_HPP
+#define ION_SHARED_MEMORY_TRANSPORT_HPP
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+
+namespace boost
+{
+namespace interprocess
+{
+class mapped_region;
+}
+}
+
+
+namespace ion
+{
+
+
+namespace detail
+{
+struct shared_memory_segment_header;
+}
+
+
+/*
+Front- and backend normally exchange messages over the backend's stdin/stdout pipes. For high message rates (for example, the metadata_result
+events of a scan), a shared memory segment can be used instead, which avoids a system call per write and read in the common case.
+
+The segment contains two byte rings, one for each direction. Each ring has exactly one writer and one reader. The ring positions are protected
+by a process-shared mutex, which only needs a system call if it is contended; the data itself is copied without holding the mutex. A reader
+only sleeps on the ring's condition when the ring is empty (and a writer only when it is full), and the other side only signals the condition
+if someone is sleeping on it, so during bursts, no system calls are made at all. While sleeping, the other process is checked periodically;
+if it no longer exists, the transport is considered closed. Processes are identified by their ID and their start time, so a process that
+reuses the ID of a dead one is not mistaken for it. The mutexes are robust: if a process dies while holding one, the other process still
+acquires it, and the transport is considered closed as well, so a crashing process can never block the other one forever.
+
+The frontend creates the segment and tells the backend about it through the pipes, using the text command   set_transport "shm" "<name>"   .
+The backend opens the segment and answers with   transport "shm"   (still through the pipe); everything after that is exchanged through the
+segment. If the backend cannot open the segment, it answers with   transport "pipe"   , and the pipes stay in use. Once opened, the backend
+removes the segment's name, so the segment disappears as soon as both processes are gone, even if they crash. The messages themselves are
+encoded just like with the pipes (see message_framing.hpp); the protocol is negotiated before the transport.
+
+shared_memory_transport is the segment itself. shared_memory_streambuf makes it usable as a stream, which is how the backend main loop uses it.
+shared_memory_connection is meant for frontends: it reads from the segment in a thread, and hands over the received data to the frontend's thread.
+*/
+class shared_memory_transport:
+	private boost::noncopyable
+{
+public:
+	enum side_type
+	{
+		frontend_side = 0,
+		backend_side = 1
+	};
+
+	// Size of each ring in bytes. The sizes are rounded up to powers of two.
+	static std::size_t const default_ring_size = 1024 * 1024;
+
+
+	shared_memory_transport();
+	~shared_memory_transport();
+
+	// Creates a new segment with the given name; used by the frontend. Returns false if the segment could not be created.
+	bool create(std::string const &new_name, std::size_t const ring_size = default_ring_size);
+	// Opens an existing segment; used by the backend. Returns false if the segment does not exist or is not a valid transport segment.
+	bool open(std::string const &new_name);
+
+	/*
+	Marks the transport as closed for both sides, and wakes up threads that wait in read() or write() (in both processes).
+	Data that was written before can still be read. Unlike close(), this can be called while other threads use the transport.
+	*/
+	void shutdown();
+	/*
+	Shuts down the transport, and unmaps the segment. If the segment was created by this object, its name is removed.
+	@pre No other thread may be using this transport
+	*/
+	void close();
+
+	bool is_open() const { return header != 0; }
+	std::string const & get_name() const { return name; }
+
+	// Blocks until all data was written. Returns false if the transport was closed, or the other process is gone.
+	bool write(char const *data, std::size_t const size);
+	// Blocks until at least one byte is available, and reads up to max_size bytes. Returns 0 once the transport is closed and all data was read,
+	// or if the other process is gone.
+	std::size_t read(char *buffer, std::size_t const max_size);
+
+	// Returns a name that is unique to this process and call.
+	static std::string generate_name();
+
+
+private:
+	char* get_ring_data(side_type const ring_side);
+
+
+	boost::scoped_ptr < boost::interprocess::mapped_region > region;
+	detail::shared_memory_segment_header *header;
+	side_type side;
+	std::string name;
+};
+
+
+/*
+Stream buffer for reading from and writing to a shared memory transport. Reading blocks until data is available; end-of-file is reported
+once the transport is closed. Writing is unbuffered, so each write() call on the stream results in one write to the transport.
+Reading and writing may happen in different threads.
+*/
+class shared_memory_streambuf:
+	public std::streambuf,
+	private boost::noncopyable
+{
+public:
+	explicit shared_memory_streambuf(shared_memory_transport &transport, std::size_t const read_buffer_size = 64 * 1024);
+
+
+protected:
+	virtual int_type underflow();
+	virtual int_type overflow(int_type c);
+	virtual std::streamsize xsputn(char const *s, std::streamsize n);
+
+
+private:
+	shared_memory_transport &transport;
+	std::vector < char > read_buffer;
+};
+
+
+/*
+Frontend side of a shared memory transport. create() creates a segment with a generated name, which is then sent to the backend with the
+set_transport command (see message_channel.hpp). Once the backend switched, start_reading() starts a thread that reads from the segment.
+The thread collects the received data, and calls the data available callback when data arrives while none was waiting; the callback
+is invoked in the reading thread, so it should just notify the frontend's own thread, which then calls fetch_received_data().
+*/
+class shared_memory_connection:
+	private boost::noncopyable
+{
+public:
+	typedef boost::function < void() > data_available_callback_t;
+
+
+	explicit shared_memory_connection(data_available_callback_t const &data_available_callback);
+	~shared_memory_connection();
+
+	bool create();
+	void start_reading();
+	// Stops the reading thread, and closes the transport. Received data that was not fetched yet is discarded.
+	void close();
+
+	bool is_open() const { return transport.is_open(); }
+	std::string const & get_name() const { return transport.get_name(); }
+
+	bool write(std::string const &data);
+	// Replaces the contents of data with the data received since the last call.
+	void fetch_received_data(std::string &data);
+
+
+private:
+	void reading_loop();
+
+
+	shared_memory_transport transport;
+	data_available_callback_t data_available_callback;
+	boost::thread reading_thread;
+	boost::mutex received_data_mutex;
+	std::string received_data;
+};
+
+
+}
+
+
+#endif
+
@@ -39,7 +39,6 @@ namespace speex_resampler
 
 
 /* TODO:
-- handle bit depths other than 16
 - test with decoders that change the frequency while playing
 */
 
@@ -129,6 +128,8 @@ audio_common::sample_type speex_resampler::find_compatible_type(audio_common::sa
 		case audio_common::sample_s24_x8_msb:
 		case audio_common::sample_s32:
 			return audio_common::sample_s32;
+		case audio_common::sample_float32:
+			return audio_common::sample_float32;
 		default:
 			return audio_common::sample_unknown;
 	}
@@ -189,6 +190,7 @@ unsigned long speex_resampler::operator()(
 		{
 			case audio_common::sample_s16: num_written_samples = resample_16bit(input_data, num_input_samples, &output_buffer[offset], adjusted_max_num_output_samples); break;
 			case audio_common::sample_s32: num_written_samples = resample_32bit(input_data, num_input_samples, &output_buffer[offset], adjusted_max_num_output_samples); break;
+			case audio_common::sample_float32: num_written_samples = resample_float(input_data, num_input_samples, &output_buffer[offset], adjusted_max_num_output_samples); break;
 			default: assert(0); return 0;
 		}
 
@@ -241,6 +243,50 @@ unsigned long speex_resampler::resample_16bit(void const *input_data, unsigned l
 
 unsigned long speex_resampler::resample_32bit(void const *input_data, unsigned long const num_input_samples, void *output_data, unsigned long const max_num_output_samples)
 {
+	// the resampler is built with floating point support; s32 sample values are converted to floats in the -1.0 .. 1.0 range before resampling,
+	// and converted back afterwards (reinterpreting the integers as floats - as was done previously - produces garbage)
+
+	static float const scale = 2147483648.0f;
+	unsigned int num_channels = internal_data_->num_channels;
+
+	float_input_buffer.resize(num_input_samples * num_channels);
+	float_output_buffer.resize(max_num_output_samples * num_channels);
+
+	int32_t const *in_ptr = reinterpret_cast < int32_t const * > (input_data);
+	for (unsigned long i = 0; i < num_input_samples * num_channels; ++i)
+		float_input_buffer[i] = float(in_ptr[i]) / scale;
+
+	spx_uint32_t in_length = num_input_samples;
+	spx_uint32_t out_length = max_num_output_samples;
+
+	int err;
+	err = speex_resampler_process_interleaved_float(
+		internal_data_->speex_resampler,
+		float_input_buffer.empty() ? 0 : &float_input_buffer[0],
+		&in_length,
+		float_output_buffer.empty() ? 0 : &float_output_buffer[0],
+		&out_length
+	);
+
+	int32_t *out_ptr = reinterpret_cast < int32_t * > (output_data);
+	for (unsigned long i = 0; i < out_length * num_channels; ++i)
+	{
+		float value = float_output_buffer[i] * scale;
+		if (value >= scale)
+			out_ptr[i] = 2147483647;
+		else if (value < -scale)
+			out_ptr[i] = -2147483647 - 1;
+		else
+			out_ptr[i] = int32_t(value);
+	}
+
+	return out_length;
+}
+
+
+unsigned long speex_resampler::resample_float(void const *input_data, unsigned long const num_input_samples, void *output_data, unsigned long const max_num_output_samples)
+{
+	// the resampler works with floats internally, so float samples can be passed through without any conversion
 	spx_uint32_t in_length = num_input_samples;
 	spx_uint32_t out_length = max_num_output_samples;
 
@@ -262,4 +308,3 @@ unsigned long speex_resampler::resample_32bit(void const *input_data, unsigned l
 
 }
 }
-
@@ -64,6 +64,7 @@ public:
 protected:
 	unsigned long resample_16bit(void const *input_data, unsigned long const num_input_samples, void *output_data, unsigned long const max_num_output_samples);
 	unsigned long resample_32bit(void const *input_data, unsigned long const num_input_samples, void *output_data, unsigned long const max_num_output_samples);
+	unsigned long resample_float(void const *input_data, unsigned long const num_input_samples, void *output_data, unsigned long const max_num_output_samples);
 
 
 	struct internal_data;
@@ -71,6 +72,9 @@ protected:
 
 	typedef std::vector < uint8_t > buffer_t;
 	buffer_t output_buffer;
+
+	typedef std::vector < float > float_buffer_t;
+	float_buffer_t float_input_buffer, float_output_buffer;
 };
 
 
@@ -0,0 +1,135 @@
+#include <iostream>
+#include <string>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/lexical_cast.hpp>
+#include <ion/command_line_tools.hpp>
+#include <ion/metadata.hpp>
+
+
+/*
+Microbenchmark for the command line tools. It splits and recombines metadata event lines, like the ones the frontend receives
+from the backend during scanning. Each line carries a URI and a JSON metadata object with a few sub resources, which contains
+plenty of characters that need escaping (quotes and newlines).
+
+Usage: command_line_benchmark [<number of iterations>]
+*/
+
+
+namespace
+{
+
+
+ion::params_t create_metadata_event_params(unsigned int const index)
+{
+	ion::metadata_t metadata = ion::empty_metadata();
+	ion::set_metadata_value(metadata, "title", "Some \"quoted\" song title #" + boost::lexical_cast < std::string > (index));
+	ion::set_metadata_value(metadata, "artist", std::string("Artist with a \\ backslash"));
+	ion::set_metadata_value(metadata, "decoder_type", std::string("gme"));
+	ion::set_metadata_value(metadata, "num_ticks", 6086990 + index);
+	ion::set_metadata_value(metadata, "num_ticks_per_second", 44100);
+
+	ion::metadata_t sub_resources(Json::arrayValue);
+	for (unsigned int i = 0; i < 8; ++i)
+	{
+		ion::metadata_t sub_resource = ion::empty_metadata();
+		ion::set_metadata_value(sub_resource, "sub_resource_index", i);
+		ion::set_metadata_value(sub_resource, "title", "Subsong " + boost::lexical_cast < std::string > (i));
+		ion::set_metadata_value(sub_resource, "num_ticks", 44100 * (i + 60));
+		sub_resources.append(sub_resource);
+	}
+	metadata["sub_resources"] = sub_resources;
+
+	ion::params_t params;
+	params.push_back("file:///home/user/music/chiptunes/pack_" + boost::lexical_cast < std::string > (index) + ".nsf?id=" + boost::lexical_cast < std::string > (index));
+	params.push_back(ion::get_metadata_string(metadata));
+	return params;
+}
+
+
+void print_result(std::string const &name, boost::posix_time::time_duration const &duration, unsigned long const num_lines, unsigned long const num_bytes)
+{
+	double seconds = duration.total_microseconds() / 1000000.0;
+	std::cout << name << ": " << (num_lines / seconds) << " lines/s, " << (num_bytes / seconds / (1024.0 * 1024.0)) << " MB/s" << std::endl;
+}
+
+
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned int const num_distinct_lines = 64;
+	unsigned long num_iterations = 200000;
+	if (argc >= 2)
+		num_iterations = boost::lexical_cast < unsigned long > (argv[1]);
+
+	std::vector < ion::params_t > event_params;
+	std::vector < std::string > lines;
+	unsigned long total_line_length = 0;
+	for (unsigned int i = 0; i < num_distinct_lines; ++i)
+	{
+		event_params.push_back(create_metadata_event_params(i));
+		lines.push_back(ion::recombine_command_line("metadata", event_params.back()));
+		total_line_length += lines.back().length();
+	}
+
+	unsigned long const num_bytes = total_line_length * (num_iterations / num_distinct_lines);
+	unsigned long const num_lines = (num_iterations / num_distinct_lines) * num_distinct_lines;
+	std::cout << "average line length: " << (total_line_length / num_distinct_lines) << " bytes, " << num_lines << " lines" << std::endl;
+
+	// checksum, so the compiler cannot optimize the work away
+	unsigned long checksum = 0;
+
+
+	// splitting, with new command and params objects for each line (like most callers do)
+	{
+		boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+		for (unsigned long i = 0; i < num_lines; ++i)
+		{
+			std::string command;
+			ion::params_t params;
+			ion::split_command_line(lines[i % num_distinct_lines], command, params);
+			checksum += params[1].length();
+		}
+		print_result("split (new objects)", boost::posix_time::microsec_clock::universal_time() - start_time, num_lines, num_bytes);
+	}
+
+	// splitting, reusing the command and params objects
+	{
+		std::string command;
+		ion::params_t params;
+		boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+		for (unsigned long i = 0; i < num_lines; ++i)
+		{
+			ion::split_command_line(lines[i % num_distinct_lines], command, params);
+			checksum += params[1].length();
+		}
+		print_result("split (reused objects)", boost::posix_time::microsec_clock::universal_time() - start_time, num_lines, num_bytes);
+	}
+
+	// recombining, returning a new line each time
+	{
+		boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+		for (unsigned long i = 0; i < num_lines; ++i)
+			checksum += ion::recombine_command_line("metadata", event_params[i % num_distinct_lines]).length();
+		print_result("recombine (new line)", boost::posix_time::microsec_clock::universal_time() - start_time, num_lines, num_bytes);
+	}
+
+	// recombining into a reused line
+	{
+		std::string line;
+		boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+		for (unsigned long i = 0; i < num_lines; ++i)
+		{
+			ion::recombine_command_line("metadata", event_params[i % num_distinct_lines], line);
+			checksum += line.length();
+		}
+		print_result("recombine (reused line)", boost::posix_time::microsec_clock::universal_time() - start_time, num_lines, num_bytes);
+	}
+
+
+	std::cout << "checksum: " << checksum << std::endl;
+
+	return 0;
+}
+
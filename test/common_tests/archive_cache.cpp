@@ -0,0 +1,194 @@
+#include "test.hpp"
+#include <unistd.h>
+#include <zlib.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/spirit/home/phoenix/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include "archive_cache.hpp"
+#include "test_zip.hpp"
+
+
+namespace
+{
+
+
+using ion::test::bytes_t;
+using ion::test::zip_member;
+using ion::test::write_zip;
+
+
+void get_member_in_thread(ion::audio_common::archive_cache *cache, std::string const &archive_path, std::string const &member_name, ion::audio_common::archive_cache::member_data_ptr_t *data)
+{
+	*data = cache->get_member(archive_path, member_name);
+}
+
+
+bytes_t make_data(unsigned int const size, unsigned int const seed)
+{
+	bytes_t data(size);
+	for (unsigned int i = 0; i < size; ++i)
+		data[i] = uint8_t((i / 16) * seed + (i % 3));
+	return data;
+}
+
+
+}
+
+
+int test_main(int, char **)
+{
+	typedef ion::audio_common::archive_cache archive_cache;
+	typedef ion::audio_common::source source;
+
+	std::string const prefix = "/tmp/ion_archive_cache_test_" + boost::lexical_cast < std::string > (getpid());
+	std::string const zip_filename = prefix + ".zip";
+	std::string const gzip_filename = prefix + "_single.mod.gz";
+
+	std::vector < zip_member > members(3);
+	members[0].name = "stored.mod"; members[0].data = make_data(1000, 3); members[0].deflate = false;
+	members[1].name = "songs/deflated.xm"; members[1].data = make_data(20000, 5); members[1].deflate = true;
+	members[2].name = "empty.s3m"; members[2].deflate = true;
+	write_zip(zip_filename, members);
+
+
+	// the archive is opened once, no matter how many members are read
+	{
+		archive_cache cache;
+
+		archive_cache::member_names_t names;
+		TEST_ASSERT(cache.get_member_names(zip_filename, names), "could not read the member names");
+		TEST_VALUE(names.size(), 3u);
+
+		for (int round = 0; round < 2; ++round)
+		{
+			for (unsigned int i = 0; i < members.size(); ++i)
+			{
+				archive_cache::member_data_ptr_t data = cache.get_member(zip_filename, members[i].name);
+				TEST_ASSERT(data, "member could not be extracted");
+				TEST_ASSERT(*data == members[i].data, "member data mismatch");
+			}
+		}
+
+		TEST_ASSERT(!cache.get_member(zip_filename, "missing.mod"), "nonexistent member was found");
+		TEST_ASSERT(!cache.get_member(zip_filename, "some_directory/"), "directory was returned as member");
+
+		archive_cache::stats stats_ = cache.get_stats();
+		TEST_VALUE(stats_.num_archive_opens, 1u);
+		TEST_VALUE(stats_.num_member_hits, 3u);
+		TEST_VALUE(stats_.num_cached_bytes, 21000u);
+	}
+
+
+	// concurrent requests for the same member inflate it only once, and all get the same data
+	{
+		archive_cache cache;
+		archive_cache::member_data_ptr_t data[4];
+		boost::thread_group threads;
+		for (int i = 0; i < 4; ++i)
+			threads.create_thread(boost::phoenix::bind(&get_member_in_thread, &cache, zip_filename, members[1].name, &data[i]));
+		threads.join_all();
+
+		for (int i = 0; i < 4; ++i)
+		{
+			TEST_ASSERT(data[i], "member could not be extracted");
+			TEST_ASSERT(data[i] == data[0], "member inflated more than once");
+		}
+		TEST_ASSERT(*data[0] == members[1].data, "member data mismatch");
+
+		archive_cache::stats stats_ = cache.get_stats();
+		TEST_VALUE(stats_.num_member_misses, 1u);
+		TEST_VALUE(stats_.num_member_hits, 3u);
+	}
+
+
+	// sources for members are created from URIs with an archive_member option
+	{
+		archive_cache cache;
+		ion::uri uri_("file://" + zip_filename);
+		uri_.get_options()["archive_member"] = "songs/deflated.xm";
+
+		ion::audio_common::source_ptr_t member_source = cache.create_source(uri_);
+		TEST_ASSERT(member_source, "no source created");
+		TEST_VALUE(member_source->get_size(), 20000);
+		TEST_ASSERT(member_source->get_contiguous_view(0, 20000) != 0, "no contiguous view");
+
+		bytes_t dest(20000);
+		member_source->seek(100, source::seek_absolute);
+		TEST_VALUE(member_source->read(&dest[0], 20000), 19900);
+		TEST_ASSERT(std::memcmp(&dest[0], &members[1].data[100], 19900) == 0, "read mismatch");
+		TEST_ASSERT(member_source->end_of_data_reached(), "end of data not reported");
+
+		TEST_ASSERT(!cache.create_source(ion::uri("file://" + zip_filename)), "source created without archive_member option");
+	}
+
+
+	// the least recently used members are evicted once the cache size is exceeded
+	{
+		archive_cache cache(25000);
+		cache.get_member(zip_filename, "songs/deflated.xm");
+		cache.get_member(zip_filename, "stored.mod");
+		TEST_VALUE(cache.get_stats().num_cached_bytes, 21000u);
+
+		std::vector < zip_member > more_members(1);
+		more_members[0].name = "other.mod"; more_members[0].data = make_data(10000, 7); more_members[0].deflate = true;
+		std::string const other_zip_filename = prefix + "_other.zip";
+		write_zip(other_zip_filename, more_members);
+
+		cache.get_member(other_zip_filename, "other.mod");
+		TEST_VALUE(cache.get_stats().num_cached_bytes, 11000u);
+
+		cache.get_member(zip_filename, "stored.mod");
+		TEST_VALUE(cache.get_stats().num_member_hits, 1u);
+
+		std::remove(other_zip_filename.c_str());
+	}
+
+
+	// modified archives are indexed again
+	{
+		archive_cache cache;
+		TEST_ASSERT(*(cache.get_member(zip_filename, "stored.mod")) == members[0].data, "member data mismatch");
+
+		members[0].data = make_data(1500, 11);
+		write_zip(zip_filename, members);
+
+		TEST_ASSERT(*(cache.get_member(zip_filename, "stored.mod")) == members[0].data, "outdated member data returned");
+		TEST_VALUE(cache.get_stats().num_archive_opens, 2u);
+	}
+
+
+	// gzip files contain one member, named after the file
+	{
+		bytes_t data = make_data(5000, 13);
+		gzFile gzip_file = gzopen(gzip_filename.c_str(), "wb");
+		gzwrite(gzip_file, &data[0], data.size());
+		gzclose(gzip_file);
+
+		archive_cache cache;
+		archive_cache::member_names_t names;
+		TEST_ASSERT(cache.get_member_names(gzip_filename, names), "could not read the member names");
+		TEST_VALUE(names.size(), 1u);
+
+		std::string member_name = gzip_filename.substr(gzip_filename.find_last_of('/') + 1);
+		member_name.erase(member_name.length() - 3);
+		TEST_VALUE(names[0], member_name);
+
+		archive_cache::member_data_ptr_t member_data = cache.get_member(gzip_filename, member_name);
+		TEST_ASSERT(member_data, "member could not be extracted");
+		TEST_ASSERT(*member_data == data, "member data mismatch");
+	}
+
+
+	std::remove(zip_filename.c_str());
+	std::remove(gzip_filename.c_str());
+
+	return 0;
+}
+
+
+INIT_TEST
@@ -0,0 +1,216 @@
+#include "test.hpp"
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <ion/backend_main_loop.hpp>
+#include <ion/flat_playlist.hpp>
+#include <ion/playlists.hpp>
+#include <ion/scanner_base.hpp>
+#include "backend.hpp"
+#include "decoder.hpp"
+#include "decoder_creator.hpp"
+#include "file_source.hpp"
+#include "test_zip.hpp"
+
+
+namespace
+{
+
+
+// Decoder for resources that start with "TEST"; the rest of the resource is the title
+class test_decoder:
+	public ion::audio_common::decoder
+{
+public:
+	explicit test_decoder(ion::audio_common::send_event_callback_t const &send_event_callback, ion::uri const &uri_, std::string const &title):
+		decoder(send_event_callback),
+		uri_(uri_),
+		title(title)
+	{
+	}
+
+	virtual bool is_initialized() const { return true; }
+	virtual bool can_playback() const { return false; }
+	virtual long set_current_position(long const) { return 0; }
+	virtual long get_current_position() const { return 0; }
+
+	virtual ion::metadata_t get_metadata() const
+	{
+		ion::metadata_t metadata_(Json::objectValue);
+		metadata_["title"] = title;
+		return metadata_;
+	}
+
+	virtual std::string get_type() const { return "test"; }
+	virtual ion::uri get_uri() const { return uri_; }
+	virtual long get_num_ticks() const { return 1000; }
+	virtual long get_num_ticks_per_second() const { return 1000; }
+	virtual void set_playback_properties(ion::audio_common::playback_properties const &) {}
+	virtual ion::audio_common::decoder_properties get_decoder_properties() const { return ion::audio_common::decoder_properties(); }
+	virtual unsigned int update(void *, unsigned int const) { return 0; }
+
+
+protected:
+	ion::uri uri_;
+	std::string title;
+};
+
+
+class test_decoder_creator:
+	public ion::audio_common::decoder_creator
+{
+public:
+	virtual ion::audio_common::decoder_ptr_t create(ion::audio_common::source_ptr_t source_, ion::metadata_t const &, ion::audio_common::send_event_callback_t const &send_event_callback)
+	{
+		char data[256];
+		long num_read = source_->read(data, sizeof(data));
+		if ((num_read < 4) || (std::memcmp(data, "TEST", 4) != 0))
+			return ion::audio_common::decoder_ptr_t();
+
+		return ion::audio_common::decoder_ptr_t(new test_decoder(send_event_callback, source_->get_uri(), std::string(data + 4, num_read - 4)));
+	}
+
+	virtual std::string get_type() const { return "test"; }
+};
+
+
+typedef ion::playlists < ion::flat_playlist > playlists_t;
+
+
+// Scanner that talks to a backend in the same process; the test passes the data back and forth (see run_scan() below)
+class test_scanner:
+	public ion::scanner_base < test_scanner, playlists_t >
+{
+public:
+	typedef ion::scanner_base < test_scanner, playlists_t > base_t;
+
+	explicit test_scanner(playlists_t &playlists_):
+		base_t(playlists_)
+	{
+	}
+
+	void send_to_backend(std::string const &data) { backend_input += data; }
+	void restart_watchdog_timer() {}
+	void stop_watchdog_timer() {}
+	void restart_backend() {}
+	void adding_queue_entry(ion::uri const &, playlist_t &, bool const) {}
+	void removing_queue_entry(ion::uri const &, playlist_t &, bool const) {}
+	void scanning_in_progress(bool const) {}
+
+	void resource_successfully_scanned(ion::uri const &uri_, playlist_t &, ion::metadata_t const &metadata_)
+	{
+		scanned_uris.push_back(uri_);
+		scanned_titles.push_back(ion::get_metadata_value < std::string > (metadata_, "title", ""));
+	}
+
+	void unrecognized_resource(ion::uri const &uri_, playlist_t &) { unrecognized_uris.push_back(uri_); }
+	void resource_corrupted(ion::uri const &uri_, playlist_t &) { failed_uris.push_back(uri_); }
+	void scanning_failed(ion::uri const &uri_, playlist_t &) { failed_uris.push_back(uri_); }
+
+	using base_t::backend_started;
+	using base_t::parse_backend_data;
+
+
+	std::string backend_input;
+	std::vector < ion::uri > scanned_uris, unrecognized_uris, failed_uris;
+	std::vector < std::string > scanned_titles;
+};
+
+
+typedef ion::backend_main_loop < ion::audio_backend::backend > backend_main_loop_t;
+
+
+// Passes the commands the scanner sent to the backend's main loop, and the events the backend sent in turn back to the scanner,
+// until the scanner's queue is empty
+void run_scan(test_scanner &scanner, ion::audio_backend::backend &backend_, backend_main_loop_t &main_loop, std::stringstream &backend_in, std::stringstream &backend_out)
+{
+	for (int round = 0; (round < 16) && !scanner.get_queue().empty(); ++round)
+	{
+		backend_in.clear();
+		backend_in.str(scanner.backend_input);
+		scanner.backend_input.clear();
+		while (backend_in.good())
+			main_loop.iterate();
+
+		backend_.wait_for_metadata_batches();
+		main_loop.flush_events();
+
+		std::string events = backend_out.str();
+		backend_out.str("");
+		if (!events.empty())
+			scanner.parse_backend_data(events.data(), events.size());
+	}
+}
+
+
+ion::test::bytes_t make_data(std::string const &str)
+{
+	return ion::test::bytes_t(str.begin(), str.end());
+}
+
+
+}
+
+
+int test_main(int, char **)
+{
+	std::string const zip_filename = "/tmp/ion_archive_scan_test_" + boost::lexical_cast < std::string > (getpid()) + ".zip";
+
+	std::vector < ion::test::zip_member > members(3);
+	members[0].name = "first.test"; members[0].data = make_data("TESTfirst song"); members[0].deflate = false;
+	members[1].name = "songs/second.test"; members[1].data = make_data("TESTsecond song"); members[1].deflate = true;
+	members[2].name = "readme.txt"; members[2].data = make_data("not a song"); members[2].deflate = true;
+	ion::test::write_zip(zip_filename, members);
+
+	{
+		// the creators are declared before the backend, so they outlive its threads (just like in the backend's main.cpp)
+		ion::audio_backend::file_source_creator file_source_creator_;
+		test_decoder_creator test_decoder_creator_;
+		ion::audio_backend::backend backend_;
+		backend_.get_source_creators().push_back(&file_source_creator_);
+		backend_.get_decoder_creators().push_back(&test_decoder_creator_);
+
+		std::stringstream backend_in, backend_out;
+		backend_main_loop_t main_loop(backend_in, backend_out, backend_);
+
+		ion::flat_playlist::unique_ids_t unique_ids_;
+		ion::flat_playlist *playlist_ = new ion::flat_playlist(unique_ids_);
+		playlists_t playlists;
+		playlists.add_playlist(playlists_t::playlist_ptr_t(playlist_));
+
+		test_scanner scanner(playlists);
+		scanner.backend_started();
+		scanner.issue_scan_request(ion::uri("file://" + zip_filename), *playlist_);
+		run_scan(scanner, backend_, main_loop, backend_in, backend_out);
+
+		TEST_ASSERT(scanner.get_queue().empty(), "scan did not finish");
+		TEST_VALUE(scanner.failed_uris.size(), 0u);
+
+		// the archive itself is replaced by its members; the one no decoder recognizes is reported as usual
+		TEST_VALUE(scanner.scanned_uris.size(), 2u);
+		TEST_VALUE(scanner.scanned_uris[0].get_path(), zip_filename);
+		TEST_VALUE(scanner.scanned_uris[0].get_options()["archive_member"], "first.test");
+		TEST_VALUE(scanner.scanned_titles[0], "first song");
+		TEST_VALUE(scanner.scanned_uris[1].get_options()["archive_member"], "songs/second.test");
+		TEST_VALUE(scanner.scanned_titles[1], "second song");
+
+		TEST_VALUE(scanner.unrecognized_uris.size(), 1u);
+		TEST_VALUE(scanner.unrecognized_uris[0].get_options()["archive_member"], "readme.txt");
+
+		// listing the members and scanning each of them opened the archive only once
+		TEST_VALUE(file_source_creator_.get_archive_cache().get_stats().num_archive_opens, 1u);
+		TEST_VALUE(file_source_creator_.get_archive_cache().get_stats().num_member_misses, 3u);
+	}
+
+	std::remove(zip_filename.c_str());
+
+	return 0;
+}
+
+
+INIT_TEST
+
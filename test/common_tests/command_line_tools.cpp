@@ -73,6 +73,34 @@ int test_main(int, char **)
 	}
 
 
+	{
+		// split_command_line() replaces previous contents, so the same objects can be reused for several lines
+		std::string split_command("previous");
+		ion::params_t split_params = boost::assign::list_of("x")("y")("z");
+		ion::split_command_line("bar \"a\\\\b\" \"\\\"c\\\"\" \"unterminated", split_command, split_params);
+
+		TEST_VALUE(split_command, "bar");
+		TEST_VALUE(split_params.size(), 2);
+		TEST_VALUE(split_params[0], "a\\b");
+		TEST_VALUE(split_params[1], "\"c\"");
+
+		std::string line("previous line");
+		ion::recombine_command_line(split_command, split_params, line);
+		TEST_VALUE(line, "bar \"a\\\\b\" \"\\\"c\\\"\"");
+	}
+
+	{
+		// the pointer range variants append to the given string
+		std::string input("xx\"y\nzz"), result("prefix:");
+		ion::escape_param(input.data() + 2, input.data() + 6, result);
+		TEST_VALUE(result, "prefix:\\\"y\\nz");
+
+		result = "prefix:";
+		std::string escaped_input("\\\"y\\n");
+		ion::unescape_param(escaped_input.data(), escaped_input.data() + escaped_input.length(), result);
+		TEST_VALUE(result, "prefix:\"y\n");
+	}
+
 
 	return 0;
 }
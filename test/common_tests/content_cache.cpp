@@ -0,0 +1,126 @@
+#include "test.hpp"
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/lexical_cast.hpp>
+#include "content_cache.hpp"
+
+
+namespace
+{
+
+
+std::vector < uint8_t > write_file(std::string const &filename, unsigned int const size, unsigned int const seed)
+{
+	std::vector < uint8_t > data(size);
+	for (unsigned int i = 0; i < size; ++i)
+		data[i] = uint8_t(i * seed);
+
+	std::ofstream out(filename.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast < char const * > (&data[0]), data.size());
+	return data;
+}
+
+
+}
+
+
+int test_main(int, char **)
+{
+	typedef ion::audio_common::content_cache content_cache;
+
+	std::string const prefix = "/tmp/ion_content_cache_test_" + boost::lexical_cast < std::string > (getpid());
+	std::string const filenames[3] = { prefix + "_a", prefix + "_b", prefix + "_c" };
+
+
+	// repeated accesses are served from memory
+	{
+		content_cache cache(10000, 4000);
+		std::vector < uint8_t > data = write_file(filenames[0], 3000, 3);
+
+		content_cache::content_ptr_t content = cache.get(filenames[0]);
+		TEST_ASSERT(content, "file not read");
+		TEST_ASSERT(*content == data, "content mismatch");
+		TEST_ASSERT(cache.get(filenames[0]) == content, "content not shared");
+
+		content_cache::stats stats_ = cache.get_stats();
+		TEST_VALUE(stats_.num_misses, 1u);
+		TEST_VALUE(stats_.num_hits, 1u);
+		TEST_VALUE(stats_.num_entries, 1u);
+		TEST_VALUE(stats_.num_cached_bytes, 3000u);
+
+		// modified files are read again
+		data = write_file(filenames[0], 2500, 5);
+		content = cache.get(filenames[0]);
+		TEST_ASSERT(content && (*content == data), "outdated content returned");
+		TEST_VALUE(cache.get_stats().num_cached_bytes, 2500u);
+	}
+
+
+	// large files, missing files and directories are not cached
+	{
+		content_cache cache(10000, 4000);
+		write_file(filenames[1], 5000, 7);
+
+		TEST_ASSERT(!cache.get(filenames[1]), "file larger than the maximum entry size was cached");
+		TEST_ASSERT(!cache.get(prefix + "_missing"), "missing file returned");
+		TEST_ASSERT(!cache.get("/tmp"), "directory returned");
+		TEST_VALUE(cache.get_stats().num_entries, 0u);
+	}
+
+
+	// lookups never read files, they only return contents that are already cached
+	{
+		content_cache cache(10000, 4000);
+		std::vector < uint8_t > data = write_file(filenames[0], 3000, 3);
+
+		TEST_ASSERT(!cache.lookup(filenames[0]), "lookup read the file");
+		TEST_VALUE(cache.get_stats().num_entries, 0u);
+
+		content_cache::content_ptr_t content = cache.get(filenames[0]);
+		TEST_ASSERT(cache.lookup(filenames[0]) == content, "cached content not returned by lookup");
+
+		write_file(filenames[0], 2500, 5);
+		TEST_ASSERT(!cache.lookup(filenames[0]), "outdated content returned by lookup");
+		TEST_VALUE(cache.get_stats().num_entries, 0u);
+	}
+
+
+	// the least recently used entries are dropped once the maximum total size is exceeded
+	{
+		content_cache cache(7000, 4000);
+		write_file(filenames[0], 3000, 3);
+		write_file(filenames[1], 3000, 7);
+		write_file(filenames[2], 3000, 11);
+
+		cache.get(filenames[0]);
+		cache.get(filenames[1]);
+		cache.get(filenames[0]);
+		cache.get(filenames[2]); // drops filenames[1]
+
+		content_cache::stats stats_ = cache.get_stats();
+		TEST_VALUE(stats_.num_entries, 2u);
+		TEST_VALUE(stats_.num_cached_bytes, 6000u);
+
+		cache.get(filenames[0]);
+		TEST_VALUE(cache.get_stats().num_hits, 2u);
+		cache.get(filenames[1]);
+		TEST_VALUE(cache.get_stats().num_misses, 4u);
+
+		cache.clear();
+		TEST_VALUE(cache.get_stats().num_entries, 0u);
+		TEST_VALUE(cache.get_stats().num_cached_bytes, 0u);
+	}
+
+
+	for (int i = 0; i < 3; ++i)
+		std::remove(filenames[i].c_str());
+
+	return 0;
+}
+
+
+INIT_TEST
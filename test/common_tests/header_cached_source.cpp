@@ -0,0 +1,122 @@
+#include "test.hpp"
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include "test_source.hpp"
+#include "header_cached_source.hpp"
+
+
+int test_main(int, char **)
+{
+	typedef ion::test::test_source test_source;
+	typedef ion::audio_common::source source;
+	typedef ion::audio_common::header_cached_source header_cached_source;
+
+	std::vector < uint8_t > data(1000);
+	for (unsigned int i = 0; i < data.size(); ++i)
+		data[i] = uint8_t(i * 7);
+
+
+	// the header is read once, and repeated reads of it (with resets in between) do not touch the wrapped source
+	{
+		boost::shared_ptr < test_source > source_(new test_source(data));
+		header_cached_source cached_source(source_, 64);
+
+		TEST_VALUE(cached_source.get_header().size(), 64u);
+		TEST_ASSERT(std::memcmp(&(cached_source.get_header()[0]), &data[0], 64) == 0, "header mismatch");
+		TEST_VALUE(source_->num_read_calls, 1);
+
+		for (int i = 0; i < 3; ++i)
+		{
+			uint8_t dest[32];
+			cached_source.reset();
+			TEST_VALUE(cached_source.read(dest, 4), 4);
+			TEST_ASSERT(std::memcmp(dest, &data[0], 4) == 0, "read mismatch");
+			cached_source.seek(29, source::seek_absolute);
+			TEST_VALUE(cached_source.read(dest, 6), 6);
+			TEST_ASSERT(std::memcmp(dest, &data[29], 6) == 0, "read mismatch");
+		}
+
+		TEST_VALUE(source_->num_read_calls, 1);
+	}
+
+
+	// reads crossing the end of the header continue in the wrapped source, and the end of data is reported
+	{
+		boost::shared_ptr < test_source > source_(new test_source(data));
+		header_cached_source cached_source(source_, 64);
+
+		uint8_t dest[1000];
+		TEST_VALUE(cached_source.read(dest, 100), 100);
+		TEST_ASSERT(std::memcmp(dest, &data[0], 100) == 0, "read mismatch");
+		TEST_VALUE(cached_source.get_position(), 100);
+		TEST_VALUE(cached_source.read(dest, 1000), 900);
+		TEST_ASSERT(std::memcmp(dest, &data[100], 900) == 0, "read mismatch");
+		TEST_ASSERT(cached_source.end_of_data_reached(), "end of data not reported");
+		TEST_VALUE(cached_source.read(dest, 1), 0);
+
+		// the wrapped source is in its end-of-data state now; reading past the header after a reset has to recover from that
+		cached_source.reset();
+		TEST_ASSERT(!cached_source.end_of_data_reached(), "reset did not clear the end-of-data flag");
+		cached_source.seek(-10, source::seek_from_end);
+		TEST_VALUE(cached_source.read(dest, 10), 10);
+		TEST_ASSERT(std::memcmp(dest, &data[990], 10) == 0, "read mismatch");
+	}
+
+
+	// resources smaller than the header size
+	{
+		std::vector < uint8_t > small_data(data.begin(), data.begin() + 10);
+		boost::shared_ptr < test_source > source_(new test_source(small_data));
+		header_cached_source cached_source(source_, 64);
+
+		TEST_VALUE(cached_source.get_header().size(), 10u);
+		TEST_ASSERT(!source_->end_of_data_reached(), "the header was read past the end of the source");
+
+		uint8_t dest[64];
+		TEST_VALUE(cached_source.read(dest, 64), 10);
+		TEST_ASSERT(std::memcmp(dest, &small_data[0], 10) == 0, "read mismatch");
+		TEST_ASSERT(cached_source.end_of_data_reached(), "end of data not reported");
+	}
+
+
+	// non-seekable sources; after reading past the header, a reset has to start over at the beginning of the wrapped source
+	{
+		boost::shared_ptr < test_source > source_(new test_source(data, false));
+		header_cached_source cached_source(source_, 64);
+
+		TEST_VALUE(cached_source.get_header().size(), 64u);
+		TEST_ASSERT(!cached_source.can_seek(source::seek_absolute), "non-seekable source reported as seekable");
+
+		// reads within the header are still served from memory
+		uint8_t dest[1000];
+		TEST_VALUE(cached_source.read(dest, 16), 16);
+		cached_source.reset();
+		TEST_VALUE(source_->num_resets, 0);
+
+		TEST_VALUE(cached_source.read(dest, 100), 100);
+		TEST_ASSERT(std::memcmp(dest, &data[0], 100) == 0, "read mismatch");
+
+		for (int i = 0; i < 2; ++i)
+		{
+			cached_source.reset();
+			TEST_VALUE(cached_source.get_position(), 0);
+			TEST_VALUE(cached_source.read(dest, 200), 200);
+			TEST_ASSERT(std::memcmp(dest, &data[0], 200) == 0, "read mismatch after reset");
+			TEST_VALUE(cached_source.get_position(), 200);
+		}
+
+		TEST_VALUE(cached_source.read(dest, 1000), 800);
+		TEST_ASSERT(std::memcmp(dest, &data[200], 800) == 0, "read mismatch");
+		TEST_ASSERT(cached_source.end_of_data_reached(), "end of data not reported");
+		TEST_VALUE(cached_source.get_header().size(), 64u);
+	}
+
+
+	return 0;
+}
+
+
+INIT_TEST
+
@@ -0,0 +1,277 @@
+#include "test.hpp"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/spirit/home/phoenix/bind.hpp>
+#include <boost/spirit/home/phoenix/core/argument.hpp>
+#include <boost/thread/thread.hpp>
+#include "http_source.hpp"
+
+
+namespace
+{
+
+
+typedef std::vector < uint8_t > bytes_t;
+
+
+// Minimal HTTP server on the loopback interface, serving one connection at a time:
+// /file.bin     : the file data; range requests are supported
+// /redirect     : redirects to /file.bin
+// /live         : an Icecast-style live stream with ICY metadata every live_metadata_interval bytes
+class loopback_server
+{
+public:
+	enum { live_metadata_interval = 1000, live_stream_size = 5000 };
+
+
+	explicit loopback_server(bytes_t const &file_data):
+		file_data(file_data),
+		num_requests(0)
+	{
+		listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+		struct sockaddr_in address;
+		std::memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = 0;
+		bind(listen_fd, reinterpret_cast < struct sockaddr* > (&address), sizeof(address));
+		listen(listen_fd, 4);
+
+		socklen_t address_length = sizeof(address);
+		getsockname(listen_fd, reinterpret_cast < struct sockaddr* > (&address), &address_length);
+		port = ntohs(address.sin_port);
+
+		thread = boost::thread(boost::phoenix::bind(&loopback_server::run, this));
+	}
+
+	~loopback_server()
+	{
+		shutdown(listen_fd, SHUT_RDWR);
+		close(listen_fd);
+		thread.join();
+	}
+
+	std::string get_base_uri() const
+	{
+		return "http://127.0.0.1:" + boost::lexical_cast < std::string > (port);
+	}
+
+
+	bytes_t file_data;
+	int num_requests;
+
+
+protected:
+	void run()
+	{
+		while (true)
+		{
+			int connection_fd = accept(listen_fd, 0, 0);
+			if (connection_fd == -1)
+				break;
+
+			serve(connection_fd);
+			close(connection_fd);
+		}
+	}
+
+	void serve(int const connection_fd)
+	{
+		std::string request;
+		char buffer[1024];
+		while (request.find("\r\n\r\n") == std::string::npos)
+		{
+			ssize_t ret = recv(connection_fd, buffer, sizeof(buffer), 0);
+			if (ret <= 0)
+				return;
+			request.append(buffer, ret);
+		}
+
+		++num_requests;
+
+		std::string path = request.substr(4, request.find(' ', 4) - 4);
+		long range_start = 0;
+		std::string::size_type range_pos = request.find("Range: bytes=");
+		if (range_pos != std::string::npos)
+			range_start = std::atol(request.c_str() + range_pos + 13);
+
+		if (path == "/file.bin")
+		{
+			std::string size_str = boost::lexical_cast < std::string > (file_data.size());
+			std::string header;
+			if (range_pos != std::string::npos)
+			{
+				header = "HTTP/1.0 206 Partial Content\r\nContent-Length: " + boost::lexical_cast < std::string > (file_data.size() - range_start) + "\r\n";
+				header += "Content-Range: bytes " + boost::lexical_cast < std::string > (range_start) + "-" + boost::lexical_cast < std::string > (file_data.size() - 1) + "/" + size_str + "\r\n\r\n";
+			}
+			else
+				header = "HTTP/1.0 200 OK\r\nContent-Length: " + size_str + "\r\nAccept-Ranges: bytes\r\n\r\n";
+
+			send_data(connection_fd, header.c_str(), header.length());
+			send_data(connection_fd, &file_data[range_start], file_data.size() - range_start);
+		}
+		else if (path == "/redirect")
+		{
+			std::string header = "HTTP/1.0 302 Found\r\nLocation: /file.bin\r\n\r\n";
+			send_data(connection_fd, header.c_str(), header.length());
+		}
+		else if (path == "/live")
+		{
+			std::string header = "ICY 200 OK\r\nicy-name: Test\r\nicy-metaint: " + boost::lexical_cast < std::string > (int(live_metadata_interval)) + "\r\n\r\n";
+			send_data(connection_fd, header.c_str(), header.length());
+
+			for (int i = 0; i < live_stream_size / live_metadata_interval; ++i)
+			{
+				send_data(connection_fd, &file_data[i * live_metadata_interval], live_metadata_interval);
+
+				// title changes in the first and third block only
+				std::string metadata;
+				if (i == 0)
+					metadata = "StreamTitle='Song A';StreamUrl='';";
+				else if (i == 2)
+					metadata = "StreamTitle='Song B';";
+				metadata.resize(((metadata.length() + 15) / 16) * 16, '\0');
+
+				uint8_t length = metadata.length() / 16;
+				send_data(connection_fd, &length, 1);
+				send_data(connection_fd, metadata.c_str(), metadata.length());
+			}
+		}
+		else
+		{
+			std::string header = "HTTP/1.0 404 Not Found\r\n\r\n";
+			send_data(connection_fd, header.c_str(), header.length());
+		}
+	}
+
+	void send_data(int const connection_fd, void const *data, std::size_t const num_bytes)
+	{
+		std::size_t num_sent_bytes = 0;
+		while (num_sent_bytes < num_bytes)
+		{
+			ssize_t ret = send(connection_fd, reinterpret_cast < char const * > (data) + num_sent_bytes, num_bytes - num_sent_bytes, MSG_NOSIGNAL);
+			if (ret <= 0)
+				return;
+			num_sent_bytes += ret;
+		}
+	}
+
+
+	int listen_fd;
+	unsigned short port;
+	boost::thread thread;
+};
+
+
+struct event_recorder
+{
+	void record(std::string const &event, ion::params_t const &params)
+	{
+		events.push_back(event);
+		event_params.push_back(params);
+	}
+
+	std::vector < std::string > events;
+	std::vector < ion::params_t > event_params;
+};
+
+
+// Reads until the end of data, since http_source may return less than requested
+long read_all(ion::audio_common::source &source_, uint8_t *dest, long const num_bytes)
+{
+	long num_read_bytes = 0;
+	while ((num_read_bytes < num_bytes) && source_.can_read())
+		num_read_bytes += source_.read(dest + num_read_bytes, num_bytes - num_read_bytes);
+	return num_read_bytes;
+}
+
+
+}
+
+
+int test_main(int, char **)
+{
+	typedef ion::audio_common::source source;
+	typedef ion::audio_common::http_source http_source;
+
+	bytes_t data(100000);
+	for (unsigned int i = 0; i < data.size(); ++i)
+		data[i] = uint8_t(i * 7 + i / 256);
+
+	loopback_server server(data);
+
+
+	// progressive download with range request seeking
+	{
+		http_source source_(ion::uri(server.get_base_uri() + "/file.bin"));
+		TEST_ASSERT(source_.is_ok(), "connection failed");
+		TEST_ASSERT(source_.may_block(), "http source does not report blocking I/O");
+		TEST_ASSERT(!source_.is_live_stream(), "file reported as live stream");
+		TEST_VALUE(source_.get_size(), 100000);
+		TEST_ASSERT(source_.can_seek(source::seek_absolute), "range requests not detected");
+
+		bytes_t dest(100000);
+		TEST_VALUE(read_all(source_, &dest[0], 1000), 1000);
+		TEST_ASSERT(std::memcmp(&dest[0], &data[0], 1000) == 0, "read mismatch");
+
+		source_.seek(-500, source::seek_from_end);
+		TEST_VALUE(source_.get_position(), 99500);
+		TEST_VALUE(read_all(source_, &dest[0], 100000), 500);
+		TEST_ASSERT(std::memcmp(&dest[0], &data[99500], 500) == 0, "read mismatch");
+		TEST_ASSERT(source_.end_of_data_reached(), "end of data not reported");
+
+		source_.reset();
+		TEST_VALUE(read_all(source_, &dest[0], 100000), 100000);
+		TEST_ASSERT(dest == data, "read mismatch");
+	}
+
+
+	// redirects are followed, missing resources are reported
+	{
+		http_source source_(ion::uri(server.get_base_uri() + "/redirect"));
+		TEST_ASSERT(source_.is_ok(), "redirect not followed");
+		TEST_VALUE(source_.get_size(), 100000);
+
+		ion::audio_common::http_source_creator creator;
+		TEST_ASSERT(!creator.create(ion::uri(server.get_base_uri() + "/missing"), ion::audio_common::send_event_callback_t()), "missing resource not reported");
+	}
+
+
+	// live streams: ICY metadata is removed from the data, and title changes are sent as metadata events
+	{
+		event_recorder recorder;
+		http_source source_(
+			ion::uri(server.get_base_uri() + "/live"),
+			boost::phoenix::bind(&event_recorder::record, &recorder, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2)
+		);
+		TEST_ASSERT(source_.is_ok(), "connection failed");
+		TEST_ASSERT(source_.is_live_stream(), "live stream not detected");
+		TEST_VALUE(source_.get_size(), -1);
+		TEST_ASSERT(!source_.can_seek(source::seek_absolute), "live stream reported as seekable");
+
+		bytes_t dest(10000);
+		TEST_VALUE(read_all(source_, &dest[0], 10000), long(loopback_server::live_stream_size));
+		TEST_ASSERT(std::memcmp(&dest[0], &data[0], loopback_server::live_stream_size) == 0, "stream data mismatch");
+		TEST_VALUE(source_.get_stream_title(), "Song B");
+
+		TEST_VALUE(recorder.events.size(), 2u);
+		TEST_VALUE(recorder.events[0], "metadata");
+		TEST_VALUE(recorder.event_params[0].size(), 2u);
+		TEST_ASSERT(recorder.event_params[0][1].find("Song A") != std::string::npos, "missing title in metadata event");
+		TEST_ASSERT(recorder.event_params[1][1].find("Song B") != std::string::npos, "missing title in metadata event");
+	}
+
+
+	return 0;
+}
+
+
+INIT_TEST
@@ -0,0 +1,327 @@
+#include "test.hpp"
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/assign/list_of.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/spirit/home/phoenix/bind.hpp>
+#include <boost/spirit/home/phoenix/core/argument.hpp>
+#include <ion/backend_main_loop.hpp>
+#include <ion/message_channel.hpp>
+#include <ion/message_framing.hpp>
+#include <ion/metadata.hpp>
+
+
+namespace
+{
+
+
+struct received_messages
+{
+	std::string sent_data;
+	std::vector < std::string > commands;
+	std::vector < ion::params_t > params;
+
+	void send_data(std::string const &data)
+	{
+		sent_data += data;
+	}
+
+	void message(std::string const &command, ion::params_t const &params_)
+	{
+		commands.push_back(command);
+		params.push_back(params_);
+	}
+};
+
+
+// Minimal backend for the main loop; it echoes commands, and sends metadata using the encoding the main loop selected
+struct echo_backend
+{
+	ion::metadata_encoding encoding;
+	boost::function < void(std::string const &, ion::params_t const &) > send_event_callback;
+	echo_backend(): encoding(ion::json_metadata_encoding) {}
+};
+
+template < typename Callback >
+void set_send_event_callback(echo_backend &backend_, Callback const &callback)
+{
+	backend_.send_event_callback = callback;
+}
+
+
+// String buffer whose writes block while the gate is closed; this lets events pile up in the main loop's queue
+struct gated_stringbuf:
+	std::stringbuf
+{
+	boost::mutex mutex;
+	boost::condition_variable condition;
+	bool gate_open, write_waiting;
+
+	gated_stringbuf(): gate_open(false), write_waiting(false) {}
+
+	void wait_for_write()
+	{
+		boost::unique_lock < boost::mutex > lock(mutex);
+		while (!write_waiting)
+			condition.wait(lock);
+	}
+
+	void open_gate()
+	{
+		{
+			boost::lock_guard < boost::mutex > lock(mutex);
+			gate_open = true;
+		}
+		condition.notify_all();
+	}
+
+	std::streamsize xsputn(char const *s, std::streamsize n)
+	{
+		{
+			boost::unique_lock < boost::mutex > lock(mutex);
+			write_waiting = true;
+			condition.notify_all();
+			while (!gate_open)
+				condition.wait(lock);
+		}
+		return std::stringbuf::xsputn(s, n);
+	}
+};
+
+void set_metadata_encoding(echo_backend &backend_, ion::metadata_encoding const new_encoding)
+{
+	backend_.encoding = new_encoding;
+}
+
+std::string get_backend_type(echo_backend const &)
+{
+	return "echo";
+}
+
+void execute_command(echo_backend &backend_, std::string const &command, ion::params_t const &params, std::string &response_command, ion::params_t &response_params)
+{
+	if (command == "get_metadata")
+	{
+		ion::metadata_t metadata_ = ion::empty_metadata();
+		ion::set_metadata_value(metadata_, "title", std::string("a \"quoted\"\ntitle"));
+		response_command = "metadata";
+		response_params = boost::assign::list_of(params[0])(ion::get_metadata_string(metadata_, backend_.encoding));
+	}
+	else
+	{
+		response_command = "echo_" + command;
+		response_params = params;
+	}
+}
+
+
+}
+
+
+int test_main(int, char **)
+{
+	ion::params_t const params = boost::assign::list_of < std::string > ("file:///a \"b\"\nc")(std::string("\0\x01\n\\", 4))("");
+
+	// encoding and decoding in both protocols, with the data fed in single bytes
+	for (int i = 0; i < 2; ++i)
+	{
+		ion::protocol_type protocol = (i == 0) ? ion::text_protocol : ion::framed_protocol;
+
+		std::string data;
+		ion::encode_message(protocol, "first", params, data);
+		ion::encode_message(protocol, "second", ion::params_t(), data);
+
+		ion::message_decoder decoder(protocol);
+		std::string command;
+		ion::params_t decoded_params;
+		std::vector < std::string > commands;
+		for (std::string::size_type j = 0; j < data.length(); ++j)
+		{
+			decoder.feed(&data[j], 1);
+			while (decoder.next_message(command, decoded_params))
+			{
+				commands.push_back(command);
+				if (command == "first")
+				{
+					TEST_VALUE(decoded_params.size(), params.size());
+					for (std::size_t k = 0; k < params.size(); ++k)
+						TEST_ASSERT(decoded_params[k] == params[k], "protocol " << ion::get_protocol_name(protocol) << " param #" << k);
+				}
+				else
+					TEST_VALUE(decoded_params.size(), 0u);
+			}
+		}
+
+		TEST_VALUE(commands.size(), 2u);
+		TEST_VALUE(commands[0], "first");
+		TEST_VALUE(commands[1], "second");
+
+		// the blocking variant
+		std::istringstream in(data);
+		std::string buffer;
+		TEST_ASSERT(ion::read_message(in, protocol, command, decoded_params, buffer), "");
+		TEST_VALUE(command, "first");
+		TEST_VALUE(decoded_params.size(), params.size());
+		TEST_ASSERT(ion::read_message(in, protocol, command, decoded_params, buffer), "");
+		TEST_VALUE(command, "second");
+		TEST_VALUE(decoded_params.size(), 0u);
+		TEST_ASSERT(!ion::read_message(in, protocol, command, decoded_params, buffer), "");
+	}
+
+	// switching the protocol in the middle of buffered data; empty lines and CRLF line endings are tolerated
+	{
+		std::string data("\r\nprotocol \"framed\"\r\n");
+		ion::encode_message(ion::framed_protocol, "framed_message", params, data);
+
+		ion::message_decoder decoder;
+		decoder.feed(data.data(), data.length());
+
+		std::string command;
+		ion::params_t decoded_params;
+		TEST_ASSERT(decoder.next_message(command, decoded_params), "");
+		TEST_VALUE(command, "protocol");
+		TEST_VALUE(decoded_params.size(), 1u);
+		TEST_VALUE(decoded_params[0], "framed");
+
+		decoder.set_protocol(ion::framed_protocol);
+		TEST_ASSERT(decoder.next_message(command, decoded_params), "");
+		TEST_VALUE(command, "framed_message");
+		TEST_ASSERT(decoded_params == params, "");
+		TEST_ASSERT(!decoder.next_message(command, decoded_params), "");
+	}
+
+	// oversized frames are treated as corruption
+	{
+		std::string data("\xff\xff\xff\xff" "abcd", 8);
+		ion::message_decoder decoder(ion::framed_protocol);
+		decoder.feed(data.data(), data.length());
+
+		std::string command;
+		ion::params_t decoded_params;
+		TEST_ASSERT(!decoder.next_message(command, decoded_params), "");
+
+		data.clear();
+		ion::encode_message(ion::framed_protocol, "after_corruption", ion::params_t(), data);
+		decoder.feed(data.data(), data.length());
+		TEST_ASSERT(decoder.next_message(command, decoded_params), "");
+		TEST_VALUE(command, "after_corruption");
+	}
+
+	// negotiation between a message channel and a backend main loop
+	{
+		received_messages received;
+		ion::message_channel channel(
+			boost::phoenix::bind(&received_messages::send_data, &received, boost::phoenix::arg_names::arg1),
+			boost::phoenix::bind(&received_messages::message, &received, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2)
+		);
+
+		channel.backend_started();
+		TEST_ASSERT(channel.is_negotiating(), "");
+		TEST_VALUE(received.sent_data, "set_protocol \"framed\"\n");
+
+		// sent while negotiating -> queued
+		channel.send_message("get_metadata", boost::assign::list_of("file:///x"));
+		channel.send_message("ping", ion::params_t());
+		TEST_VALUE(received.sent_data, "set_protocol \"framed\"\n");
+
+		// Run the backend main loop with the negotiation command; its answer makes the channel send the queued commands
+		std::istringstream backend_in(received.sent_data);
+		std::ostringstream backend_out;
+		echo_backend backend_;
+		ion::backend_main_loop < echo_backend > main_loop(backend_in, backend_out, backend_);
+		main_loop.iterate();
+		main_loop.flush_events();
+		TEST_VALUE(backend_.encoding, ion::binary_metadata_encoding);
+		TEST_VALUE(backend_out.str(), "protocol \"framed\"\n");
+
+		received.sent_data.clear();
+		channel.feed(backend_out.str().data(), backend_out.str().length());
+		TEST_ASSERT(!channel.is_negotiating(), "");
+		TEST_VALUE(channel.get_protocol(), ion::framed_protocol);
+		TEST_VALUE(channel.get_metadata_encoding(), ion::binary_metadata_encoding);
+		TEST_VALUE(received.commands.size(), 0u);
+
+		// The queued commands were sent as frames; let the main loop process them, then feed its events back to the channel
+		backend_in.clear();
+		backend_in.str(received.sent_data + std::string("\x00\x00\x00\x06\x04quit\x00", 10));
+		backend_out.str("");
+		main_loop.run();
+
+		std::string events = backend_out.str();
+		for (std::string::size_type i = 0; i < events.length(); ++i)
+			channel.feed(&events[i], 1);
+
+		TEST_VALUE(received.commands.size(), 2u);
+		TEST_VALUE(received.commands[0], "metadata");
+		TEST_VALUE(received.params[0].size(), 2u);
+		TEST_VALUE(received.params[0][0], "file:///x");
+		ion::metadata_optional_t metadata_ = ion::parse_metadata(received.params[0][1]);
+		TEST_ASSERT(metadata_, "");
+		TEST_VALUE(ion::get_metadata_value < std::string > (*metadata_, "title", ""), "a \"quoted\"\ntitle");
+		TEST_VALUE(received.commands[1], "pong");
+
+		// a restart of the backend resets the channel to the text protocol
+		channel.set_preferred_protocol(ion::text_protocol);
+		channel.backend_started();
+		TEST_ASSERT(!channel.is_negotiating(), "");
+		TEST_VALUE(channel.get_protocol(), ion::text_protocol);
+		received.sent_data.clear();
+		channel.send_message("ping", ion::params_t());
+		TEST_VALUE(received.sent_data, "ping\n");
+	}
+
+	// backends that do not know the set_protocol command keep the text protocol
+	{
+		received_messages received;
+		ion::message_channel channel(
+			boost::phoenix::bind(&received_messages::send_data, &received, boost::phoenix::arg_names::arg1),
+			boost::phoenix::bind(&received_messages::message, &received, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2)
+		);
+
+		channel.backend_started();
+		channel.send_message("stop", ion::params_t());
+
+		std::string answer("unknown_command \"set_protocol\"\nstopped \"file:///x\"\n");
+		received.sent_data.clear();
+		channel.feed(answer.data(), answer.length());
+		TEST_ASSERT(!channel.is_negotiating(), "");
+		TEST_VALUE(channel.get_protocol(), ion::text_protocol);
+		TEST_VALUE(received.sent_data, "stop\n");
+		TEST_VALUE(received.commands.size(), 1u);
+		TEST_VALUE(received.commands[0], "stopped");
+	}
+
+	// events queued while the main loop writes keep their order; only directly consecutive current_position events are coalesced
+	{
+		std::istringstream backend_in;
+		gated_stringbuf backend_buf;
+		std::ostream backend_out(&backend_buf);
+		echo_backend backend_;
+		ion::backend_main_loop < echo_backend > main_loop(backend_in, backend_out, backend_);
+
+		backend_.send_event_callback("first", ion::params_t());
+		backend_buf.wait_for_write();
+
+		backend_.send_event_callback("current_position", boost::assign::list_of("1"));
+		backend_.send_event_callback("current_position", boost::assign::list_of("2"));
+		backend_.send_event_callback("info", boost::assign::list_of("x"));
+		backend_.send_event_callback("error", boost::assign::list_of("y"));
+		backend_.send_event_callback("current_position", boost::assign::list_of("3"));
+		backend_.send_event_callback("transition", boost::assign::list_of("a")("b"));
+		backend_.send_event_callback("current_position", boost::assign::list_of("0"));
+		backend_buf.open_gate();
+		main_loop.flush_events();
+
+		// the position of the previous resource must arrive before the transition, not after it
+		TEST_VALUE(backend_buf.str(), "first\ncurrent_position \"2\"\ninfo \"x\"\nerror \"y\"\ncurrent_position \"3\"\ntransition \"a\" \"b\"\ncurrent_position \"0\"\n");
+	}
+
+	return 0;
+}
+
+
+INIT_TEST
+
@@ -38,6 +38,31 @@ int test_main(int, char **)
 		TEST_VALUE(ion::get_metadata_value(*metadata_, "b", 121), 121);
 	}
 
+	{
+		// binary encoding round trip, covering all value types
+		ion::metadata_optional_t metadata_ = ion::parse_metadata("{\"title\" : \"a\\\"b\\nc\", \"negative\" : -123456, \"positive\" : 4000000000, \"real\" : 0.25, \"yes\" : true, \"no\" : false, \"nothing\" : null, \"list\" : [1, \"x\", {\"nested\" : [] }], \"empty\" : {}}");
+		TEST_ASSERT(metadata_, "");
+
+		std::string binary_str = ion::get_metadata_string(*metadata_, ion::binary_metadata_encoding);
+		TEST_ASSERT(binary_str.length() < ion::get_metadata_string(*metadata_).length(), "binary encoding is not more compact than JSON");
+
+		ion::metadata_optional_t decoded_metadata = ion::parse_metadata(binary_str);
+		TEST_ASSERT(decoded_metadata, "");
+		TEST_ASSERT(*decoded_metadata == *metadata_, "decoded: " << ion::get_metadata_string(*decoded_metadata));
+		TEST_VALUE(ion::get_metadata_value < std::string > (*decoded_metadata, "title", ""), "a\"b\nc");
+		TEST_VALUE(ion::get_metadata_value(*decoded_metadata, "negative", 0), -123456);
+		TEST_VALUE(ion::get_metadata_value < double > (*decoded_metadata, "real", 0), 0.25);
+
+		// the JSON encoding is still the default
+		TEST_VALUE(ion::get_metadata_string(*metadata_, ion::json_metadata_encoding), ion::get_metadata_string(*metadata_));
+
+		// truncated or corrupted binary data must be rejected
+		for (std::size_t length = 1; length < binary_str.length(); ++length)
+			TEST_ASSERT(!ion::parse_metadata(binary_str.substr(0, length)), "truncated binary metadata with length " << length << " was accepted");
+		TEST_ASSERT(!ion::parse_metadata(binary_str + 'x'), "binary metadata with trailing data was accepted");
+		TEST_ASSERT(!ion::parse_metadata(std::string("\x01\x07\xff\xff\xff\xff\x0f", 7)), "bogus array size was accepted");
+	}
+
 	return 0;
 }
 
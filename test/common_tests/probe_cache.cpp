@@ -0,0 +1,118 @@
+#include "test.hpp"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/lexical_cast.hpp>
+#include <ion/command_line_tools.hpp>
+#include "probe_cache.hpp"
+
+
+namespace
+{
+
+
+void write_file(std::string const &filename, std::string const &contents)
+{
+	std::ofstream out(filename.c_str(), std::ios::out | std::ios::trunc);
+	out << contents;
+}
+
+
+}
+
+
+int test_main(int, char **)
+{
+	typedef ion::audio_common::probe_cache probe_cache;
+
+	std::string const prefix = "/tmp/ion_probe_cache_test_" + boost::lexical_cast < std::string > (getpid());
+	std::string const resource_filename = prefix + "_resource";
+	std::string const cache_filename = prefix + "_cache";
+	ion::uri const resource_uri("file://" + resource_filename);
+	std::remove(cache_filename.c_str());
+
+	write_file(resource_filename, "0123456789");
+
+	probe_cache::entry entry_;
+	entry_.decoder_type = "flac";
+
+
+	// entries are found as long as the file is unchanged, and persist across instances
+	{
+		probe_cache cache;
+		TEST_ASSERT(cache.open(cache_filename), "could not open cache file");
+
+		probe_cache::entry found_entry;
+		TEST_ASSERT(!cache.lookup(resource_uri, found_entry), "empty cache returned an entry");
+
+		cache.store(resource_uri, entry_);
+		TEST_ASSERT(cache.lookup(resource_uri, found_entry), "stored entry not found");
+		TEST_VALUE(found_entry.decoder_type, "flac");
+
+		// only local files are cached
+		cache.store(ion::uri("http://localhost/abc"), entry_);
+		TEST_VALUE(cache.get_num_entries(), 1u);
+	}
+
+	{
+		probe_cache cache;
+		TEST_ASSERT(cache.open(cache_filename), "could not open cache file");
+		TEST_VALUE(cache.get_num_entries(), 1u);
+
+		probe_cache::entry found_entry;
+		TEST_ASSERT(cache.lookup(resource_uri, found_entry), "persisted entry not found");
+		TEST_VALUE(found_entry.decoder_type, "flac");
+
+		// a modified file invalidates the entry
+		write_file(resource_filename, "01234567890123456789");
+		TEST_ASSERT(!cache.lookup(resource_uri, found_entry), "entry of modified file was returned");
+
+		cache.store(resource_uri, entry_);
+		cache.forget(resource_uri);
+		TEST_ASSERT(!cache.lookup(resource_uri, found_entry), "forgotten entry was returned");
+	}
+
+	// forgetting persists too
+	{
+		probe_cache cache;
+		TEST_ASSERT(cache.open(cache_filename), "could not open cache file");
+		TEST_VALUE(cache.get_num_entries(), 0u);
+	}
+
+
+	// lines written by older versions carry additional stream parameters, which are ignored
+	{
+		struct stat stat_;
+		TEST_ASSERT(stat(resource_filename.c_str(), &stat_) == 0, "could not stat resource");
+
+		ion::params_t params;
+		params.push_back(resource_filename);
+		params.push_back(boost::lexical_cast < std::string > (stat_.st_size));
+		params.push_back(boost::lexical_cast < std::string > (stat_.st_mtime));
+		params.push_back(boost::lexical_cast < std::string > (stat_.st_ino));
+		params.push_back("vorbis");
+		params.push_back("44100");
+		params.push_back("2");
+		params.push_back("0");
+		write_file(cache_filename, ion::recombine_command_line("entry", params) + "\n");
+
+		probe_cache cache;
+		TEST_ASSERT(cache.open(cache_filename), "could not open cache file");
+
+		probe_cache::entry found_entry;
+		TEST_ASSERT(cache.lookup(resource_uri, found_entry), "entry in the old format not found");
+		TEST_VALUE(found_entry.decoder_type, "vorbis");
+	}
+
+
+	std::remove(resource_filename.c_str());
+	std::remove(cache_filename.c_str());
+
+	return 0;
+}
+
+
+INIT_TEST
+
@@ -0,0 +1,140 @@
+#include "test.hpp"
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/spirit/home/phoenix/bind.hpp>
+#include <boost/spirit/home/phoenix/core/argument.hpp>
+#include <boost/thread/thread.hpp>
+#include "test_source.hpp"
+#include "read_ahead_source.hpp"
+
+
+namespace
+{
+
+
+struct event_recorder
+{
+	void record(std::string const &event, ion::params_t const &)
+	{
+		events.push_back(event);
+	}
+
+	std::vector < std::string > events;
+};
+
+
+void wait_until_buffered(ion::audio_common::read_ahead_source const &source_, unsigned long const num_bytes)
+{
+	for (int i = 0; (i < 500) && (source_.get_num_buffered_bytes() < num_bytes); ++i)
+		boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+}
+
+
+}
+
+
+int test_main(int, char **)
+{
+	typedef ion::test::test_source test_source;
+	typedef ion::audio_common::source source;
+	typedef ion::audio_common::read_ahead_source read_ahead_source;
+
+	std::vector < uint8_t > data(1000);
+	for (unsigned int i = 0; i < data.size(); ++i)
+		data[i] = uint8_t(i * 7);
+
+	read_ahead_source::settings settings_;
+	settings_.prefetch_depth = 256;
+	settings_.block_size = 64;
+	settings_.read_deadline = 50;
+	settings_.failure_timeout = 300;
+
+
+	// sequential reads deliver the wrapped source's data, and the end of data is reported
+	{
+		boost::shared_ptr < test_source > source_(new test_source(data));
+		read_ahead_source read_ahead_source_(source_, settings_);
+
+		std::vector < uint8_t > dest(1000);
+		long position = 0;
+		while (position < 1000)
+		{
+			long num_read_bytes = read_ahead_source_.read(&dest[position], 77);
+			TEST_ASSERT(num_read_bytes > 0, "read failed");
+			position += num_read_bytes;
+			TEST_VALUE(read_ahead_source_.get_position(), position);
+		}
+		TEST_ASSERT(dest == data, "read mismatch");
+
+		uint8_t byte;
+		TEST_VALUE(read_ahead_source_.read(&byte, 1), 0);
+		TEST_ASSERT(read_ahead_source_.end_of_data_reached(), "end of data not reported");
+		TEST_ASSERT(read_ahead_source_.is_ok(), "end of data reported as failure");
+	}
+
+
+	// seeking, both within the buffered data and outside of it
+	{
+		boost::shared_ptr < test_source > source_(new test_source(data));
+		read_ahead_source read_ahead_source_(source_, settings_);
+
+		uint8_t dest[16];
+		wait_until_buffered(read_ahead_source_, 256);
+		read_ahead_source_.seek(100, source::seek_absolute);
+		TEST_VALUE(read_ahead_source_.read(dest, 16), 16);
+		TEST_ASSERT(std::memcmp(dest, &data[100], 16) == 0, "read mismatch");
+
+		read_ahead_source_.seek(-10, source::seek_from_end);
+		TEST_VALUE(read_ahead_source_.read(dest, 16), 10);
+		TEST_ASSERT(std::memcmp(dest, &data[990], 10) == 0, "read mismatch");
+		TEST_ASSERT(read_ahead_source_.end_of_data_reached(), "end of data not reported");
+
+		// the wrapped source reached its end; seeking back has to recover from that
+		read_ahead_source_.seek(5, source::seek_absolute);
+		TEST_VALUE(read_ahead_source_.read(dest, 16), 16);
+		TEST_ASSERT(std::memcmp(dest, &data[5], 16) == 0, "read mismatch");
+
+		read_ahead_source_.seek(-21, source::seek_relative);
+		TEST_VALUE(read_ahead_source_.get_position(), 0);
+	}
+
+
+	// a stalled wrapped source is reported while data is still buffered, and turns into a failure once the buffer ran dry
+	{
+		boost::shared_ptr < test_source > source_(new test_source(data));
+		event_recorder recorder;
+		read_ahead_source read_ahead_source_(source_, settings_, boost::phoenix::bind(&event_recorder::record, &recorder, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2));
+
+		wait_until_buffered(read_ahead_source_, 256);
+		source_->set_blocked(true);
+
+		std::vector < uint8_t > dest(1000);
+		TEST_VALUE(read_ahead_source_.read(&dest[0], 64), 64);
+		boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+		TEST_VALUE(read_ahead_source_.read(&dest[64], 64), 64);
+		TEST_VALUE(recorder.events.size(), 1u);
+		TEST_VALUE(recorder.events[0], "source_stalled");
+
+		TEST_VALUE(read_ahead_source_.read(&dest[128], 1000 - 128), 128);
+		TEST_ASSERT(std::memcmp(&dest[0], &data[0], 256) == 0, "read mismatch");
+		TEST_ASSERT(!read_ahead_source_.is_ok(), "failure not reported");
+		TEST_VALUE(recorder.events.size(), 2u);
+		TEST_VALUE(recorder.events[1], "data_source_failure");
+
+		// once the wrapped source works again, a reset brings the read_ahead_source back
+		source_->set_blocked(false);
+		read_ahead_source_.reset();
+		TEST_ASSERT(read_ahead_source_.is_ok(), "reset did not clear the failure");
+		TEST_VALUE(read_ahead_source_.read(&dest[0], 1000), 1000);
+		TEST_ASSERT(dest == data, "read mismatch");
+	}
+
+
+	return 0;
+}
+
+
+INIT_TEST
@@ -63,6 +63,34 @@ int test_main(int, char **)
 			TEST_VALUE(convert_sample_value(input_samples[i], sample_s32, sample_s16), expected_output_samples[i]);
 	}
 
+
+	{
+		// float sample values are exchanged in the s32 range; values outside of -1.0 .. 1.0 get clipped
+		float samples[6] = { 0.0f, 0.5f, -0.5f, -1.0f, 1.5f, -2.0f };
+		long expected_values[6] = { 0, 1073741824l, -1073741824l, -2147483647l - 1, 2147483647l, -2147483647l - 1 };
+
+		for (int i = 0; i < 6; ++i)
+			TEST_VALUE(get_sample_value(samples, i, sample_float32), expected_values[i]);
+	}
+
+	{
+		float samples[3] = { 0.0f, 0.0f, 0.0f };
+
+		set_sample_value(samples, 0, 1073741824l, sample_float32);
+		set_sample_value(samples, 1, -1073741824l, sample_float32);
+		set_sample_value(samples, 2, 0, sample_float32);
+
+		TEST_VALUE(samples[0], 0.5f);
+		TEST_VALUE(samples[1], -0.5f);
+		TEST_VALUE(samples[2], 0.0f);
+	}
+
+	{
+		TEST_VALUE(convert_sample_value(1000, sample_s16, sample_float32), 1000l << 16);
+		TEST_VALUE(convert_sample_value(1000l << 16, sample_float32, sample_s16), 1000);
+		TEST_VALUE(convert_sample_value(1000l << 16, sample_float32, sample_s32), 1000l << 16);
+	}
+
 	return 0;
 }
 
@@ -0,0 +1,252 @@
+#include "test.hpp"
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/assign/list_of.hpp>
+#include <boost/spirit/home/phoenix/bind.hpp>
+#include <boost/spirit/home/phoenix/core/argument.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <ion/backend_main_loop.hpp>
+#include <ion/message_channel.hpp>
+#include <ion/shared_memory_transport.hpp>
+
+
+namespace
+{
+
+
+void write_pattern(ion::shared_memory_transport *transport, std::size_t const size)
+{
+	std::vector < char > data(size);
+	for (std::size_t i = 0; i < size; ++i)
+		data[i] = char(i * 7);
+	// written in odd-sized pieces, so that the ring wraps around in the middle of a write
+	for (std::size_t offset = 0; offset < size; offset += 10007)
+		transport->write(&data[offset], std::min(std::size_t(10007), size - offset));
+	transport->shutdown();
+}
+
+
+// Minimal backend for the main loop; it answers each command with an echo event
+struct echo_backend
+{
+};
+
+template < typename Callback >
+void set_send_event_callback(echo_backend &, Callback const &)
+{
+}
+
+void set_metadata_encoding(echo_backend &, ion::metadata_encoding const)
+{
+}
+
+std::string get_backend_type(echo_backend const &)
+{
+	return "echo";
+}
+
+void execute_command(echo_backend &, std::string const &command, ion::params_t const &params, std::string &response_command, ion::params_t &response_params)
+{
+	response_command = "echo_" + command;
+	response_params = params;
+}
+
+
+// Plays the role of a frontend: a message channel that switches to a shared memory connection
+struct frontend
+{
+	ion::shared_memory_connection connection;
+	ion::message_channel channel;
+	bool shared_memory_active;
+	std::string pipe_data, transport_name;
+	std::vector < std::string > commands;
+
+	boost::mutex mutex;
+	boost::condition_variable condition;
+	bool data_available;
+
+	frontend():
+		connection(boost::phoenix::bind(&frontend::notify, this)),
+		channel(
+			boost::phoenix::bind(&frontend::send_data, this, boost::phoenix::arg_names::arg1),
+			boost::phoenix::bind(&frontend::message, this, boost::phoenix::arg_names::arg1, boost::phoenix::arg_names::arg2),
+			ion::text_protocol
+		),
+		shared_memory_active(false),
+		data_available(false)
+	{
+		channel.set_transport_callback(boost::phoenix::bind(&frontend::transport_switched, this, boost::phoenix::arg_names::arg1));
+	}
+
+	void send_data(std::string const &data)
+	{
+		if (shared_memory_active)
+			connection.write(data);
+		else
+			pipe_data += data;
+	}
+
+	void message(std::string const &command, ion::params_t const &)
+	{
+		commands.push_back(command);
+	}
+
+	void transport_switched(std::string const &new_transport_name)
+	{
+		transport_name = new_transport_name;
+		shared_memory_active = (new_transport_name == "shm");
+		if (shared_memory_active)
+			connection.start_reading();
+	}
+
+	// called by the connection's reading thread
+	void notify()
+	{
+		boost::lock_guard < boost::mutex > lock(mutex);
+		data_available = true;
+		condition.notify_all();
+	}
+
+	void wait_for_commands(std::size_t const num_commands)
+	{
+		std::string data;
+		while (commands.size() < num_commands)
+		{
+			{
+				boost::unique_lock < boost::mutex > lock(mutex);
+				while (!data_available)
+					condition.wait(lock);
+				data_available = false;
+			}
+
+			connection.fetch_received_data(data);
+			channel.feed(data.data(), data.length());
+		}
+	}
+};
+
+
+}
+
+
+int test_main(int, char **)
+{
+	// data larger than the ring passes through unchanged
+	{
+		ion::shared_memory_transport creator, opener;
+		std::string name = ion::shared_memory_transport::generate_name();
+		TEST_ASSERT(creator.create(name, 4096), "");
+		TEST_ASSERT(opener.open(name), "");
+
+		// the opener removed the name
+		ion::shared_memory_transport another_opener;
+		TEST_ASSERT(!another_opener.open(name), "");
+
+		std::size_t const size = 1000000;
+		boost::thread writer_thread(boost::phoenix::bind(&write_pattern, &creator, size));
+
+		std::vector < char > buffer(3000);
+		std::size_t num_read = 0;
+		bool data_valid = true;
+		while (std::size_t num_bytes = opener.read(&buffer[0], buffer.size()))
+		{
+			for (std::size_t i = 0; i < num_bytes; ++i)
+				data_valid = data_valid && (buffer[i] == char((num_read + i) * 7));
+			num_read += num_bytes;
+		}
+
+		writer_thread.join();
+		TEST_VALUE(num_read, size);
+		TEST_ASSERT(data_valid, "");
+		TEST_ASSERT(!opener.write("x", 1), "writing to a closed transport must fail");
+	}
+
+	// reading stops once the other process is gone, even if it did not close the transport
+	{
+		ion::shared_memory_transport creator;
+		std::string name = ion::shared_memory_transport::generate_name();
+		TEST_ASSERT(creator.create(name, 4096), "");
+
+		pid_t child_pid = fork();
+		if (child_pid == 0)
+		{
+			ion::shared_memory_transport opener;
+			_exit(opener.open(name) && opener.write("x", 1) ? 0 : 1);
+		}
+
+		int status = 0;
+		waitpid(child_pid, &status, 0);
+		TEST_ASSERT(WIFEXITED(status) && (WEXITSTATUS(status) == 0), "child could not open the transport");
+
+		char buffer[16];
+		TEST_VALUE(creator.read(buffer, sizeof(buffer)), 1u);
+		TEST_VALUE(buffer[0], 'x');
+		TEST_VALUE(creator.read(buffer, sizeof(buffer)), 0u);
+	}
+
+
+	// a frontend switches the backend main loop to the shared memory transport
+	{
+		frontend frontend_;
+		TEST_ASSERT(frontend_.connection.create(), "");
+		frontend_.channel.request_transport("shm", frontend_.connection.get_name());
+		frontend_.channel.backend_started();
+		TEST_VALUE(frontend_.pipe_data, ion::recombine_command_line("set_transport", boost::assign::list_of < std::string > ("shm")(frontend_.connection.get_name())) + "\n");
+
+		// sent while negotiating -> queued, and later sent through shared memory
+		frontend_.channel.send_message("ping", boost::assign::list_of("1"));
+
+		std::istringstream backend_in(frontend_.pipe_data);
+		std::ostringstream backend_out;
+		echo_backend backend_;
+		ion::backend_main_loop < echo_backend > main_loop(backend_in, backend_out, backend_);
+		main_loop.iterate();
+		main_loop.flush_events();
+		TEST_VALUE(backend_out.str(), "transport \"shm\"\n");
+
+		frontend_.pipe_data.clear();
+		frontend_.channel.feed(backend_out.str().data(), backend_out.str().length());
+		TEST_VALUE(frontend_.transport_name, "shm");
+		TEST_ASSERT(!frontend_.channel.is_negotiating(), "");
+		TEST_VALUE(frontend_.pipe_data, "");
+
+		boost::thread backend_thread(boost::phoenix::bind(&ion::backend_main_loop < echo_backend > ::run, &main_loop));
+		frontend_.channel.send_message("get_backend_type");
+		frontend_.wait_for_commands(2);
+		frontend_.channel.send_message("quit");
+		backend_thread.join();
+		frontend_.connection.close();
+
+		TEST_VALUE(frontend_.commands[0], "pong");
+		TEST_VALUE(frontend_.commands[1], "backend_type");
+		TEST_VALUE(backend_out.str(), "transport \"shm\"\n");
+		TEST_VALUE(frontend_.pipe_data, "");
+	}
+
+	// a backend without set_transport support keeps the pipes
+	{
+		frontend frontend_;
+		TEST_ASSERT(frontend_.connection.create(), "");
+		frontend_.channel.request_transport("shm", frontend_.connection.get_name());
+		frontend_.channel.backend_started();
+		frontend_.channel.send_message("ping");
+		frontend_.pipe_data.clear();
+
+		std::string answer("unknown_command \"set_transport\"\n");
+		frontend_.channel.feed(answer.data(), answer.length());
+		TEST_VALUE(frontend_.transport_name, "pipe");
+		TEST_VALUE(frontend_.pipe_data, "ping\n");
+	}
+
+	return 0;
+}
+
+
+INIT_TEST
+
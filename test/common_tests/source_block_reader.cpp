@@ -0,0 +1,113 @@
+#include "test.hpp"
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include "test_source.hpp"
+#include "source_block_reader.hpp"
+
+
+int test_main(int, char **)
+{
+	typedef ion::test::test_source test_source;
+
+	std::vector < uint8_t > data(1000);
+	for (unsigned int i = 0; i < data.size(); ++i)
+		data[i] = uint8_t(i * 7);
+
+
+	// byte-wise reads are served from blocks
+	{
+		test_source source_(data);
+		ion::audio_common::source_block_reader reader(source_, 256);
+
+		for (unsigned int i = 0; i < data.size(); ++i)
+			TEST_VALUE(reader.get_byte(), int(data[i]));
+
+		TEST_VALUE(source_.num_read_calls, 4);
+		TEST_VALUE(reader.get_byte(), -1);
+		TEST_ASSERT(reader.end_of_data_reached(), "end of data not reported");
+		// reads are capped at the source size, so the source itself never hits its end
+		TEST_ASSERT(!source_.end_of_data_reached(), "source was read past its end");
+	}
+
+
+	// bulk reads, including short reads at the end
+	{
+		test_source source_(data);
+		ion::audio_common::source_block_reader reader(source_, 256);
+
+		uint8_t dest[1000];
+		TEST_VALUE(reader.read(dest, 10), 10);
+		TEST_ASSERT(std::memcmp(dest, &data[0], 10) == 0, "bulk read mismatch");
+		TEST_VALUE(reader.read(dest, 600), 600);
+		TEST_ASSERT(std::memcmp(dest, &data[10], 600) == 0, "bulk read mismatch");
+		TEST_VALUE(reader.get_position(), 610);
+		TEST_VALUE(reader.read(dest, 1000), 390);
+		TEST_ASSERT(std::memcmp(dest, &data[610], 390) == 0, "bulk read mismatch");
+		TEST_VALUE(reader.read(dest, 1), 0);
+	}
+
+
+	// seeking within and outside of the buffered block
+	{
+		test_source source_(data);
+		ion::audio_common::source_block_reader reader(source_, 256);
+
+		TEST_VALUE(reader.get_byte(), int(data[0]));
+		long num_read_calls = source_.num_read_calls;
+
+		reader.seek(100, ion::audio_common::source::seek_absolute);
+		TEST_VALUE(reader.get_byte(), int(data[100]));
+
+		reader.seek(-50, ion::audio_common::source::seek_relative);
+		TEST_VALUE(reader.get_position(), 51);
+		TEST_VALUE(reader.get_byte(), int(data[51]));
+		reader.seek(200, ion::audio_common::source::seek_absolute);
+		TEST_VALUE(reader.get_byte(), int(data[200]));
+		TEST_VALUE(source_.num_read_calls, num_read_calls);
+
+		reader.seek(500, ion::audio_common::source::seek_relative);
+		TEST_VALUE(reader.get_position(), 701);
+		TEST_VALUE(reader.get_byte(), int(data[701]));
+
+		reader.seek(-1, ion::audio_common::source::seek_from_end);
+		TEST_VALUE(reader.get_byte(), int(data[999]));
+		TEST_VALUE(reader.get_byte(), -1);
+
+		reader.seek(3, ion::audio_common::source::seek_absolute);
+		TEST_ASSERT(!reader.end_of_data_reached(), "seeking did not clear the end-of-data flag");
+		TEST_VALUE(reader.get_byte(), int(data[3]));
+	}
+
+
+	// sources with a contiguous view are not read at all
+	{
+		test_source source_(data);
+		source_.provide_view = true;
+		ion::audio_common::source_block_reader reader(source_, 256);
+
+		uint8_t dest[600];
+		TEST_VALUE(reader.get_byte(), int(data[0]));
+		TEST_VALUE(reader.read(dest, 600), 600);
+		TEST_ASSERT(std::memcmp(dest, &data[1], 600) == 0, "bulk read mismatch");
+
+		reader.seek(-10, ion::audio_common::source::seek_from_end);
+		TEST_VALUE(reader.get_position(), 990);
+		TEST_VALUE(reader.read(dest, 600), 10);
+		TEST_ASSERT(std::memcmp(dest, &data[990], 10) == 0, "bulk read mismatch");
+		TEST_VALUE(reader.get_byte(), -1);
+		TEST_ASSERT(reader.end_of_data_reached(), "end of data not reported");
+
+		reader.seek(5, ion::audio_common::source::seek_absolute);
+		TEST_VALUE(reader.get_byte(), int(data[5]));
+
+		TEST_VALUE(source_.num_read_calls, 0);
+	}
+
+
+	return 0;
+}
+
+
+INIT_TEST
+
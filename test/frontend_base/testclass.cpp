@@ -20,6 +20,9 @@ testclass::testclass():
 	frontend_->get_current_uri_changed_signal().connect(boost::lambda::bind(&testclass::current_uri_changed, this, boost::lambda::_1));
 	frontend_->set_current_playlist(&simple_playlist_);
 
+	// the text protocol keeps the printed backend output readable, and lets try_read_stdout_line() find event names in it
+	frontend_->get_message_channel().set_preferred_protocol(ion::text_protocol);
+
 	connect(&backend_process, SIGNAL(readyRead()), this, SLOT(try_read_stdout_line()));
 	connect(&backend_process, SIGNAL(readyReadStandardOutput()), this, SLOT(try_read_stdout_line()));
 	connect(&backend_process, SIGNAL(readyReadStandardError()), this, SLOT(try_read_stderr_line()));
@@ -65,15 +68,12 @@ void testclass::started()
 
 void testclass::try_read_stdout_line()
 {
-	while (backend_process.canReadLine())
-	{
-		QString line = backend_process.readLine().trimmed();
-		std::cerr << "stdout> " << line.toStdString() << std::endl;
-		frontend_->parse_incoming_line(line.toStdString());
+	QByteArray data = backend_process.readAll();
+	std::cerr << "stdout> " << std::string(data.constData(), data.size()) << std::flush;
+	frontend_->parse_incoming_data(data.constData(), data.size());
 
-		if (line.startsWith("resource_finished"))
-			print_backend_line("quit");
-	}
+	if (data.contains("resource_finished"))
+		frontend_->send_quit();
 
 }
 
@@ -85,8 +85,8 @@ void testclass::try_read_stderr_line()
 
 void testclass::print_backend_line(std::string const &line)
 {
-	std::cerr << "stdin> " << line << std::endl;
-	backend_process.write((line + "\n").c_str());
+	std::cerr << "stdin> " << line << std::flush;
+	backend_process.write(line.data(), line.length());
 }
 
 
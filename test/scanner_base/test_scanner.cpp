@@ -27,6 +27,9 @@ test_scanner::test_scanner(playlists_t &playlists_, int const max_num_entries_ad
 	backend_process.setReadChannel(QProcess::StandardOutput);
 	backend_process.setProcessChannelMode(QProcess::SeparateChannels);
 
+	// the text protocol keeps the logged data readable
+	channel.set_preferred_protocol(ion::text_protocol);
+
 	start_backend();
 }
 
@@ -44,10 +47,10 @@ test_scanner::~test_scanner()
 }
 
 
-void test_scanner::send_to_backend(std::string const &command_line)
+void test_scanner::send_to_backend(std::string const &data)
 {
-	std::cerr << '[' << QDateTime::currentDateTime().toString().toStdString() << "]  output> " << command_line << std::endl;
-	backend_process.write(std::string(command_line + '\n').c_str());
+	std::cerr << '[' << QDateTime::currentDateTime().toString().toStdString() << "]  output> " << data << std::flush;
+	backend_process.write(data.data(), data.length());
 }
 
 
@@ -91,7 +94,7 @@ void test_scanner::scanning_in_progress(bool const state)
 	if (!state)
 	{
 		std::cerr << "quit" << std::endl;
-		backend_process.write("quit\n");
+		send_quit();
 		QCoreApplication::instance()->quit();
 	}
 }
@@ -124,13 +127,13 @@ void test_scanner::scanning_failed(ion::uri const &uri_, playlist_t &playlist_)
 
 void test_scanner::try_read_stdout_line()
 {
-	while (backend_process.canReadLine())
-	{
-		QString line = backend_process.readLine().trimmed();
-		std::cerr << '[' << QDateTime::currentDateTime().toString().toStdString() << "]  scan backend stdout> " << line.toStdString() << std::endl;
+	QByteArray data = backend_process.readAll();
+	if (data.isEmpty())
+		return;
 
-		parse_backend_event(line.toStdString());
-	}
+	std::cerr << '[' << QDateTime::currentDateTime().toString().toStdString() << "]  scan backend stdout> " << std::string(data.constData(), data.size()) << std::flush;
+
+	parse_backend_data(data.constData(), data.size());
 }
 
 
@@ -181,6 +184,7 @@ void test_scanner::start_backend()
 			std::cerr << "Starting \"" << *exec_name << "\"\n";
 			backend_process.start(*exec_name);
 			backend_process.waitForStarted(30000);
+			backend_started();
 			found_exec = true;
 			break;
 		}
@@ -22,7 +22,7 @@ public:
 	~test_scanner();
 
 
-	void send_to_backend(std::string const &command_line);
+	void send_to_backend(std::string const &data);
 	void restart_watchdog_timer();
 	void stop_watchdog_timer();
 	void restart_backend();
@@ -0,0 +1,123 @@
+#ifndef TEST_SOURCE_HPP
+#define TEST_SOURCE_HPP
+
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <ion/uri.hpp>
+#include "source.hpp"
+
+
+namespace ion
+{
+namespace test
+{
+
+
+
+/*
+Source over an in-memory byte array, for testing source wrappers and readers. Unlike audio_common::memory_source, it behaves like a file
+in that reading past the end puts it in the end-of-data state, in which seeking does nothing until reset() is called. It also counts
+read() and reset() calls, and can simulate other kinds of sources:
+- If it is not seekable, it behaves like a live stream: its size is unknown, and it can only be read from the beginning again after a reset.
+- Its data can optionally be provided as a contiguous view.
+- Reads can be blocked, to simulate a stalled network filesystem.
+*/
+class test_source:
+	public ion::audio_common::source
+{
+public:
+	explicit test_source(std::vector < uint8_t > const &data, bool const seekable = true):
+		data(data),
+		position(0),
+		eof(false),
+		seekable(seekable),
+		provide_view(false),
+		blocked(false),
+		num_read_calls(0),
+		num_resets(0)
+	{
+	}
+
+	void set_blocked(bool const new_blocked)
+	{
+		boost::lock_guard < boost::mutex > lock(mutex);
+		blocked = new_blocked;
+		condition.notify_all();
+	}
+
+	virtual void reset() { position = 0; eof = false; ++num_resets; }
+
+	virtual long read(void *dest, long const num_bytes)
+	{
+		{
+			boost::unique_lock < boost::mutex > lock(mutex);
+			while (blocked)
+				condition.wait(lock);
+		}
+
+		if (eof)
+			return 0;
+
+		++num_read_calls;
+		long num_to_read = std::min(num_bytes, long(data.size()) - position);
+		std::memcpy(dest, &data[position], num_to_read);
+		position += num_to_read;
+		if (num_to_read < num_bytes)
+			eof = true;
+		return num_to_read;
+	}
+
+	virtual bool can_read() const { return !eof; }
+	virtual bool end_of_data_reached() const { return eof; }
+	virtual bool is_ok() const { return true; }
+
+	virtual void seek(long const new_position, seek_type const type)
+	{
+		if (eof || !seekable)
+			return;
+
+		long base = 0;
+		switch (type)
+		{
+			case seek_absolute: base = 0; break;
+			case seek_relative: base = position; break;
+			case seek_from_end: base = data.size(); break;
+		}
+		position = std::max(0L, std::min(long(data.size()), base + new_position));
+	}
+
+	virtual bool can_seek(seek_type const) const { return seekable; }
+	virtual long get_position() const { return position; }
+	virtual long get_size() const { return seekable ? long(data.size()) : -1; }
+	virtual ion::uri get_uri() const { return ion::uri("file://test"); }
+
+	virtual void const * get_contiguous_view(long const offset, long const num_bytes)
+	{
+		if (!provide_view || (offset < 0) || ((offset + num_bytes) > long(data.size())))
+			return 0;
+		return &data[offset];
+	}
+
+
+	std::vector < uint8_t > data;
+	long position;
+	bool eof, seekable, provide_view, blocked;
+	long num_read_calls, num_resets;
+	boost::mutex mutex;
+	boost::condition_variable condition;
+};
+
+
+
+}
+}
+
+
+#endif
+
@@ -0,0 +1,124 @@
+#ifndef TEST_ZIP_HPP
+#define TEST_ZIP_HPP
+
+
+#include <zlib.h>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace ion
+{
+namespace test
+{
+
+
+
+typedef std::vector < uint8_t > bytes_t;
+
+
+struct zip_member
+{
+	std::string name;
+	bytes_t data;
+	bool deflate;
+};
+
+
+inline void put_u16(bytes_t &out, unsigned int const value)
+{
+	out.push_back(value & 0xFF);
+	out.push_back((value >> 8) & 0xFF);
+}
+
+
+inline void put_u32(bytes_t &out, uint32_t const value)
+{
+	put_u16(out, value & 0xFFFF);
+	put_u16(out, value >> 16);
+}
+
+
+inline bytes_t raw_deflate(bytes_t const &data)
+{
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+	deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+
+	bytes_t compressed(deflateBound(&stream, data.size()));
+	stream.next_in = const_cast < Bytef* > (data.empty() ? 0 : &data[0]);
+	stream.avail_in = data.size();
+	stream.next_out = &compressed[0];
+	stream.avail_out = compressed.size();
+	deflate(&stream, Z_FINISH);
+	compressed.resize(stream.total_out);
+	deflateEnd(&stream);
+
+	return compressed;
+}
+
+
+// Writes a minimal zip archive; the directory entry checks that directories are skipped
+inline void write_zip(std::string const &filename, std::vector < zip_member > const &members)
+{
+	bytes_t archive, directory;
+	unsigned int num_entries = 0;
+
+	for (unsigned int i = 0; i <= members.size(); ++i)
+	{
+		bool is_directory = (i == members.size());
+		std::string name = is_directory ? std::string("some_directory/") : members[i].name;
+		bytes_t data = is_directory ? bytes_t() : members[i].data;
+		bool deflate = !is_directory && members[i].deflate;
+
+		uint32_t crc = crc32(0, Z_NULL, 0);
+		if (!data.empty())
+			crc = crc32(crc, &data[0], data.size());
+		bytes_t stored_data = deflate ? raw_deflate(data) : data;
+
+		uint32_t offset = archive.size();
+
+		put_u32(archive, 0x04034b50);
+		put_u16(archive, 20); put_u16(archive, 0); put_u16(archive, deflate ? 8 : 0);
+		put_u16(archive, 0); put_u16(archive, 0);
+		put_u32(archive, crc); put_u32(archive, stored_data.size()); put_u32(archive, data.size());
+		put_u16(archive, name.length()); put_u16(archive, 0);
+		archive.insert(archive.end(), name.begin(), name.end());
+		archive.insert(archive.end(), stored_data.begin(), stored_data.end());
+
+		put_u32(directory, 0x02014b50);
+		put_u16(directory, 20); put_u16(directory, 20); put_u16(directory, 0); put_u16(directory, deflate ? 8 : 0);
+		put_u16(directory, 0); put_u16(directory, 0);
+		put_u32(directory, crc); put_u32(directory, stored_data.size()); put_u32(directory, data.size());
+		put_u16(directory, name.length()); put_u16(directory, 0); put_u16(directory, 0);
+		put_u16(directory, 0); put_u16(directory, 0); put_u32(directory, 0);
+		put_u32(directory, offset);
+		directory.insert(directory.end(), name.begin(), name.end());
+
+		++num_entries;
+	}
+
+	uint32_t directory_offset = archive.size();
+	archive.insert(archive.end(), directory.begin(), directory.end());
+
+	put_u32(archive, 0x06054b50);
+	put_u16(archive, 0); put_u16(archive, 0);
+	put_u16(archive, num_entries); put_u16(archive, num_entries);
+	put_u32(archive, directory.size()); put_u32(archive, directory_offset);
+	put_u16(archive, 0);
+
+	std::ofstream out(filename.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast < char const * > (&archive[0]), archive.size());
+}
+
+
+
+}
+}
+
+
+#endif
+
@@ -0,0 +1,123 @@
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/lexical_cast.hpp>
+#include <ion/command_line_tools.hpp>
+#include <ion/metadata.hpp>
+#include "file_source.hpp"
+#include "uade_decoder.hpp"
+
+
+/*
+Measures the seek latency of the UADE decoder. UADE cannot seek by itself, so forward seeks let the emulator run from the
+current position to the target and discard the output, while backward seeks restart the song and skip from its beginning.
+A seek is timed from the set_current_position() call until the first update() call after it returns, since the actual
+seek happens in update(). Forward seeks are timed for growing distances, backward seeks for targets near the
+beginning and far into the song.
+
+Usage: uade_seek_benchmark <song file> [<subsong index>]
+*/
+
+
+namespace
+{
+
+
+typedef ion::audio_common::decoder_ptr_t decoder_ptr_t;
+
+
+unsigned int const frequency = 44100;
+unsigned int const num_buffer_samples = 1024;
+
+
+void print_event(std::string const &command, ion::params_t const &params)
+{
+	std::cerr << ion::recombine_command_line(command, params) << std::endl;
+}
+
+
+// Seeks to the given position (in seconds), and returns the time it took in milliseconds
+double timed_seek(ion::audio_common::decoder &decoder_, long const position_in_seconds, std::vector < int16_t > &buffer)
+{
+	boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+	decoder_.set_current_position(position_in_seconds * decoder_.get_num_ticks_per_second());
+	decoder_.update(&buffer[0], num_buffer_samples);
+	boost::posix_time::time_duration duration = boost::posix_time::microsec_clock::universal_time() - start_time;
+	return duration.total_microseconds() / 1000.0;
+}
+
+
+void print_seek(std::string const &direction, long const from_seconds, long const to_seconds, double const milliseconds)
+{
+	std::cout << direction << " seek from " << from_seconds << " s to " << to_seconds << " s: " << milliseconds << " ms" << std::endl;
+}
+
+
+}
+
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " <song file> [<subsong index>]" << std::endl;
+		return -1;
+	}
+
+	std::string path = argv[1];
+	if (path[0] != '/')
+	{
+		char cwd[4096];
+		if (getcwd(cwd, sizeof(cwd)) != 0)
+			path = std::string(cwd) + "/" + path;
+	}
+
+	ion::uri uri_("file://" + path);
+	if (argc >= 3)
+		uri_.get_options()["sub_resource_index"] = argv[2];
+
+	ion::audio_backend::file_source_creator source_creator_;
+	ion::audio_backend::uade_decoder_creator decoder_creator_;
+
+	ion::audio_common::source_ptr_t source_ = source_creator_.create_for_playback(uri_, &print_event);
+	if (!source_)
+	{
+		std::cerr << "Could not open " << path << std::endl;
+		return -1;
+	}
+
+	decoder_ptr_t decoder_ = decoder_creator_.create(source_, ion::empty_metadata(), &print_event);
+	if (!decoder_)
+	{
+		std::cerr << "UADE could not play " << path << std::endl;
+		return -1;
+	}
+
+	decoder_->set_playback_properties(ion::audio_common::playback_properties(frequency, num_buffer_samples, 2, ion::audio_common::sample_s16));
+	std::vector < int16_t > buffer(num_buffer_samples * 2);
+	decoder_->update(&buffer[0], num_buffer_samples);
+
+	// forward seeks over growing distances, each continuing from the previous target
+	long const forward_targets[] = { 1, 5, 15, 45, 105 };
+	long position = 0;
+	for (unsigned int i = 0; i < sizeof(forward_targets) / sizeof(long); ++i)
+	{
+		print_seek("forward", position, forward_targets[i], timed_seek(*decoder_, forward_targets[i], buffer));
+		position = forward_targets[i];
+	}
+
+	// backward seeks, each restarting the song; the forward seeks in between return to the end position
+	long const backward_targets[] = { 0, 5, 60, 100 };
+	for (unsigned int i = 0; i < sizeof(backward_targets) / sizeof(long); ++i)
+	{
+		print_seek("backward", position, backward_targets[i], timed_seek(*decoder_, backward_targets[i], buffer));
+		timed_seek(*decoder_, forward_targets[sizeof(forward_targets) / sizeof(long) - 1], buffer);
+		position = forward_targets[sizeof(forward_targets) / sizeof(long) - 1];
+	}
+
+	return 0;
+}
+